@@ -0,0 +1,115 @@
+//
+//  bench/gen.c
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "synth.h"
+
+/*
+ * Command-line frontend of the synthetic-input generator, to write out inputs
+ * for running tbd itself on.
+ */
+
+static void print_usage(void) {
+    fputs("Usage: bench_gen <thin|fat32|fat64|dsc> <output-path> [options]\n"
+          "Options:\n",
+          stderr);
+
+    synth_options_print_usage();
+}
+
+static bool parse_kind(const char *__notnull const arg, enum synth_kind *kind) {
+    if (strcmp(arg, "thin") == 0) {
+        *kind = SYNTH_KIND_THIN;
+    } else if (strcmp(arg, "fat32") == 0) {
+        *kind = SYNTH_KIND_FAT32;
+    } else if (strcmp(arg, "fat64") == 0) {
+        *kind = SYNTH_KIND_FAT64;
+    } else if (strcmp(arg, "dsc") == 0) {
+        *kind = SYNTH_KIND_DSC;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+int main(const int argc, const char *const argv[]) {
+    if (argc < 3) {
+        print_usage();
+        return 1;
+    }
+
+    enum synth_kind kind = SYNTH_KIND_THIN;
+    if (!parse_kind(argv[1], &kind)) {
+        fprintf(stderr, "Unrecognized kind of file: %s\n", argv[1]);
+        print_usage();
+
+        return 1;
+    }
+
+    struct synth_options options = synth_options_default();
+    for (int i = 3; i < argc; i++) {
+        switch (synth_options_parse_option(&options, argc, argv, &i)) {
+            case E_SYNTH_PARSE_OPTION_OK:
+                break;
+
+            case E_SYNTH_PARSE_OPTION_UNRECOGNIZED:
+                fprintf(stderr, "Unrecognized option: %s\n", argv[i]);
+                print_usage();
+
+                return 1;
+
+            case E_SYNTH_PARSE_OPTION_INVALID_COUNT:
+                fprintf(stderr,
+                        "Please provide a valid count for option %s\n",
+                        argv[i]);
+
+                return 1;
+        }
+    }
+
+    struct synth_file file = {};
+    if (!synth_file_create(&file, kind, &options)) {
+        fputs("Too many symbols for the provided depth of the export-trie\n",
+              stderr);
+
+        return 1;
+    }
+
+    const char *const path = argv[2];
+    FILE *const out = fopen(path, "wb");
+
+    if (out == NULL) {
+        fprintf(stderr,
+                "Failed to open file at path: %s, error: %s\n",
+                path,
+                strerror(errno));
+
+        synth_file_destroy(&file);
+        return 1;
+    }
+
+    const bool failed =
+        fwrite(file.data, 1, file.size, out) != file.size || fclose(out) != 0;
+
+    synth_file_destroy(&file);
+
+    if (failed) {
+        fprintf(stderr,
+                "Failed to write to file at path: %s, error: %s\n",
+                path,
+                strerror(errno));
+
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,496 @@
+//
+//  bench/stages.c
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dsc_image.h"
+#include "dyld_shared_cache.h"
+#include "macho_file.h"
+#include "parse_or_list_fields.h"
+#include "synth.h"
+#include "tbd.h"
+
+/*
+ * Benchmark of the stages tbd goes through for every image, timed separately on
+ * synthetic thin and fat mach-o files, and on every image of a synthetic
+ * dyld_shared_cache.
+ *
+ * As parsing already sorts the info, the symbols are shuffled before timing
+ * tbd_ci_sort_info(), so the sort is measured on unsorted input.
+ */
+
+enum stage {
+    STAGE_PARSE,
+    STAGE_SORT,
+    STAGE_CREATE,
+
+    STAGE_COUNT
+};
+
+static const char *const stage_names[STAGE_COUNT] = {
+    [STAGE_PARSE] = "parse",
+    [STAGE_SORT] = "sort (shuffled)",
+    [STAGE_CREATE] = "create"
+};
+
+struct stage_times {
+    uint64_t total;
+    uint64_t min;
+    uint64_t count;
+};
+
+struct bench_info {
+    struct tbd_create_info info;
+    struct tbd_create_info orig;
+
+    struct string_buffer export_trie_sb;
+    struct stage_times times[STAGE_COUNT];
+
+    FILE *devnull;
+    uint64_t random_state;
+};
+
+static void print_usage(void) {
+    fputs("Usage: bench_stages [options]\n"
+          "Options:\n"
+          "    --iterations <count>, Amount of times every file is parsed "
+          "(default: 50)\n"
+          "    --version <v1|v2|v3|v4>, Version of the .tbd files created "
+          "(default: v2)\n",
+          stderr);
+
+    synth_options_print_usage();
+}
+
+static uint64_t get_time_ns(void) {
+    struct timespec spec = {};
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+
+    return (uint64_t)spec.tv_sec * 1000000000ull + (uint64_t)spec.tv_nsec;
+}
+
+static void
+add_time(struct bench_info *__notnull const bench,
+         const enum stage stage,
+         const uint64_t begin,
+         const uint64_t end)
+{
+    struct stage_times *const times = bench->times + stage;
+    const uint64_t time = end - begin;
+
+    if (times->count == 0 || time < times->min) {
+        times->min = time;
+    }
+
+    times->total += time;
+    times->count += 1;
+}
+
+static uint64_t next_random(struct bench_info *__notnull const bench) {
+    bench->random_state ^= bench->random_state << 13;
+    bench->random_state ^= bench->random_state >> 7;
+    bench->random_state ^= bench->random_state << 17;
+
+    return bench->random_state;
+}
+
+/*
+ * Fisher-Yates shuffle of the symbols, seeded the same way for every file so
+ * runs are comparable.
+ */
+
+static void shuffle_symbols(struct bench_info *__notnull const bench) {
+    struct tbd_symbol_info *const symbols = bench->info.fields.symbols.data;
+    const uint64_t count = bench->info.fields.symbols.item_count;
+
+    bench->random_state = 0x9e3779b97f4a7c15;
+    for (uint64_t i = count; i > 1; i--) {
+        const uint64_t j = next_random(bench) % i;
+        const struct tbd_symbol_info symbol = symbols[i - 1];
+
+        symbols[i - 1] = symbols[j];
+        symbols[j] = symbol;
+    }
+}
+
+static bool
+parse_callback(struct tbd_create_info *__notnull const info_in,
+               const enum macho_file_parse_callback_type type,
+               void *const cb_info)
+{
+    (void)info_in;
+    (void)type;
+    (void)cb_info;
+
+    return true;
+}
+
+/*
+ * Time the sort and create stages of an already parsed image, and reset the
+ * info for the next image.
+ */
+
+static bool sort_and_create(struct bench_info *__notnull const bench) {
+    shuffle_symbols(bench);
+
+    const uint64_t sort_begin = get_time_ns();
+    tbd_ci_sort_info(&bench->info);
+
+    const uint64_t create_begin = get_time_ns();
+    const enum tbd_create_result create_result =
+        tbd_create_with_info(&bench->info,
+                             bench->devnull,
+                             (struct tbd_create_options){});
+
+    const uint64_t create_end = get_time_ns();
+
+    add_time(bench, STAGE_SORT, sort_begin, create_begin);
+    add_time(bench, STAGE_CREATE, create_begin, create_end);
+
+    tbd_create_info_clear_fields_and_create_from(&bench->info, &bench->orig);
+    if (create_result != E_TBD_CREATE_OK) {
+        fputs("Failed to create .tbd file\n", stderr);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+bench_macho(struct bench_info *__notnull const bench,
+            const int fd,
+            const uint64_t iterations)
+{
+    for (uint64_t i = 0; i != iterations; i++) {
+        if (lseek(fd, 0, SEEK_SET) != 0) {
+            fprintf(stderr, "Failed to seek file, error: %s\n", strerror(errno));
+            return false;
+        }
+
+        const uint64_t begin = get_time_ns();
+
+        struct macho_file macho = {};
+        struct magic_buffer magic_buffer = {};
+
+        const enum macho_file_open_result open_result =
+            macho_file_open(&macho, &magic_buffer, fd, (struct range){});
+
+        if (open_result != E_MACHO_FILE_OPEN_OK) {
+            fputs("Failed to open synthetic mach-o file\n", stderr);
+            return false;
+        }
+
+        const struct macho_file_parse_extra_args extra = {
+            .callback = parse_callback,
+            .export_trie_sb = &bench->export_trie_sb
+        };
+
+        const enum macho_file_parse_result parse_result =
+            macho_file_parse_from_file(&bench->info,
+                                       &macho,
+                                       extra,
+                                       (struct tbd_parse_options){},
+                                       (struct macho_file_parse_options){});
+
+        add_time(bench, STAGE_PARSE, begin, get_time_ns());
+        if (parse_result != E_MACHO_FILE_PARSE_OK) {
+            fputs("Failed to parse synthetic mach-o file\n", stderr);
+            tbd_create_info_clear_fields_and_create_from(&bench->info,
+                                                         &bench->orig);
+
+            return false;
+        }
+
+        if (!sort_and_create(bench)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+bench_dsc(struct bench_info *__notnull const bench,
+          const int fd,
+          const uint64_t iterations)
+{
+    /*
+     * dyld_shared_cache_parse_from_file() reads the rest of the header from
+     * where the magic ends.
+     */
+
+    char magic[16] = {};
+    if (lseek(fd, 0, SEEK_SET) != 0 || read(fd, magic, 16) != 16) {
+        fprintf(stderr, "Failed to read file, error: %s\n", strerror(errno));
+        return false;
+    }
+
+    const struct dyld_shared_cache_parse_options dsc_options = {
+        .track_extracted_images = true
+    };
+
+    struct dyld_shared_cache_info dsc_info = {};
+    const enum dyld_shared_cache_parse_result dsc_result =
+        dyld_shared_cache_parse_from_file(&dsc_info, fd, magic, dsc_options);
+
+    if (dsc_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        fputs("Failed to parse synthetic dyld_shared_cache\n", stderr);
+        return false;
+    }
+
+    bool result = true;
+    for (uint64_t i = 0; i != iterations && result; i++) {
+        const struct dyld_cache_image_info *image = dsc_info.images;
+        const struct dyld_cache_image_info *const end =
+            image + dsc_info.images_count;
+
+        for (; image != end; image++) {
+            const uint64_t begin = get_time_ns();
+            const enum dsc_image_parse_result parse_result =
+                dsc_image_parse(&bench->info,
+                                &dsc_info,
+                                image,
+                                parse_callback,
+                                NULL,
+                                &bench->export_trie_sb,
+                                (struct macho_file_parse_options){},
+                                (struct tbd_parse_options){},
+                                (struct dsc_image_parse_options){});
+
+            add_time(bench, STAGE_PARSE, begin, get_time_ns());
+            if (parse_result != E_DSC_IMAGE_PARSE_OK) {
+                fputs("Failed to parse synthetic dyld_shared_cache image\n",
+                      stderr);
+
+                tbd_create_info_clear_fields_and_create_from(&bench->info,
+                                                             &bench->orig);
+
+                result = false;
+                break;
+            }
+
+            if (!sort_and_create(bench)) {
+                result = false;
+                break;
+            }
+        }
+    }
+
+    dyld_shared_cache_info_destroy(&dsc_info);
+    return result;
+}
+
+static void
+print_times(const char *__notnull const name,
+            struct bench_info *__notnull const bench)
+{
+    for (enum stage stage = 0; stage != STAGE_COUNT; stage++) {
+        struct stage_times *const times = bench->times + stage;
+        if (times->count == 0) {
+            continue;
+        }
+
+        const double mean = (double)times->total / (double)times->count / 1e3;
+        const double min = (double)times->min / 1e3;
+
+        printf("%-6s %-16s %10.2f us mean %10.2f us min (%" PRIu64 " runs)\n",
+               name,
+               stage_names[stage],
+               mean,
+               min,
+               times->count);
+    }
+
+    memset(bench->times, 0, sizeof(bench->times));
+}
+
+/*
+ * Write the synthetic file out to an unlinked temporary file, as the parse
+ * functions read from a file-descriptor.
+ */
+
+static int create_temp_file(const struct synth_file *__notnull const file) {
+    char path[] = "/tmp/tbd-bench-XXXXXX";
+
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr,
+                "Failed to create temporary file, error: %s\n",
+                strerror(errno));
+
+        return -1;
+    }
+
+    unlink(path);
+
+    uint64_t written = 0;
+    while (written != file->size) {
+        const ssize_t result =
+            write(fd, file->data + written, file->size - written);
+
+        if (result <= 0) {
+            fprintf(stderr,
+                    "Failed to write temporary file, error: %s\n",
+                    strerror(errno));
+
+            close(fd);
+            return -1;
+        }
+
+        written += (uint64_t)result;
+    }
+
+    return fd;
+}
+
+static bool parse_iterations(const char *const arg, uint64_t *const out) {
+    if (arg == NULL) {
+        return false;
+    }
+
+    char *end = NULL;
+    const unsigned long long count = strtoull(arg, &end, 10);
+
+    if (end == arg || *end != '\0' || count == 0) {
+        return false;
+    }
+
+    *out = count;
+    return true;
+}
+
+int main(const int argc, const char *const argv[]) {
+    struct synth_options options = synth_options_default();
+
+    uint64_t iterations = 50;
+    enum tbd_version version = TBD_VERSION_V2;
+
+    for (int i = 1; i < argc; i++) {
+        const char *const option = argv[i];
+        if (strcmp(option, "--iterations") == 0) {
+            if (!parse_iterations(argv[i + 1], &iterations)) {
+                fputs("Please provide a valid count of iterations\n", stderr);
+                return 1;
+            }
+
+            i++;
+            continue;
+        }
+
+        if (strcmp(option, "--version") == 0) {
+            if (i + 1 == argc) {
+                fputs("Please provide a .tbd version\n", stderr);
+                return 1;
+            }
+
+            version = parse_tbd_version(argv[i + 1]);
+            if (version == TBD_VERSION_NONE) {
+                fprintf(stderr, "Unrecognized .tbd version: %s\n", argv[i + 1]);
+                return 1;
+            }
+
+            i++;
+            continue;
+        }
+
+        switch (synth_options_parse_option(&options, argc, argv, &i)) {
+            case E_SYNTH_PARSE_OPTION_OK:
+                break;
+
+            case E_SYNTH_PARSE_OPTION_UNRECOGNIZED:
+                fprintf(stderr, "Unrecognized option: %s\n", option);
+                print_usage();
+
+                return 1;
+
+            case E_SYNTH_PARSE_OPTION_INVALID_COUNT:
+                fprintf(stderr,
+                        "Please provide a valid count for option %s\n",
+                        option);
+
+                return 1;
+        }
+    }
+
+    struct bench_info bench = {
+        .info.version = version,
+        .orig.version = version
+    };
+
+    bench.devnull = fopen("/dev/null", "w");
+    if (bench.devnull == NULL) {
+        fprintf(stderr,
+                "Failed to open /dev/null, error: %s\n",
+                strerror(errno));
+
+        return 1;
+    }
+
+    static const struct {
+        const char *name;
+        enum synth_kind kind;
+    } files[] = {
+        { "thin", SYNTH_KIND_THIN },
+        { "fat32", SYNTH_KIND_FAT32 },
+        { "fat64", SYNTH_KIND_FAT64 },
+        { "dsc", SYNTH_KIND_DSC }
+    };
+
+    printf("%" PRIu32 " symbols, %" PRIu32 " undefineds, %" PRIu64
+           " iterations\n",
+           options.symbols_count,
+           options.undefineds_count,
+           iterations);
+
+    int ret = 0;
+    for (uint64_t i = 0; i != sizeof(files) / sizeof(*files); i++) {
+        struct synth_file file = {};
+        if (!synth_file_create(&file, files[i].kind, &options)) {
+            fputs("Too many symbols for the provided depth of the "
+                  "export-trie\n",
+                  stderr);
+
+            ret = 1;
+            break;
+        }
+
+        const int fd = create_temp_file(&file);
+        synth_file_destroy(&file);
+
+        if (fd < 0) {
+            ret = 1;
+            break;
+        }
+
+        bool result = false;
+        if (files[i].kind == SYNTH_KIND_DSC) {
+            result = bench_dsc(&bench, fd, iterations);
+        } else {
+            result = bench_macho(&bench, fd, iterations);
+        }
+
+        close(fd);
+        if (!result) {
+            ret = 1;
+            break;
+        }
+
+        print_times(files[i].name, &bench);
+    }
+
+    tbd_create_info_destroy(&bench.info);
+    sb_destroy(&bench.export_trie_sb);
+    fclose(bench.devnull);
+
+    return ret;
+}
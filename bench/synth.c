@@ -0,0 +1,827 @@
+//
+//  bench/synth.c
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mach-o/fat.h"
+#include "mach-o/loader.h"
+#include "mach-o/nlist.h"
+
+#include "dyld_shared_cache_format.h"
+#include "swap.h"
+#include "synth.h"
+
+static const uint64_t synth_page_size = 4096;
+static const uint64_t synth_dsc_base_address = 0x7fff20000000;
+
+static const struct synth_arch {
+    cpu_type_t cputype;
+    cpu_subtype_t cpusubtype;
+} synth_archs[] = {
+    { CPU_TYPE_X86_64, CPU_SUBTYPE_X86_64_ALL },
+    { CPU_TYPE_ARM64, 0 },
+    { CPU_TYPE_X86_64, CPU_SUBTYPE_X86_64_H },
+    { CPU_TYPE_ARM64, 2 }
+};
+
+static const uint32_t synth_archs_count =
+    sizeof(synth_archs) / sizeof(*synth_archs);
+
+/*
+ * Symbols added to the top of every trie, to cover the objc and quoted symbol
+ * paths of tbd.
+ */
+
+static const char *const synth_extra_symbols[] = {
+    "_OBJC_CLASS_$_Foo",
+    "_OBJC_METACLASS_$_Foo",
+    "_OBJC_IVAR_$_Foo.bar",
+    "_OBJC_EHTYPE_$_Foo",
+    "_needs:quote",
+    "_needs,quote[]",
+    ".objc_class_name_Old"
+};
+
+#define SYNTH_EXTRA_SYMBOLS_COUNT \
+    (sizeof(synth_extra_symbols) / sizeof(*synth_extra_symbols))
+
+static const char *const synth_clients[] = {
+    "ClientA",
+    "Client:B",
+    "ClientC"
+};
+
+static const char *const synth_reexports[] = {
+    "/usr/lib/libre1.dylib",
+    "/usr/lib/libre2.dylib"
+};
+
+/*
+ * Reserve size zeroed bytes at the end of file, and return their offset.
+ */
+
+static uint64_t
+file_add(struct synth_file *__notnull const file,
+         const void *const data,
+         const uint64_t size)
+{
+    const uint64_t offset = file->size;
+    if (offset + size > file->capacity) {
+        uint64_t capacity = file->capacity;
+        if (capacity == 0) {
+            capacity = synth_page_size;
+        }
+
+        while (capacity < offset + size) {
+            capacity *= 2;
+        }
+
+        uint8_t *const data_ptr = realloc(file->data, capacity);
+        if (data_ptr == NULL) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+
+        memset(data_ptr + file->capacity, 0, capacity - file->capacity);
+
+        file->data = data_ptr;
+        file->capacity = capacity;
+    }
+
+    if (data != NULL) {
+        memcpy(file->data + offset, data, size);
+    }
+
+    file->size = offset + size;
+    return offset;
+}
+
+static void
+file_align(struct synth_file *__notnull const file, const uint64_t alignment) {
+    const uint64_t remainder = file->size % alignment;
+    if (remainder != 0) {
+        file_add(file, NULL, alignment - remainder);
+    }
+}
+
+static inline void *
+file_at(const struct synth_file *__notnull const file, const uint64_t offset) {
+    return file->data + offset;
+}
+
+/*
+ * Write value as an uleb128 padded to 4 bytes, so a child's offset can be
+ * written once the child's node has been added.
+ */
+
+static void
+write_padded_uleb128(struct synth_file *__notnull const file,
+                     const uint64_t offset,
+                     const uint32_t value)
+{
+    uint8_t *const bytes = file_at(file, offset);
+
+    bytes[0] = 0x80 | (value & 0x7f);
+    bytes[1] = 0x80 | ((value >> 7) & 0x7f);
+    bytes[2] = 0x80 | ((value >> 14) & 0x7f);
+    bytes[3] = (value >> 21) & 0x7f;
+}
+
+struct trie_info {
+    uint32_t depth;
+    uint32_t branch_count;
+    uint32_t leaves_left;
+
+    /*
+     * The (1-based) index of the arch of a fat file whose trie is being
+     * created, when varying archs, or 0.
+     */
+
+    uint32_t arch_number;
+};
+
+static void
+add_terminal_node(struct synth_file *__notnull const file, const uint8_t flags) {
+    const uint8_t node[4] = { 2, flags, 0, 0 };
+    file_add(file, node, sizeof(node));
+}
+
+static void
+add_trie_node(struct synth_file *__notnull const trie,
+              struct trie_info *__notnull const info,
+              const uint32_t level,
+              const uint32_t id)
+{
+    if (level == info->depth) {
+        uint8_t flags = EXPORT_SYMBOL_FLAGS_KIND_REGULAR;
+        if (id % 7 == 0) {
+            flags = EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION;
+        }
+
+        add_terminal_node(trie, flags);
+        return;
+    }
+
+    const uint8_t terminal_size = 0;
+    file_add(trie, &terminal_size, sizeof(terminal_size));
+
+    const uint64_t children_count_offset = file_add(trie, NULL, 1);
+    const uint32_t arch_number = info->arch_number;
+
+    uint64_t child_offsets[255];
+    uint32_t children_count = 0;
+
+    for (uint32_t i = 0; i != info->branch_count; i++) {
+        if (info->leaves_left == 0) {
+            break;
+        }
+
+        const bool is_last_level = (level + 1 == info->depth);
+        if (is_last_level) {
+            info->leaves_left -= 1;
+            if (arch_number != 0 && (i + arch_number) % 5 == 0) {
+                continue;
+            }
+        }
+
+        char label[32];
+        if (level == 0) {
+            snprintf(label, sizeof(label), "_s%c%u", 'A' + (i % 26), i);
+        } else {
+            snprintf(label, sizeof(label), "%c%u", 'a' + (level % 26), i);
+        }
+
+        file_add(trie, label, strlen(label) + 1);
+        child_offsets[children_count] = file_add(trie, NULL, 4);
+
+        children_count++;
+    }
+
+    uint64_t extra_offsets[SYNTH_EXTRA_SYMBOLS_COUNT];
+    uint32_t extra_count = 0;
+
+    if (level == 0) {
+        for (uint32_t i = 0; i != SYNTH_EXTRA_SYMBOLS_COUNT; i++) {
+            if (arch_number != 0 && (i + arch_number) % 3 == 0) {
+                continue;
+            }
+
+            const char *const symbol = synth_extra_symbols[i];
+
+            file_add(trie, symbol, strlen(symbol) + 1);
+            extra_offsets[extra_count] = file_add(trie, NULL, 4);
+
+            extra_count++;
+        }
+    }
+
+    uint8_t *const count_ptr = file_at(trie, children_count_offset);
+    *count_ptr = (uint8_t)(children_count + extra_count);
+
+    for (uint32_t i = 0; i != children_count; i++) {
+        write_padded_uleb128(trie, child_offsets[i], (uint32_t)trie->size);
+        add_trie_node(trie, info, level + 1, id * info->branch_count + i);
+    }
+
+    for (uint32_t i = 0; i != extra_count; i++) {
+        write_padded_uleb128(trie, extra_offsets[i], (uint32_t)trie->size);
+        add_terminal_node(trie, EXPORT_SYMBOL_FLAGS_KIND_REGULAR);
+    }
+}
+
+/*
+ * Every node of the trie has the same amount of children, the lowest amount
+ * where the trie holds symbols_count symbols within trie_depth levels.
+ */
+
+static bool
+create_trie(struct synth_file *__notnull const trie,
+            const struct synth_options *__notnull const options,
+            const uint32_t arch_number)
+{
+    uint32_t depth = options->trie_depth;
+    if (depth == 0) {
+        depth = 1;
+    }
+
+    uint32_t branch_count = 1;
+    do {
+        uint64_t leaves_count = 1;
+        for (uint32_t i = 0; i != depth; i++) {
+            leaves_count *= branch_count;
+            if (leaves_count >= options->symbols_count) {
+                break;
+            }
+        }
+
+        if (leaves_count >= options->symbols_count) {
+            break;
+        }
+
+        branch_count++;
+    } while (branch_count <= 255);
+
+    if (branch_count > 255) {
+        return false;
+    }
+
+    struct trie_info info = {
+        .depth = depth,
+        .branch_count = branch_count,
+        .leaves_left = options->symbols_count,
+        .arch_number = arch_number
+    };
+
+    add_trie_node(trie, &info, 0, 0);
+    file_align(trie, 8);
+
+    return true;
+}
+
+static uint64_t
+add_load_command(struct synth_file *__notnull const file,
+                 const uint32_t cmd,
+                 const uint32_t cmdsize)
+{
+    const uint64_t offset = file_add(file, NULL, cmdsize);
+    struct load_command *const load_cmd = file_at(file, offset);
+
+    load_cmd->cmd = cmd;
+    load_cmd->cmdsize = cmdsize;
+
+    return offset;
+}
+
+static void
+add_dylib_command(struct synth_file *__notnull const file,
+                  const uint32_t cmd,
+                  const char *__notnull const name,
+                  const uint32_t current_version,
+                  const uint32_t compat_version)
+{
+    const uint32_t name_length = (uint32_t)strlen(name);
+    const uint32_t size =
+        (sizeof(struct dylib_command) + name_length + 1 + 7) & ~7u;
+
+    const uint64_t offset = add_load_command(file, cmd, size);
+    struct dylib_command *const dylib_cmd = file_at(file, offset);
+
+    dylib_cmd->dylib.name.offset = sizeof(struct dylib_command);
+    dylib_cmd->dylib.current_version = current_version;
+    dylib_cmd->dylib.compatibility_version = compat_version;
+
+    memcpy(file_at(file, offset + sizeof(*dylib_cmd)), name, name_length);
+}
+
+static void
+add_string_command(struct synth_file *__notnull const file,
+                   const uint32_t cmd,
+                   const char *__notnull const string)
+{
+    /*
+     * sub_framework_command and sub_client_command share the same layout.
+     */
+
+    const uint64_t offset = add_load_command(file, cmd, 24);
+    struct sub_client_command *const client_cmd = file_at(file, offset);
+
+    client_cmd->client.offset = sizeof(*client_cmd);
+    memcpy(file_at(file, offset + sizeof(*client_cmd)),
+           string,
+           strlen(string));
+}
+
+/*
+ * Add a 64-bit dylib at the end of file.
+ *
+ * The linkedit offsets are relative to the start of file when in_cache is set,
+ * as in a dyld_shared_cache, and relative to the image's start otherwise.
+ */
+
+static bool
+add_image(struct synth_file *__notnull const file,
+          const struct synth_options *__notnull const options,
+          const struct synth_arch *__notnull const arch,
+          const char *__notnull const install_name,
+          const uint32_t uuid_seed,
+          const uint32_t arch_number,
+          const bool in_cache)
+{
+    const uint64_t image_offset = file->size;
+    const uint64_t header_offset =
+        file_add(file, NULL, sizeof(struct mach_header_64));
+
+    const uint64_t load_cmds_offset = file->size;
+    uint32_t ncmds = 0;
+
+    add_dylib_command(file, LC_ID_DYLIB, install_name, 0x10203, 0x10000);
+    ncmds++;
+
+    const uint64_t uuid_offset =
+        add_load_command(file, LC_UUID, sizeof(struct uuid_command));
+
+    struct uuid_command *const uuid_cmd = file_at(file, uuid_offset);
+    for (uint8_t i = 0; i != sizeof(uuid_cmd->uuid); i++) {
+        uuid_cmd->uuid[i] =
+            (uint8_t)(uuid_seed * 31 + i * 7 + (uuid_seed >> 8));
+    }
+
+    ncmds++;
+
+    const uint64_t build_version_offset =
+        add_load_command(file,
+                         LC_BUILD_VERSION,
+                         sizeof(struct build_version_command));
+
+    struct build_version_command *const build_version_cmd =
+        file_at(file, build_version_offset);
+
+    build_version_cmd->platform = PLATFORM_MACOS;
+    build_version_cmd->minos = 0xa0f00;
+    build_version_cmd->sdk = 0xa0f00;
+
+    ncmds++;
+
+    if (options->add_metadata) {
+        add_string_command(file, LC_SUB_FRAMEWORK, "Umbrella");
+        ncmds++;
+
+        for (uint32_t i = 0; i != 3; i++) {
+            if (arch_number != 0 && (i + arch_number) % 2 == 0) {
+                continue;
+            }
+
+            add_string_command(file, LC_SUB_CLIENT, synth_clients[i]);
+            ncmds++;
+        }
+
+        for (uint32_t i = 0; i != 2; i++) {
+            if (arch_number != 0 && (i + arch_number) % 3 == 0) {
+                continue;
+            }
+
+            add_dylib_command(file, LC_REEXPORT_DYLIB, synth_reexports[i], 0, 0);
+            ncmds++;
+        }
+    }
+
+    const uint64_t dyld_info_offset =
+        add_load_command(file,
+                         LC_DYLD_INFO_ONLY,
+                         sizeof(struct dyld_info_command));
+
+    const uint64_t symtab_offset =
+        add_load_command(file, LC_SYMTAB, sizeof(struct symtab_command));
+
+    ncmds += 2;
+
+    struct mach_header_64 *const header = file_at(file, header_offset);
+
+    header->magic = MH_MAGIC_64;
+    header->cputype = arch->cputype;
+    header->cpusubtype = arch->cpusubtype;
+    header->filetype = MH_DYLIB;
+    header->ncmds = ncmds;
+    header->sizeofcmds = (uint32_t)(file->size - load_cmds_offset);
+    header->flags = MH_TWOLEVEL | MH_APP_EXTENSION_SAFE;
+
+    file_align(file, 8);
+
+    uint64_t base = image_offset;
+    if (in_cache) {
+        base = 0;
+    }
+
+    struct synth_file trie = {};
+    if (!create_trie(&trie, options, arch_number)) {
+        synth_file_destroy(&trie);
+        return false;
+    }
+
+    const uint64_t trie_offset = file_add(file, trie.data, trie.size);
+    struct dyld_info_command *const dyld_info_cmd =
+        file_at(file, dyld_info_offset);
+
+    dyld_info_cmd->export_off = (uint32_t)(trie_offset - base);
+    dyld_info_cmd->export_size = (uint32_t)trie.size;
+
+    synth_file_destroy(&trie);
+
+    /*
+     * The symbol-table only holds the undefined symbols.
+     */
+
+    struct synth_file strings = {};
+    file_add(&strings, " ", 2);
+
+    const uint64_t symbols_offset = file->size;
+    for (uint32_t i = 0; i != options->undefineds_count; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "_undef_%u", i);
+
+        const struct nlist_64 symbol = {
+            .n_un.n_strx = (uint32_t)file_add(&strings, name, strlen(name) + 1),
+            .n_type = N_EXT
+        };
+
+        file_add(file, &symbol, sizeof(symbol));
+    }
+
+    file_align(&strings, 8);
+
+    const uint64_t strings_offset = file_add(file, strings.data, strings.size);
+    synth_file_destroy(&strings);
+
+    struct symtab_command *const symtab_cmd = file_at(file, symtab_offset);
+
+    symtab_cmd->symoff = (uint32_t)(symbols_offset - base);
+    symtab_cmd->nsyms = options->undefineds_count;
+    symtab_cmd->stroff = (uint32_t)(strings_offset - base);
+    symtab_cmd->strsize = (uint32_t)(file->size - strings_offset);
+
+    file_align(file, 16);
+    return true;
+}
+
+static const char synth_install_name[] = "/usr/lib/libsynth.dylib";
+
+static bool
+create_fat(struct synth_file *__notnull const file,
+           const struct synth_options *__notnull const options,
+           const bool is_64)
+{
+    uint32_t archs_count = options->archs_count;
+    if (archs_count == 0 || archs_count > synth_archs_count) {
+        archs_count = 1;
+    }
+
+    uint64_t arch_size = sizeof(struct fat_arch);
+    if (is_64) {
+        arch_size = sizeof(struct fat_arch_64);
+    }
+
+    file_add(file, NULL, sizeof(struct fat_header) + arch_size * archs_count);
+
+    struct fat_header *const header = file_at(file, 0);
+
+    header->magic = swap_uint32(FAT_MAGIC);
+    if (is_64) {
+        header->magic = swap_uint32(FAT_MAGIC_64);
+    }
+
+    header->nfat_arch = swap_uint32(archs_count);
+
+    for (uint32_t i = 0; i != archs_count; i++) {
+        file_align(file, synth_page_size);
+
+        uint32_t arch_number = 0;
+        if (options->vary_archs) {
+            arch_number = i + 1;
+        }
+
+        const struct synth_arch *const arch = synth_archs + i;
+        const uint64_t image_offset = file->size;
+
+        const bool added_image =
+            add_image(file,
+                      options,
+                      arch,
+                      synth_install_name,
+                      i + 1,
+                      arch_number,
+                      false);
+
+        if (!added_image) {
+            return false;
+        }
+
+        const uint64_t image_size = file->size - image_offset;
+        const uint64_t arch_offset =
+            sizeof(struct fat_header) + (arch_size * i);
+
+        if (is_64) {
+            struct fat_arch_64 *const fat_arch = file_at(file, arch_offset);
+
+            fat_arch->cputype = (cpu_type_t)swap_uint32(arch->cputype);
+            fat_arch->cpusubtype = (cpu_subtype_t)swap_uint32(arch->cpusubtype);
+            fat_arch->offset = swap_uint64(image_offset);
+            fat_arch->size = swap_uint64(image_size);
+            fat_arch->align = swap_uint32(12);
+        } else {
+            struct fat_arch *const fat_arch = file_at(file, arch_offset);
+
+            fat_arch->cputype = (cpu_type_t)swap_uint32(arch->cputype);
+            fat_arch->cpusubtype = (cpu_subtype_t)swap_uint32(arch->cpusubtype);
+            fat_arch->offset = swap_uint32((uint32_t)image_offset);
+            fat_arch->size = swap_uint32((uint32_t)image_size);
+            fat_arch->align = swap_uint32(12);
+        }
+    }
+
+    return true;
+}
+
+static bool
+create_dsc(struct synth_file *__notnull const file,
+           const struct synth_options *__notnull const options)
+{
+    const uint32_t images_count = options->images_count;
+
+    uint32_t mappings_count = options->mappings_count;
+    if (mappings_count == 0) {
+        mappings_count = 1;
+    }
+
+    const uint64_t header_offset =
+        file_add(file, NULL, sizeof(struct dyld_cache_header));
+
+    const uint64_t mappings_offset =
+        file_add(file,
+                 NULL,
+                 sizeof(struct dyld_cache_mapping_info) * mappings_count);
+
+    const uint64_t images_offset =
+        file_add(file,
+                 NULL,
+                 sizeof(struct dyld_cache_image_info) * images_count);
+
+    struct dyld_cache_header *const header = file_at(file, header_offset);
+
+    memcpy(header->magic, "dyld_v1  x86_64", 16);
+
+    header->mappingOffset = (uint32_t)mappings_offset;
+    header->mappingCount = mappings_count;
+    header->imagesOffsetOld = (uint32_t)images_offset;
+    header->imagesCountOld = images_count;
+
+    for (uint32_t i = 0; i != images_count; i++) {
+        char path[128];
+        snprintf(path,
+                 sizeof(path),
+                 "/System/Library/Frameworks/F%u.framework/Versions/A/F%u",
+                 i % 37,
+                 i);
+
+        const uint64_t path_offset = file_add(file, path, strlen(path) + 1);
+        struct dyld_cache_image_info *const image =
+            (struct dyld_cache_image_info *)file_at(file, images_offset) + i;
+
+        image->pathFileOffset = (uint32_t)path_offset;
+    }
+
+    for (uint32_t i = 0; i != images_count; i++) {
+        file_align(file, synth_page_size);
+
+        const uint64_t image_offset = file->size;
+        const struct dyld_cache_image_info *const image =
+            (struct dyld_cache_image_info *)file_at(file, images_offset) + i;
+
+        /*
+         * Copy the path out of the file, as adding the image may move the
+         * file's data.
+         */
+
+        char path[128];
+        snprintf(path,
+                 sizeof(path),
+                 "%s",
+                 (const char *)file_at(file, image->pathFileOffset));
+
+        if (!add_image(file, options, synth_archs, path, i + 1, 0, true)) {
+            return false;
+        }
+
+        struct dyld_cache_image_info *const image_info =
+            (struct dyld_cache_image_info *)file_at(file, images_offset) + i;
+
+        image_info->address = synth_dsc_base_address + image_offset;
+    }
+
+    file_align(file, synth_page_size);
+
+    /*
+     * Split the cache into page-aligned mappings, listed in the reverse order
+     * of their addresses.
+     */
+
+    const uint64_t pages_count = file->size / synth_page_size;
+    const uint64_t pages_per_mapping =
+        (pages_count + mappings_count - 1) / mappings_count;
+
+    const uint64_t mapping_size = pages_per_mapping * synth_page_size;
+    for (uint32_t i = 0; i != mappings_count; i++) {
+        uint64_t begin = i * mapping_size;
+        uint64_t end = begin + mapping_size;
+
+        if (begin > file->size) {
+            begin = file->size;
+        }
+
+        if (end > file->size) {
+            end = file->size;
+        }
+
+        struct dyld_cache_mapping_info *const mapping =
+            (struct dyld_cache_mapping_info *)file_at(file, mappings_offset) +
+            (mappings_count - 1 - i);
+
+        mapping->address = synth_dsc_base_address + begin;
+        mapping->size = end - begin;
+        mapping->fileOffset = begin;
+        mapping->maxProt = 5;
+        mapping->initProt = 5;
+    }
+
+    return true;
+}
+
+struct synth_options synth_options_default(void) {
+    const struct synth_options options = {
+        .symbols_count = 1000,
+        .trie_depth = 2,
+        .undefineds_count = 50,
+
+        .archs_count = 2,
+
+        .images_count = 100,
+        .mappings_count = 1
+    };
+
+    return options;
+}
+
+static bool parse_count(const char *const arg, uint32_t *__notnull const out) {
+    if (arg == NULL) {
+        return false;
+    }
+
+    char *end = NULL;
+    const unsigned long count = strtoul(arg, &end, 10);
+
+    if (end == arg || *end != '\0' || count > UINT32_MAX) {
+        return false;
+    }
+
+    *out = (uint32_t)count;
+    return true;
+}
+
+enum synth_parse_option_result
+synth_options_parse_option(struct synth_options *__notnull const options,
+                           const int argc,
+                           const char *const *__notnull const argv,
+                           int *__notnull const index_in)
+{
+    const int index = *index_in;
+    const char *const option = argv[index];
+
+    uint32_t *count = NULL;
+    if (strcmp(option, "--symbols") == 0) {
+        count = &options->symbols_count;
+    } else if (strcmp(option, "--depth") == 0) {
+        count = &options->trie_depth;
+    } else if (strcmp(option, "--undefineds") == 0) {
+        count = &options->undefineds_count;
+    } else if (strcmp(option, "--archs") == 0) {
+        count = &options->archs_count;
+    } else if (strcmp(option, "--images") == 0) {
+        count = &options->images_count;
+    } else if (strcmp(option, "--mappings") == 0) {
+        count = &options->mappings_count;
+    } else if (strcmp(option, "--metadata") == 0) {
+        options->add_metadata = true;
+        return E_SYNTH_PARSE_OPTION_OK;
+    } else if (strcmp(option, "--vary-archs") == 0) {
+        options->vary_archs = true;
+        return E_SYNTH_PARSE_OPTION_OK;
+    } else {
+        return E_SYNTH_PARSE_OPTION_UNRECOGNIZED;
+    }
+
+    if (index + 1 == argc || !parse_count(argv[index + 1], count)) {
+        return E_SYNTH_PARSE_OPTION_INVALID_COUNT;
+    }
+
+    *index_in = index + 1;
+    return E_SYNTH_PARSE_OPTION_OK;
+}
+
+void synth_options_print_usage(void) {
+    fputs("    --symbols <count>,    Amount of exported symbols per image "
+          "(default: 1000)\n"
+          "    --depth <count>,      Depth of the export-trie (default: 2)\n"
+          "    --undefineds <count>, Amount of undefined symbols per image "
+          "(default: 50)\n"
+          "    --archs <count>,      Amount of archs of a fat file, at most 4 "
+          "(default: 2)\n"
+          "    --images <count>,     Amount of images of a dyld_shared_cache "
+          "(default: 100)\n"
+          "    --mappings <count>,   Amount of mappings of a dyld_shared_cache "
+          "(default: 1)\n"
+          "    --metadata,           Add a parent-umbrella, clients and "
+          "re-exports to every image\n"
+          "    --vary-archs,         Give every arch of a fat file a different "
+          "set of symbols\n",
+          stderr);
+}
+
+bool
+synth_file_create(struct synth_file *__notnull const file,
+                  const enum synth_kind kind,
+                  const struct synth_options *__notnull const options)
+{
+    *file = (struct synth_file){};
+
+    bool result = false;
+    switch (kind) {
+        case SYNTH_KIND_THIN: {
+            uint32_t arch_number = 0;
+            if (options->vary_archs) {
+                arch_number = 1;
+            }
+
+            result =
+                add_image(file,
+                          options,
+                          synth_archs,
+                          synth_install_name,
+                          1,
+                          arch_number,
+                          false);
+
+            break;
+        }
+
+        case SYNTH_KIND_FAT32:
+            result = create_fat(file, options, false);
+            break;
+
+        case SYNTH_KIND_FAT64:
+            result = create_fat(file, options, true);
+            break;
+
+        case SYNTH_KIND_DSC:
+            result = create_dsc(file, options);
+            break;
+    }
+
+    if (!result) {
+        synth_file_destroy(file);
+    }
+
+    return result;
+}
+
+void synth_file_destroy(struct synth_file *__notnull const file) {
+    free(file->data);
+
+    file->data = NULL;
+    file->size = 0;
+    file->capacity = 0;
+}
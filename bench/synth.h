@@ -0,0 +1,105 @@
+//
+//  bench/synth.h
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "notnull.h"
+
+/*
+ * Generator of synthetic mach-o files and dyld_shared_caches, used to benchmark
+ * tbd without any real input files.
+ *
+ * Every image is a 64-bit dylib with an export-trie holding symbols_count
+ * symbols, whose nodes are trie_depth levels deep, along with a symbol-table
+ * holding undefineds_count undefined symbols.
+ */
+
+enum synth_kind {
+    SYNTH_KIND_THIN,
+    SYNTH_KIND_FAT32,
+    SYNTH_KIND_FAT64,
+    SYNTH_KIND_DSC
+};
+
+struct synth_options {
+    uint32_t symbols_count;
+    uint32_t trie_depth;
+    uint32_t undefineds_count;
+
+    /*
+     * The amount of archs of a fat file, at most 4.
+     */
+
+    uint32_t archs_count;
+
+    /*
+     * The amount of images of a dyld_shared_cache, and the amount of mappings
+     * the images are split into.
+     */
+
+    uint32_t images_count;
+    uint32_t mappings_count;
+
+    /*
+     * Add a parent-umbrella, clients and re-exports to every image.
+     */
+
+    bool add_metadata : 1;
+
+    /*
+     * Leave out some symbols and metadata for every arch of a fat file, so the
+     * archs don't share the same set of symbols.
+     */
+
+    bool vary_archs : 1;
+};
+
+struct synth_file {
+    uint8_t *data;
+    uint64_t size;
+    uint64_t capacity;
+};
+
+/*
+ * Returns the default options, that create a file of 1000 symbols, 2 levels
+ * deep, and 50 undefineds, with 2 archs for a fat file, and 100 images in one
+ * mapping for a dyld_shared_cache.
+ */
+
+struct synth_options synth_options_default(void);
+
+enum synth_parse_option_result {
+    E_SYNTH_PARSE_OPTION_OK,
+    E_SYNTH_PARSE_OPTION_UNRECOGNIZED,
+    E_SYNTH_PARSE_OPTION_INVALID_COUNT
+};
+
+/*
+ * Parse the generator's option at argv[*index_in] into options, advancing
+ * index_in past any of the option's arguments.
+ */
+
+enum synth_parse_option_result
+synth_options_parse_option(struct synth_options *__notnull options,
+                           int argc,
+                           const char *const *__notnull argv,
+                           int *__notnull index_in);
+
+void synth_options_print_usage(void);
+
+bool
+synth_file_create(struct synth_file *__notnull file,
+                  enum synth_kind kind,
+                  const struct synth_options *__notnull options);
+
+void synth_file_destroy(struct synth_file *__notnull file);
+
+#endif /* SYNTH_H */
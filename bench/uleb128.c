@@ -0,0 +1,221 @@
+//
+//  bench/uleb128.c
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "macho_file_parse_export_trie.h"
+
+/*
+ * Microbenchmark of the export-trie's uleb128 decoding, comparing it against a
+ * plain byte-by-byte decoder.
+ *
+ * The ulebs are distributed as they are found in export-tries, where most are
+ * terminal-sizes, flags, child-counts, and node-offsets of one to three bytes,
+ * with the remaining being addresses of four to eight bytes.
+ */
+
+static const uint64_t uleb_count = 1 << 20;
+static const uint64_t rounds = 64;
+
+static uint64_t random_state = 0x9e3779b97f4a7c15;
+
+static uint64_t next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+
+    return random_state;
+}
+
+static uint64_t get_random_value(void) {
+    const uint64_t kind = next_random() % 16;
+    const uint64_t random = next_random();
+
+    if (kind < 8) {
+        return random & 0x7f;
+    } else if (kind < 12) {
+        return random & 0x3fff;
+    } else if (kind < 14) {
+        return random & 0x1fffff;
+    } else if (kind < 15) {
+        return random & 0xffffffff;
+    }
+
+    return random & 0xffffffffffffff;
+}
+
+static uint8_t *write_uleb128(uint8_t *iter, uint64_t value) {
+    do {
+        uint8_t byte = value & 0x7f;
+
+        value >>= 7;
+        if (value != 0) {
+            byte |= 0x80;
+        }
+
+        *iter = byte;
+        iter++;
+    } while (value != 0);
+
+    return iter;
+}
+
+/*
+ * Not inlined, so both decoders are called the same way.
+ */
+
+__attribute__((noinline)) static const uint8_t *
+read_uleb128_64_bytewise(const uint8_t *iter,
+                         const uint8_t *const end,
+                         uint64_t *const result_out)
+{
+    uint64_t result = 0;
+    for (uint64_t shift = 0; shift < 64; shift += 7) {
+        if (iter == end) {
+            return NULL;
+        }
+
+        const uint8_t byte = *iter;
+        iter++;
+
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *result_out = result;
+            return iter;
+        }
+    }
+
+    return NULL;
+}
+
+static uint64_t get_time_ns(void) {
+    struct timespec spec = {};
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+
+    return (uint64_t)spec.tv_sec * 1000000000ull + (uint64_t)spec.tv_nsec;
+}
+
+static void
+print_result(const char *const name,
+             const uint64_t begin,
+             const uint64_t end,
+             const uint64_t sum)
+{
+    const double ns = (double)(end - begin) / (double)(uleb_count * rounds);
+    printf("%-24s %8.3f ns/uleb (checksum %" PRIx64 ")\n", name, ns, sum);
+}
+
+int main(void) {
+    uint64_t *const values = calloc(uleb_count, sizeof(uint64_t));
+    uint8_t *const buffer = calloc(uleb_count, 10);
+
+    if (values == NULL || buffer == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        return 1;
+    }
+
+    uint8_t *buffer_end = buffer;
+    for (uint64_t i = 0; i != uleb_count; i++) {
+        values[i] = get_random_value();
+        buffer_end = write_uleb128(buffer_end, values[i]);
+    }
+
+    /*
+     * Verify the decoders against the written values before timing them.
+     */
+
+    const uint8_t *iter = buffer;
+    for (uint64_t i = 0; i != uleb_count; i++) {
+        uint64_t value = 0;
+        const uint8_t *const next = read_uleb128_64(iter, buffer_end, &value);
+
+        if (next == NULL || value != values[i]) {
+            fprintf(stderr, "read_uleb128_64() failed at uleb %" PRIu64 "\n", i);
+            return 1;
+        }
+
+        uint32_t value_32 = 0;
+        const uint8_t *const next_32 =
+            read_uleb128_32(iter, buffer_end, &value_32);
+
+        if (values[i] > UINT32_MAX) {
+            if (next_32 != NULL) {
+                fprintf(stderr,
+                        "read_uleb128_32() accepted 64-bit uleb %" PRIu64 "\n",
+                        i);
+
+                return 1;
+            }
+        } else if (next_32 != next || value_32 != values[i]) {
+            fprintf(stderr, "read_uleb128_32() failed at uleb %" PRIu64 "\n", i);
+            return 1;
+        }
+
+        if (skip_uleb128(iter, buffer_end) != next) {
+            fprintf(stderr, "skip_uleb128() failed at uleb %" PRIu64 "\n", i);
+            return 1;
+        }
+
+        iter = next;
+    }
+
+    printf("%" PRIu64 " ulebs, %" PRIu64 " bytes, %" PRIu64 " rounds\n",
+           uleb_count,
+           (uint64_t)(buffer_end - buffer),
+           rounds);
+
+    uint64_t sum = 0;
+    uint64_t begin = get_time_ns();
+
+    for (uint64_t round = 0; round != rounds; round++) {
+        iter = buffer;
+        while (iter != buffer_end) {
+            uint64_t value = 0;
+            iter = read_uleb128_64_bytewise(iter, buffer_end, &value);
+            sum += value;
+        }
+    }
+
+    print_result("byte-by-byte", begin, get_time_ns(), sum);
+
+    sum = 0;
+    begin = get_time_ns();
+
+    for (uint64_t round = 0; round != rounds; round++) {
+        iter = buffer;
+        while (iter != buffer_end) {
+            uint64_t value = 0;
+            iter = read_uleb128_64(iter, buffer_end, &value);
+            sum += value;
+        }
+    }
+
+    print_result("read_uleb128_64()", begin, get_time_ns(), sum);
+
+    sum = 0;
+    begin = get_time_ns();
+
+    for (uint64_t round = 0; round != rounds; round++) {
+        iter = buffer;
+        while (iter != buffer_end) {
+            iter = skip_uleb128(iter, buffer_end);
+            sum++;
+        }
+    }
+
+    print_result("skip_uleb128()", begin, get_time_ns(), sum);
+
+    free(buffer);
+    free(values);
+
+    return 0;
+}
@@ -27,6 +27,7 @@ enum dsc_image_parse_result {
     E_DSC_IMAGE_PARSE_READ_FAIL,
 
     E_DSC_IMAGE_PARSE_NO_MAPPING,
+    E_DSC_IMAGE_PARSE_SUBCACHE_UNAVAILABLE,
     E_DSC_IMAGE_PARSE_SIZE_TOO_SMALL,
 
     E_DSC_IMAGE_PARSE_INVALID_RANGE,
@@ -66,7 +67,7 @@ struct dsc_image_parse_options {
 enum dsc_image_parse_result
 dsc_image_parse(struct tbd_create_info *__notnull info_in,
                 struct dyld_shared_cache_info *__notnull dsc_info,
-                struct dyld_cache_image_info *__notnull image,
+                const struct dyld_cache_image_info *__notnull image,
                 const macho_file_parse_error_callback callback,
                 void *const callback_info,
                 struct string_buffer *__notnull export_trie_sb,
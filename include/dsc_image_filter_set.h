@@ -0,0 +1,66 @@
+//
+//  include/dsc_image_filter_set.h
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef DSC_IMAGE_FILTER_SET_H
+#define DSC_IMAGE_FILTER_SET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "array.h"
+#include "notnull.h"
+#include "tbd_for_main.h"
+
+/*
+ * The image-filters and image-paths of a tbd_for_main, compiled into a single
+ * hash-table of exact paths, file-names, and directory-components, so that an
+ * image-path is matched against every filter with one pass over the path.
+ *
+ * Filters that can't be hashed (file-names and directories with a slash) are
+ * still matched one by one.
+ */
+
+struct dsc_image_filter_set {
+    struct tbd_for_main_dsc_image_filter *filters;
+
+    uint32_t *buckets;
+    uint64_t buckets_count;
+
+    struct array unhashed;
+
+    /*
+     * The (uint32_t) indices of the filters matched by the last call to
+     * dsc_image_filter_set_match(), in ascending order.
+     */
+
+    struct array matches;
+
+    bool has_paths : 1;
+    bool has_filenames : 1;
+    bool has_directories : 1;
+};
+
+bool
+dsc_image_filter_set_create(struct dsc_image_filter_set *__notnull set,
+                            const struct array *__notnull filters);
+
+/*
+ * Find every filter that path passes through, storing their indices in matches
+ * and pointing their tmp_ptr to the matched part of path, as
+ * path_has_filename() and path_has_dir_component() do.
+ *
+ * Returns the number of filters matched.
+ */
+
+uint64_t
+dsc_image_filter_set_match(struct dsc_image_filter_set *__notnull set,
+                           const char *__notnull path,
+                           uint64_t path_length);
+
+void dsc_image_filter_set_destroy(struct dsc_image_filter_set *__notnull set);
+
+#endif /* DSC_IMAGE_FILTER_SET_H */
@@ -0,0 +1,85 @@
+//
+//  include/dsc_index.h
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef DSC_INDEX_H
+#define DSC_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "array.h"
+#include "dyld_shared_cache.h"
+#include "notnull.h"
+
+/*
+ * An on-disk index of the image-paths of a dyld_shared_cache, keyed on the
+ * cache's uuid and image-table, so images can be found by their path,
+ * file-name, or directories without reading every image-path string.
+ *
+ * The index only narrows down the images that may match, every image found
+ * still has to be checked against its path.
+ */
+
+enum dsc_index_kind {
+    DSC_INDEX_KIND_PATH = 1,
+    DSC_INDEX_KIND_FILENAME,
+    DSC_INDEX_KIND_DIRECTORY
+};
+
+struct dsc_index_header;
+struct dsc_index_entry;
+
+struct dsc_index {
+    const struct dsc_index_header *header;
+
+    const uint32_t *buckets;
+    const struct dsc_index_entry *entries;
+
+    /*
+     * Images whose paths aren't absolute, and so aren't indexed, which have to
+     * be checked on every lookup.
+     */
+
+    const uint32_t *unindexed;
+
+    void *data;
+    uint64_t size;
+
+    bool is_mapped : 1;
+};
+
+/*
+ * Find the index of the dyld_shared_cache in the directory at dir_path, or
+ * otherwise create the index and store it there.
+ *
+ * Returns false if no index could be found or created.
+ */
+
+bool
+dsc_index_open(struct dsc_index *__notnull index,
+               const char *__notnull dir_path,
+               uint64_t dir_path_length,
+               const struct dyld_shared_cache_info *__notnull dsc_info);
+
+/*
+ * Add the (uint32_t) indices of every image that may have string as its path,
+ * file-name or directory, depending on kind, to the end of images_out.
+ *
+ * Returns false if string can't be looked up through the index, in which case
+ * every image has to be checked.
+ */
+
+bool
+dsc_index_find_images(const struct dsc_index *__notnull index,
+                      enum dsc_index_kind kind,
+                      const char *__notnull string,
+                      uint64_t length,
+                      struct array *__notnull images_out);
+
+void dsc_index_destroy(struct dsc_index *__notnull index);
+
+#endif /* DSC_INDEX_H */
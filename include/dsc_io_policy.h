@@ -0,0 +1,126 @@
+//
+//  include/dsc_io_policy.h
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef DSC_IO_POLICY_H
+#define DSC_IO_POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dyld_shared_cache.h"
+#include "notnull.h"
+#include "range.h"
+
+/*
+ * The parts of an image's header and load-commands, export-trie, symbol-table
+ * and string-table, read while parsing the image.
+ */
+
+#define DSC_IO_IMAGE_RANGES_MAX 4
+
+struct dsc_io_range {
+    struct range range;
+
+    /*
+     * The size of range counted in readahead_size, or zero if range is already
+     * counted through an image ahead of this one in the window.
+     */
+
+    uint64_t counted_size;
+};
+
+struct dsc_io_image {
+    const struct dyld_cache_image_info *image;
+
+    struct dsc_io_range ranges[DSC_IO_IMAGE_RANGES_MAX];
+    uint32_t ranges_count;
+};
+
+/*
+ * Advise the kernel on how a dyld_shared_cache's map is read while its images
+ * are parsed.
+ *
+ * The images selected to be parsed next are read in ahead of time with
+ * MADV_WILLNEED, and the ranges of an image are dropped with MADV_DONTNEED once
+ * the image is written out, unless an image in the window still uses them.
+ *
+ * When max_rss is provided, the total size of the ranges of every image in the
+ * window is kept under max_rss. The resident memory of tbd is also checked
+ * every time an image is released. When it's over max_rss, every page of the
+ * map outside the window's ranges is dropped, including the pages read while
+ * parsing images that were already written out, and the window is shrunk. The
+ * window grows back one image at a time once tbd is under max_rss again.
+ *
+ * Only pages of the map can be dropped, so memory allocated by tbd itself
+ * counts toward max_rss, but isn't lowered.
+ */
+
+struct dsc_io_policy {
+    const struct dyld_shared_cache_info *dsc_info;
+
+    struct dsc_io_image *window;
+    uint32_t window_capacity;
+
+    uint32_t window_front;
+    uint32_t window_count;
+
+    /*
+     * The most images the window may currently hold, which is lowered while
+     * tbd is over max_rss.
+     */
+
+    uint32_t window_limit;
+
+    uint64_t page_size;
+    uint64_t max_rss;
+    uint64_t readahead_size;
+};
+
+/*
+ * Create a policy for dsc_info holding at most window_capacity images ahead,
+ * keeping tbd's resident memory under max_rss bytes, or with no limit if
+ * max_rss is zero.
+ *
+ * The image-table is advised to be read sequentially.
+ */
+
+bool
+dsc_io_policy_create(struct dsc_io_policy *__notnull policy,
+                     const struct dyld_shared_cache_info *__notnull dsc_info,
+                     uint32_t window_capacity,
+                     uint64_t max_rss);
+
+/*
+ * Read image's ranges in ahead of time, adding image to the back of the
+ * window.
+ *
+ * Returns false if the window is full, or if image's ranges don't fit in
+ * max_rss, in which case image should be prefetched again after the next call
+ * to dsc_io_policy_release(). An image always fits into an empty window.
+ */
+
+bool
+dsc_io_policy_prefetch(
+    struct dsc_io_policy *__notnull policy,
+    const struct dyld_cache_image_info *__notnull image);
+
+/*
+ * Drop the ranges of image, which has been written out, from memory, and remove
+ * image from the window. Images may be released in any order, and image may not
+ * have been prefetched at all.
+ *
+ * If tbd is then over max_rss, the pages of the map not used by the window are
+ * dropped as well, and the window is shrunk.
+ */
+
+void
+dsc_io_policy_release(struct dsc_io_policy *__notnull policy,
+                      const struct dyld_cache_image_info *__notnull image);
+
+void dsc_io_policy_destroy(struct dsc_io_policy *__notnull policy);
+
+#endif /* DSC_IO_POLICY_H */
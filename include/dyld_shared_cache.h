@@ -9,6 +9,7 @@
 #ifndef DYLD_SHARED_CACHE_H
 #define DYLD_SHARED_CACHE_H
 
+#include <pthread.h>
 #include <stdbool.h>
 
 #include "mach/machine.h"
@@ -18,8 +19,19 @@
 #include "range.h"
 
 struct dyld_shared_cache_parse_options {
-    bool zero_image_pads : 1;
+    /*
+     * Create the extracted-images bitset, to mark images as extracted.
+     */
+
+    bool track_extracted_images : 1;
     bool verify_image_path_offsets : 1;
+
+    /*
+     * The path of the cache-file, which the paths of the cache's subcaches are
+     * made from, or NULL if the cache's subcaches shouldn't be opened.
+     */
+
+    const char *path;
 };
 
 struct dyld_shared_cache_flags {
@@ -39,16 +51,87 @@ enum dyld_shared_cache_parse_result {
 
     E_DYLD_SHARED_CACHE_PARSE_INVALID_IMAGES,
     E_DYLD_SHARED_CACHE_PARSE_INVALID_MAPPINGS,
+    E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES,
 
     E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_RANGES,
     E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_IMAGES,
     E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_MAPPINGS
 };
 
+/*
+ * An entry of the mapping-index, the address-ranges of the mappings sorted by
+ * their begin-address.
+ *
+ * max_end is the largest end-address of this range and every range before it
+ * in the index, and order is the position of the range's mapping in the
+ * mapping-list.
+ */
+
+struct dyld_shared_cache_mapping_range {
+    uint64_t begin;
+    uint64_t end;
+    uint64_t max_end;
+
+    uint64_t file_offset;
+    uint32_t order;
+};
+
+/*
+ * One of the files of a dyld_shared_cache, either the main cache-file, or one
+ * of its subcaches.
+ */
+
+struct dyld_shared_cache_file {
+    const uint8_t *map;
+    uint64_t size;
+
+    struct range available_range;
+};
+
+/*
+ * A subcache of a dyld_shared_cache split across multiple files, holding the
+ * mappings starting at address.
+ *
+ * A subcache's file is only opened and mapped once an address is looked up in
+ * the subcache, so subcaches holding none of the images parsed are never read.
+ */
+
+struct dyld_shared_cache_subcache {
+    char *path;
+    uint64_t address;
+
+    pthread_mutex_t lock;
+    struct dyld_shared_cache_file file;
+
+    struct dyld_shared_cache_mapping_range *mapping_index;
+    uint32_t mapping_index_count;
+
+    /*
+     * When the subcache failed to be mapped, map_errno holds the errno of the
+     * failure, or zero if the subcache's file was itself invalid.
+     */
+
+    int map_errno;
+
+    bool is_mapped : 1;
+    bool failed_to_map : 1;
+    bool did_print_map_failure : 1;
+};
+
 struct dyld_shared_cache_info {
-    struct dyld_cache_image_info *images;
+    const struct dyld_cache_image_info *images;
     uint32_t images_count;
 
+    /*
+     * A bit for every image, set once the image has been extracted, or NULL
+     * if not tracking extracted images.
+     *
+     * The state is kept out of the map, so the map can stay read-only, and its
+     * pages clean and shared with every other process mapping the cache.
+     */
+
+    uint64_t *extracted_images;
+
     /*
      * An absolute offset to the array of dyld_cache_mapping_info structures.
      */
@@ -56,7 +139,13 @@ struct dyld_shared_cache_info {
     const struct dyld_cache_mapping_info *mappings;
     uint32_t mappings_count;
 
-    uint8_t *map;
+    struct dyld_shared_cache_mapping_range *mapping_index;
+    uint32_t mapping_index_count;
+
+    struct dyld_shared_cache_subcache *subcaches;
+    uint32_t subcaches_count;
+
+    const uint8_t *map;
     uint64_t size;
     uint64_t arch_index;
 
@@ -81,11 +170,78 @@ dyld_shared_cache_parse_from_range(
     uint64_t end,
     struct dyld_shared_cache_parse_options options);
 
+/*
+ * Translate a memory-address into a file-offset through the mapping of the main
+ * cache-file containing the address. The size available in that mapping from
+ * the address is returned in max_size_out.
+ *
+ * Returns 0 if no mapping contains the address.
+ */
+
+uint64_t
+dyld_shared_cache_get_offset_for_addr(
+    const struct dyld_shared_cache_info *__notnull info,
+    uint64_t address,
+    uint64_t *__notnull max_size_out);
+
+/*
+ * Like dyld_shared_cache_get_offset_for_addr(), but also look through the
+ * mappings of the cache's subcaches, mapping the subcache containing the
+ * address if needed. The file the offset is in is returned in file_out.
+ *
+ * Returns 0 if no mapping contains the address, or if the subcache containing
+ * the address couldn't be mapped.
+ */
+
+uint64_t
+dyld_shared_cache_get_file_for_addr(
+    const struct dyld_shared_cache_info *__notnull info,
+    uint64_t address,
+    uint64_t *__notnull max_size_out,
+    struct dyld_shared_cache_file *__notnull file_out);
+
+/*
+ * Returns whether address is in a subcache of info that couldn't be mapped, in
+ * which case the address can't be translated, even though it may be valid.
+ */
+
+bool
+dyld_shared_cache_addr_in_unavailable_subcache(
+    const struct dyld_shared_cache_info *__notnull info,
+    uint64_t address);
+
+/*
+ * Drop the pages of every subcache of info that has been mapped from memory.
+ * The pages are read in again if they're used afterwards.
+ */
+
+void
+dyld_shared_cache_drop_subcache_pages(
+    const struct dyld_shared_cache_info *__notnull info);
+
 void
 dyld_shared_cache_print_list_of_images(int fd,
                                        uint64_t start,
                                        uint64_t end);
 
+static inline bool
+dyld_shared_cache_image_was_extracted(
+    const struct dyld_shared_cache_info *__notnull const info,
+    const struct dyld_cache_image_info *__notnull const image)
+{
+    const uint64_t index = (uint64_t)(image - info->images);
+    return (info->extracted_images[index / 64] & (1ull << (index % 64)));
+}
+
+static inline void
+dyld_shared_cache_mark_image_extracted(
+    struct dyld_shared_cache_info *__notnull const info,
+    const struct dyld_cache_image_info *__notnull const image)
+{
+    const uint64_t index = (uint64_t)(image - info->images);
+    info->extracted_images[index / 64] |= 1ull << (index % 64);
+}
+
 void
 dyld_shared_cache_info_destroy(struct dyld_shared_cache_info *__notnull info);
 
@@ -15,13 +15,99 @@
  * From dyld/dyld3/shared-cache/dyld_cache_format.h in apple's dyld source.
  */
 
+/*
+ * Fields past dyldBaseAddress are only present when mappingOffset is past the
+ * end of the field, as the mappings always follow the header.
+ *
+ * imagesOffsetOld and imagesCountOld were replaced by imagesOffset and
+ * imagesCount once caches were split into subcaches.
+ */
+
 struct dyld_cache_header {
     char magic[16];
     uint32_t mappingOffset;
     uint32_t mappingCount;
+    uint32_t imagesOffsetOld;
+    uint32_t imagesCountOld;
+    uint64_t dyldBaseAddress;
+    uint64_t codeSignatureOffset;
+    uint64_t codeSignatureSize;
+    uint64_t slideInfoOffsetUnused;
+    uint64_t slideInfoSizeUnused;
+    uint64_t localSymbolsOffset;
+    uint64_t localSymbolsSize;
+    uint8_t uuid[16];
+    uint64_t cacheType;
+    uint32_t branchPoolsOffset;
+    uint32_t branchPoolsCount;
+    uint64_t dyldInCacheMH;
+    uint64_t dyldInCacheEntry;
+    uint64_t imagesTextOffset;
+    uint64_t imagesTextCount;
+    uint64_t patchInfoAddr;
+    uint64_t patchInfoSize;
+    uint64_t otherImageGroupAddrUnused;
+    uint64_t otherImageGroupSizeUnused;
+    uint64_t progClosuresAddr;
+    uint64_t progClosuresSize;
+    uint64_t progClosuresTrieAddr;
+    uint64_t progClosuresTrieSize;
+    uint32_t platform;
+    uint32_t formatVersion;
+    uint64_t sharedRegionStart;
+    uint64_t sharedRegionSize;
+    uint64_t maxSlide;
+    uint64_t dylibsImageArrayAddr;
+    uint64_t dylibsImageArraySize;
+    uint64_t dylibsTrieAddr;
+    uint64_t dylibsTrieSize;
+    uint64_t otherImageArrayAddr;
+    uint64_t otherImageArraySize;
+    uint64_t otherTrieAddr;
+    uint64_t otherTrieSize;
+    uint32_t mappingWithSlideOffset;
+    uint32_t mappingWithSlideCount;
+    uint64_t dylibsPBLStateArrayAddrUnused;
+    uint64_t dylibsPBLSetAddr;
+    uint64_t programsPBLSetPoolAddr;
+    uint64_t programsPBLSetPoolSize;
+    uint64_t programTrieAddr;
+    uint32_t programTrieSize;
+    uint32_t osVersion;
+    uint32_t altPlatform;
+    uint32_t altOsVersion;
+    uint64_t swiftOptsOffset;
+    uint64_t swiftOptsSize;
+    uint32_t subCacheArrayOffset;
+    uint32_t subCacheArrayCount;
+    uint8_t symbolFileUUID[16];
+    uint64_t rosettaReadOnlyAddr;
+    uint64_t rosettaReadOnlySize;
+    uint64_t rosettaReadWriteAddr;
+    uint64_t rosettaReadWriteSize;
     uint32_t imagesOffset;
     uint32_t imagesCount;
-    uint64_t dyldBaseAddress;
+    uint32_t cacheSubType;
+};
+
+/*
+ * The entries of the subcache-array, which are stored as
+ * dyld_subcache_entry_v1 when mappingOffset is at or before cacheSubType.
+ *
+ * A subcache's file is found next to the main cache-file, with the path of the
+ * main cache-file followed by fileSuffix, or for dyld_subcache_entry_v1, by a
+ * dot and the entry's index plus one.
+ */
+
+struct dyld_subcache_entry_v1 {
+    uint8_t uuid[16];
+    uint64_t cacheVMOffset;
+};
+
+struct dyld_subcache_entry {
+    uint8_t uuid[16];
+    uint64_t cacheVMOffset;
+    char fileSuffix[32];
 };
 
 struct dyld_cache_mapping_info {
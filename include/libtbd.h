@@ -0,0 +1,143 @@
+//
+//  include/libtbd.h
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef LIBTBD_H
+#define LIBTBD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dsc_image.h"
+#include "dyld_shared_cache.h"
+#include "macho_file.h"
+#include "notnull.h"
+#include "string_buffer.h"
+#include "tbd.h"
+
+/*
+ * An in-process interface to tbd, for converting many mach-o files, or
+ * dyld_shared_cache images, without starting tbd for each one.
+ *
+ * A tbd_context keeps its allocations between conversions, so they can be
+ * reused for the next file. A context must only be used by one thread at a
+ * time, but any number of contexts can be used on separate threads.
+ */
+
+struct tbd_context_options {
+    /*
+     * The .tbd version to write, or TBD_VERSION_NONE for the default of v2.
+     */
+
+    enum tbd_version version;
+
+    struct tbd_parse_options parse_options;
+    struct tbd_create_options write_options;
+    struct macho_file_parse_options macho_options;
+
+    /*
+     * Called on the same thread to decide whether to continue on errors that
+     * can be ignored. Without a callback, every such error fails conversion.
+     */
+
+    macho_file_parse_error_callback callback;
+    void *callback_info;
+};
+
+struct tbd_context {
+    struct tbd_context_options options;
+    struct tbd_create_info info;
+
+    /*
+     * The .tbd document created by the last successful conversion, which stays
+     * valid until the next conversion.
+     */
+
+    struct string_buffer document;
+    struct string_buffer export_trie_sb;
+
+    struct dyld_shared_cache_info dsc_info;
+
+    /*
+     * The result of the parser that failed the last conversion, depending on
+     * the tbd_context_result returned.
+     */
+
+    enum macho_file_parse_result macho_parse_result;
+    enum dyld_shared_cache_parse_result dsc_parse_result;
+    enum dsc_image_parse_result dsc_image_parse_result;
+
+    bool has_dsc : 1;
+};
+
+enum tbd_context_result {
+    E_TBD_CONTEXT_OK,
+
+    E_TBD_CONTEXT_SEEK_FAIL,
+    E_TBD_CONTEXT_READ_FAIL,
+
+    E_TBD_CONTEXT_NOT_A_MACHO,
+    E_TBD_CONTEXT_NOT_A_SHARED_CACHE,
+
+    /*
+     * The parser's own result is stored in the context's macho_parse_result,
+     * dsc_parse_result, or dsc_image_parse_result respectively.
+     */
+
+    E_TBD_CONTEXT_MACHO_PARSE_FAIL,
+    E_TBD_CONTEXT_DSC_PARSE_FAIL,
+    E_TBD_CONTEXT_DSC_IMAGE_PARSE_FAIL,
+
+    E_TBD_CONTEXT_NO_SHARED_CACHE,
+    E_TBD_CONTEXT_INVALID_IMAGE_INDEX,
+
+    E_TBD_CONTEXT_WRITE_FAIL
+};
+
+void
+tbd_context_create(struct tbd_context *__notnull ctx,
+                   struct tbd_context_options options);
+
+/*
+ * Convert the mach-o file at fd, which is read from the beginning, into a .tbd
+ * document stored in ctx->document.
+ */
+
+enum tbd_context_result
+tbd_context_convert_fd(struct tbd_context *__notnull ctx, int fd);
+
+/*
+ * Convert the mach-o file read into data into a .tbd document stored in
+ * ctx->document. data is only used for the duration of the call.
+ */
+
+enum tbd_context_result
+tbd_context_convert_buffer(struct tbd_context *__notnull ctx,
+                           const void *__notnull data,
+                           uint64_t size);
+
+/*
+ * Open the dyld_shared_cache file at fd to convert its images, closing any
+ * dyld_shared_cache ctx previously opened.
+ */
+
+enum tbd_context_result
+tbd_context_open_dsc(struct tbd_context *__notnull ctx, int fd);
+
+/*
+ * Convert the image at index (from zero) of the image-table of the
+ * dyld_shared_cache opened in ctx into a .tbd document stored in
+ * ctx->document.
+ */
+
+enum tbd_context_result
+tbd_context_convert_dsc_image(struct tbd_context *__notnull ctx,
+                              uint32_t index);
+
+void tbd_context_close_dsc(struct tbd_context *__notnull ctx);
+void tbd_context_destroy(struct tbd_context *__notnull ctx);
+
+#endif /* LIBTBD_H */
@@ -73,12 +73,24 @@ macho_file_open(struct macho_file *__notnull macho,
                 int fd,
                 struct range range);
 
+/*
+ * Open a mach-o file that has already been read into (or mapped at) map. The
+ * returned macho has no file-descriptor, and can only be parsed with
+ * macho_file_parse_from_map().
+ */
+
+enum macho_file_open_result
+macho_file_open_from_map(struct macho_file *__notnull macho,
+                         const uint8_t *__notnull map,
+                         uint64_t size);
+
 enum macho_file_parse_result {
     E_MACHO_FILE_PARSE_OK,
     E_MACHO_FILE_PARSE_ERROR_PASSED_TO_CALLBACK,
 
     E_MACHO_FILE_PARSE_SEEK_FAIL,
     E_MACHO_FILE_PARSE_READ_FAIL,
+    E_MACHO_FILE_PARSE_MMAP_FAIL,
 
     E_MACHO_FILE_PARSE_SIZE_TOO_SMALL,
 
@@ -170,6 +182,20 @@ macho_file_parse_from_file(struct tbd_create_info *__notnull info_in,
                            struct tbd_parse_options tbd_options,
                            struct macho_file_parse_options options);
 
+/*
+ * Parse a mach-o file opened with macho_file_open_from_map(). Strings are only
+ * copied out of map if options.copy_strings_in_map is set, otherwise map must
+ * stay valid for as long as info_in's symbols are used.
+ */
+
+enum macho_file_parse_result
+macho_file_parse_from_map(struct tbd_create_info *__notnull info_in,
+                          const struct macho_file *__notnull macho,
+                          const uint8_t *__notnull map,
+                          struct macho_file_parse_extra_args extra,
+                          struct tbd_parse_options tbd_options,
+                          struct macho_file_parse_options options);
+
 void macho_file_print_archs(int fd);
 
 #endif /* MACHO_FILE_H */
@@ -28,11 +28,25 @@ struct macho_file_parse_export_trie_args {
     struct tbd_parse_options tbd_options;
 };
 
-enum macho_file_parse_result
-macho_file_parse_export_trie_from_file(
-    struct macho_file_parse_export_trie_args args,
-    int fd,
-    uint64_t base_offset);
+/*
+ * Read (or skip) the uleb128 at iter, without reading past end.
+ *
+ * Returns a pointer to the byte past the uleb128, or NULL if the uleb128 is
+ * invalid, or is not terminated before end.
+ */
+
+const uint8_t *
+read_uleb128_32(const uint8_t *__notnull iter,
+                const uint8_t *__notnull end,
+                uint32_t *__notnull result_out);
+
+const uint8_t *
+read_uleb128_64(const uint8_t *__notnull iter,
+                const uint8_t *__notnull end,
+                uint64_t *__notnull result_out);
+
+const uint8_t *
+skip_uleb128(const uint8_t *__notnull iter, const uint8_t *__notnull end);
 
 enum macho_file_parse_result
 macho_file_parse_export_trie_from_map(
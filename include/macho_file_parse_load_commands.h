@@ -24,24 +24,6 @@ struct macho_file_parse_lc_flags {
     bool is_big_endian : 1;
 };
 
-struct mf_parse_lc_from_file_info {
-    int fd;
-
-    const struct arch_info *arch;
-    uint64_t arch_index;
-
-    struct range macho_range;
-    struct range available_range;
-
-    uint32_t ncmds;
-    uint32_t sizeofcmds;
-    uint32_t header_size;
-
-    struct tbd_parse_options tbd_options;
-    struct macho_file_parse_options options;
-    struct macho_file_parse_lc_flags flags;
-};
-
 struct macho_file_lc_info_out {
     uint32_t export_off;
     uint32_t export_size;
@@ -49,13 +31,6 @@ struct macho_file_lc_info_out {
     struct symtab_command symtab;
 };
 
-enum macho_file_parse_result
-macho_file_parse_load_commands_from_file(
-    struct tbd_create_info *__notnull info_in,
-    const struct mf_parse_lc_from_file_info *__notnull parse_info,
-    struct macho_file_parse_extra_args extra,
-    struct macho_file_lc_info_out *sym_info_out);
-
 struct mf_parse_lc_from_map_info {
     const uint8_t *map;
     uint64_t map_size;
@@ -21,6 +21,13 @@ struct macho_file_parse_symtab_args {
 
     bool is_big_endian : 1;
 
+    /*
+     * Symbol strings are only copied if copy_strings is set, and otherwise
+     * point into the map, which must then outlive info_in's symbols.
+     */
+
+    bool copy_strings : 1;
+
     uint32_t symoff;
     uint32_t nsyms;
     uint32_t stroff;
@@ -30,18 +37,6 @@ struct macho_file_parse_symtab_args {
     struct tbd_parse_options tbd_options;
 };
 
-enum macho_file_parse_result
-macho_file_parse_symtab_from_file(
-    const struct macho_file_parse_symtab_args *__notnull args,
-    int fd,
-    uint64_t base_offset);
-
-enum macho_file_parse_result
-macho_file_parse_symtab_64_from_file(
-    const struct macho_file_parse_symtab_args *__notnull args,
-    int fd,
-    uint64_t base_offset);
-
 enum macho_file_parse_result
 macho_file_parse_symtab_from_map(
     const struct macho_file_parse_symtab_args *__notnull args,
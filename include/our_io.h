@@ -13,6 +13,7 @@
 
 #include <dirent.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 int our_open(const char *path, int flags, int mode);
@@ -24,10 +25,20 @@ int our_rmdir(const char *path);
 
 off_t our_lseek(int fd, off_t offset, int whence);
 ssize_t our_read(int fd, void *buf, size_t size);
+ssize_t our_write(int fd, const void *buf, size_t size);
 
 DIR *our_fdopendir(int fd);
 struct dirent *our_readdir(DIR *dir);
 
 ssize_t our_getline(char **lineptr, size_t *n, FILE *stream);
 
+typedef int (*our_store_file_callback)(int fd, const void *info);
+
+int
+our_store_file(const char *dir_path,
+               uint64_t dir_path_length,
+               const char *path,
+               our_store_file_callback callback,
+               const void *info);
+
 #endif /* OUR_IO_H */
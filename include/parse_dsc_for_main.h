@@ -9,6 +9,8 @@
 #ifndef PARSE_DSC_FOR_MAIN_H
 #define PARSE_DSC_FOR_MAIN_H
 
+#include <pthread.h>
+
 #include "magic_buffer.h"
 #include "string_buffer.h"
 #include "tbd_for_main.h"
@@ -38,11 +40,25 @@ struct parse_dsc_for_main_args {
 
     FILE *combine_file;
 
+    /*
+     * When combining while recursing with jobs, documents are written out to
+     * the end of combine_sb instead, and combine_file is left untouched.
+     */
+
+    struct string_buffer *combine_sb;
+
     bool dont_handle_non_dsc_error : 1;
     bool print_paths : 1;
 
     struct string_buffer *export_trie_sb;
     struct parse_dsc_for_main_options options;
+
+    /*
+     * When files are parsed from multiple threads while recursing, orig_lock
+     * is held whenever orig is read or modified. Otherwise, orig_lock is NULL.
+     */
+
+    pthread_mutex_t *orig_lock;
 };
 
 enum parse_dsc_for_main_result {
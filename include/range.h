@@ -25,4 +25,33 @@ bool range_contains_end(struct range range, uint64_t end);
 bool range_contains_other(struct range left, struct range right);
 bool ranges_overlap(struct range left, struct range right);
 
+/*
+ * Compare two ranges by their begin-location, for qsort().
+ */
+
+int range_begin_comparator(const void *left, const void *right);
+
+/*
+ * Sort the count ranges by their begin-location, in place.
+ */
+
+void ranges_sort(struct range *ranges, uint64_t count);
+
+/*
+ * Sort the count ranges by their begin-location, and merge the ranges that
+ * overlap or border one another. Returns the number of ranges left at the
+ * front of ranges.
+ */
+
+uint64_t ranges_sort_and_merge(struct range *ranges, uint64_t count);
+
+/*
+ * Check whether any two of the count ranges overlap, in O(n log n) by sorting
+ * ranges by their begin-location. Empty ranges don't overlap any range.
+ *
+ * ranges is sorted in place.
+ */
+
+bool ranges_have_overlap(struct range *ranges, uint64_t count);
+
 #endif /* RANGE_H */
@@ -0,0 +1,29 @@
+//
+//  include/stdin_file.h
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef STDIN_FILE_H
+#define STDIN_FILE_H
+
+/*
+ * Get a file-descriptor for the file provided through stdin that can be seeked
+ * and mapped, as the mach-o and dyld_shared_cache parsers require.
+ *
+ * stdin itself is returned when it's a regular file. Otherwise, such as when
+ * stdin is a pipe, the input is read into an anonymous file, which is returned
+ * instead.
+ *
+ * A single-arch mach-o file is streamed: only its header, load-commands, and
+ * the ranges parsed after them (the symbol-table, export-trie, and objc
+ * image-info) are kept, and the rest of the file is left as a hole. Fat files,
+ * dyld_shared_caches, and all other input are spooled in full.
+ *
+ * Returns -1 on failure, with errno set.
+ */
+
+int stdin_file_open(void);
+
+#endif /* STDIN_FILE_H */
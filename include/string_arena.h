@@ -0,0 +1,38 @@
+//
+//  include/string_arena.h
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef STRING_ARENA_H
+#define STRING_ARENA_H
+
+#include <stdint.h>
+#include "notnull.h"
+
+/*
+ * A bump-allocator for null-terminated strings that all share the same
+ * lifetime, which are then freed together by string_arena_clear() or
+ * string_arena_destroy().
+ *
+ * Clearing an arena keeps its blocks around to be reused by later strings.
+ */
+
+struct string_arena_block;
+struct string_arena {
+    struct string_arena_block *first;
+    struct string_arena_block *current;
+
+    uint64_t used;
+};
+
+char *
+string_arena_copy(struct string_arena *__notnull arena,
+                  const char *__notnull string,
+                  uint64_t length);
+
+void string_arena_clear(struct string_arena *__notnull arena);
+void string_arena_destroy(struct string_arena *__notnull arena);
+
+#endif /* STRING_ARENA_H */
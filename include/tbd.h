@@ -17,7 +17,10 @@
 
 #include "bit_list.h"
 #include "notnull.h"
+#include "string_arena.h"
+#include "string_buffer.h"
 #include "target_list.h"
+#include "tbd_stats.h"
 
 /*
  * Options to handle when parsing out information for tbd_create_info.
@@ -201,6 +204,14 @@ struct tbd_create_info_flags {
      */
 
     bool uses_full_targets : 1;
+
+    /*
+     * Indicate that an error-callback was called while parsing, which may have
+     * modified info with user-input. Such info is never stored in the
+     * conversion-cache.
+     */
+
+    bool called_error_callback : 1;
 };
 
 struct tbd_create_info_fields {
@@ -224,11 +235,40 @@ struct tbd_create_info_fields {
     struct array uuids;
 };
 
+/*
+ * An open-addressed hash-index into the symbols array, used to find an existing
+ * symbol while parsing without keeping the symbols array sorted.
+ *
+ * The symbols array is instead only sorted once, through tbd_ci_sort_info(),
+ * after parsing has finished.
+ */
+
+struct tbd_symbol_index {
+    struct tbd_symbol_index_slot *slots;
+    uint64_t capacity;
+};
+
 struct tbd_create_info {
     enum tbd_version version;
 
     struct tbd_create_info_fields fields;
     struct tbd_create_info_flags flags;
+
+    struct tbd_symbol_index symbols_index;
+
+    /*
+     * Holds the strings of the metadata and symbols arrays, as well as the
+     * install-name when it was copied while parsing.
+     */
+
+    struct string_arena string_arena;
+
+    /*
+     * The stats the time spent on, and the counters of, this info are added
+     * to, or NULL when not collecting stats.
+     */
+
+    struct tbd_stats *stats;
 };
 
 enum tbd_ci_set_target_count_result {
@@ -275,6 +315,11 @@ tbd_ci_add_metadata(struct tbd_create_info *__notnull info_in,
                     bool copy_string,
                     struct tbd_parse_options options);
 
+/*
+ * When copy_string is false, string is stored as is, and must stay valid for as
+ * long as info_in's symbols are used.
+ */
+
 enum tbd_ci_add_data_result
 tbd_ci_add_symbol_with_type(struct tbd_create_info *__notnull info_in,
                             const char *__notnull string,
@@ -282,6 +327,7 @@ tbd_ci_add_symbol_with_type(struct tbd_create_info *__notnull info_in,
                             uint64_t arch_index,
                             enum tbd_symbol_type type,
                             enum tbd_symbol_meta_type meta_type,
+                            bool copy_string,
                             struct tbd_parse_options options);
 
 enum tbd_ci_add_data_result
@@ -292,6 +338,7 @@ tbd_ci_add_symbol_with_info(struct tbd_create_info *__notnull info_in,
                             enum tbd_symbol_type predefined_type,
                             enum tbd_symbol_meta_type meta_type,
                             bool is_exported,
+                            bool copy_string,
                             struct tbd_parse_options options);
 
 enum tbd_ci_add_data_result
@@ -354,6 +401,15 @@ struct tbd_create_options {
     };
 };
 
+/*
+ * Write out the .tbd document for info to the end of sb, instead of to a file.
+ */
+
+enum tbd_create_result
+tbd_create_with_info_to_buffer(const struct tbd_create_info *__notnull info,
+                               struct string_buffer *__notnull sb,
+                               struct tbd_create_options options);
+
 enum tbd_create_result
 tbd_create_with_info(const struct tbd_create_info *__notnull info,
                      FILE *__notnull file,
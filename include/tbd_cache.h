@@ -0,0 +1,84 @@
+//
+//  include/tbd_cache.h
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef TBD_CACHE_H
+#define TBD_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dyld_shared_cache.h"
+#include "notnull.h"
+#include "string_buffer.h"
+
+/*
+ * Forward-declare tbd_for_main as tbd_for_main.h refers to tbd_cache_entry as
+ * well.
+ */
+
+struct tbd_for_main;
+
+/*
+ * An entry of the on-disk conversion-cache, storing the .tbd document created
+ * for a file (or dyld_shared_cache image).
+ *
+ * An entry is keyed on the uuids and load-commands of all of the file's archs,
+ * along with the tbd-version and every option that affects the created .tbd
+ * document. Files missing an uuid for any arch are never cached.
+ */
+
+struct tbd_cache_entry {
+    struct string_buffer key;
+    uint64_t hash;
+
+    /*
+     * The created .tbd document, which is only valid when has_document is set,
+     * either by having been found in the cache, or by having been created.
+     */
+
+    struct string_buffer document;
+    bool has_document : 1;
+};
+
+/*
+ * Create the key for the mach-o file (thin or fat) in map, and look up its
+ * document in tbd's cache-directory.
+ *
+ * Returns false if the file cannot be cached.
+ */
+
+bool
+tbd_cache_entry_create_for_macho(struct tbd_cache_entry *__notnull entry,
+                                 const struct tbd_for_main *__notnull tbd,
+                                 const uint8_t *__notnull map,
+                                 uint64_t size);
+
+bool
+tbd_cache_entry_create_for_dsc_image(
+    struct tbd_cache_entry *__notnull entry,
+    const struct tbd_for_main *__notnull tbd,
+    const struct dyld_shared_cache_info *__notnull dsc_info,
+    const struct dyld_cache_image_info *__notnull image);
+
+/*
+ * Store the entry's document in tbd's cache-directory.
+ *
+ * Failing to store an entry isn't fatal, so no error is returned.
+ */
+
+void
+tbd_cache_entry_store(const struct tbd_cache_entry *__notnull entry,
+                      const struct tbd_for_main *__notnull tbd);
+
+int
+tbd_cache_entry_write_to_file(const struct tbd_cache_entry *__notnull entry,
+                              FILE *__notnull file);
+
+void tbd_cache_entry_destroy(struct tbd_cache_entry *__notnull entry);
+
+#endif /* TBD_CACHE_H */
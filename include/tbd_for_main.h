@@ -15,7 +15,10 @@
 #include "macho_file.h"
 #include "notnull.h"
 #include "request_user_input.h"
+#include "string_buffer.h"
 #include "tbd.h"
+#include "tbd_cache.h"
+#include "tbd_stats.h"
 
 enum tbd_for_main_dsc_image_filter_type {
     TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_FILE,
@@ -70,6 +73,11 @@ struct tbd_for_main_options {
 
     bool no_requests     : 1;
     bool ignore_warnings : 1;
+
+    bool print_stats         : 1;
+    bool print_stats_as_json : 1;
+
+    bool dsc_images_in_file_order : 1;
 };
 
 struct tbd_for_main_flags {
@@ -146,6 +154,50 @@ struct tbd_for_main {
     enum tbd_platform platform;
     uint64_t dsc_filter_paths_count;
 
+    /*
+     * The number of worker-threads used to parse dyld_shared_cache images.
+     * Zero or one means images are parsed serially on the calling thread.
+     */
+
+    uint32_t jobs;
+
+    /*
+     * The most memory to keep resident while parsing a dyld_shared_cache, or
+     * zero for no limit.
+     */
+
+    uint64_t max_rss;
+
+    /*
+     * The directory of the conversion-cache, or NULL when not caching.
+     */
+
+    const char *cache_path;
+    uint64_t cache_path_length;
+
+    /*
+     * The conversion-cache entry of the file currently being written out, or
+     * NULL. When the entry has a document, the document is written out instead
+     * of info.
+     */
+
+    struct tbd_cache_entry *cache_entry;
+
+    /*
+     * The directory of the dyld_shared_cache image-indices, or NULL when not
+     * indexing images.
+     */
+
+    const char *dsc_index_path;
+    uint64_t dsc_index_path_length;
+
+    /*
+     * The report the stats of every file parsed are added to, or NULL when not
+     * collecting stats.
+     */
+
+    struct tbd_stats_report *stats_report;
+
     struct retained_user_info retained;
     struct tbd_for_main_options options;
     struct tbd_for_main_flags flags;
@@ -213,6 +265,18 @@ tbd_for_main_open_write_file_for_path(const struct tbd_for_main *__notnull tbd,
                                       FILE **__notnull file_out,
                                       char **__notnull terminator_out);
 
+/*
+ * Open the write-file at path, printing an error if the write-file could not
+ * be opened, in which case NULL is returned.
+ */
+
+FILE *
+tbd_for_main_open_write_file_or_print_error(
+    const struct tbd_for_main *__notnull tbd,
+    char *__notnull path,
+    uint64_t path_length,
+    char **__notnull terminator_out);
+
 void
 tbd_for_main_write_to_file(const struct tbd_for_main *__notnull tbd,
                            char *__notnull write_path,
@@ -221,6 +285,17 @@ tbd_for_main_write_to_file(const struct tbd_for_main *__notnull tbd,
                            FILE *__notnull file,
                            bool print_paths);
 
+/*
+ * Write out the .tbd document to the end of sb, to later be written out to the
+ * file at write_path.
+ */
+
+void
+tbd_for_main_write_to_buffer(const struct tbd_for_main *__notnull tbd,
+                             const char *__notnull write_path,
+                             struct string_buffer *__notnull sb,
+                             bool print_paths);
+
 void
 tbd_for_main_write_to_stdout(const struct tbd_for_main *__notnull tbd,
                              const char *__notnull input_path,
@@ -233,6 +308,20 @@ tbd_for_main_write_to_stdout_for_dsc_image(
     const char *__notnull image_path,
     bool print_paths);
 
+/*
+ * Create info for a copy of tbd that is used by another thread, with the fields
+ * not stored in arrays shared with orig.
+ */
+
+void
+tbd_for_main_create_info_from_orig(struct tbd_create_info *__notnull info,
+                                   const struct tbd_for_main *__notnull tbd,
+                                   const struct tbd_for_main *__notnull orig);
+
+void
+tbd_for_main_destroy_info_from_orig(struct tbd_create_info *__notnull info,
+                                    const struct tbd_for_main *__notnull orig);
+
 void tbd_for_main_destroy(struct tbd_for_main *__notnull tbd);
 
 #endif /* TBD_FOR_MAIN_H */
@@ -0,0 +1,115 @@
+//
+//  include/tbd_stats.h
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef TBD_STATS_H
+#define TBD_STATS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "array.h"
+#include "notnull.h"
+
+/*
+ * The phases the time spent on a file is split between. Time is only ever
+ * counted for the innermost phase, so symbol-insertion done while walking an
+ * export-trie is not counted for the export-trie as well.
+ *
+ * Time outside of any phase is counted as none.
+ */
+
+enum tbd_stats_phase {
+    TBD_STATS_PHASE_NONE,
+
+    TBD_STATS_PHASE_OPEN,
+    TBD_STATS_PHASE_LOAD_COMMANDS,
+    TBD_STATS_PHASE_EXPORT_TRIE,
+    TBD_STATS_PHASE_SYMBOLS,
+    TBD_STATS_PHASE_SORT,
+    TBD_STATS_PHASE_WRITE,
+
+    TBD_STATS_PHASE_COUNT
+};
+
+struct tbd_stats {
+    /*
+     * Monotonic-clock times in nanoseconds. Phases of images parsed on several
+     * threads are summed, and so may add up to more than elapsed.
+     */
+
+    uint64_t elapsed;
+    uint64_t phase_times[TBD_STATS_PHASE_COUNT];
+
+    uint64_t symbols_added;
+    uint64_t duplicates_merged;
+    uint64_t bytes_written;
+    uint64_t images_skipped;
+
+    enum tbd_stats_phase phase;
+    uint64_t phase_begin;
+};
+
+uint64_t tbd_stats_get_time(void);
+
+/*
+ * Make phase the current phase of stats, returning the phase to be restored
+ * with tbd_stats_leave_phase().
+ */
+
+enum tbd_stats_phase
+tbd_stats_enter_phase(struct tbd_stats *__notnull stats,
+                      enum tbd_stats_phase phase);
+
+void
+tbd_stats_leave_phase(struct tbd_stats *__notnull stats,
+                      enum tbd_stats_phase prev_phase);
+
+void
+tbd_stats_add(struct tbd_stats *__notnull stats,
+              const struct tbd_stats *__notnull other);
+
+struct tbd_stats_file {
+    char *path;
+    struct tbd_stats stats;
+};
+
+/*
+ * The stats of every file parsed, in the order the files finished being
+ * parsed. Files may be added from multiple threads.
+ */
+
+struct tbd_stats_report {
+    struct array files;
+    struct tbd_stats total;
+
+    pthread_mutex_t lock;
+};
+
+void tbd_stats_report_create(struct tbd_stats_report *__notnull report);
+
+/*
+ * Add the stats of the file at path, with name (if not NULL) appended to path.
+ */
+
+void
+tbd_stats_report_add_file(struct tbd_stats_report *__notnull report,
+                          const char *__notnull path,
+                          uint64_t path_length,
+                          const char *name,
+                          uint64_t name_length,
+                          const struct tbd_stats *__notnull stats);
+
+void
+tbd_stats_report_print(const struct tbd_stats_report *__notnull report,
+                       FILE *__notnull file,
+                       bool as_json);
+
+void tbd_stats_report_destroy(struct tbd_stats_report *__notnull report);
+
+#endif /* TBD_STATS_H */
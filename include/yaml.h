@@ -17,4 +17,14 @@
 
 bool yaml_c_str_needs_quotes(const char *__notnull string, uint64_t length);
 
+/*
+ * Get the length of string, as strnlen() would, while also finding whether the
+ * string needs quotes, so the string only has to be scanned once.
+ */
+
+uint64_t
+yaml_c_str_get_length_and_needs_quotes(const char *__notnull string,
+                                       uint64_t max_length,
+                                       bool *__notnull needs_quotes_out);
+
 #endif /* YAML_H */
@@ -6,12 +6,14 @@
 //  Copyright © 2018 - 2020 inoahdev. All rights reserved.
 //
 
+#include <string.h>
 #include <unistd.h>
 
 #include "mach-o/loader.h"
 #include "mach-o/fat.h"
 
 #include "dsc_image.h"
+#include "guard_overflow.h"
 #include "macho_file_parse_load_commands.h"
 #include "macho_file_parse_export_trie.h"
 #include "macho_file_parse_symtab.h"
@@ -48,6 +50,7 @@ translate_macho_file_parse_result(const enum macho_file_parse_result result) {
             return E_DSC_IMAGE_PARSE_SEEK_FAIL;
 
         case E_MACHO_FILE_PARSE_READ_FAIL:
+        case E_MACHO_FILE_PARSE_MMAP_FAIL:
             return E_DSC_IMAGE_PARSE_READ_FAIL;
 
         case E_MACHO_FILE_PARSE_SIZE_TOO_SMALL:
@@ -136,93 +139,189 @@ translate_macho_file_parse_result(const enum macho_file_parse_result result) {
     return E_DSC_IMAGE_PARSE_OK;
 }
 
+static inline bool
+call_callback(const macho_file_parse_error_callback callback,
+              struct tbd_create_info *__notnull const info_in,
+              const enum macho_file_parse_callback_type type,
+              void *const cb_info)
+{
+    if (callback != NULL) {
+        if (callback(info_in, type, cb_info)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 /*
- * dyld_shared_cache data is stored in different mappings, with each mapping
- * copied over to memory at runtime with different memory-protections.
- *
- * To find our mach-o data, we have to take our data's memory-address, and find
- * the mapping with a memory-range containing our data's memory-address.
- *
- * The mach-o data's file-offset is simply at the mapping's file location,
- * plus the memory-mapping-index of the mach-o data.
- *
- * Some dyld_shared_cache mappings will have a memory-range larger than the
- * range reserved on file. For this reason, we may have a memory-address that
- * doesn't have a corresponding file-location.
+ * In a dyld_shared_cache split into subcaches, an image's __LINKEDIT may be in
+ * a different file than the image's header. The offsets to the export-trie,
+ * symbol-table, and string-table are file-offsets of __LINKEDIT's file, and
+ * have to be translated through __LINKEDIT's memory-address instead.
  */
 
-static uint64_t
-get_offset_from_addr(struct dyld_shared_cache_info *__notnull const info,
-                     const uint64_t address,
-                     uint64_t *__notnull const max_size_out)
+struct linkedit_segment {
+    uint64_t vmaddr;
+    uint64_t fileoff;
+};
+
+static bool
+find_linkedit_segment(const uint8_t *__notnull const load_commands,
+                      const uint32_t ncmds,
+                      const uint64_t size,
+                      const bool is_64,
+                      struct linkedit_segment *__notnull const segment_out)
 {
-    const uint64_t count = info->mappings_count;
+    const uint8_t *iter = load_commands;
+    const uint8_t *const end = iter + size;
 
-    const struct dyld_cache_mapping_info *mapping = info->mappings;
-    const struct dyld_cache_mapping_info *const end = mapping + count;
+    for (uint32_t i = 0; i != ncmds; i++) {
+        const uint64_t size_left = (uint64_t)(end - iter);
+        if (size_left < sizeof(struct load_command)) {
+            break;
+        }
 
-    for (; mapping != end; mapping++) {
-        const uint64_t mapping_begin = mapping->address;
-        const uint64_t mapping_end = mapping_begin + mapping->size;
+        const struct load_command *const lc =
+            (const struct load_command *)iter;
 
-        const struct range mapping_range = {
-            .begin = mapping_begin,
-            .end = mapping_end
-        };
+        const uint32_t cmdsize = lc->cmdsize;
+        if (cmdsize < sizeof(struct load_command) || cmdsize > size_left) {
+            break;
+        }
+
+        iter += cmdsize;
+        if (is_64) {
+            if (lc->cmd != LC_SEGMENT_64) {
+                continue;
+            }
+
+            if (cmdsize < sizeof(struct segment_command_64)) {
+                continue;
+            }
+
+            const struct segment_command_64 *const segment =
+                (const struct segment_command_64 *)lc;
+
+            if (strncmp(segment->segname, "__LINKEDIT", 16) != 0) {
+                continue;
+            }
+
+            segment_out->vmaddr = segment->vmaddr;
+            segment_out->fileoff = segment->fileoff;
+
+            return true;
+        }
+
+        if (lc->cmd != LC_SEGMENT) {
+            continue;
+        }
 
-        if (!range_contains_location(mapping_range, address)) {
+        if (cmdsize < sizeof(struct segment_command)) {
             continue;
         }
 
-        const uint64_t delta = address - mapping_begin;
-        const uint64_t file_offset = mapping->fileOffset + delta;
+        const struct segment_command *const segment =
+            (const struct segment_command *)lc;
 
-        *max_size_out = (mapping->size - delta);
-        return file_offset;
+        if (strncmp(segment->segname, "__LINKEDIT", 16) != 0) {
+            continue;
+        }
+
+        segment_out->vmaddr = segment->vmaddr;
+        segment_out->fileoff = segment->fileoff;
+
+        return true;
     }
 
-    return 0;
+    return false;
 }
 
-static inline bool
-call_callback(const macho_file_parse_error_callback callback,
-              struct tbd_create_info *__notnull const info_in,
-              const enum macho_file_parse_callback_type type,
-              void *const cb_info)
+/*
+ * Translate offset, a file-offset of __LINKEDIT's file, into a file-offset of
+ * the file holding __LINKEDIT's memory-address, which is returned in file_out.
+ *
+ * Returns 0 if offset isn't in any mapping.
+ */
+
+static uint32_t
+translate_linkedit_offset(
+    const struct dyld_shared_cache_info *__notnull const dsc_info,
+    const struct linkedit_segment *__notnull const linkedit,
+    const uint32_t offset,
+    struct dyld_shared_cache_file *__notnull const file_out)
 {
-    if (callback != NULL) {
-        if (callback(info_in, type, cb_info)) {
-            return true;
-        }
+    if (offset < linkedit->fileoff) {
+        return 0;
     }
 
-    return false;
+    uint64_t address = linkedit->vmaddr;
+    if (guard_overflow_add(&address, offset - linkedit->fileoff)) {
+        return 0;
+    }
+
+    uint64_t max_size = 0;
+    const uint64_t file_offset =
+        dyld_shared_cache_get_file_for_addr(dsc_info,
+                                            address,
+                                            &max_size,
+                                            file_out);
+
+    if (file_offset > UINT32_MAX) {
+        return 0;
+    }
+
+    return (uint32_t)file_offset;
 }
 
-enum dsc_image_parse_result
-dsc_image_parse(struct tbd_create_info *__notnull const info_in,
-                struct dyld_shared_cache_info *__notnull const dsc_info,
-                struct dyld_cache_image_info *__notnull const image,
-                const macho_file_parse_error_callback callback,
-                void *const cb_info,
-                struct string_buffer *__notnull const export_trie_sb,
-                struct macho_file_parse_options macho_options,
-                const struct tbd_parse_options tbd_options,
-                __unused const struct dsc_image_parse_options options)
+/*
+ * Get the error for an address that couldn't be translated into a file-offset,
+ * which is result, unless the address is in a subcache that couldn't be
+ * mapped.
+ */
+
+static enum dsc_image_parse_result
+get_translate_error(const struct dyld_shared_cache_info *__notnull const info,
+                    const uint64_t address,
+                    const enum dsc_image_parse_result result)
 {
+    if (dyld_shared_cache_addr_in_unavailable_subcache(info, address)) {
+        return E_DSC_IMAGE_PARSE_SUBCACHE_UNAVAILABLE;
+    }
+
+    return result;
+}
+
+static enum dsc_image_parse_result
+parse_image(struct tbd_create_info *__notnull const info_in,
+            struct dyld_shared_cache_info *__notnull const dsc_info,
+            const struct dyld_cache_image_info *__notnull const image,
+            const macho_file_parse_error_callback callback,
+            void *const cb_info,
+            struct string_buffer *__notnull const export_trie_sb,
+            struct macho_file_parse_options macho_options,
+            const struct tbd_parse_options tbd_options)
+{
+    struct dyld_shared_cache_file image_file = {};
     uint64_t max_image_size = 0;
+
     const uint64_t file_offset =
-        get_offset_from_addr(dsc_info, image->address, &max_image_size);
+        dyld_shared_cache_get_file_for_addr(dsc_info,
+                                            image->address,
+                                            &max_image_size,
+                                            &image_file);
 
     if (file_offset == 0) {
-        return E_DSC_IMAGE_PARSE_NO_MAPPING;
+        return get_translate_error(dsc_info,
+                                   image->address,
+                                   E_DSC_IMAGE_PARSE_NO_MAPPING);
     }
 
     if (max_image_size < sizeof(struct mach_header)) {
         return E_DSC_IMAGE_PARSE_SIZE_TOO_SMALL;
     }
 
-    const uint8_t *const map = dsc_info->map;
+    const uint8_t *const map = image_file.map;
     const struct mach_header *const header =
         (const struct mach_header *)(map + file_offset);
 
@@ -302,13 +401,13 @@ dsc_image_parse(struct tbd_create_info *__notnull const info_in,
 
     struct mf_parse_lc_from_map_info info = {
         .map = map,
-        .map_size = dsc_info->size,
+        .map_size = image_file.size,
 
         .macho = (const uint8_t *)header,
         .macho_size = max_image_size,
 
         .arch = dsc_info->arch,
-        .available_map_range = dsc_info->available_range,
+        .available_map_range = image_file.available_range,
 
         .ncmds = header->ncmds,
         .sizeofcmds = header->sizeofcmds,
@@ -337,6 +436,28 @@ dsc_image_parse(struct tbd_create_info *__notnull const info_in,
         return translate_macho_file_parse_result(parse_load_commands_result);
     }
 
+    /*
+     * Caches without subcaches keep everything in a single file, where the
+     * offsets are used as is.
+     */
+
+    struct linkedit_segment linkedit = {};
+    bool translate_offsets = false;
+
+    if (dsc_info->subcaches_count != 0 && !is_big_endian) {
+        uint64_t sizeofcmds = header->sizeofcmds;
+        if (sizeofcmds > max_image_size - header_size) {
+            sizeofcmds = max_image_size - header_size;
+        }
+
+        translate_offsets =
+            find_linkedit_segment((const uint8_t *)header + header_size,
+                                  header->ncmds,
+                                  sizeofcmds,
+                                  is_64,
+                                  &linkedit);
+    }
+
     bool parsed_dyld_info = false;
     bool parse_symtab = true;
 
@@ -348,21 +469,39 @@ dsc_image_parse(struct tbd_create_info *__notnull const info_in,
     enum macho_file_parse_result ret = E_MACHO_FILE_PARSE_OK;
     if (!macho_options.use_symbol_table) {
         if (lc_info.export_off != 0 && lc_info.export_size != 0) {
+            struct dyld_shared_cache_file export_file = image_file;
+            uint32_t export_off = lc_info.export_off;
+
+            if (translate_offsets) {
+                export_off =
+                    translate_linkedit_offset(dsc_info,
+                                              &linkedit,
+                                              export_off,
+                                              &export_file);
+
+                if (export_off == 0) {
+                    return get_translate_error(
+                        dsc_info,
+                        linkedit.vmaddr,
+                        E_DSC_IMAGE_PARSE_INVALID_EXPORTS_TRIE);
+                }
+            }
+
             const struct macho_file_parse_export_trie_args args = {
                 .info_in = info_in,
-                .available_range = dsc_info->available_range,
+                .available_range = export_file.available_range,
 
                 .is_64 = is_64,
                 .is_big_endian = is_big_endian,
 
-                .export_off = lc_info.export_off,
+                .export_off = export_off,
                 .export_size = lc_info.export_size,
 
                 .sb_buffer = extra.export_trie_sb,
                 .tbd_options = tbd_options
             };
 
-            ret = macho_file_parse_export_trie_from_map(args, map);
+            ret = macho_file_parse_export_trie_from_map(args, export_file.map);
             if (ret != E_MACHO_FILE_PARSE_OK) {
                 return translate_macho_file_parse_result(ret);
             }
@@ -381,25 +520,70 @@ dsc_image_parse(struct tbd_create_info *__notnull const info_in,
     }
 
     if (parse_symtab) {
+        struct dyld_shared_cache_file symtab_file = image_file;
+
+        uint32_t symoff = lc_info.symtab.symoff;
+        uint32_t stroff = lc_info.symtab.stroff;
+
+        if (translate_offsets) {
+            struct dyld_shared_cache_file strtab_file = {};
+
+            symoff =
+                translate_linkedit_offset(dsc_info,
+                                          &linkedit,
+                                          symoff,
+                                          &symtab_file);
+
+            if (symoff == 0) {
+                return get_translate_error(
+                    dsc_info,
+                    linkedit.vmaddr,
+                    E_DSC_IMAGE_PARSE_INVALID_SYMBOL_TABLE);
+            }
+
+            stroff =
+                translate_linkedit_offset(dsc_info,
+                                          &linkedit,
+                                          stroff,
+                                          &strtab_file);
+
+            /*
+             * The symbol-table and string-table are parsed out of the same
+             * map, so they have to be in the same file.
+             */
+
+            if (stroff == 0) {
+                return get_translate_error(
+                    dsc_info,
+                    linkedit.vmaddr,
+                    E_DSC_IMAGE_PARSE_INVALID_STRING_TABLE);
+            }
+
+            if (strtab_file.map != symtab_file.map) {
+                return E_DSC_IMAGE_PARSE_INVALID_STRING_TABLE;
+            }
+        }
+
         const struct macho_file_parse_symtab_args args = {
             .info_in = info_in,
-            .available_range = dsc_info->available_range,
+            .available_range = symtab_file.available_range,
 
             .is_big_endian = is_big_endian,
+            .copy_strings = macho_options.copy_strings_in_map,
 
-            .symoff = lc_info.symtab.symoff,
+            .symoff = symoff,
             .nsyms = lc_info.symtab.nsyms,
 
-            .stroff = lc_info.symtab.stroff,
+            .stroff = stroff,
             .strsize = lc_info.symtab.strsize,
 
             .tbd_options = tbd_options
         };
 
         if (is_64) {
-            ret = macho_file_parse_symtab_64_from_map(&args, map);
+            ret = macho_file_parse_symtab_64_from_map(&args, symtab_file.map);
         } else {
-            ret = macho_file_parse_symtab_from_map(&args, map);
+            ret = macho_file_parse_symtab_from_map(&args, symtab_file.map);
         }
     } else if (!parsed_dyld_info) {
         /*
@@ -408,6 +592,7 @@ dsc_image_parse(struct tbd_create_info *__notnull const info_in,
          */
 
         if (tbd_options.ignore_exports || tbd_options.ignore_missing_exports) {
+            tbd_ci_sort_info(info_in);
             return E_DSC_IMAGE_PARSE_OK;
         }
 
@@ -418,5 +603,51 @@ dsc_image_parse(struct tbd_create_info *__notnull const info_in,
         return translate_macho_file_parse_result(ret);
     }
 
+    tbd_ci_sort_info(info_in);
     return E_DSC_IMAGE_PARSE_OK;
 }
+
+enum dsc_image_parse_result
+dsc_image_parse(struct tbd_create_info *__notnull const info_in,
+                struct dyld_shared_cache_info *__notnull const dsc_info,
+                const struct dyld_cache_image_info *__notnull const image,
+                const macho_file_parse_error_callback callback,
+                void *const cb_info,
+                struct string_buffer *__notnull const export_trie_sb,
+                const struct macho_file_parse_options macho_options,
+                const struct tbd_parse_options tbd_options,
+                __unused const struct dsc_image_parse_options options)
+{
+    struct tbd_stats *const stats = info_in->stats;
+    if (stats == NULL) {
+        return parse_image(info_in,
+                           dsc_info,
+                           image,
+                           callback,
+                           cb_info,
+                           export_trie_sb,
+                           macho_options,
+                           tbd_options);
+    }
+
+    /*
+     * Everything parsed out of the image, besides what has its own phase, is
+     * counted as parsing the load-commands.
+     */
+
+    const enum tbd_stats_phase prev_phase =
+        tbd_stats_enter_phase(stats, TBD_STATS_PHASE_LOAD_COMMANDS);
+
+    const enum dsc_image_parse_result result =
+        parse_image(info_in,
+                    dsc_info,
+                    image,
+                    callback,
+                    cb_info,
+                    export_trie_sb,
+                    macho_options,
+                    tbd_options);
+
+    tbd_stats_leave_phase(stats, prev_phase);
+    return result;
+}
@@ -0,0 +1,398 @@
+//
+//  src/dsc_image_filter_set.c
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dsc_image_filter_set.h"
+#include "path.h"
+
+static inline uint64_t
+hash_string(const char *__notnull const string, const uint64_t length) {
+    /*
+     * FNV-1a. The hash doesn't include the filter's type, so a path-component
+     * only has to be hashed once to be looked up as both a file-name and a
+     * directory.
+     */
+
+    uint64_t hash = 14695981039346656037ull;
+
+    const uint8_t *iter = (const uint8_t *)string;
+    const uint8_t *const end = iter + length;
+
+    for (; iter != end; iter++) {
+        hash ^= *iter;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static inline bool
+filter_is_hashable(
+    const struct tbd_for_main_dsc_image_filter *__notnull const filter)
+{
+    if (filter->type == TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_PATH) {
+        return true;
+    }
+
+    const uint64_t length = filter->length;
+    return (length != 0 && memchr(filter->string, '/', length) == NULL);
+}
+
+static bool
+add_index(struct array *__notnull const array, const uint32_t index) {
+    const enum array_result add_index_result =
+        array_add_item(array, sizeof(index), &index, NULL);
+
+    return (add_index_result == E_ARRAY_OK);
+}
+
+bool
+dsc_image_filter_set_create(struct dsc_image_filter_set *__notnull const set,
+                            const struct array *__notnull const filters)
+{
+    *set = (struct dsc_image_filter_set){
+        .filters = filters->data
+    };
+
+    const uint64_t filters_count = filters->item_count;
+
+    uint64_t buckets_count = 2;
+    while (buckets_count < filters_count * 2) {
+        buckets_count <<= 1;
+    }
+
+    uint32_t *const buckets = calloc(buckets_count, sizeof(uint32_t));
+    if (buckets == NULL) {
+        return false;
+    }
+
+    set->buckets = buckets;
+    set->buckets_count = buckets_count;
+
+    const uint64_t mask = buckets_count - 1;
+    for (uint32_t i = 0; i != filters_count; i++) {
+        const struct tbd_for_main_dsc_image_filter *const filter =
+            set->filters + i;
+
+        if (!filter_is_hashable(filter)) {
+            if (!add_index(&set->unhashed, i)) {
+                dsc_image_filter_set_destroy(set);
+                return false;
+            }
+
+            continue;
+        }
+
+        switch (filter->type) {
+            case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_FILE:
+                set->has_filenames = true;
+                break;
+
+            case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_DIRECTORY:
+                set->has_directories = true;
+                break;
+
+            case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_PATH:
+                set->has_paths = true;
+                break;
+        }
+
+        /*
+         * Buckets store the filter's index plus one, so an empty bucket is
+         * zero.
+         */
+
+        uint64_t bucket = hash_string(filter->string, filter->length) & mask;
+        while (buckets[bucket] != 0) {
+            bucket = (bucket + 1) & mask;
+        }
+
+        buckets[bucket] = i + 1;
+    }
+
+    return true;
+}
+
+static bool
+filter_matches_path(
+    struct tbd_for_main_dsc_image_filter *__notnull const filter,
+    const char *__notnull const path,
+    const uint64_t path_length)
+{
+    const char *const string = filter->string;
+    const uint64_t length = filter->length;
+
+    const char **const ptr = &filter->tmp_ptr;
+    switch (filter->type) {
+        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_PATH:
+            if (length != path_length) {
+                return false;
+            }
+
+            return (memcmp(path, string, length) == 0);
+
+        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_FILE:
+            return path_has_filename(path, path_length, string, length, ptr);
+
+        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_DIRECTORY:
+            return path_has_dir_component(path,
+                                          path_length,
+                                          string,
+                                          length,
+                                          ptr);
+    }
+
+    return false;
+}
+
+static bool
+is_matched(const struct dsc_image_filter_set *__notnull const set,
+           const uint32_t index)
+{
+    const uint32_t *iter = set->matches.data;
+    const uint32_t *const end = set->matches.data_end;
+
+    for (; iter != end; iter++) {
+        if (*iter == index) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Match every hashed filter of type with string, a part of path starting at
+ * ptr.
+ */
+
+static bool
+match_hashed(struct dsc_image_filter_set *__notnull const set,
+             const enum tbd_for_main_dsc_image_filter_type type,
+             const char *__notnull const string,
+             const uint64_t length,
+             const char *__notnull const ptr)
+{
+    const uint64_t mask = set->buckets_count - 1;
+    uint64_t bucket = hash_string(string, length) & mask;
+
+    for (; set->buckets[bucket] != 0; bucket = (bucket + 1) & mask) {
+        const uint32_t index = set->buckets[bucket] - 1;
+        struct tbd_for_main_dsc_image_filter *const filter =
+            set->filters + index;
+
+        if (filter->type != type || filter->length != length) {
+            continue;
+        }
+
+        if (memcmp(filter->string, string, length) != 0) {
+            continue;
+        }
+
+        /*
+         * A directory may be matched by more than one component of the path,
+         * in which case only the first component is kept.
+         */
+
+        if (type == TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_DIRECTORY) {
+            if (is_matched(set, index)) {
+                continue;
+            }
+        }
+
+        filter->tmp_ptr = ptr;
+        if (!add_index(&set->matches, index)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Match the hashed filters against every path-component of path, which has to
+ * start with a slash.
+ */
+
+static bool
+match_components(struct dsc_image_filter_set *__notnull const set,
+                 const char *__notnull const path,
+                 const uint64_t path_length)
+{
+    uint64_t end = path_length;
+    while (end != 0 && path[end - 1] == '/') {
+        end--;
+    }
+
+    uint64_t begin = 0;
+    while (begin != end) {
+        if (path[begin] == '/') {
+            begin++;
+            continue;
+        }
+
+        const char *const component = path + begin;
+        const char *const slash = memchr(component, '/', end - begin);
+
+        if (slash != NULL) {
+            const uint64_t length = (uint64_t)(slash - component);
+            if (set->has_directories) {
+                const bool matched =
+                    match_hashed(set,
+                                 TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_DIRECTORY,
+                                 component,
+                                 length,
+                                 component);
+
+                if (!matched) {
+                    return false;
+                }
+            }
+
+            begin += length;
+            continue;
+        }
+
+        if (set->has_filenames) {
+            /*
+             * path_has_filename() points to the slash before the file-name
+             * when the file-name is the first component of the path.
+             */
+
+            const char *ptr = component;
+            if (begin == 1) {
+                ptr = path;
+            }
+
+            const bool matched =
+                match_hashed(set,
+                             TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_FILE,
+                             component,
+                             end - begin,
+                             ptr);
+
+            if (!matched) {
+                return false;
+            }
+        }
+
+        break;
+    }
+
+    return true;
+}
+
+static int
+indices_comparator(const void *__notnull const left,
+                   const void *__notnull const right)
+{
+    const uint32_t left_index = *(const uint32_t *)left;
+    const uint32_t right_index = *(const uint32_t *)right;
+
+    if (left_index < right_index) {
+        return -1;
+    } else if (left_index > right_index) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static void fail_with_array_failure(void) {
+    fputs("Experienced an array failure while trying to match "
+          "dyld_shared_cache images against the provided filters\n",
+          stderr);
+
+    exit(1);
+}
+
+uint64_t
+dsc_image_filter_set_match(struct dsc_image_filter_set *__notnull const set,
+                           const char *__notnull const path,
+                           const uint64_t path_length)
+{
+    array_clear(&set->matches);
+
+    /*
+     * Only absolute paths are split into components, others are rare enough
+     * to be matched against every filter one by one.
+     */
+
+    if (path[0] != '/') {
+        const uint64_t buckets_count = set->buckets_count;
+        for (uint64_t i = 0; i != buckets_count; i++) {
+            const uint32_t index = set->buckets[i];
+            if (index == 0) {
+                continue;
+            }
+
+            struct tbd_for_main_dsc_image_filter *const filter =
+                set->filters + (index - 1);
+
+            if (filter_matches_path(filter, path, path_length)) {
+                if (!add_index(&set->matches, index - 1)) {
+                    fail_with_array_failure();
+                }
+            }
+        }
+    } else {
+        if (set->has_paths) {
+            const bool matched =
+                match_hashed(set,
+                             TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_PATH,
+                             path,
+                             path_length,
+                             path);
+
+            if (!matched) {
+                fail_with_array_failure();
+            }
+        }
+
+        if (set->has_filenames || set->has_directories) {
+            if (!match_components(set, path, path_length)) {
+                fail_with_array_failure();
+            }
+        }
+    }
+
+    const uint32_t *iter = set->unhashed.data;
+    const uint32_t *const end = set->unhashed.data_end;
+
+    for (; iter != end; iter++) {
+        struct tbd_for_main_dsc_image_filter *const filter =
+            set->filters + *iter;
+
+        if (filter_matches_path(filter, path, path_length)) {
+            if (!add_index(&set->matches, *iter)) {
+                fail_with_array_failure();
+            }
+        }
+    }
+
+    const uint64_t matches_count = set->matches.item_count;
+    if (matches_count > 1) {
+        array_sort_with_comparator(&set->matches,
+                                   sizeof(uint32_t),
+                                   indices_comparator);
+    }
+
+    return matches_count;
+}
+
+void
+dsc_image_filter_set_destroy(struct dsc_image_filter_set *__notnull const set) {
+    free(set->buckets);
+
+    array_destroy(&set->unhashed);
+    array_destroy(&set->matches);
+
+    *set = (struct dsc_image_filter_set){};
+}
@@ -0,0 +1,642 @@
+//
+//  src/dsc_index.c
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dsc_index.h"
+#include "dyld_shared_cache_format.h"
+#include "our_io.h"
+#include "string_buffer.h"
+
+/*
+ * Every index-file starts with this header, followed by the key (padded to 8
+ * bytes), the buckets (buckets_count + 1 entry-offsets, padded to 8 bytes), the
+ * entries, and finally the unindexed images.
+ *
+ * The entries of bucket i are the entries from buckets[i] to buckets[i + 1].
+ */
+
+static const char dsc_index_magic[8] = "tbddsci1";
+
+struct dsc_index_header {
+    char magic[8];
+    uint64_t key_length;
+
+    uint32_t images_count;
+    uint32_t buckets_count;
+    uint32_t entries_count;
+    uint32_t unindexed_count;
+};
+
+struct dsc_index_entry {
+    uint64_t hash;
+
+    uint32_t image_index;
+    uint32_t kind;
+};
+
+static inline uint64_t pad_to_8(const uint64_t size) {
+    return ((size + 7) & ~7ull);
+}
+
+static inline uint64_t
+hash_bytes(uint64_t hash, const void *__notnull const data, const uint64_t size)
+{
+    /*
+     * FNV-1a.
+     */
+
+    const uint8_t *iter = (const uint8_t *)data;
+    const uint8_t *const end = iter + size;
+
+    for (; iter != end; iter++) {
+        hash ^= *iter;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static inline uint64_t
+hash_string(const enum dsc_index_kind kind,
+            const char *__notnull const string,
+            const uint64_t length)
+{
+    const uint8_t kind_byte = (uint8_t)kind;
+    const uint64_t hash =
+        hash_bytes(14695981039346656037ull, &kind_byte, sizeof(kind_byte));
+
+    return hash_bytes(hash, string, length);
+}
+
+/*
+ * The key is made up of the cache's uuid (if it has one), its size, and a hash
+ * of its image-table, which covers the pathFileOffset of every image.
+ *
+ * The pad field is left out, so indices created when it was still used to mark
+ * images as extracted stay valid.
+ */
+
+static bool
+create_key(struct string_buffer *__notnull const key,
+           const struct dyld_shared_cache_info *__notnull const dsc_info)
+{
+    const struct dyld_cache_header *const header =
+        (const struct dyld_cache_header *)dsc_info->map;
+
+    /*
+     * Only dyld_shared_caches new enough to have a uuid have their mappings
+     * start after it.
+     */
+
+    const uint64_t uuid_end =
+        offsetof(struct dyld_cache_header, uuid) + sizeof(header->uuid);
+
+    uint8_t uuid[16] = {};
+    if (header->mappingOffset >= uuid_end) {
+        memcpy(uuid, header->uuid, sizeof(uuid));
+    }
+
+    uint64_t images_hash = 14695981039346656037ull;
+
+    const struct dyld_cache_image_info *image = dsc_info->images;
+    const struct dyld_cache_image_info *const end =
+        image + dsc_info->images_count;
+
+    for (; image != end; image++) {
+        images_hash = hash_bytes(images_hash, &image->address, 8);
+        images_hash = hash_bytes(images_hash, &image->modTime, 8);
+        images_hash = hash_bytes(images_hash, &image->inode, 8);
+        images_hash = hash_bytes(images_hash, &image->pathFileOffset, 4);
+    }
+
+    const uint64_t size = dsc_info->size;
+    const uint64_t images_count = dsc_info->images_count;
+
+    const bool failed =
+        sb_add_c_str(key, (const char *)uuid, sizeof(uuid)) ||
+        sb_add_c_str(key, (const char *)&size, sizeof(size)) ||
+        sb_add_c_str(key, (const char *)&images_count, sizeof(images_count)) ||
+        sb_add_c_str(key, (const char *)&images_hash, sizeof(images_hash));
+
+    return !failed;
+}
+
+static char *
+create_index_path(const char *__notnull const dir_path,
+                  const uint64_t dir_path_length,
+                  const struct string_buffer *__notnull const key)
+{
+    const uint64_t length =
+        dir_path_length + sizeof("/0123456789abcdef.dscindex");
+
+    char *const path = malloc(length);
+    if (path == NULL) {
+        return NULL;
+    }
+
+    const uint64_t hash =
+        hash_bytes(14695981039346656037ull, key->data, key->length);
+
+    snprintf(path,
+             length,
+             "%s/%016llx.dscindex",
+             dir_path,
+             (unsigned long long)hash);
+
+    return path;
+}
+
+/*
+ * Point index at the sections of the index-file in data, after verifying the
+ * sections are in bounds and the file's key matches key.
+ */
+
+static bool
+set_index_data(struct dsc_index *__notnull const index,
+               void *__notnull const data,
+               const uint64_t size,
+               const struct string_buffer *__notnull const key)
+{
+    const struct dsc_index_header *const header =
+        (const struct dsc_index_header *)data;
+
+    if (size < sizeof(*header)) {
+        return false;
+    }
+
+    const uint32_t buckets_count = header->buckets_count;
+    const uint32_t entries_count = header->entries_count;
+
+    const bool valid_header =
+        memcmp(header->magic, dsc_index_magic, sizeof(dsc_index_magic)) == 0 &&
+        header->key_length == key->length &&
+        buckets_count != 0 &&
+        (buckets_count & (buckets_count - 1)) == 0;
+
+    if (!valid_header) {
+        return false;
+    }
+
+    const uint64_t key_offset = sizeof(*header);
+    const uint64_t buckets_offset = key_offset + pad_to_8(key->length);
+    const uint64_t entries_offset =
+        buckets_offset + pad_to_8(sizeof(uint32_t) * (buckets_count + 1ull));
+
+    const uint64_t unindexed_offset =
+        entries_offset + sizeof(struct dsc_index_entry) * entries_count;
+
+    const uint64_t end =
+        unindexed_offset + sizeof(uint32_t) * header->unindexed_count;
+
+    if (end != size) {
+        return false;
+    }
+
+    const uint8_t *const bytes = (const uint8_t *)data;
+    if (memcmp(bytes + key_offset, key->data, key->length) != 0) {
+        return false;
+    }
+
+    const uint32_t *const buckets = (const uint32_t *)(bytes + buckets_offset);
+    for (uint32_t i = 0; i != buckets_count; i++) {
+        if (buckets[i] > buckets[i + 1]) {
+            return false;
+        }
+    }
+
+    if (buckets[0] != 0 || buckets[buckets_count] != entries_count) {
+        return false;
+    }
+
+    index->header = header;
+    index->buckets = buckets;
+    index->entries = (const struct dsc_index_entry *)(bytes + entries_offset);
+    index->unindexed = (const uint32_t *)(bytes + unindexed_offset);
+
+    index->data = data;
+    index->size = size;
+
+    return true;
+}
+
+static bool
+find_index(struct dsc_index *__notnull const index,
+           const char *__notnull const path,
+           const struct string_buffer *__notnull const key)
+{
+    const int fd = our_open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) < 0 || sbuf.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    const uint64_t size = (uint64_t)sbuf.st_size;
+    void *const map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    if (!set_index_data(index, map, size, key)) {
+        munmap(map, size);
+        return false;
+    }
+
+    index->is_mapped = true;
+    return true;
+}
+
+static bool
+add_entry(struct array *__notnull const entries,
+          const enum dsc_index_kind kind,
+          const uint32_t image_index,
+          const char *__notnull const string,
+          const uint64_t length)
+{
+    const struct dsc_index_entry entry = {
+        .hash = hash_string(kind, string, length),
+        .image_index = image_index,
+        .kind = kind
+    };
+
+    const enum array_result add_entry_result =
+        array_add_item(entries, sizeof(entry), &entry, NULL);
+
+    return (add_entry_result == E_ARRAY_OK);
+}
+
+/*
+ * Add an entry for the path, and for every component of the path, with the
+ * last component being the file-name, and the others being directories.
+ */
+
+static bool
+add_entries_for_path(struct array *__notnull const entries,
+                     const uint32_t image_index,
+                     const char *__notnull const path,
+                     const uint64_t length)
+{
+    if (!add_entry(entries, DSC_INDEX_KIND_PATH, image_index, path, length)) {
+        return false;
+    }
+
+    uint64_t end = length;
+    while (end != 0 && path[end - 1] == '/') {
+        end--;
+    }
+
+    uint64_t begin = 0;
+    while (begin != end) {
+        if (path[begin] == '/') {
+            begin++;
+            continue;
+        }
+
+        const char *const component = path + begin;
+        const char *const slash = memchr(component, '/', end - begin);
+
+        uint64_t component_end = end;
+        enum dsc_index_kind kind = DSC_INDEX_KIND_FILENAME;
+
+        if (slash != NULL) {
+            component_end = (uint64_t)(slash - path);
+            kind = DSC_INDEX_KIND_DIRECTORY;
+        }
+
+        const uint64_t component_length = component_end - begin;
+        if (!add_entry(entries, kind, image_index, component, component_length))
+        {
+            return false;
+        }
+
+        begin = component_end;
+    }
+
+    return true;
+}
+
+static bool
+collect_entries(const struct dyld_shared_cache_info *__notnull const dsc_info,
+                struct array *__notnull const entries,
+                struct array *__notnull const unindexed)
+{
+    const uint64_t size = dsc_info->size;
+    const uint32_t images_count = dsc_info->images_count;
+
+    for (uint32_t i = 0; i != images_count; i++) {
+        const uint64_t offset = dsc_info->images[i].pathFileOffset;
+        if (offset < size) {
+            const char *const path = (const char *)(dsc_info->map + offset);
+            const uint64_t length = strnlen(path, size - offset);
+
+            if (length == 0) {
+                continue;
+            }
+
+            if (path[0] == '/' && length != size - offset) {
+                if (!add_entries_for_path(entries, i, path, length)) {
+                    return false;
+                }
+
+                continue;
+            }
+        }
+
+        const enum array_result add_image_result =
+            array_add_item(unindexed, sizeof(i), &i, NULL);
+
+        if (add_image_result != E_ARRAY_OK) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Lay out the index-file in memory, with the entries sorted into their
+ * buckets.
+ */
+
+static void *
+create_index_data(const struct dyld_shared_cache_info *__notnull const dsc_info,
+                  const struct string_buffer *__notnull const key,
+                  const struct array *__notnull const entries,
+                  const struct array *__notnull const unindexed,
+                  uint64_t *__notnull const size_out)
+{
+    const uint32_t entries_count = (uint32_t)entries->item_count;
+    const uint32_t unindexed_count = (uint32_t)unindexed->item_count;
+
+    uint32_t buckets_count = 1;
+    while (buckets_count < entries_count) {
+        buckets_count <<= 1;
+    }
+
+    const uint64_t key_offset = sizeof(struct dsc_index_header);
+    const uint64_t buckets_offset = key_offset + pad_to_8(key->length);
+    const uint64_t entries_offset =
+        buckets_offset + pad_to_8(sizeof(uint32_t) * (buckets_count + 1ull));
+
+    const uint64_t unindexed_offset =
+        entries_offset + sizeof(struct dsc_index_entry) * entries_count;
+
+    const uint64_t size =
+        unindexed_offset + sizeof(uint32_t) * unindexed_count;
+
+    uint8_t *const data = calloc(1, size);
+    if (data == NULL) {
+        return NULL;
+    }
+
+    struct dsc_index_header *const header = (struct dsc_index_header *)data;
+    memcpy(header->magic, dsc_index_magic, sizeof(dsc_index_magic));
+
+    header->key_length = key->length;
+    header->images_count = dsc_info->images_count;
+    header->buckets_count = buckets_count;
+    header->entries_count = entries_count;
+    header->unindexed_count = unindexed_count;
+
+    memcpy(data + key_offset, key->data, key->length);
+
+    /*
+     * Count the entries of every bucket, turn the counts into offsets, and
+     * finally place every entry at its bucket's offset.
+     */
+
+    uint32_t *const buckets = (uint32_t *)(data + buckets_offset);
+    const uint32_t mask = buckets_count - 1;
+
+    const struct dsc_index_entry *const entries_begin = entries->data;
+    const struct dsc_index_entry *const entries_end = entries->data_end;
+
+    const struct dsc_index_entry *entry = entries_begin;
+    for (; entry != entries_end; entry++) {
+        buckets[(entry->hash & mask) + 1] += 1;
+    }
+
+    for (uint32_t i = 0; i != buckets_count; i++) {
+        buckets[i + 1] += buckets[i];
+    }
+
+    uint32_t *const next = malloc(sizeof(uint32_t) * buckets_count);
+    if (next == NULL) {
+        free(data);
+        return NULL;
+    }
+
+    memcpy(next, buckets, sizeof(uint32_t) * buckets_count);
+
+    struct dsc_index_entry *const sorted =
+        (struct dsc_index_entry *)(data + entries_offset);
+
+    for (entry = entries_begin; entry != entries_end; entry++) {
+        const uint32_t bucket = (uint32_t)(entry->hash & mask);
+
+        sorted[next[bucket]] = *entry;
+        next[bucket] += 1;
+    }
+
+    free(next);
+    memcpy(data + unindexed_offset,
+           unindexed->data,
+           sizeof(uint32_t) * unindexed_count);
+
+    *size_out = size;
+    return data;
+}
+
+static int write_index(const int fd, const void *const info) {
+    const struct dsc_index *const index = (const struct dsc_index *)info;
+    if (our_write(fd, index->data, index->size) < 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static void
+store_index(const struct dsc_index *__notnull const index,
+            const char *__notnull const dir_path,
+            const uint64_t dir_path_length,
+            const struct string_buffer *__notnull const key)
+{
+    char *const path = create_index_path(dir_path, dir_path_length, key);
+    if (path == NULL) {
+        return;
+    }
+
+    our_store_file(dir_path, dir_path_length, path, write_index, index);
+    free(path);
+}
+
+static bool
+create_index(struct dsc_index *__notnull const index,
+             const struct dyld_shared_cache_info *__notnull const dsc_info,
+             const struct string_buffer *__notnull const key)
+{
+    struct array entries = {};
+    struct array unindexed = {};
+
+    if (!collect_entries(dsc_info, &entries, &unindexed)) {
+        array_destroy(&entries);
+        array_destroy(&unindexed);
+
+        return false;
+    }
+
+    uint64_t size = 0;
+    void *const data =
+        create_index_data(dsc_info, key, &entries, &unindexed, &size);
+
+    array_destroy(&entries);
+    array_destroy(&unindexed);
+
+    if (data == NULL) {
+        return false;
+    }
+
+    if (!set_index_data(index, data, size, key)) {
+        free(data);
+        return false;
+    }
+
+    return true;
+}
+
+bool
+dsc_index_open(struct dsc_index *__notnull const index,
+               const char *__notnull const dir_path,
+               const uint64_t dir_path_length,
+               const struct dyld_shared_cache_info *__notnull const dsc_info)
+{
+    *index = (struct dsc_index){};
+
+    struct string_buffer key = {};
+    if (!create_key(&key, dsc_info)) {
+        sb_destroy(&key);
+        return false;
+    }
+
+    char *const path = create_index_path(dir_path, dir_path_length, &key);
+    if (path == NULL) {
+        sb_destroy(&key);
+        return false;
+    }
+
+    const bool found = find_index(index, path, &key);
+    free(path);
+
+    if (found) {
+        sb_destroy(&key);
+        return true;
+    }
+
+    if (!create_index(index, dsc_info, &key)) {
+        sb_destroy(&key);
+        return false;
+    }
+
+    store_index(index, dir_path, dir_path_length, &key);
+    sb_destroy(&key);
+
+    return true;
+}
+
+bool
+dsc_index_find_images(const struct dsc_index *__notnull const index,
+                      const enum dsc_index_kind kind,
+                      const char *__notnull const string,
+                      const uint64_t length,
+                      struct array *__notnull const images_out)
+{
+    /*
+     * File-names and directories are single path-components, and so can't be
+     * found when they're empty or contain a slash.
+     */
+
+    if (kind != DSC_INDEX_KIND_PATH) {
+        if (length == 0 || memchr(string, '/', length) != NULL) {
+            return false;
+        }
+    }
+
+    const struct dsc_index_header *const header = index->header;
+
+    const uint64_t hash = hash_string(kind, string, length);
+    const uint32_t bucket = (uint32_t)(hash & (header->buckets_count - 1));
+
+    const struct dsc_index_entry *entry =
+        index->entries + index->buckets[bucket];
+
+    const struct dsc_index_entry *const end =
+        index->entries + index->buckets[bucket + 1];
+
+    for (; entry != end; entry++) {
+        if (entry->hash != hash || entry->kind != kind) {
+            continue;
+        }
+
+        if (entry->image_index >= header->images_count) {
+            continue;
+        }
+
+        const enum array_result add_image_result =
+            array_add_item(images_out,
+                           sizeof(entry->image_index),
+                           &entry->image_index,
+                           NULL);
+
+        if (add_image_result != E_ARRAY_OK) {
+            return false;
+        }
+    }
+
+    const uint32_t *image = index->unindexed;
+    const uint32_t *const unindexed_end = image + header->unindexed_count;
+
+    for (; image != unindexed_end; image++) {
+        if (*image >= header->images_count) {
+            continue;
+        }
+
+        const enum array_result add_image_result =
+            array_add_item(images_out, sizeof(*image), image, NULL);
+
+        if (add_image_result != E_ARRAY_OK) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void dsc_index_destroy(struct dsc_index *__notnull const index) {
+    if (index->is_mapped) {
+        munmap(index->data, index->size);
+    } else {
+        free(index->data);
+    }
+
+    *index = (struct dsc_index){};
+}
@@ -0,0 +1,602 @@
+//
+//  src/dsc_io_policy.c
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <sys/mman.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mach-o/loader.h"
+#include "mach-o/nlist.h"
+
+#include "dsc_io_policy.h"
+#include "guard_overflow.h"
+#include "our_io.h"
+
+static inline uint64_t
+round_up_to_page(const struct dsc_io_policy *__notnull const policy,
+                 const uint64_t value)
+{
+    const uint64_t mask = policy->page_size - 1;
+    return ((value + mask) & ~mask);
+}
+
+static void
+advise(const struct dsc_io_policy *__notnull const policy,
+       const struct range range,
+       const int advice)
+{
+    if (range.begin == range.end) {
+        return;
+    }
+
+    /*
+     * The advice is only a hint, so failures are ignored.
+     */
+
+    void *const begin = (void *)(policy->dsc_info->map + range.begin);
+    madvise(begin, range.end - range.begin, advice);
+}
+
+/*
+ * Add the pages holding size bytes at offset of the map to io_image's ranges,
+ * merging them into an existing range they overlap or border.
+ */
+
+static void
+add_range(const struct dsc_io_policy *__notnull const policy,
+          struct dsc_io_image *__notnull const io_image,
+          const uint64_t offset,
+          const uint64_t size)
+{
+    const uint64_t map_size = policy->dsc_info->size;
+    if (offset >= map_size || size == 0) {
+        return;
+    }
+
+    uint64_t end = offset;
+    if (guard_overflow_add(&end, size) || end > map_size) {
+        end = map_size;
+    }
+
+    struct range range = {
+        .begin = offset & ~(policy->page_size - 1),
+        .end = round_up_to_page(policy, end)
+    };
+
+    struct dsc_io_range *iter = io_image->ranges;
+    const struct dsc_io_range *const ranges_end = iter + io_image->ranges_count;
+
+    for (; iter != ranges_end; iter++) {
+        if (range.end < iter->range.begin || range.begin > iter->range.end) {
+            continue;
+        }
+
+        if (iter->range.begin < range.begin) {
+            range.begin = iter->range.begin;
+        }
+
+        if (iter->range.end > range.end) {
+            range.end = iter->range.end;
+        }
+
+        iter->range = range;
+        return;
+    }
+
+    if (io_image->ranges_count == DSC_IO_IMAGE_RANGES_MAX) {
+        return;
+    }
+
+    io_image->ranges[io_image->ranges_count].range = range;
+    io_image->ranges_count += 1;
+}
+
+/*
+ * Find the ranges of image's header and load-commands, export-trie, and symbol
+ * and string tables. Like the symbol and string tables, the export-trie's
+ * offset is relative to the start of the dyld_shared_cache.
+ *
+ * Only images in the host's byte-order have ranges besides their header.
+ */
+
+static void
+get_image_ranges(const struct dsc_io_policy *__notnull const policy,
+                 const struct dyld_cache_image_info *__notnull const image,
+                 struct dsc_io_image *__notnull const io_image)
+{
+    *io_image = (struct dsc_io_image){ .image = image };
+
+    const struct dyld_shared_cache_info *const dsc_info = policy->dsc_info;
+
+    uint64_t max_image_size = 0;
+    const uint64_t file_offset =
+        dyld_shared_cache_get_offset_for_addr(dsc_info,
+                                              image->address,
+                                              &max_image_size);
+
+    if (file_offset == 0 || max_image_size < sizeof(struct mach_header)) {
+        return;
+    }
+
+    const struct mach_header *const header =
+        (const struct mach_header *)(dsc_info->map + file_offset);
+
+    uint64_t header_size = sizeof(struct mach_header);
+    uint64_t nlist_size = sizeof(struct nlist);
+
+    if (header->magic == MH_MAGIC_64) {
+        header_size = sizeof(struct mach_header_64);
+        nlist_size = sizeof(struct nlist_64);
+    } else if (header->magic != MH_MAGIC) {
+        add_range(policy, io_image, file_offset, header_size);
+        return;
+    }
+
+    if (max_image_size < header_size) {
+        return;
+    }
+
+    uint64_t sizeofcmds = header->sizeofcmds;
+    if (sizeofcmds > max_image_size - header_size) {
+        sizeofcmds = max_image_size - header_size;
+    }
+
+    add_range(policy, io_image, file_offset, header_size + sizeofcmds);
+
+    const uint8_t *iter = (const uint8_t *)header + header_size;
+    const uint8_t *const end = iter + sizeofcmds;
+
+    const uint32_t ncmds = header->ncmds;
+    for (uint32_t i = 0; i != ncmds; i++) {
+        const uint64_t size_left = (uint64_t)(end - iter);
+        if (size_left < sizeof(struct load_command)) {
+            break;
+        }
+
+        const struct load_command *const lc =
+            (const struct load_command *)iter;
+
+        const uint32_t cmdsize = lc->cmdsize;
+        if (cmdsize < sizeof(struct load_command) || cmdsize > size_left) {
+            break;
+        }
+
+        switch (lc->cmd) {
+            case LC_SYMTAB: {
+                if (cmdsize < sizeof(struct symtab_command)) {
+                    break;
+                }
+
+                const struct symtab_command *const symtab =
+                    (const struct symtab_command *)lc;
+
+                add_range(policy,
+                          io_image,
+                          symtab->symoff,
+                          symtab->nsyms * nlist_size);
+
+                add_range(policy, io_image, symtab->stroff, symtab->strsize);
+                break;
+            }
+
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY: {
+                if (cmdsize < sizeof(struct dyld_info_command)) {
+                    break;
+                }
+
+                const struct dyld_info_command *const dyld_info =
+                    (const struct dyld_info_command *)lc;
+
+                add_range(policy,
+                          io_image,
+                          dyld_info->export_off,
+                          dyld_info->export_size);
+
+                break;
+            }
+
+            case LC_DYLD_EXPORTS_TRIE: {
+                if (cmdsize < sizeof(struct linkedit_data_command)) {
+                    break;
+                }
+
+                const struct linkedit_data_command *const export_trie =
+                    (const struct linkedit_data_command *)lc;
+
+                add_range(policy,
+                          io_image,
+                          export_trie->dataoff,
+                          export_trie->datasize);
+
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        iter += cmdsize;
+    }
+}
+
+static inline struct dsc_io_image *
+get_window_image(const struct dsc_io_policy *__notnull const policy,
+                 const uint32_t index)
+{
+    const uint32_t position =
+        (policy->window_front + index) % policy->window_capacity;
+
+    return policy->window + position;
+}
+
+/*
+ * Find a range of an image in the window that overlaps range, or NULL if no
+ * image in the window uses range.
+ */
+
+static struct dsc_io_range *
+find_range_in_window(const struct dsc_io_policy *__notnull const policy,
+                     const struct range range)
+{
+    const uint32_t window_count = policy->window_count;
+    for (uint32_t i = 0; i != window_count; i++) {
+        struct dsc_io_image *const io_image = get_window_image(policy, i);
+
+        struct dsc_io_range *iter = io_image->ranges;
+        const struct dsc_io_range *const end = iter + io_image->ranges_count;
+
+        for (; iter != end; iter++) {
+            if (ranges_overlap(iter->range, range)) {
+                return iter;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+bool
+dsc_io_policy_create(
+    struct dsc_io_policy *__notnull const policy,
+    const struct dyld_shared_cache_info *__notnull const dsc_info,
+    const uint32_t window_capacity,
+    const uint64_t max_rss)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0) {
+        page_size = 4096;
+    }
+
+    struct dsc_io_image *const window =
+        calloc(window_capacity, sizeof(struct dsc_io_image));
+
+    if (window == NULL) {
+        return false;
+    }
+
+    *policy = (struct dsc_io_policy){
+        .dsc_info = dsc_info,
+
+        .window = window,
+        .window_capacity = window_capacity,
+        .window_limit = window_capacity,
+
+        .page_size = (uint64_t)page_size,
+        .max_rss = max_rss
+    };
+
+    const uint64_t images_offset =
+        (uint64_t)((const uint8_t *)dsc_info->images - dsc_info->map);
+
+    const uint64_t images_size =
+        sizeof(struct dyld_cache_image_info) * dsc_info->images_count;
+
+    const struct range images_range = {
+        .begin = images_offset & ~(policy->page_size - 1),
+        .end = round_up_to_page(policy, images_offset + images_size)
+    };
+
+    advise(policy, images_range, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool
+dsc_io_policy_prefetch(
+    struct dsc_io_policy *__notnull const policy,
+    const struct dyld_cache_image_info *__notnull const image)
+{
+    if (policy->window_count >= policy->window_limit) {
+        return false;
+    }
+
+    struct dsc_io_image io_image = {};
+    get_image_ranges(policy, image, &io_image);
+
+    /*
+     * Ranges shared with an image already in the window, like a string-table
+     * shared by every image, are only read in and counted once.
+     */
+
+    uint64_t new_size = 0;
+
+    struct dsc_io_range *iter = io_image.ranges;
+    const struct dsc_io_range *const end = iter + io_image.ranges_count;
+
+    for (; iter != end; iter++) {
+        const struct dsc_io_range *const user =
+            find_range_in_window(policy, iter->range);
+
+        if (user != NULL && range_contains_other(user->range, iter->range)) {
+            continue;
+        }
+
+        iter->counted_size = range_get_size(iter->range);
+        new_size += iter->counted_size;
+    }
+
+    if (policy->max_rss != 0 && policy->window_count != 0) {
+        if (policy->readahead_size + new_size > policy->max_rss) {
+            return false;
+        }
+    }
+
+    for (iter = io_image.ranges; iter != end; iter++) {
+        if (iter->counted_size != 0) {
+            advise(policy, iter->range, MADV_WILLNEED);
+        }
+    }
+
+    struct dsc_io_image *const back =
+        get_window_image(policy, policy->window_count);
+
+    *back = io_image;
+
+    policy->window_count += 1;
+    policy->readahead_size += new_size;
+
+    return true;
+}
+
+/*
+ * Drop the ranges of io_image, which is no longer in the window, except for
+ * those still used by an image in the window, which are then counted through
+ * that image instead.
+ */
+
+static void
+drop_ranges(struct dsc_io_policy *__notnull const policy,
+            const struct dsc_io_image *__notnull const io_image)
+{
+    const struct dsc_io_range *iter = io_image->ranges;
+    const struct dsc_io_range *const end = iter + io_image->ranges_count;
+
+    for (; iter != end; iter++) {
+        policy->readahead_size -= iter->counted_size;
+
+        struct dsc_io_range *const user =
+            find_range_in_window(policy, iter->range);
+
+        if (user == NULL) {
+            advise(policy, iter->range, MADV_DONTNEED);
+            continue;
+        }
+
+        if (iter->counted_size != 0 && user->counted_size == 0) {
+            user->counted_size = range_get_size(user->range);
+            policy->readahead_size += user->counted_size;
+        }
+    }
+}
+
+/*
+ * Remove the image at index of the window, moving the images behind it forward.
+ */
+
+static void
+release_at(struct dsc_io_policy *__notnull const policy, const uint32_t index)
+{
+    const struct dsc_io_image io_image = *get_window_image(policy, index);
+    const uint32_t window_count = policy->window_count;
+
+    if (index == 0) {
+        policy->window_front =
+            (policy->window_front + 1) % policy->window_capacity;
+    } else {
+        for (uint32_t i = index + 1; i != window_count; i++) {
+            *get_window_image(policy, i - 1) = *get_window_image(policy, i);
+        }
+    }
+
+    policy->window_count -= 1;
+    drop_ranges(policy, &io_image);
+}
+
+#ifdef __linux__
+
+/*
+ * Get the resident memory of tbd, in bytes, or zero if it can't be found.
+ *
+ * /proc/self/statm holds the size of the program, followed by its resident
+ * size, both in pages.
+ */
+
+static uint64_t
+get_resident_size(const struct dsc_io_policy *__notnull const policy) {
+    const int fd = our_open("/proc/self/statm", O_RDONLY, 0);
+    if (fd < 0) {
+        return 0;
+    }
+
+    char buffer[128];
+    const ssize_t read_size = our_read(fd, buffer, sizeof(buffer) - 1);
+
+    close(fd);
+
+    if (read_size <= 0) {
+        return 0;
+    }
+
+    buffer[read_size] = '\0';
+
+    unsigned long long size = 0;
+    unsigned long long resident = 0;
+
+    if (sscanf(buffer, "%llu %llu", &size, &resident) != 2) {
+        return 0;
+    }
+
+    return (uint64_t)resident * policy->page_size;
+}
+
+#else
+
+/*
+ * Get the resident memory of the map, in bytes, or zero if it can't be found.
+ *
+ * Without /proc/self/statm, only the pages of the map are counted, through
+ * mincore().
+ */
+
+static uint64_t
+get_resident_size(const struct dsc_io_policy *__notnull const policy) {
+    const struct dyld_shared_cache_info *const dsc_info = policy->dsc_info;
+
+    const uint64_t map_size = round_up_to_page(policy, dsc_info->size);
+    const uint64_t pages_count = map_size / policy->page_size;
+
+    char *const vec = malloc(pages_count);
+    if (vec == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    if (mincore((void *)dsc_info->map, map_size, (void *)vec) != 0) {
+        free(vec);
+        return 0;
+    }
+
+    uint64_t resident_count = 0;
+    for (uint64_t i = 0; i != pages_count; i++) {
+        resident_count += (vec[i] & 1);
+    }
+
+    free(vec);
+    return resident_count * policy->page_size;
+}
+
+#endif
+
+/*
+ * Drop every page of the map, and of the subcaches mapped, except for the
+ * ranges of the images in the window.
+ */
+
+static void
+drop_unused_pages(const struct dsc_io_policy *__notnull const policy) {
+    const uint32_t window_count = policy->window_count;
+    struct range *ranges = NULL;
+
+    if (window_count != 0) {
+        ranges = calloc(window_count * DSC_IO_IMAGE_RANGES_MAX,
+                        sizeof(struct range));
+
+        if (ranges == NULL) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+    }
+
+    uint64_t ranges_count = 0;
+    for (uint32_t i = 0; i != window_count; i++) {
+        const struct dsc_io_image *const io_image = get_window_image(policy, i);
+        for (uint32_t j = 0; j != io_image->ranges_count; j++) {
+            ranges[ranges_count] = io_image->ranges[j].range;
+            ranges_count += 1;
+        }
+    }
+
+    ranges_count = ranges_sort_and_merge(ranges, ranges_count);
+
+    /*
+     * Drop the gaps between the window's ranges, which are page-aligned, along
+     * with the pages before the first and after the last.
+     */
+
+    struct range gap = {};
+    for (uint64_t i = 0; i != ranges_count; i++) {
+        gap.end = ranges[i].begin;
+        advise(policy, gap, MADV_DONTNEED);
+
+        gap.begin = ranges[i].end;
+    }
+
+    gap.end = round_up_to_page(policy, policy->dsc_info->size);
+    if (gap.begin < gap.end) {
+        advise(policy, gap, MADV_DONTNEED);
+    }
+
+    free(ranges);
+    dyld_shared_cache_drop_subcache_pages(policy->dsc_info);
+}
+
+/*
+ * Check tbd's resident memory against max_rss, dropping the pages of the map
+ * not in use, and shrinking the window, while tbd is over max_rss.
+ */
+
+static void enforce_max_rss(struct dsc_io_policy *__notnull const policy) {
+    if (policy->max_rss == 0) {
+        return;
+    }
+
+    if (get_resident_size(policy) <= policy->max_rss) {
+        if (policy->window_limit != policy->window_capacity) {
+            policy->window_limit += 1;
+        }
+
+        return;
+    }
+
+    drop_unused_pages(policy);
+    if (policy->window_limit > 1) {
+        policy->window_limit /= 2;
+    }
+}
+
+void
+dsc_io_policy_release(struct dsc_io_policy *__notnull const policy,
+                      const struct dyld_cache_image_info *__notnull const image)
+{
+    const uint32_t window_count = policy->window_count;
+    for (uint32_t i = 0; i != window_count; i++) {
+        if (get_window_image(policy, i)->image == image) {
+            release_at(policy, i);
+            enforce_max_rss(policy);
+
+            return;
+        }
+    }
+
+    struct dsc_io_image io_image = {};
+    get_image_ranges(policy, image, &io_image);
+
+    drop_ranges(policy, &io_image);
+    enforce_max_rss(policy);
+}
+
+void dsc_io_policy_destroy(struct dsc_io_policy *__notnull const policy) {
+    while (policy->window_count != 0) {
+        release_at(policy, 0);
+    }
+
+    free(policy->window);
+    *policy = (struct dsc_io_policy){};
+}
@@ -10,7 +10,10 @@
 #include <sys/stat.h>
 
 #include <errno.h>
+#include <fcntl.h>
 
+#include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -25,6 +28,15 @@
 static const uint64_t dsc_magic_64_normal = 2319765435151317348;
 static const uint64_t dsc_magic_64_arm64_32 = 7003509047616633188;
 
+/*
+ * Only the fields before codeSignatureOffset are found in the header of every
+ * dyld_shared_cache. The rest of the header is only there up to where the
+ * mappings begin.
+ */
+
+static const uint64_t legacy_header_size =
+    offsetof(struct dyld_cache_header, codeSignatureOffset);
+
 static int
 get_arch_info_from_magic(const char magic[const 16],
                          const struct arch_info **__notnull const arch_info_out)
@@ -199,6 +211,359 @@ get_arch_info_from_magic(const char magic[const 16],
     return 0;
 }
 
+/*
+ * Sort the mapping-ranges by begin-address, and mappings that begin at the same
+ * address by the order they're listed in, so the first mapping listed is still
+ * found first.
+ */
+
+static int
+mapping_range_comparator(const void *const left, const void *const right) {
+    const struct dyld_shared_cache_mapping_range *const left_range =
+        (const struct dyld_shared_cache_mapping_range *)left;
+
+    const struct dyld_shared_cache_mapping_range *const right_range =
+        (const struct dyld_shared_cache_mapping_range *)right;
+
+    if (left_range->begin != right_range->begin) {
+        return (left_range->begin < right_range->begin) ? -1 : 1;
+    }
+
+    if (left_range->order != right_range->order) {
+        return (left_range->order < right_range->order) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Create an index of the mappings' address-ranges, sorted by begin-address, so
+ * that an address can be translated into a file-offset with a binary search.
+ *
+ * Empty mappings, and mappings whose address-range overflows, can't contain any
+ * address, and are left out.
+ */
+
+static struct dyld_shared_cache_mapping_range *
+create_mapping_index(
+    const struct dyld_cache_mapping_info *__notnull const mapping_list,
+    const uint32_t mappings_count,
+    uint32_t *__notnull const count_out)
+{
+    struct dyld_shared_cache_mapping_range *const index =
+        calloc(mappings_count, sizeof(struct dyld_shared_cache_mapping_range));
+
+    if (index == NULL) {
+        return NULL;
+    }
+
+    uint32_t count = 0;
+
+    const struct dyld_cache_mapping_info *mapping = mapping_list;
+    const struct dyld_cache_mapping_info *const end =
+        mapping + mappings_count;
+
+    for (uint32_t order = 0; mapping != end; mapping++, order++) {
+        const uint64_t begin = mapping->address;
+
+        uint64_t mapping_end = begin;
+        if (guard_overflow_add(&mapping_end, mapping->size)) {
+            continue;
+        }
+
+        if (mapping_end == begin) {
+            continue;
+        }
+
+        index[count] = (struct dyld_shared_cache_mapping_range){
+            .begin = begin,
+            .end = mapping_end,
+            .file_offset = mapping->fileOffset,
+            .order = order
+        };
+
+        count++;
+    }
+
+    qsort(index, count, sizeof(*index), mapping_range_comparator);
+
+    uint64_t max_end = 0;
+    for (uint32_t i = 0; i != count; i++) {
+        if (index[i].end > max_end) {
+            max_end = index[i].end;
+        }
+
+        index[i].max_end = max_end;
+    }
+
+    *count_out = count;
+    return index;
+}
+
+static inline bool
+header_has_field(const struct dyld_cache_header *__notnull const header,
+                 const uint64_t field_end)
+{
+    return (header->mappingOffset >= field_end);
+}
+
+static enum dyld_shared_cache_parse_result
+read_header(const int fd, struct dyld_cache_header *__notnull const header) {
+    const size_t legacy_size = legacy_header_size - sizeof(header->magic);
+    if (our_read(fd, &header->mappingOffset, legacy_size) < 0) {
+        if (errno == EOVERFLOW) {
+            return E_DYLD_SHARED_CACHE_PARSE_NOT_A_CACHE;
+        }
+
+        return E_DYLD_SHARED_CACHE_PARSE_READ_FAIL;
+    }
+
+    /*
+     * The fields of the header missing from the file are left zeroed. A file
+     * too small for the rest of the header is too small for the mappings as
+     * well, which is caught while validating the mappings.
+     */
+
+    uint64_t header_size = header->mappingOffset;
+    if (header_size <= legacy_header_size) {
+        return E_DYLD_SHARED_CACHE_PARSE_OK;
+    }
+
+    if (header_size > sizeof(*header)) {
+        header_size = sizeof(*header);
+    }
+
+    uint8_t *const rest = (uint8_t *)header + legacy_header_size;
+    if (our_read(fd, rest, header_size - legacy_header_size) < 0) {
+        return E_DYLD_SHARED_CACHE_PARSE_READ_FAIL;
+    }
+
+    return E_DYLD_SHARED_CACHE_PARSE_OK;
+}
+
+/*
+ * Caches split into subcaches moved the image-array to new fields, leaving the
+ * old fields zeroed.
+ */
+
+static void
+get_images_array(const struct dyld_cache_header *__notnull const header,
+                 uint32_t *__notnull const offset_out,
+                 uint32_t *__notnull const count_out)
+{
+    const uint64_t images_count_end =
+        offsetof(struct dyld_cache_header, imagesCount) +
+        sizeof(header->imagesCount);
+
+    if (header_has_field(header, images_count_end)) {
+        if (header->imagesOffset != 0) {
+            *offset_out = header->imagesOffset;
+            *count_out = header->imagesCount;
+
+            return;
+        }
+    }
+
+    *offset_out = header->imagesOffsetOld;
+    *count_out = header->imagesCountOld;
+}
+
+/*
+ * Verify that every mapping is within the file, and that no mappings overlap
+ * on file.
+ */
+
+static enum dyld_shared_cache_parse_result
+validate_mappings(
+    const struct dyld_cache_mapping_info *__notnull const mapping_list,
+    const uint32_t mappings_count,
+    const uint64_t file_size)
+{
+    if (mappings_count == 0) {
+        return E_DYLD_SHARED_CACHE_PARSE_OK;
+    }
+
+    /*
+     * We use full_cache_range to verify our dsc-mappings.
+     *
+     * Our mappings are comparable to mach-o segments, recording the information
+     * of large swaths of file and address-space in the entire dyld_shared_cache
+     * file.
+     */
+
+    const struct range full_cache_range = {
+        .begin = 0,
+        .end = file_size
+    };
+
+    struct range *const file_ranges =
+        calloc(mappings_count, sizeof(struct range));
+
+    if (file_ranges == NULL) {
+        return E_DYLD_SHARED_CACHE_PARSE_ALLOC_FAIL;
+    }
+
+    enum dyld_shared_cache_parse_result result = E_DYLD_SHARED_CACHE_PARSE_OK;
+    uint32_t valid_count = 0;
+
+    for (; valid_count != mappings_count; valid_count++) {
+        const struct dyld_cache_mapping_info *const mapping =
+            mapping_list + valid_count;
+
+        const uint64_t mapping_file_begin = mapping->fileOffset;
+
+        /*
+         * We skip validation of mapping's address-range we don't use it, and
+         * because we aim to be lenient.
+         */
+
+        uint64_t mapping_file_end = mapping_file_begin;
+        if (guard_overflow_add(&mapping_file_end, mapping->size)) {
+            result = E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_MAPPINGS;
+            break;
+        }
+
+        const struct range mapping_file_range = {
+            .begin = mapping_file_begin,
+            .end = mapping_file_end
+        };
+
+        if (!range_contains_other(full_cache_range, mapping_file_range)) {
+            result = E_DYLD_SHARED_CACHE_PARSE_INVALID_MAPPINGS;
+            break;
+        }
+
+        file_ranges[valid_count] = mapping_file_range;
+    }
+
+    /*
+     * Overlapping mappings are reported ahead of an invalid mapping that comes
+     * after them.
+     */
+
+    if (ranges_have_overlap(file_ranges, valid_count)) {
+        result = E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_MAPPINGS;
+    }
+
+    free(file_ranges);
+    return result;
+}
+
+/*
+ * Older caches store the subcache-array as dyld_subcache_entry_v1, whose files
+ * are named after their index instead of a suffix.
+ */
+
+static inline bool
+has_v1_subcache_entries(
+    const struct dyld_cache_header *__notnull const header)
+{
+    return !header_has_field(header,
+                             offsetof(struct dyld_cache_header, cacheSubType) +
+                             1);
+}
+
+static void destroy_subcache(struct dyld_shared_cache_subcache *__notnull sub);
+
+static char *
+create_subcache_path(const char *__notnull const path,
+                     const uint64_t path_length,
+                     const char *__notnull const suffix,
+                     const uint64_t suffix_length)
+{
+    char *const subcache_path = malloc(path_length + suffix_length + 1);
+    if (subcache_path == NULL) {
+        return NULL;
+    }
+
+    memcpy(subcache_path, path, path_length);
+    memcpy(subcache_path + path_length, suffix, suffix_length);
+
+    subcache_path[path_length + suffix_length] = '\0';
+    return subcache_path;
+}
+
+/*
+ * Create the list of the cache's subcaches, without opening any of them. The
+ * address of each subcache is relative to the address of the first mapping of
+ * the main cache-file.
+ *
+ * The .symbols subcache only holds the local symbols of the cache's images,
+ * which aren't parsed, and so isn't part of the list.
+ */
+
+static enum dyld_shared_cache_parse_result
+create_subcaches(const uint8_t *__notnull const map,
+                 const struct dyld_cache_header *__notnull const header,
+                 const uint64_t base_address,
+                 const char *__notnull const path,
+                 struct dyld_shared_cache_subcache **__notnull const list_out)
+{
+    const uint32_t count = header->subCacheArrayCount;
+    struct dyld_shared_cache_subcache *const list =
+        calloc(count, sizeof(struct dyld_shared_cache_subcache));
+
+    if (list == NULL) {
+        return E_DYLD_SHARED_CACHE_PARSE_ALLOC_FAIL;
+    }
+
+    const uint8_t *const array = map + header->subCacheArrayOffset;
+    const uint64_t path_length = strlen(path);
+
+    for (uint32_t i = 0; i != count; i++) {
+        struct dyld_shared_cache_subcache *const subcache = list + i;
+
+        uint64_t vm_offset = 0;
+        char *subcache_path = NULL;
+
+        if (has_v1_subcache_entries(header)) {
+            const struct dyld_subcache_entry_v1 *const entry =
+                (const struct dyld_subcache_entry_v1 *)array + i;
+
+            char suffix[16] = {};
+            const int suffix_length =
+                snprintf(suffix, sizeof(suffix), ".%u", i + 1);
+
+            vm_offset = entry->cacheVMOffset;
+            subcache_path =
+                create_subcache_path(path,
+                                     path_length,
+                                     suffix,
+                                     (uint64_t)suffix_length);
+        } else {
+            const struct dyld_subcache_entry *const entry =
+                (const struct dyld_subcache_entry *)array + i;
+
+            const uint64_t suffix_length =
+                strnlen(entry->fileSuffix, sizeof(entry->fileSuffix));
+
+            vm_offset = entry->cacheVMOffset;
+            subcache_path =
+                create_subcache_path(path,
+                                     path_length,
+                                     entry->fileSuffix,
+                                     suffix_length);
+        }
+
+        if (subcache_path == NULL) {
+            for (uint32_t j = 0; j != i; j++) {
+                destroy_subcache(list + j);
+            }
+
+            free(list);
+            return E_DYLD_SHARED_CACHE_PARSE_ALLOC_FAIL;
+        }
+
+        subcache->path = subcache_path;
+        subcache->address = base_address + vm_offset;
+
+        pthread_mutex_init(&subcache->lock, NULL);
+    }
+
+    *list_out = list;
+    return E_DYLD_SHARED_CACHE_PARSE_OK;
+}
+
 enum dyld_shared_cache_parse_result
 dyld_shared_cache_parse_from_file(
     struct dyld_shared_cache_info *__notnull const info_in,
@@ -216,14 +581,18 @@ dyld_shared_cache_parse_from_file(
     }
 
     struct dyld_cache_header header = {};
-    if (our_read(fd, &header.mappingOffset, sizeof(header) - 16) < 0) {
-        if (errno == EOVERFLOW) {
-            return E_DYLD_SHARED_CACHE_PARSE_NOT_A_CACHE;
-        }
+    const enum dyld_shared_cache_parse_result read_header_result =
+        read_header(fd, &header);
 
-        return E_DYLD_SHARED_CACHE_PARSE_READ_FAIL;
+    if (read_header_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        return read_header_result;
     }
 
+    uint32_t images_offset = 0;
+    uint32_t images_count = 0;
+
+    get_images_array(&header, &images_offset, &images_count);
+
     /*
      * Validate that the mapping-infos array and images-array have no overflows.
      */
@@ -239,11 +608,11 @@ dyld_shared_cache_parse_from_file(
     }
 
     uint64_t images_size = sizeof(struct dyld_cache_image_info);
-    if (guard_overflow_mul(&images_size, header.imagesCount)) {
+    if (guard_overflow_mul(&images_size, images_count)) {
         return E_DYLD_SHARED_CACHE_PARSE_INVALID_IMAGES;
     }
 
-    uint64_t images_off_end = header.imagesOffset;
+    uint64_t images_off_end = images_offset;
     if (guard_overflow_add(&images_off_end, images_size)) {
         return E_DYLD_SHARED_CACHE_PARSE_INVALID_IMAGES;
     }
@@ -255,7 +624,7 @@ dyld_shared_cache_parse_from_file(
 
     const uint64_t dsc_size = (uint64_t)sbuf.st_size;
     const struct range no_main_header_range = {
-        .begin = sizeof(struct dyld_cache_header),
+        .begin = legacy_header_size,
         .end = dsc_size
     };
 
@@ -269,7 +638,7 @@ dyld_shared_cache_parse_from_file(
     };
 
     const struct range images_range = {
-        .begin = header.imagesOffset,
+        .begin = images_offset,
         .end = images_off_end
     };
 
@@ -302,17 +671,56 @@ dyld_shared_cache_parse_from_file(
         return E_DYLD_SHARED_CACHE_PARSE_INVALID_IMAGES;
     }
 
+    /*
+     * The subcache-array is only needed when the subcaches are to be opened,
+     * and a cache without any mappings of its own has no address for its
+     * subcaches to be relative to.
+     */
+
+    const uint64_t subcache_count_end =
+        offsetof(struct dyld_cache_header, subCacheArrayCount) +
+        sizeof(header.subCacheArrayCount);
+
+    const bool has_subcaches =
+        options.path != NULL &&
+        header_has_field(&header, subcache_count_end) &&
+        header.subCacheArrayCount != 0 &&
+        header.mappingCount != 0;
+
+    struct range subcaches_range = {};
+    if (has_subcaches) {
+        uint64_t subcaches_size = sizeof(struct dyld_subcache_entry);
+        if (has_v1_subcache_entries(&header)) {
+            subcaches_size = sizeof(struct dyld_subcache_entry_v1);
+        }
+
+        if (guard_overflow_mul(&subcaches_size, header.subCacheArrayCount)) {
+            return E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES;
+        }
+
+        subcaches_range.begin = header.subCacheArrayOffset;
+        subcaches_range.end = header.subCacheArrayOffset + subcaches_size;
+
+        if (!range_contains_other(no_main_header_range, subcaches_range)) {
+            return E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES;
+        }
+
+        if (ranges_overlap(subcaches_range, mappings_range) ||
+            ranges_overlap(subcaches_range, images_range))
+        {
+            return E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_RANGES;
+        }
+    }
+
     /*
      * After validating all our fields, we finally map the dyld_shared_cache
      * file to memory.
      *
-     * We map with write protections so we can use extra fields (like a
-     * dyld_cache_image_info's pad field) to save on memory, but use MAP_PRIVATE
-     * to prevent writing on the original file itself.
+     * The map is only ever read from, so its pages are never copied, and can
+     * be shared with every other process that maps the same cache.
      */
 
-    uint8_t *const map =
-        mmap(0, dsc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    uint8_t *const map = mmap(0, dsc_size, PROT_READ, MAP_PRIVATE, fd, 0);
 
     if (map == MAP_FAILED) {
         return E_DYLD_SHARED_CACHE_PARSE_MMAP_FAIL;
@@ -321,151 +729,471 @@ dyld_shared_cache_parse_from_file(
     const struct dyld_cache_mapping_info *const mapping_list =
         (const struct dyld_cache_mapping_info *)(map + header.mappingOffset);
 
+    const enum dyld_shared_cache_parse_result validate_mappings_result =
+        validate_mappings(mapping_list, header.mappingCount, dsc_size);
+
+    if (validate_mappings_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        munmap(map, dsc_size);
+        return validate_mappings_result;
+    }
+
     /*
-     * We use full_cache_range to verify our dsc-mappings.
-     *
-     * Our mappings are comparable to mach-o segments, recording the information
-     * of large swaths of file and address-space in the entire dyld_shared_cache
-     * file.
+     * Create an "available range" where other data structures may lie without
+     * overlapping with dyld_shared_cache file structures.
      */
 
-    const struct range full_cache_range = {
-        .begin = 0,
+    struct range available_range = {
+        .begin = images_off_end,
         .end = dsc_size
     };
 
-    /*
-     * Verify we don't have any overlapping mappings.
-     */
+    if (available_range.begin < mappings_off_end) {
+        available_range.begin = mappings_off_end;
+    }
 
-    const struct dyld_cache_mapping_info *mapping = mapping_list;
-    const struct dyld_cache_mapping_info *const mappings_end =
-        mapping + header.mappingCount;
+    if (available_range.begin < subcaches_range.end) {
+        available_range.begin = subcaches_range.end;
+    }
 
-    for (; mapping != mappings_end; mapping++) {
-        const uint64_t mapping_file_begin = mapping->fileOffset;
+    const struct dyld_cache_image_info *const image_list =
+        (const struct dyld_cache_image_info *)(map + images_offset);
 
-        /*
-         * We skip validation of mapping's address-range we don't use it, and
-         * because we aim to be lenient.
-         */
+    if (options.verify_image_path_offsets) {
+        const struct dyld_cache_image_info *image = image_list;
+        const struct dyld_cache_image_info *const images_end =
+            image + images_count;
+
+        for (; image != images_end; image++) {
+            const uint32_t location = image->pathFileOffset;
+            if (range_contains_location(available_range, location)) {
+                continue;
+            }
 
-        uint64_t mapping_file_end = mapping_file_begin;
-        if (guard_overflow_add(&mapping_file_end, mapping->size)) {
             munmap(map, dsc_size);
-            return E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_MAPPINGS;
+            return E_DYLD_SHARED_CACHE_PARSE_INVALID_IMAGES;
         }
+    }
 
-        const struct range mapping_file_range = {
-            .begin = mapping_file_begin,
-            .end = mapping_file_end
-        };
+    uint64_t *extracted_images = NULL;
+    if (options.track_extracted_images) {
+        uint64_t words_count = ((uint64_t)images_count + 63) / 64;
+        if (words_count == 0) {
+            words_count = 1;
+        }
 
-        if (!range_contains_other(full_cache_range, mapping_file_range)) {
+        extracted_images = calloc(words_count, sizeof(uint64_t));
+        if (extracted_images == NULL) {
             munmap(map, dsc_size);
-            return E_DYLD_SHARED_CACHE_PARSE_INVALID_MAPPINGS;
+            return E_DYLD_SHARED_CACHE_PARSE_ALLOC_FAIL;
         }
+    }
 
-        /*
-         * Check the previous mappings, which conveniently have already gone
-         * through verification in this loop before, for any overlaps with the
-         * current mapping.
-         */
+    uint32_t mapping_index_count = 0;
+    struct dyld_shared_cache_mapping_range *mapping_index = NULL;
 
-        const struct dyld_cache_mapping_info *inner = mapping_list;
-        for (; inner != mapping; inner++) {
-            const uint64_t inner_file_begin = inner->fileOffset;
-            const uint64_t inner_file_end = inner_file_begin + inner->size;
+    if (header.mappingCount != 0) {
+        mapping_index =
+            create_mapping_index(mapping_list,
+                                 header.mappingCount,
+                                 &mapping_index_count);
 
-            const struct range inner_file_range = {
-                .begin = inner_file_begin,
-                .end = inner_file_end
-            };
+        if (mapping_index == NULL) {
+            free(extracted_images);
+            munmap(map, dsc_size);
 
-            if (!ranges_overlap(mapping_file_range, inner_file_range)) {
-                continue;
-            }
+            return E_DYLD_SHARED_CACHE_PARSE_ALLOC_FAIL;
+        }
+    }
 
+    struct dyld_shared_cache_subcache *subcaches = NULL;
+    if (has_subcaches) {
+        const enum dyld_shared_cache_parse_result create_subcaches_result =
+            create_subcaches(map,
+                             &header,
+                             mapping_list->address,
+                             options.path,
+                             &subcaches);
+
+        if (create_subcaches_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+            free(mapping_index);
+            free(extracted_images);
             munmap(map, dsc_size);
-            return E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_MAPPINGS;
+
+            return create_subcaches_result;
         }
+
+        info_in->subcaches = subcaches;
+        info_in->subcaches_count = header.subCacheArrayCount;
     }
 
+    info_in->images = image_list;
+    info_in->images_count = images_count;
+    info_in->extracted_images = extracted_images;
+
+    info_in->mappings = mapping_list;
+    info_in->mappings_count = header.mappingCount;
+
+    info_in->mapping_index = mapping_index;
+    info_in->mapping_index_count = mapping_index_count;
+
+    info_in->arch = arch;
+
+    info_in->map = map;
+    info_in->size = dsc_size;
+
+    info_in->available_range = available_range;
+    info_in->flags.unmap_map = true;
+
+    return E_DYLD_SHARED_CACHE_PARSE_OK;
+}
+
+/*
+ * dyld_shared_cache data is stored in different mappings, with each mapping
+ * copied over to memory at runtime with different memory-protections.
+ *
+ * To find our data, we have to take our data's memory-address, and find the
+ * mapping with a memory-range containing our data's memory-address.
+ *
+ * The data's file-offset is simply at the mapping's file location, plus the
+ * memory-mapping-index of the data.
+ *
+ * Some dyld_shared_cache mappings will have a memory-range larger than the
+ * range reserved on file. For this reason, we may have a memory-address that
+ * doesn't have a corresponding file-location.
+ */
+
+static uint64_t
+get_offset_in_index(
+    const struct dyld_shared_cache_mapping_range *const index,
+    const uint32_t index_count,
+    const uint64_t address,
+    uint64_t *__notnull const max_size_out)
+{
     /*
-     * Create an "available range" where other data structures may lie without
-     * overlapping with dyld_shared_cache file structures.
+     * Find the last range with a begin-address at or below address.
      */
 
-    struct range available_range = {
-        .begin = images_off_end,
-        .end = dsc_size
-    };
+    uint32_t low = 0;
+    uint32_t high = index_count;
 
-    if (available_range.begin < mappings_off_end) {
-        available_range.begin = mappings_off_end;
+    while (low != high) {
+        const uint32_t middle = low + (high - low) / 2;
+        if (index[middle].begin <= address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
     }
 
-    struct dyld_cache_image_info *const image_list =
-        (struct dyld_cache_image_info *)(map + header.imagesOffset);
+    if (low == 0) {
+        return 0;
+    }
 
     /*
-     * Perform the image operations if need be.
-     *
-     * Since the images array is quite large (Usually >1000 images), we aim to
-     * do everything in only one loop.
+     * The address-ranges of mappings may overlap, in which case the mapping
+     * listed first is used. Ranges before the one found are checked as well,
+     * until a range whose max_end shows that neither it nor any range before it
+     * contains address.
      */
 
-    if (options.zero_image_pads) {
-        struct dyld_cache_image_info *image = image_list;
-        const struct dyld_cache_image_info *const images_end =
-            image + header.imagesCount;
-
-        if (options.verify_image_path_offsets) {
-            for (; image != images_end; image++) {
-                const uint32_t location = image->pathFileOffset;
-                if (!range_contains_location(available_range, location)) {
-                    munmap(map, dsc_size);
-                    return E_DYLD_SHARED_CACHE_PARSE_INVALID_IMAGES;
-                }
+    const struct dyld_shared_cache_mapping_range *range = NULL;
+    const struct dyld_shared_cache_mapping_range *iter = index + (low - 1);
 
-                image->pad = 0;
-            }
-        } else {
-            for (; image != images_end; image++) {
-                image->pad = 0;
+    for (; iter->max_end > address; iter--) {
+        if (address < iter->end) {
+            if (range == NULL || iter->order < range->order) {
+                range = iter;
             }
         }
-    } else if (options.verify_image_path_offsets) {
-        struct dyld_cache_image_info *image = image_list;
-        const struct dyld_cache_image_info *const images_end =
-            image + header.imagesCount;
 
-        for (; image != images_end; image++) {
-            const uint32_t location = image->pathFileOffset;
-            if (range_contains_location(available_range, location)) {
-                continue;
-            }
+        if (iter == index) {
+            break;
+        }
+    }
 
-            munmap(map, dsc_size);
-            return E_DYLD_SHARED_CACHE_PARSE_INVALID_IMAGES;
+    if (range == NULL) {
+        return 0;
+    }
+
+    const uint64_t delta = address - range->begin;
+
+    *max_size_out = (range->end - address);
+    return range->file_offset + delta;
+}
+
+uint64_t
+dyld_shared_cache_get_offset_for_addr(
+    const struct dyld_shared_cache_info *__notnull const info,
+    const uint64_t address,
+    uint64_t *__notnull const max_size_out)
+{
+    return get_offset_in_index(info->mapping_index,
+                               info->mapping_index_count,
+                               address,
+                               max_size_out);
+}
+
+/*
+ * Open and map subcache's file, which has to have the same magic as the main
+ * cache-file, and create the index of its mappings.
+ */
+
+static bool
+map_subcache(const struct dyld_shared_cache_info *__notnull const info,
+             struct dyld_shared_cache_subcache *__notnull const subcache)
+{
+    const int fd = our_open(subcache->path, O_RDONLY, 0);
+    if (fd < 0) {
+        subcache->map_errno = errno;
+        return false;
+    }
+
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) < 0) {
+        subcache->map_errno = errno;
+        close(fd);
+
+        return false;
+    }
+
+    const uint64_t size = (uint64_t)sbuf.st_size;
+    if (size < legacy_header_size) {
+        close(fd);
+        return false;
+    }
+
+    uint8_t *const map = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        subcache->map_errno = errno;
+        close(fd);
+
+        return false;
+    }
+
+    close(fd);
+
+    const struct dyld_cache_header *const header =
+        (const struct dyld_cache_header *)map;
+
+    if (memcmp(header->magic, info->map, sizeof(header->magic)) != 0) {
+        munmap(map, size);
+        return false;
+    }
+
+    uint64_t mappings_size = sizeof(struct dyld_cache_mapping_info);
+    if (guard_overflow_mul(&mappings_size, header->mappingCount)) {
+        munmap(map, size);
+        return false;
+    }
+
+    const struct range no_header_range = {
+        .begin = legacy_header_size,
+        .end = size
+    };
+
+    const struct range mappings_range = {
+        .begin = header->mappingOffset,
+        .end = header->mappingOffset + mappings_size
+    };
+
+    if (!range_contains_other(no_header_range, mappings_range)) {
+        munmap(map, size);
+        return false;
+    }
+
+    const struct dyld_cache_mapping_info *const mapping_list =
+        (const struct dyld_cache_mapping_info *)(map + header->mappingOffset);
+
+    const enum dyld_shared_cache_parse_result validate_mappings_result =
+        validate_mappings(mapping_list, header->mappingCount, size);
+
+    if (validate_mappings_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        munmap(map, size);
+        return false;
+    }
+
+    uint32_t mapping_index_count = 0;
+    struct dyld_shared_cache_mapping_range *mapping_index = NULL;
+
+    if (header->mappingCount != 0) {
+        mapping_index =
+            create_mapping_index(mapping_list,
+                                 header->mappingCount,
+                                 &mapping_index_count);
+
+        if (mapping_index == NULL) {
+            subcache->map_errno = ENOMEM;
+            munmap(map, size);
+
+            return false;
         }
     }
 
-    info_in->images = image_list;
-    info_in->images_count = header.imagesCount;
+    subcache->file = (struct dyld_shared_cache_file){
+        .map = map,
+        .size = size,
 
-    info_in->mappings = mapping_list;
-    info_in->mappings_count = header.mappingCount;
+        .available_range = {
+            .begin = mappings_range.end,
+            .end = size
+        }
+    };
 
-    info_in->arch = arch;
+    subcache->mapping_index = mapping_index;
+    subcache->mapping_index_count = mapping_index_count;
 
-    info_in->map = map;
-    info_in->size = dsc_size;
+    return true;
+}
 
-    info_in->available_range = available_range;
-    info_in->flags.unmap_map = true;
+/*
+ * Find the subcache holding the mappings at address, the subcache with the
+ * highest address at or below address.
+ */
 
-    return E_DYLD_SHARED_CACHE_PARSE_OK;
+static struct dyld_shared_cache_subcache *
+find_subcache_for_addr(
+    const struct dyld_shared_cache_info *__notnull const info,
+    const uint64_t address)
+{
+    struct dyld_shared_cache_subcache *result = NULL;
+
+    struct dyld_shared_cache_subcache *iter = info->subcaches;
+    const struct dyld_shared_cache_subcache *const end =
+        iter + info->subcaches_count;
+
+    for (; iter != end; iter++) {
+        if (iter->address > address) {
+            continue;
+        }
+
+        if (result == NULL || iter->address > result->address) {
+            result = iter;
+        }
+    }
+
+    return result;
+}
+
+uint64_t
+dyld_shared_cache_get_file_for_addr(
+    const struct dyld_shared_cache_info *__notnull const info,
+    const uint64_t address,
+    uint64_t *__notnull const max_size_out,
+    struct dyld_shared_cache_file *__notnull const file_out)
+{
+    const uint64_t offset =
+        get_offset_in_index(info->mapping_index,
+                            info->mapping_index_count,
+                            address,
+                            max_size_out);
+
+    if (offset != 0) {
+        *file_out = (struct dyld_shared_cache_file){
+            .map = info->map,
+            .size = info->size,
+            .available_range = info->available_range
+        };
+
+        return offset;
+    }
+
+    struct dyld_shared_cache_subcache *const subcache =
+        find_subcache_for_addr(info, address);
+
+    if (subcache == NULL) {
+        return 0;
+    }
+
+    /*
+     * Images may be parsed on several threads at once, so the subcache is
+     * mapped under its lock. A subcache that failed to be mapped isn't tried
+     * again.
+     */
+
+    pthread_mutex_lock(&subcache->lock);
+    if (!subcache->is_mapped && !subcache->failed_to_map) {
+        if (map_subcache(info, subcache)) {
+            subcache->is_mapped = true;
+        } else {
+            subcache->failed_to_map = true;
+        }
+    }
+
+    const bool is_mapped = subcache->is_mapped;
+    pthread_mutex_unlock(&subcache->lock);
+
+    if (!is_mapped) {
+        return 0;
+    }
+
+    const uint64_t subcache_offset =
+        get_offset_in_index(subcache->mapping_index,
+                            subcache->mapping_index_count,
+                            address,
+                            max_size_out);
+
+    if (subcache_offset == 0) {
+        return 0;
+    }
+
+    *file_out = subcache->file;
+    return subcache_offset;
+}
+
+bool
+dyld_shared_cache_addr_in_unavailable_subcache(
+    const struct dyld_shared_cache_info *__notnull const info,
+    const uint64_t address)
+{
+    struct dyld_shared_cache_subcache *const subcache =
+        find_subcache_for_addr(info, address);
+
+    if (subcache == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&subcache->lock);
+    const bool failed_to_map = subcache->failed_to_map;
+    pthread_mutex_unlock(&subcache->lock);
+
+    return failed_to_map;
+}
+
+void
+dyld_shared_cache_drop_subcache_pages(
+    const struct dyld_shared_cache_info *__notnull const info)
+{
+    struct dyld_shared_cache_subcache *iter = info->subcaches;
+    const struct dyld_shared_cache_subcache *const end =
+        iter + info->subcaches_count;
+
+    for (; iter != end; iter++) {
+        pthread_mutex_lock(&iter->lock);
+
+        /*
+         * The map is read-only, so its pages are always clean, and can be
+         * dropped even while the subcache's images are being parsed.
+         */
+
+        if (iter->is_mapped) {
+            madvise((void *)iter->file.map, iter->file.size, MADV_DONTNEED);
+        }
+
+        pthread_mutex_unlock(&iter->lock);
+    }
+}
+
+static void
+destroy_subcache(struct dyld_shared_cache_subcache *__notnull const sub) {
+    if (sub->is_mapped) {
+        munmap((void *)sub->file.map, sub->file.size);
+    }
+
+    free(sub->mapping_index);
+    free(sub->path);
+
+    pthread_mutex_destroy(&sub->lock);
+    *sub = (struct dyld_shared_cache_subcache){};
 }
 
 void
@@ -473,14 +1201,35 @@ dyld_shared_cache_info_destroy(
     struct dyld_shared_cache_info *__notnull const info)
 {
     if (info->flags.unmap_map) {
-        munmap(info->map, info->size);
+        munmap((void *)info->map, info->size);
     }
 
     info->map = NULL;
     info->size = 0;
 
+    free(info->mapping_index);
+
+    struct dyld_shared_cache_subcache *subcache = info->subcaches;
+    const struct dyld_shared_cache_subcache *const subcaches_end =
+        subcache + info->subcaches_count;
+
+    for (; subcache != subcaches_end; subcache++) {
+        destroy_subcache(subcache);
+    }
+
+    free(info->subcaches);
+
+    info->subcaches = NULL;
+    info->subcaches_count = 0;
+
     info->mappings = NULL;
+    info->mapping_index = NULL;
+    info->mapping_index_count = 0;
+
     info->images = NULL;
 
+    free(info->extracted_images);
+    info->extracted_images = NULL;
+
     info->arch = NULL;
 }
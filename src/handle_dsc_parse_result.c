@@ -12,7 +12,6 @@
 #include "handle_dsc_parse_result.h"
 #include "macho_file.h"
 #include "request_user_input.h"
-#include "unused.h"
 
 void
 handle_dsc_file_parse_result(
@@ -169,6 +168,26 @@ handle_dsc_file_parse_result(
 
             break;
 
+        case E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES:
+            if (is_recursing) {
+                fprintf(stderr,
+                        "dyld_shared_cache file (at path %s/%s) has invalid "
+                        "subcaches\n",
+                        dir_path,
+                        name);
+            } else if (print_paths) {
+                fprintf(stderr,
+                        "dyld_shared_cache file (at path %s) has invalid "
+                        "subcaches\n",
+                        dir_path);
+            } else {
+                fputs("dyld_shared_cache file at the provided path has invalid "
+                      "subcaches\n",
+                      stderr);
+            }
+
+            break;
+
         case E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_RANGES:
             if (is_recursing) {
                 fprintf(stderr,
@@ -259,13 +278,15 @@ print_dsc_image_parse_error_message_header(
 
 bool
 handle_dsc_image_parse_error_callback(
-    struct tbd_create_info *__unused __notnull const info_in,
+    struct tbd_create_info *__notnull const info_in,
     const enum macho_file_parse_callback_type type,
     void *const callback_info)
 {
     struct handle_dsc_image_parse_error_cb_info *const cb_info =
         (struct handle_dsc_image_parse_error_cb_info *)callback_info;
 
+    info_in->flags.called_error_callback = true;
+
     if (!cb_info->did_print_messages_header) {
         print_dsc_image_parse_error_message_header(cb_info->print_paths,
                                                    cb_info->dsc_dir_path,
@@ -604,6 +625,14 @@ print_dsc_image_parse_error(const char *__notnull const image_path,
 
             break;
 
+        case E_DSC_IMAGE_PARSE_SUBCACHE_UNAVAILABLE:
+            fprintf(stderr,
+                    "Image (with path %s) is in a subcache that could not be "
+                    "mapped\r\n",
+                    image_path);
+
+            break;
+
         case E_DSC_IMAGE_PARSE_FAT_NOT_SUPPORTED:
             fprintf(stderr,
                     "Image (with path %s) is an unsupported mach-o fat "
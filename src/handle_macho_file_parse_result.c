@@ -11,17 +11,18 @@
 
 #include "handle_macho_file_parse_result.h"
 #include "request_user_input.h"
-#include "unused.h"
 
 bool
 handle_macho_file_for_main_error_callback(
-    struct tbd_create_info *__unused __notnull const info_in,
+    struct tbd_create_info *__notnull const info_in,
     const enum macho_file_parse_callback_type type,
     void *const callback_info)
 {
     const struct handle_macho_file_parse_error_cb_info *const cb_info =
         (const struct handle_macho_file_parse_error_cb_info *)callback_info;
 
+    info_in->flags.called_error_callback = true;
+
     bool request_result = false;
     switch (type) {
         case ERR_MACHO_FILE_PARSE_CURRENT_VERSION_CONFLICT:
@@ -742,6 +743,25 @@ handle_macho_file_parse_result(const char *__notnull const dir_path,
 
             break;
 
+        case E_MACHO_FILE_PARSE_MMAP_FAIL:
+            if (is_recursing) {
+                fprintf(stderr,
+                        "Failed to map mach-o file (at path: %s/%s) to "
+                        "memory\n",
+                        dir_path,
+                        name);
+            } else if (print_paths) {
+                fprintf(stderr,
+                        "Failed to map mach-o file (at path: %s) to memory\n",
+                        dir_path);
+            } else {
+                fputs("Failed to map mach-o file at the provided path to "
+                      "memory\n",
+                      stderr);
+            }
+
+            break;
+
         case E_MACHO_FILE_PARSE_SIZE_TOO_SMALL:
             if (is_recursing) {
                 fprintf(stderr,
@@ -0,0 +1,250 @@
+//
+//  src/libtbd.c
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <unistd.h>
+
+#include "libtbd.h"
+#include "magic_buffer.h"
+#include "our_io.h"
+#include "target_list.h"
+
+void
+tbd_context_create(struct tbd_context *__notnull const ctx,
+                   const struct tbd_context_options options)
+{
+    *ctx = (struct tbd_context){
+        .options = options,
+        .info.version = options.version
+    };
+
+    if (ctx->info.version == TBD_VERSION_NONE) {
+        ctx->info.version = TBD_VERSION_V2;
+    }
+}
+
+/*
+ * Clear out ctx's info for the next conversion, while keeping every allocation
+ * made, including the allocation of the target-list.
+ */
+
+static void reset_info(struct tbd_context *__notnull const ctx) {
+    struct tbd_create_info *const info = &ctx->info;
+    const struct tbd_create_info empty = { .version = info->version };
+
+    struct target_list targets = info->fields.targets;
+    target_list_clear(&targets);
+
+    tbd_create_info_clear_fields_and_create_from(info, &empty);
+    info->fields.targets = targets;
+}
+
+static enum tbd_context_result
+write_document(struct tbd_context *__notnull const ctx) {
+    sb_clear(&ctx->document);
+
+    const enum tbd_create_result create_result =
+        tbd_create_with_info_to_buffer(&ctx->info,
+                                       &ctx->document,
+                                       ctx->options.write_options);
+
+    reset_info(ctx);
+    if (create_result != E_TBD_CREATE_OK) {
+        sb_clear(&ctx->document);
+        return E_TBD_CONTEXT_WRITE_FAIL;
+    }
+
+    return E_TBD_CONTEXT_OK;
+}
+
+static inline struct macho_file_parse_extra_args
+get_extra_args(struct tbd_context *__notnull const ctx) {
+    const struct macho_file_parse_extra_args extra = {
+        .callback = ctx->options.callback,
+        .cb_info = ctx->options.callback_info,
+        .export_trie_sb = &ctx->export_trie_sb
+    };
+
+    return extra;
+}
+
+static enum tbd_context_result
+handle_open_result(const enum macho_file_open_result result) {
+    switch (result) {
+        case E_MACHO_FILE_OPEN_OK:
+            return E_TBD_CONTEXT_OK;
+
+        case E_MACHO_FILE_OPEN_READ_FAIL:
+        case E_MACHO_FILE_OPEN_FSTAT_FAIL:
+            return E_TBD_CONTEXT_READ_FAIL;
+
+        case E_MACHO_FILE_OPEN_NOT_A_MACHO:
+            return E_TBD_CONTEXT_NOT_A_MACHO;
+    }
+
+    return E_TBD_CONTEXT_READ_FAIL;
+}
+
+static enum tbd_context_result
+handle_parse_result(struct tbd_context *__notnull const ctx,
+                    const enum macho_file_parse_result result)
+{
+    ctx->macho_parse_result = result;
+    if (result != E_MACHO_FILE_PARSE_OK) {
+        reset_info(ctx);
+        return E_TBD_CONTEXT_MACHO_PARSE_FAIL;
+    }
+
+    return write_document(ctx);
+}
+
+enum tbd_context_result
+tbd_context_convert_fd(struct tbd_context *__notnull const ctx, const int fd) {
+    if (our_lseek(fd, 0, SEEK_SET) < 0) {
+        return E_TBD_CONTEXT_SEEK_FAIL;
+    }
+
+    struct macho_file macho = {};
+    struct magic_buffer magic_buffer = {};
+
+    const struct range range = {};
+    const enum macho_file_open_result open_result =
+        macho_file_open(&macho, &magic_buffer, fd, range);
+
+    if (open_result != E_MACHO_FILE_OPEN_OK) {
+        return handle_open_result(open_result);
+    }
+
+    const enum macho_file_parse_result parse_result =
+        macho_file_parse_from_file(&ctx->info,
+                                   &macho,
+                                   get_extra_args(ctx),
+                                   ctx->options.parse_options,
+                                   ctx->options.macho_options);
+
+    return handle_parse_result(ctx, parse_result);
+}
+
+enum tbd_context_result
+tbd_context_convert_buffer(struct tbd_context *__notnull const ctx,
+                           const void *__notnull const data,
+                           const uint64_t size)
+{
+    const uint8_t *const map = (const uint8_t *)data;
+
+    struct macho_file macho = {};
+    const enum macho_file_open_result open_result =
+        macho_file_open_from_map(&macho, map, size);
+
+    if (open_result != E_MACHO_FILE_OPEN_OK) {
+        return handle_open_result(open_result);
+    }
+
+    /*
+     * The document is created before returning, so strings don't have to be
+     * copied out of data.
+     */
+
+    const enum macho_file_parse_result parse_result =
+        macho_file_parse_from_map(&ctx->info,
+                                  &macho,
+                                  map,
+                                  get_extra_args(ctx),
+                                  ctx->options.parse_options,
+                                  ctx->options.macho_options);
+
+    return handle_parse_result(ctx, parse_result);
+}
+
+enum tbd_context_result
+tbd_context_open_dsc(struct tbd_context *__notnull const ctx, const int fd) {
+    tbd_context_close_dsc(ctx);
+    if (our_lseek(fd, 0, SEEK_SET) < 0) {
+        return E_TBD_CONTEXT_SEEK_FAIL;
+    }
+
+    struct magic_buffer magic_buffer = {};
+    if (magic_buffer_read_n(&magic_buffer, fd, 16) != E_MAGIC_BUFFER_OK) {
+        return E_TBD_CONTEXT_READ_FAIL;
+    }
+
+    const struct dyld_shared_cache_parse_options options = {};
+    const enum dyld_shared_cache_parse_result parse_result =
+        dyld_shared_cache_parse_from_file(&ctx->dsc_info,
+                                          fd,
+                                          (const char *)magic_buffer.buff,
+                                          options);
+
+    ctx->dsc_parse_result = parse_result;
+    switch (parse_result) {
+        case E_DYLD_SHARED_CACHE_PARSE_OK:
+            break;
+
+        case E_DYLD_SHARED_CACHE_PARSE_NOT_A_CACHE:
+            return E_TBD_CONTEXT_NOT_A_SHARED_CACHE;
+
+        default:
+            return E_TBD_CONTEXT_DSC_PARSE_FAIL;
+    }
+
+    ctx->has_dsc = true;
+    return E_TBD_CONTEXT_OK;
+}
+
+enum tbd_context_result
+tbd_context_convert_dsc_image(struct tbd_context *__notnull const ctx,
+                              const uint32_t index)
+{
+    if (!ctx->has_dsc) {
+        return E_TBD_CONTEXT_NO_SHARED_CACHE;
+    }
+
+    struct dyld_shared_cache_info *const dsc_info = &ctx->dsc_info;
+    if (index >= dsc_info->images_count) {
+        return E_TBD_CONTEXT_INVALID_IMAGE_INDEX;
+    }
+
+    const struct dsc_image_parse_options options = {};
+    const enum dsc_image_parse_result parse_result =
+        dsc_image_parse(&ctx->info,
+                        dsc_info,
+                        dsc_info->images + index,
+                        ctx->options.callback,
+                        ctx->options.callback_info,
+                        &ctx->export_trie_sb,
+                        ctx->options.macho_options,
+                        ctx->options.parse_options,
+                        options);
+
+    ctx->dsc_image_parse_result = parse_result;
+    if (parse_result != E_DSC_IMAGE_PARSE_OK) {
+        reset_info(ctx);
+        return E_TBD_CONTEXT_DSC_IMAGE_PARSE_FAIL;
+    }
+
+    return write_document(ctx);
+}
+
+void tbd_context_close_dsc(struct tbd_context *__notnull const ctx) {
+    if (!ctx->has_dsc) {
+        return;
+    }
+
+    dyld_shared_cache_info_destroy(&ctx->dsc_info);
+
+    ctx->dsc_info = (struct dyld_shared_cache_info){};
+    ctx->has_dsc = false;
+}
+
+void tbd_context_destroy(struct tbd_context *__notnull const ctx) {
+    tbd_context_close_dsc(ctx);
+    tbd_create_info_destroy(&ctx->info);
+
+    sb_destroy(&ctx->document);
+    sb_destroy(&ctx->export_trie_sb);
+
+    *ctx = (struct tbd_context){};
+}
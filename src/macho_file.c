@@ -6,6 +6,7 @@
 //  Copyright © 2018 - 2020 inoahdev. All rights reserved.
 //
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <errno.h>
@@ -71,6 +72,17 @@ struct macho_magic_info {
     uint32_t other;
 };
 
+static void swap_mach_header(struct mach_header *__notnull const header) {
+    header->cputype = swap_int32(header->cputype);
+    header->cpusubtype = swap_int32(header->cpusubtype);
+
+    header->ncmds = swap_uint32(header->ncmds);
+    header->sizeofcmds = swap_uint32(header->sizeofcmds);
+
+    header->filetype = swap_uint32(header->filetype);
+    header->flags = swap_uint32(header->flags);
+}
+
 enum macho_file_open_result
 macho_file_open(struct macho_file *__notnull const macho,
                 struct magic_buffer *__notnull const buffer,
@@ -114,14 +126,7 @@ macho_file_open(struct macho_file *__notnull const macho,
          */
 
         if (magic_is_big_endian(magic)) {
-            header.cputype = swap_int32(header.cputype);
-            header.cpusubtype = swap_int32(header.cpusubtype);
-
-            header.ncmds = swap_uint32(header.ncmds);
-            header.sizeofcmds = swap_uint32(header.sizeofcmds);
-
-            header.filetype = swap_uint32(header.filetype);
-            header.flags = swap_uint32(header.flags);
+            swap_mach_header(&header);
         }
     } else {
         return E_MACHO_FILE_OPEN_NOT_A_MACHO;
@@ -150,6 +155,45 @@ macho_file_open(struct macho_file *__notnull const macho,
     return E_MACHO_FILE_OPEN_OK;
 }
 
+enum macho_file_open_result
+macho_file_open_from_map(struct macho_file *__notnull const macho,
+                         const uint8_t *__notnull const map,
+                         const uint64_t size)
+{
+    if (size < sizeof(struct mach_header)) {
+        return E_MACHO_FILE_OPEN_NOT_A_MACHO;
+    }
+
+    uint32_t nfat_arch = 1;
+    struct mach_header header = {};
+
+    const struct macho_magic_info *const magic_info =
+        (const struct macho_magic_info *)map;
+
+    const uint32_t magic = magic_info->magic;
+    if (magic_is_fat(magic)) {
+        nfat_arch = magic_info->other;
+        if (magic_is_big_endian(magic)) {
+            nfat_arch = swap_uint32(nfat_arch);
+        }
+    } else if (magic_is_thin(magic)) {
+        memcpy(&header, map, sizeof(header));
+        if (magic_is_big_endian(magic)) {
+            swap_mach_header(&header);
+        }
+    } else {
+        return E_MACHO_FILE_OPEN_NOT_A_MACHO;
+    }
+
+    macho->fd = -1;
+    macho->magic = magic;
+    macho->nfat_arch = nfat_arch;
+    macho->header = header;
+    macho->range = (struct range){ .begin = 0, .end = size };
+
+    return E_MACHO_FILE_OPEN_OK;
+}
+
 static inline bool magic_is_64_bit(const uint32_t magic) {
     switch (magic) {
         case MH_MAGIC_64:
@@ -178,7 +222,7 @@ call_callback(struct tbd_create_info *__notnull const info_in,
 
 static enum macho_file_parse_result
 parse_thin_file(struct tbd_create_info *__notnull const info_in,
-                const int fd,
+                const uint8_t *__notnull const map,
                 const struct range container_range,
                 const struct mach_header *const header,
                 const struct arch_info *const arch,
@@ -206,13 +250,6 @@ parse_thin_file(struct tbd_create_info *__notnull const info_in,
          * mach_header.
          */
 
-        const uint64_t offset =
-            container_range.begin + sizeof(struct mach_header_64);
-
-        if (our_lseek(fd, offset, SEEK_SET) < 0) {
-            return E_MACHO_FILE_PARSE_SEEK_FAIL;
-        }
-
         lc_flags.is_64 = true;
         header_size = sizeof(struct mach_header_64);
     }
@@ -276,23 +313,42 @@ parse_thin_file(struct tbd_create_info *__notnull const info_in,
         }
     }
 
-    const struct range lc_available_range = {
-        .begin = container_range.begin + header_size,
-        .end = container_range.end,
+    /*
+     * All offsets within a mach-o file, or within one of a fat file's archs,
+     * are relative to the start of its mach-o header.
+     */
+
+    const uint8_t *const macho = map + container_range.begin;
+    const uint64_t macho_size = range_get_size(container_range);
+
+    /*
+     * Data referenced by the load-commands can only be found after them.
+     */
+
+    const struct range available_map_range = {
+        .begin = (uint64_t)header_size + header->sizeofcmds,
+        .end = macho_size
     };
 
+    if (available_map_range.begin == macho_size) {
+        return E_MACHO_FILE_PARSE_TOO_MANY_LOAD_COMMANDS;
+    }
+
     /*
      * Ignore if arch is NULL, as arch_index would be ignored as well.
      */
 
-    struct mf_parse_lc_from_file_info info = {
-        .fd = fd,
+    struct mf_parse_lc_from_map_info info = {
+        .map = macho,
+        .map_size = macho_size,
+
+        .macho = macho,
+        .macho_size = macho_size,
 
         .arch = arch,
         .arch_index = arch_index,
 
-        .macho_range = container_range,
-        .available_range = lc_available_range,
+        .available_map_range = available_map_range,
 
         .ncmds = header->ncmds,
         .sizeofcmds = header->sizeofcmds,
@@ -305,10 +361,10 @@ parse_thin_file(struct tbd_create_info *__notnull const info_in,
     };
 
     const enum macho_file_parse_result parse_load_commands_result =
-        macho_file_parse_load_commands_from_file(info_in,
-                                                 &info,
-                                                 extra,
-                                                 NULL);
+        macho_file_parse_load_commands_from_map(info_in,
+                                                &info,
+                                                extra,
+                                                NULL);
 
     if (parse_load_commands_result != E_MACHO_FILE_PARSE_OK) {
         return parse_load_commands_result;
@@ -415,7 +471,7 @@ static inline bool is_invalid_filetype(const uint32_t filetype) {
 
 static enum macho_file_parse_result
 handle_fat_32_file(struct tbd_create_info *__notnull const info_in,
-                   const int fd,
+                   const uint8_t *__notnull const map,
                    const struct range macho_range,
                    const uint32_t nfat_arch,
                    const bool is_big_endian,
@@ -423,6 +479,10 @@ handle_fat_32_file(struct tbd_create_info *__notnull const info_in,
                    const struct tbd_parse_options tbd_options,
                    const struct macho_file_parse_options options)
 {
+    if (nfat_arch == 0) {
+        return E_MACHO_FILE_PARSE_NO_ARCHITECTURES;
+    }
+
     /*
      * Calculate the total-size of the architectures given.
      */
@@ -446,15 +506,18 @@ handle_fat_32_file(struct tbd_create_info *__notnull const info_in,
         return E_MACHO_FILE_PARSE_TOO_MANY_ARCHITECTURES;
     }
 
+    /*
+     * The arch-list is copied out of the map, as verifying each arch rewrites
+     * its fields.
+     */
+
     struct fat_arch *const arch_list = malloc(archs_size);
     if (arch_list == NULL) {
         return E_MACHO_FILE_PARSE_ALLOC_FAIL;
     }
 
-    if (our_read(fd, arch_list, archs_size) < 0) {
-        free(arch_list);
-        return E_MACHO_FILE_PARSE_READ_FAIL;
-    }
+    const uint64_t archs_offset = macho_range.begin + sizeof(struct fat_header);
+    memcpy(arch_list, map + archs_offset, archs_size);
 
     /*
      * Loop over the architectures once to verify its info, then loop over again
@@ -467,54 +530,50 @@ handle_fat_32_file(struct tbd_create_info *__notnull const info_in,
         .end = macho_range.end,
     };
 
-    const enum macho_file_parse_result verify_first_arch_result =
-        verify_fat_32_arch(first_arch,
-                           macho_range.begin,
-                           available_range,
-                           is_big_endian,
-                           tbd_options,
-                           NULL);
+    /*
+     * The ranges of the archs are collected to check for overlapping archs
+     * after verifying every arch.
+     */
 
-    if (verify_first_arch_result != E_MACHO_FILE_PARSE_OK) {
+    struct range *const arch_ranges = calloc(nfat_arch, sizeof(struct range));
+    if (arch_ranges == NULL) {
         free(arch_list);
-        return verify_first_arch_result;
+        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
     }
 
-    struct fat_arch *arch = first_arch + 1;
+    struct fat_arch *arch = first_arch;
     const struct fat_arch *const end = arch_list + nfat_arch;
 
-    for (; arch != end; arch++) {
-        struct range arch_range = {};
-        const enum macho_file_parse_result verify_arch_result =
+    uint32_t verified_count = 0;
+    enum macho_file_parse_result verify_result = E_MACHO_FILE_PARSE_OK;
+
+    for (; arch != end; arch++, verified_count++) {
+        verify_result =
             verify_fat_32_arch(arch,
                                macho_range.begin,
                                available_range,
                                is_big_endian,
                                tbd_options,
-                               &arch_range);
+                               arch_ranges + verified_count);
 
-        if (verify_arch_result != E_MACHO_FILE_PARSE_OK) {
-            free(arch_list);
-            return verify_arch_result;
+        if (verify_result != E_MACHO_FILE_PARSE_OK) {
+            break;
         }
+    }
 
-        /*
-         * Make sure the arch doesn't overlap with any previous archs.
-         */
+    /*
+     * Overlapping archs are reported ahead of an invalid arch that comes after
+     * them.
+     */
 
-        const struct fat_arch *inner = arch_list;
-        for (; inner != arch; inner++) {
-            const uint64_t inner_offset = inner->offset;
-            const struct range inner_range = {
-                .begin = inner_offset,
-                .end = inner_offset + inner->size
-            };
+    if (ranges_have_overlap(arch_ranges, verified_count)) {
+        verify_result = E_MACHO_FILE_PARSE_OVERLAPPING_ARCHITECTURES;
+    }
 
-            if (ranges_overlap(arch_range, inner_range)) {
-                free(arch_list);
-                return E_MACHO_FILE_PARSE_OVERLAPPING_ARCHITECTURES;
-            }
-        }
+    free(arch_ranges);
+    if (verify_result != E_MACHO_FILE_PARSE_OK) {
+        free(arch_list);
+        return verify_result;
     }
 
     uint32_t arch_index = 0;
@@ -524,17 +583,10 @@ handle_fat_32_file(struct tbd_create_info *__notnull const info_in,
     bool parsed_one_arch = false;
 
     for (arch = arch_list; arch != end; arch++, arch_index++) {
-        const off_t arch_offset = (off_t)(macho_range.begin + arch->offset);
-        if (our_lseek(fd, arch_offset, SEEK_SET) < 0) {
-            free(arch_list);
-            return E_MACHO_FILE_PARSE_SEEK_FAIL;
-        }
+        const uint64_t arch_offset = macho_range.begin + arch->offset;
 
         struct mach_header header = {};
-        if (our_read(fd, &header, sizeof(header)) < 0) {
-            free(arch_list);
-            return E_MACHO_FILE_PARSE_READ_FAIL;
-        }
+        memcpy(&header, map + arch_offset, sizeof(header));
 
         /*
          * Swap the mach_header's fields if big-endian.
@@ -618,7 +670,7 @@ handle_fat_32_file(struct tbd_create_info *__notnull const info_in,
 
         const enum macho_file_parse_result handle_arch_result =
             parse_thin_file(info_in,
-                            fd,
+                            map,
                             arch_range,
                             &header,
                             arch_info,
@@ -736,7 +788,7 @@ verify_fat_64_arch(struct fat_arch_64 *__notnull const arch,
 
 static enum macho_file_parse_result
 handle_fat_64_file(struct tbd_create_info *__notnull const info_in,
-                   const int fd,
+                   const uint8_t *__notnull const map,
                    const struct range macho_range,
                    const uint32_t nfat_arch,
                    const bool is_big_endian,
@@ -744,6 +796,10 @@ handle_fat_64_file(struct tbd_create_info *__notnull const info_in,
                    const struct tbd_parse_options tbd_options,
                    const struct macho_file_parse_options options)
 {
+    if (nfat_arch == 0) {
+        return E_MACHO_FILE_PARSE_NO_ARCHITECTURES;
+    }
+
     /*
      * Calculate the total-size of the architectures given.
      */
@@ -767,15 +823,18 @@ handle_fat_64_file(struct tbd_create_info *__notnull const info_in,
         return E_MACHO_FILE_PARSE_TOO_MANY_ARCHITECTURES;
     }
 
+    /*
+     * The arch-list is copied out of the map, as verifying each arch rewrites
+     * its fields.
+     */
+
     struct fat_arch_64 *const arch_list = malloc(archs_size);
     if (arch_list == NULL) {
         return E_MACHO_FILE_PARSE_ALLOC_FAIL;
     }
 
-    if (our_read(fd, arch_list, archs_size) < 0) {
-        free(arch_list);
-        return E_MACHO_FILE_PARSE_READ_FAIL;
-    }
+    const uint64_t archs_offset = macho_range.begin + sizeof(struct fat_header);
+    memcpy(arch_list, map + archs_offset, archs_size);
 
     /*
      * Loop over the architectures once to verify its info, then loop over again
@@ -788,54 +847,50 @@ handle_fat_64_file(struct tbd_create_info *__notnull const info_in,
         .end = macho_range.end
     };
 
-    const enum macho_file_parse_result verify_first_arch_result =
-        verify_fat_64_arch(first_arch,
-                           macho_range.begin,
-                           available_range,
-                           is_big_endian,
-                           tbd_options,
-                           NULL);
+    /*
+     * The ranges of the archs are collected to check for overlapping archs
+     * after verifying every arch.
+     */
 
-    if (verify_first_arch_result != E_MACHO_FILE_PARSE_OK) {
+    struct range *const arch_ranges = calloc(nfat_arch, sizeof(struct range));
+    if (arch_ranges == NULL) {
         free(arch_list);
-        return verify_first_arch_result;
+        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
     }
 
-    /*
-     * Before parsing, verify each architecture.
-     */
-
-    struct fat_arch_64 *arch = first_arch + 1;
+    struct fat_arch_64 *arch = first_arch;
     const struct fat_arch_64 *const end = arch_list + nfat_arch;
 
-    for (; arch != end; arch++) {
-        struct range arch_range = {};
-        const enum macho_file_parse_result verify_arch_result =
+    uint32_t verified_count = 0;
+    enum macho_file_parse_result verify_result = E_MACHO_FILE_PARSE_OK;
+
+    for (; arch != end; arch++, verified_count++) {
+        verify_result =
             verify_fat_64_arch(arch,
                                macho_range.begin,
                                available_range,
                                is_big_endian,
                                tbd_options,
-                               &arch_range);
+                               arch_ranges + verified_count);
 
-        if (verify_arch_result != E_MACHO_FILE_PARSE_OK) {
-            free(arch_list);
-            return verify_arch_result;
+        if (verify_result != E_MACHO_FILE_PARSE_OK) {
+            break;
         }
+    }
+
+    /*
+     * Overlapping archs are reported ahead of an invalid arch that comes after
+     * them.
+     */
 
-        struct fat_arch_64 *inner = arch_list;
-        for (; inner != arch; inner++) {
-            const uint64_t inner_offset = inner->offset;
-            const struct range inner_range = {
-                .begin = inner_offset,
-                .end = inner_offset + inner->size
-            };
+    if (ranges_have_overlap(arch_ranges, verified_count)) {
+        verify_result = E_MACHO_FILE_PARSE_OVERLAPPING_ARCHITECTURES;
+    }
 
-            if (ranges_overlap(arch_range, inner_range)) {
-                free(arch_list);
-                return E_MACHO_FILE_PARSE_OVERLAPPING_ARCHITECTURES;
-            }
-        }
+    free(arch_ranges);
+    if (verify_result != E_MACHO_FILE_PARSE_OK) {
+        free(arch_list);
+        return verify_result;
     }
 
     uint32_t arch_index = 0;
@@ -845,17 +900,10 @@ handle_fat_64_file(struct tbd_create_info *__notnull const info_in,
     bool ignore_filetype = false;
 
     for (arch = arch_list; arch != end; arch++, arch_index++) {
-        const off_t arch_offset = (off_t)(macho_range.begin + arch->offset);
-        if (our_lseek(fd, arch_offset, SEEK_SET) < 0) {
-            free(arch_list);
-            return E_MACHO_FILE_PARSE_SEEK_FAIL;
-        }
+        const uint64_t arch_offset = macho_range.begin + arch->offset;
 
         struct mach_header header = {};
-        if (our_read(fd, &header, sizeof(header)) < 0) {
-            free(arch_list);
-            return E_MACHO_FILE_PARSE_READ_FAIL;
-        }
+        memcpy(&header, map + arch_offset, sizeof(header));
 
         /*
          * Swap mach_header's fields if big-endian as we deal only in
@@ -940,7 +988,7 @@ handle_fat_64_file(struct tbd_create_info *__notnull const info_in,
 
         const enum macho_file_parse_result handle_arch_result =
             parse_thin_file(info_in,
-                            fd,
+                            map,
                             arch_range,
                             &header,
                             arch_info,
@@ -978,16 +1026,15 @@ static bool magic_is_fat_64(const uint32_t magic) {
     }
 }
 
-enum macho_file_parse_result
-macho_file_parse_from_file(struct tbd_create_info *__notnull const info_in,
-                           struct macho_file *__notnull const macho,
-                           struct macho_file_parse_extra_args extra,
-                           const struct tbd_parse_options tbd_options,
-                           const struct macho_file_parse_options options)
+static enum macho_file_parse_result
+parse_macho_from_map(struct tbd_create_info *__notnull const info_in,
+                     const struct macho_file *__notnull const macho,
+                     const uint8_t *__notnull const map,
+                     const struct macho_file_parse_extra_args extra,
+                     const struct tbd_parse_options tbd_options,
+                     const struct macho_file_parse_options options)
 {
     enum macho_file_parse_result ret = E_MACHO_FILE_PARSE_OK;
-
-    const int fd = macho->fd;
     const uint32_t magic = macho->magic;
     const uint32_t nfat_arch = macho->nfat_arch;
 
@@ -1001,7 +1048,7 @@ macho_file_parse_from_file(struct tbd_create_info *__notnull const info_in,
 
         if (magic_is_fat_64(magic)) {
             ret = handle_fat_64_file(info_in,
-                                     fd,
+                                     map,
                                      macho->range,
                                      nfat_arch,
                                      magic_is_big_endian(magic),
@@ -1010,7 +1057,7 @@ macho_file_parse_from_file(struct tbd_create_info *__notnull const info_in,
                                      options);
         } else {
             ret = handle_fat_32_file(info_in,
-                                     fd,
+                                     map,
                                      macho->range,
                                      nfat_arch,
                                      magic_is_big_endian(magic),
@@ -1036,15 +1083,15 @@ macho_file_parse_from_file(struct tbd_create_info *__notnull const info_in,
         }
 
         /*
-         * If exports and undefineds were created with a full arch-set, they are
-         * already sorted.
+         * If exports and undefineds were created with a full arch-set, only the
+         * symbols need to be sorted.
          */
 
         if (tbd_options.ignore_targets) {
             info_in->flags.uses_full_targets = true;
-        } else {
-            tbd_ci_sort_info(info_in);
         }
+
+        tbd_ci_sort_info(info_in);
     } else {
         const struct mach_header header = macho->header;
         if (is_invalid_filetype(header.filetype)) {
@@ -1070,7 +1117,7 @@ macho_file_parse_from_file(struct tbd_create_info *__notnull const info_in,
         }
 
         ret = parse_thin_file(info_in,
-                              fd,
+                              map,
                               macho->range,
                               &header,
                               arch,
@@ -1097,11 +1144,102 @@ macho_file_parse_from_file(struct tbd_create_info *__notnull const info_in,
         }
 
         info_in->flags.uses_full_targets = true;
+        tbd_ci_sort_info(info_in);
     }
 
     return E_MACHO_FILE_PARSE_OK;
 }
 
+enum macho_file_parse_result
+macho_file_parse_from_file(struct tbd_create_info *__notnull const info_in,
+                           struct macho_file *__notnull const macho,
+                           const struct macho_file_parse_extra_args extra,
+                           const struct tbd_parse_options tbd_options,
+                           struct macho_file_parse_options options)
+{
+    /*
+     * Map the file once, and parse every arch out of the map, instead of
+     * seeking and reading for every header, load-command list, export-trie and
+     * symbol-table.
+     */
+
+    struct tbd_stats *const stats = info_in->stats;
+    enum tbd_stats_phase prev_phase = TBD_STATS_PHASE_NONE;
+
+    if (stats != NULL) {
+        prev_phase = tbd_stats_enter_phase(stats, TBD_STATS_PHASE_OPEN);
+    }
+
+    const uint64_t map_size = macho->range.end;
+    uint8_t *const map =
+        mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, macho->fd, 0);
+
+    if (map == MAP_FAILED) {
+        if (stats != NULL) {
+            tbd_stats_leave_phase(stats, prev_phase);
+        }
+
+        return E_MACHO_FILE_PARSE_MMAP_FAIL;
+    }
+
+    /*
+     * The map doesn't outlive this call, so all strings have to be copied.
+     */
+
+    options.copy_strings_in_map = true;
+
+    /*
+     * Everything parsed out of the map, besides what has its own phase, is
+     * counted as parsing the load-commands.
+     */
+
+    enum tbd_stats_phase map_phase = TBD_STATS_PHASE_NONE;
+    if (stats != NULL) {
+        map_phase =
+            tbd_stats_enter_phase(stats, TBD_STATS_PHASE_LOAD_COMMANDS);
+    }
+
+    const enum macho_file_parse_result parse_result =
+        parse_macho_from_map(info_in, macho, map, extra, tbd_options, options);
+
+    if (stats != NULL) {
+        tbd_stats_leave_phase(stats, map_phase);
+    }
+
+    munmap(map, map_size);
+    if (stats != NULL) {
+        tbd_stats_leave_phase(stats, prev_phase);
+    }
+
+    return parse_result;
+}
+
+enum macho_file_parse_result
+macho_file_parse_from_map(struct tbd_create_info *__notnull const info_in,
+                          const struct macho_file *__notnull const macho,
+                          const uint8_t *__notnull const map,
+                          const struct macho_file_parse_extra_args extra,
+                          const struct tbd_parse_options tbd_options,
+                          const struct macho_file_parse_options options)
+{
+    struct tbd_stats *const stats = info_in->stats;
+    enum tbd_stats_phase prev_phase = TBD_STATS_PHASE_NONE;
+
+    if (stats != NULL) {
+        prev_phase =
+            tbd_stats_enter_phase(stats, TBD_STATS_PHASE_LOAD_COMMANDS);
+    }
+
+    const enum macho_file_parse_result parse_result =
+        parse_macho_from_map(info_in, macho, map, extra, tbd_options, options);
+
+    if (stats != NULL) {
+        tbd_stats_leave_phase(stats, prev_phase);
+    }
+
+    return parse_result;
+}
+
 static bool magic_is_fat_32(const uint32_t magic) {
     switch (magic) {
         case FAT_MAGIC:
@@ -7,14 +7,15 @@
 //
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "array.h"
 #include "dsc_image.h"
 #include "guard_overflow.h"
 #include "likely.h"
 #include "macho_file.h"
 #include "macho_file_parse_export_trie.h"
-#include "our_io.h"
 #include "string_buffer.h"
 
 static inline uint8_t uleb_byte_get_has_next(const uint8_t byte) {
@@ -25,6 +26,60 @@ static inline uint8_t uleb_byte_get_bits(const uint8_t byte) {
     return (byte & 0x7f);
 }
 
+/*
+ * When at least 8 bytes are available, the uleb128 is decoded 8 bytes at a
+ * time. The terminating byte is the first byte without its MSB set, which is
+ * found by the lowest set bit of the inverted MSBs.
+ *
+ * The 7 bits of every byte are then packed together by shifting out the gaps
+ * left by the MSBs, first in pairs of bytes, then in pairs of 14 bits, and
+ * finally in pairs of 28 bits.
+ *
+ * This requires a little-endian host, where the first byte of the uleb128 is
+ * the lowest byte of the loaded word.
+ */
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define ULEB_WORD_DECODE 1
+#endif
+
+#if defined(ULEB_WORD_DECODE)
+
+static const uint64_t uleb_word_msb_mask = 0x8080808080808080;
+
+static inline uint64_t uleb_word_load(const uint8_t *__notnull const iter) {
+    uint64_t word = 0;
+    memcpy(&word, iter, sizeof(word));
+
+    return word;
+}
+
+/*
+ * Returns the amount of bytes in the uleb128 starting at the word's first byte,
+ * or 0 if the uleb128 doesn't terminate within the word.
+ */
+
+static inline uint64_t uleb_word_get_size(const uint64_t word) {
+    const uint64_t terminators = ~word & uleb_word_msb_mask;
+    if (terminators == 0) {
+        return 0;
+    }
+
+    return ((uint64_t)__builtin_ctzll(terminators) / 8) + 1;
+}
+
+static inline uint64_t
+uleb_word_get_value(uint64_t word, const uint64_t size) {
+    word &= (UINT64_MAX >> (64 - (size * 8))) & ~uleb_word_msb_mask;
+    word = (word & 0x007f007f007f007f) | ((word & 0x7f007f007f007f00) >> 1);
+    word = (word & 0x00003fff00003fff) | ((word & 0x3fff00003fff0000) >> 2);
+    word = (word & 0x000000000fffffff) | ((word & 0x0fffffff00000000) >> 4);
+
+    return word;
+}
+
+#endif
+
 const uint8_t *
 read_uleb128_32(const uint8_t *__notnull iter,
                 const uint8_t *__notnull const end,
@@ -60,15 +115,39 @@ read_uleb128_32(const uint8_t *__notnull iter,
      * are stored in the 1st component.
      */
 
+#if defined(ULEB_WORD_DECODE)
+    if (likely(end - iter >= 8)) {
+        /*
+         * A 32-bit uleb128 is at most 5 bytes long, so the word always holds
+         * the entire uleb128 of a valid value.
+         */
+
+        const uint64_t word = uleb_word_load(iter);
+        const uint64_t size = uleb_word_get_size(word);
+
+        if (unlikely(size == 0 || size > 5)) {
+            return NULL;
+        }
+
+        const uint64_t value = uleb_word_get_value(word, size);
+        if (unlikely(value > UINT32_MAX)) {
+            return NULL;
+        }
+
+        *result_out = (uint32_t)value;
+        return iter + size;
+    }
+#endif
+
     uint8_t byte = *iter;
     uint8_t has_next = uleb_byte_get_has_next(byte);
 
-    iter++;
     if (has_next == 0) {
         *result_out = byte;
-        return iter;
+        return iter + 1;
     }
 
+    iter++;
     if (unlikely(iter == end)) {
         return NULL;
     }
@@ -148,15 +227,32 @@ read_uleb128_64(const uint8_t *__notnull iter,
      * are stored in the 1st component.
      */
 
+#if defined(ULEB_WORD_DECODE)
+    if (likely(end - iter >= 8)) {
+        /*
+         * Only uleb128s of values of 2^56 or larger don't terminate within the
+         * word. These are rare, and are left to the byte-by-byte loop below.
+         */
+
+        const uint64_t word = uleb_word_load(iter);
+        const uint64_t size = uleb_word_get_size(word);
+
+        if (likely(size != 0)) {
+            *result_out = uleb_word_get_value(word, size);
+            return iter + size;
+        }
+    }
+#endif
+
     uint8_t byte = *iter;
     uint8_t has_next = uleb_byte_get_has_next(byte);
 
-    iter++;
     if (has_next == 0) {
         *result_out = byte;
-        return iter;
+        return iter + 1;
     }
 
+    iter++;
     if (unlikely(iter == end)) {
         return NULL;
     }
@@ -204,6 +300,15 @@ read_uleb128_64(const uint8_t *__notnull iter,
 const uint8_t *
 skip_uleb128(const uint8_t *__notnull iter, const uint8_t *__notnull const end)
 {
+#if defined(ULEB_WORD_DECODE)
+    if (likely(end - iter >= 8)) {
+        const uint64_t size = uleb_word_get_size(uleb_word_load(iter));
+        if (likely(size != 0)) {
+            return iter + size;
+        }
+    }
+#endif
+
     for (uint8_t i = 0; i != 9; i++) {
         const uint8_t byte = *iter;
         const uint8_t has_next = uleb_byte_get_has_next(byte);
@@ -221,16 +326,25 @@ skip_uleb128(const uint8_t *__notnull iter, const uint8_t *__notnull const end)
     return NULL;
 }
 
+/*
+ * A tree-node may not overlap any of the tree-nodes on the path leading to it,
+ * or else the export-trie loops back onto itself. We track the bytes of the
+ * tree-nodes on the current path in a bitmap, one bit per byte, marking a
+ * tree-node's bytes when its frame is pushed, and unmarking them when its frame
+ * is popped.
+ *
+ * Tree-nodes shared by multiple parents, which don't form a loop, are still
+ * allowed.
+ */
+
 static bool
-has_overlapping_range(const struct range list[const 128],
-                      const uint64_t count,
-                      const struct range range)
+trie_bytes_are_marked(const uint64_t *__notnull const path,
+                      const uint64_t begin,
+                      const uint64_t end)
 {
-    const struct range *l_range = list;
-    const struct range *const end = list + count;
-
-    for (; l_range != end; l_range++) {
-        if (ranges_overlap(*l_range, range)) {
+    for (uint64_t i = begin; i != end; i++) {
+        const uint64_t mask = (1ull << (i % 64));
+        if (unlikely(path[i / 64] & mask)) {
             return true;
         }
     }
@@ -238,6 +352,16 @@ has_overlapping_range(const struct range list[const 128],
     return false;
 }
 
+static void
+toggle_trie_bytes(uint64_t *__notnull const path,
+                  const uint64_t begin,
+                  const uint64_t end)
+{
+    for (uint64_t i = begin; i != end; i++) {
+        path[i / 64] ^= (1ull << (i % 64));
+    }
+}
+
 /*
  * The export-trie is a compressed tree designed to store symbols and other info
  * in an efficient fashion.
@@ -360,21 +484,54 @@ has_overlapping_range(const struct range list[const 128],
  *     };
  */
 
-enum macho_file_parse_result
-parse_trie_node(struct tbd_create_info *__notnull const info_in,
-                const uint64_t arch_index,
-                const uint8_t *__notnull const start,
+/*
+ * Instead of recursing once per child, the trie is walked with an explicit
+ * stack, which holds one frame for every tree-node whose children we have not
+ * yet finished parsing.
+ *
+ * Because of this, there's no limit to how deep an export-trie can be.
+ */
+
+struct trie_frame {
+    const uint8_t *iter;
+    uint64_t prefix_length;
+
+    uint32_t node_begin;
+    uint32_t node_end;
+
+    uint8_t children_left;
+};
+
+/*
+ * Because tree-nodes may be shared, a malformed export-trie could have us visit
+ * the same tree-nodes an exponential amount of times. Stop walking once we've
+ * visited more tree-nodes than this many times the export-trie's size.
+ */
+
+static const uint64_t trie_visits_per_byte = 8;
+
+struct trie_walk_info {
+    struct tbd_create_info *info_in;
+    uint64_t arch_index;
+
+    const uint8_t *start;
+    const uint8_t *end;
+
+    uint64_t *path;
+    struct string_buffer *sb_buffer;
+
+    struct tbd_parse_options options;
+};
+
+static enum macho_file_parse_result
+parse_trie_node(const struct trie_walk_info *__notnull const walk,
                 const uint32_t offset,
-                const uint8_t *__notnull const end,
-                struct range node_ranges[const 128],
-                uint8_t node_ranges_count,
-                const uint32_t export_size,
-                struct string_buffer *__notnull const sb_buffer,
-                const struct tbd_parse_options options)
+                struct trie_frame *__notnull const frame_out)
 {
-    const uint8_t *iter = start + offset;
-    uint64_t iter_size = 0;
+    const uint8_t *const end = walk->end;
+    const uint8_t *iter = walk->start + offset;
 
+    uint64_t iter_size = 0;
     if ((iter = read_uleb128_64(iter, end, &iter_size)) == NULL) {
         return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
     }
@@ -383,32 +540,12 @@ parse_trie_node(struct tbd_create_info *__notnull const info_in,
         return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
     }
 
-    uint32_t iter_off_end = offset;
-    if (guard_overflow_add(&iter_off_end, iter_size)) {
-        return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
-    }
-
     const uint8_t *const node_start = iter;
-    const uint8_t *const children = iter + iter_size;
-
-    if (unlikely(children > end)) {
+    if (unlikely(iter_size >= (uint64_t)(end - node_start))) {
         return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
     }
 
-    const struct range export_range = {
-        .begin = offset,
-        .end = offset + iter_size
-    };
-
-    const bool has_overlap_range =
-        has_overlapping_range(node_ranges, node_ranges_count, export_range);
-
-    if (unlikely(has_overlap_range)) {
-        return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
-    }
-
-    node_ranges[node_ranges_count] = export_range;
-    node_ranges_count++;
+    struct string_buffer *const sb_buffer = walk->sb_buffer;
 
     const bool is_export_info = (iter_size != 0);
     if (is_export_info) {
@@ -519,48 +656,124 @@ parse_trie_node(struct tbd_create_info *__notnull const info_in,
         }
 
         const enum tbd_ci_add_data_result add_symbol_result =
-            tbd_ci_add_symbol_with_info_and_len(info_in,
+            tbd_ci_add_symbol_with_info_and_len(walk->info_in,
                                                 sb_buffer->data,
                                                 sb_buffer->length,
-                                                arch_index,
+                                                walk->arch_index,
                                                 predefined_type,
                                                 meta_type,
                                                 true,
-                                                options);
+                                                walk->options);
 
         if (add_symbol_result != E_TBD_CI_ADD_DATA_OK) {
             return E_MACHO_FILE_PARSE_CREATE_SYMBOL_LIST_FAIL;
         }
     }
 
-    const uint8_t children_count = *iter;
-    if (children_count == 0) {
-        return E_MACHO_FILE_PARSE_OK;
-    }
-
     /*
-     * From dyld, don't parse an export-trie that gets too deep.
+     * The children-count byte directly follows the terminal info, and so must
+     * come before the end of the export-trie.
      */
 
-    if (unlikely(node_ranges_count == 128)) {
+    const uint8_t children_count = *iter;
+    iter++;
+
+    const uint32_t node_end = (uint32_t)(iter - walk->start);
+    if (unlikely(trie_bytes_are_marked(walk->path, offset, node_end))) {
         return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
     }
 
-    iter++;
-    if (unlikely(iter == end)) {
-        return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
+    if (children_count != 0) {
+        if (unlikely(iter == end)) {
+            return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
+        }
     }
 
-    /*
-     * Every child shares only the same symbol-prefix, and only the same
-     * node-ranges, both of which we need to restore to its original amount
-     * after every loop.
-     */
+    frame_out->iter = iter;
+    frame_out->prefix_length = sb_buffer->length;
+    frame_out->node_begin = offset;
+    frame_out->node_end = node_end;
+    frame_out->children_left = children_count;
+
+    return E_MACHO_FILE_PARSE_OK;
+}
+
+static enum macho_file_parse_result
+push_trie_frame(const struct trie_walk_info *__notnull const walk,
+                struct array *__notnull const stack,
+                const struct trie_frame *__notnull const frame)
+{
+    const enum array_result add_frame_result =
+        array_add_item(stack, sizeof(*frame), frame, NULL);
+
+    if (unlikely(add_frame_result != E_ARRAY_OK)) {
+        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
+    }
+
+    toggle_trie_bytes(walk->path, frame->node_begin, frame->node_end);
+    return E_MACHO_FILE_PARSE_OK;
+}
+
+static enum macho_file_parse_result
+walk_trie_nodes(const struct trie_walk_info *__notnull const walk,
+                struct array *__notnull const stack,
+                const uint32_t export_size)
+{
+    struct trie_frame root = {};
+    const enum macho_file_parse_result parse_root_result =
+        parse_trie_node(walk, 0, &root);
+
+    if (unlikely(parse_root_result != E_MACHO_FILE_PARSE_OK)) {
+        return parse_root_result;
+    }
+
+    if (root.children_left == 0) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    const enum macho_file_parse_result push_root_result =
+        push_trie_frame(walk, stack, &root);
+
+    if (unlikely(push_root_result != E_MACHO_FILE_PARSE_OK)) {
+        return push_root_result;
+    }
+
+    const uint8_t *const end = walk->end;
+    struct string_buffer *const sb_buffer = walk->sb_buffer;
+
+    uint64_t visits_left = trie_visits_per_byte * export_size;
+    while (stack->item_count != 0) {
+        struct trie_frame *const frame =
+            array_get_back(stack, sizeof(struct trie_frame));
+
+        /*
+         * Pop the frame once all of its children have been parsed, so its
+         * tree-node is no longer part of the current path.
+         */
+
+        if (frame->children_left == 0) {
+            toggle_trie_bytes(walk->path, frame->node_begin, frame->node_end);
+            array_trim_to_item_count(stack,
+                                     sizeof(struct trie_frame),
+                                     stack->item_count - 1);
+
+            continue;
+        }
+
+        if (unlikely(visits_left == 0)) {
+            return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
+        }
+
+        visits_left--;
+
+        /*
+         * Every child shares only the same symbol-prefix, which we restore to
+         * its original length before parsing every child.
+         */
 
-    const uint32_t orig_buff_length = (uint32_t)sb_buffer->length;
-    const uint8_t orig_node_ranges_count = (uint8_t)node_ranges_count;
+        const uint8_t *iter = frame->iter;
+        sb_buffer->length = frame->prefix_length;
 
-    for (uint8_t i = 0; i != children_count; i++) {
         /*
          * Pass the length-calculation of the string to strnlen in the hopes of
          * better performance.
@@ -595,8 +808,9 @@ parse_trie_node(struct tbd_create_info *__notnull const info_in,
             return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
         }
 
+        const uint8_t children_left = frame->children_left - 1;
         if (unlikely(iter == end)) {
-            if (i != children_count - 1) {
+            if (children_left != 0) {
                 return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
             }
         }
@@ -605,105 +819,66 @@ parse_trie_node(struct tbd_create_info *__notnull const info_in,
             return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
         }
 
-        const enum macho_file_parse_result parse_export_result =
-            parse_trie_node(info_in,
-                            arch_index,
-                            start,
-                            next,
-                            end,
-                            node_ranges,
-                            node_ranges_count,
-                            export_size,
-                            sb_buffer,
-                            options);
-
-        if (unlikely(parse_export_result != E_MACHO_FILE_PARSE_OK)) {
-            return parse_export_result;
-        }
-
-        node_ranges_count = orig_node_ranges_count;
-        sb_buffer->length = orig_buff_length;
-    }
-
-    return E_MACHO_FILE_PARSE_OK;
-}
+        frame->iter = iter;
+        frame->children_left = children_left;
 
-enum macho_file_parse_result
-macho_file_parse_export_trie_from_file(
-    const struct macho_file_parse_export_trie_args args,
-    const int fd,
-    const uint64_t base_offset)
-{
-    /*
-     * Validate the dyld-info exports-range.
-     */
+        struct trie_frame child = {};
+        const enum macho_file_parse_result parse_child_result =
+            parse_trie_node(walk, next, &child);
 
-    if (args.export_size < 2) {
-        return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
-    }
-
-    uint64_t export_end = args.export_off;
-    if (guard_overflow_add(&export_end, args.export_size)) {
-        return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
-    }
-
-    uint64_t full_export_off = base_offset;
-    if (guard_overflow_add(&full_export_off, args.export_off)) {
-        return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
-    }
+        if (unlikely(parse_child_result != E_MACHO_FILE_PARSE_OK)) {
+            return parse_child_result;
+        }
 
-    uint64_t full_export_end = base_offset;
-    if (guard_overflow_add(&full_export_end, export_end)) {
-        return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
-    }
+        if (child.children_left == 0) {
+            continue;
+        }
 
-    const struct range full_export_range = {
-        .begin = full_export_off,
-        .end = full_export_end
-    };
+        const enum macho_file_parse_result push_child_result =
+            push_trie_frame(walk, stack, &child);
 
-    if (!range_contains_other(args.available_range, full_export_range)) {
-        return E_MACHO_FILE_PARSE_INVALID_RANGE;
+        if (unlikely(push_child_result != E_MACHO_FILE_PARSE_OK)) {
+            return push_child_result;
+        }
     }
 
-    if (our_lseek(fd, full_export_off, SEEK_SET) < 0) {
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
-    }
+    return E_MACHO_FILE_PARSE_OK;
+}
 
-    uint8_t *const export_trie = malloc(args.export_size);
-    if (export_trie == NULL) {
+static enum macho_file_parse_result
+parse_export_trie(
+    const struct macho_file_parse_export_trie_args *__notnull const args,
+    const uint8_t *__notnull const export_trie)
+{
+    const uint32_t export_size = args->export_size;
+    uint64_t *const path = calloc((export_size + 63) / 64, sizeof(uint64_t));
+    if (path == NULL) {
         return E_MACHO_FILE_PARSE_ALLOC_FAIL;
     }
 
-    if (our_read(fd, export_trie, args.export_size) < 0) {
-        free(export_trie);
-        return E_MACHO_FILE_PARSE_READ_FAIL;
-    }
+    struct string_buffer *const sb_buffer = args->sb_buffer;
+    const struct trie_walk_info walk = {
+        .info_in = args->info_in,
+        .arch_index = args->arch_index,
+        .start = export_trie,
+        .end = export_trie + export_size,
+        .path = path,
+        .sb_buffer = sb_buffer,
+        .options = args->tbd_options
+    };
 
-    struct range node_ranges[128] = {};
+    const uint64_t orig_buff_length = sb_buffer->length;
+    struct array stack = {};
 
-    const uint8_t node_ranges_count = 0;
-    const uint8_t *const end = export_trie + args.export_size;
+    const enum macho_file_parse_result walk_result =
+        walk_trie_nodes(&walk, &stack, export_size);
 
-    const enum macho_file_parse_result parse_node_result =
-        parse_trie_node(args.info_in,
-                        args.arch_index,
-                        export_trie,
-                        0,
-                        end,
-                        node_ranges,
-                        node_ranges_count,
-                        args.export_size,
-                        args.sb_buffer,
-                        args.tbd_options);
-
-    free(export_trie);
+    sb_buffer->length = orig_buff_length;
 
-    if (parse_node_result != E_MACHO_FILE_PARSE_OK) {
-        return parse_node_result;
-    }
+    array_destroy(&stack);
+    free(path);
 
-    return E_MACHO_FILE_PARSE_OK;
+    return walk_result;
 }
 
 enum macho_file_parse_result
@@ -733,23 +908,20 @@ macho_file_parse_export_trie_from_map(
         return E_MACHO_FILE_PARSE_INVALID_EXPORTS_TRIE;
     }
 
-    const uint8_t *const export_trie = map + args.export_off;
-    const uint8_t *const end = export_trie + args.export_size;
+    struct tbd_stats *const stats = args.info_in->stats;
+    enum tbd_stats_phase prev_phase = TBD_STATS_PHASE_NONE;
 
-    struct range node_ranges[128] = {};
-    uint8_t node_ranges_count = 0;
+    if (stats != NULL) {
+        prev_phase = tbd_stats_enter_phase(stats, TBD_STATS_PHASE_EXPORT_TRIE);
+    }
 
+    const uint8_t *const export_trie = map + args.export_off;
     const enum macho_file_parse_result parse_node_result =
-        parse_trie_node(args.info_in,
-                        args.arch_index,
-                        export_trie,
-                        0,
-                        end,
-                        node_ranges,
-                        node_ranges_count,
-                        args.export_size,
-                        args.sb_buffer,
-                        args.tbd_options);
+        parse_export_trie(&args, export_trie);
+
+    if (stats != NULL) {
+        tbd_stats_leave_phase(stats, prev_phase);
+    }
 
     if (parse_node_result != E_MACHO_FILE_PARSE_OK) {
         return parse_node_result;
@@ -10,9 +10,9 @@
 #include <string.h>
 #include "mach-o/loader.h"
 
-#include "copy.h"
 #include "macho_file_parse_single_lc.h"
 #include "macho_file.h"
+#include "string_arena.h"
 
 #include "swap.h"
 #include "tbd.h"
@@ -118,6 +118,7 @@ add_export_to_info(struct tbd_create_info *__notnull const info_in,
                                     arch_index,
                                     type,
                                     TBD_SYMBOL_META_TYPE_EXPORT,
+                                    true,
                                     options);
 
     if (add_export_result != E_TBD_CI_ADD_DATA_OK) {
@@ -546,7 +547,11 @@ macho_file_parse_single_lc(
 
                 if (!ignore_install_name) {
                     if (parse_info->options.copy_strings) {
-                        install_name = alloc_and_copy(install_name, length);
+                        install_name =
+                            string_arena_copy(&info_in->string_arena,
+                                              install_name,
+                                              length);
+
                         if (install_name == NULL) {
                             return E_MACHO_FILE_PARSE_ALLOC_FAIL;
                         }
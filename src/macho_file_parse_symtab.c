@@ -6,12 +6,9 @@
 //  Copyright © 2018 - 2020 inoahdev. All rights reserved.
 //
 
-#include <fcntl.h>
-
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 #include "mach-o/nlist.h"
 #include "arch_info.h"
@@ -21,7 +18,6 @@
 #include "likely.h"
 
 #include "macho_file_parse_symtab.h"
-#include "our_io.h"
 
 #include "range.h"
 #include "swap.h"
@@ -57,6 +53,7 @@ handle_symbol(struct tbd_create_info *__notnull const info_in,
               const uint16_t n_desc,
               const uint8_t n_type,
               const bool is_undef,
+              const bool copy_string,
               const struct tbd_parse_options options)
 {
     /*
@@ -101,6 +98,7 @@ handle_symbol(struct tbd_create_info *__notnull const info_in,
                                     predefined_type,
                                     meta_type,
                                     (is_not_exported == 0),
+                                    copy_string,
                                     options);
 
     if (add_symbol_result != E_TBD_CI_ADD_DATA_OK) {
@@ -131,7 +129,8 @@ loop_nlist_32(struct tbd_create_info *__notnull const info_in,
               const uint32_t strsize,
               const uint64_t arch_index,
               const struct tbd_parse_options options,
-              const bool is_big_endian)
+              const bool is_big_endian,
+              const bool copy_strings)
 {
     const enum tbd_version version = info_in->version;
 
@@ -195,6 +194,7 @@ loop_nlist_32(struct tbd_create_info *__notnull const info_in,
                               (uint16_t)n_desc,
                               n_type,
                               is_undef,
+                              copy_strings,
                               options);
 
             if (unlikely(handle_symbol_result != E_MACHO_FILE_PARSE_OK)) {
@@ -258,6 +258,7 @@ loop_nlist_32(struct tbd_create_info *__notnull const info_in,
                               (uint16_t)n_desc,
                               n_type,
                               is_undef,
+                              copy_strings,
                               options);
 
             if (unlikely(handle_symbol_result != E_MACHO_FILE_PARSE_OK)) {
@@ -277,7 +278,8 @@ loop_nlist_64(struct tbd_create_info *__notnull const info_in,
               const uint32_t strsize,
               const uint64_t arch_index,
               const struct tbd_parse_options options,
-              const bool is_big_endian)
+              const bool is_big_endian,
+              const bool copy_strings)
 {
     const enum tbd_version version = info_in->version;
 
@@ -341,6 +343,7 @@ loop_nlist_64(struct tbd_create_info *__notnull const info_in,
                               n_desc,
                               n_type,
                               is_undef,
+                              copy_strings,
                               options);
 
             if (unlikely(handle_symbol_result != E_MACHO_FILE_PARSE_OK)) {
@@ -404,6 +407,7 @@ loop_nlist_64(struct tbd_create_info *__notnull const info_in,
                               n_desc,
                               n_type,
                               is_undef,
+                              copy_strings,
                               options);
 
             if (unlikely(handle_symbol_result != E_MACHO_FILE_PARSE_OK)) {
@@ -415,270 +419,6 @@ loop_nlist_64(struct tbd_create_info *__notnull const info_in,
     return E_MACHO_FILE_PARSE_OK;
 }
 
-enum macho_file_parse_result
-macho_file_parse_symtab_from_file(
-    const struct macho_file_parse_symtab_args *__notnull const args,
-    const int fd,
-    const uint64_t base_offset)
-{
-    const uint32_t nsyms = args->nsyms;
-    if (unlikely(nsyms == 0)) {
-        return E_MACHO_FILE_PARSE_OK;
-    }
-
-    /*
-     * Ensure the string-table and symbol-table can be fully contained within
-     * the mach-o file.
-     */
-
-    uint32_t symbol_table_size = sizeof(struct nlist);
-    if (guard_overflow_mul(&symbol_table_size, nsyms)) {
-        return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
-    }
-
-    uint64_t absolute_symoff = base_offset;
-    if (guard_overflow_add(&absolute_symoff, args->symoff)) {
-        return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
-    }
-
-    uint64_t symbol_table_end = absolute_symoff;
-    if (guard_overflow_add(&symbol_table_end, symbol_table_size)) {
-        return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
-    }
-
-    const struct range symbol_table_range = {
-        .begin = absolute_symoff,
-        .end = symbol_table_end
-    };
-
-    /*
-     * Validate that the symbol-table range is fully within the provided
-     * available-range.
-     */
-
-    const struct range available_range = args->available_range;
-    if (!range_contains_other(available_range, symbol_table_range)) {
-        return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
-    }
-
-    uint64_t absolute_stroff = base_offset;
-    if (guard_overflow_add(&absolute_stroff, args->stroff)) {
-        return E_MACHO_FILE_PARSE_INVALID_STRING_TABLE;
-    }
-
-    const uint32_t strsize = args->strsize;
-    uint64_t string_table_end = absolute_stroff;
-
-    if (guard_overflow_add(&string_table_end, strsize)) {
-        return E_MACHO_FILE_PARSE_INVALID_STRING_TABLE;
-    }
-
-    const struct range string_table_range = {
-        .begin = absolute_stroff,
-        .end = string_table_end
-    };
-
-    /*
-     * Validate that the string-table range is fully within the given
-     * available-range.
-     */
-
-    if (!range_contains_other(available_range, string_table_range)) {
-        return E_MACHO_FILE_PARSE_INVALID_STRING_TABLE;
-    }
-
-    /*
-     * Ensure the string-table and symbol-table don't overlap.
-     */
-
-    if (ranges_overlap(symbol_table_range, string_table_range)) {
-        return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
-    }
-
-    if (our_lseek(fd, absolute_symoff, SEEK_SET) < 0) {
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
-    }
-
-    struct nlist *const symbol_table = malloc(symbol_table_size);
-    if (symbol_table == NULL) {
-        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
-    }
-
-    if (our_read(fd, symbol_table, symbol_table_size) < 0) {
-        free(symbol_table);
-        return E_MACHO_FILE_PARSE_READ_FAIL;
-    }
-
-    if (our_lseek(fd, absolute_stroff, SEEK_SET) < 0) {
-        free(symbol_table);
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
-    }
-
-    char *const string_table = malloc(strsize);
-    if (string_table == NULL) {
-        free(symbol_table);
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
-    }
-
-    if (our_read(fd, string_table, strsize) < 0) {
-        free(symbol_table);
-        free(string_table);
-
-        return E_MACHO_FILE_PARSE_READ_FAIL;
-    }
-
-    const enum macho_file_parse_result loop_nlist_result =
-        loop_nlist_32(args->info_in,
-                      symbol_table,
-                      string_table,
-                      nsyms,
-                      strsize,
-                      args->arch_index,
-                      args->tbd_options,
-                      args->is_big_endian);
-
-    free(symbol_table);
-    free(string_table);
-
-    if (loop_nlist_result != E_MACHO_FILE_PARSE_OK) {
-        return loop_nlist_result;
-    }
-
-    return E_MACHO_FILE_PARSE_OK;
-}
-
-enum macho_file_parse_result
-macho_file_parse_symtab_64_from_file(
-    const struct macho_file_parse_symtab_args *__notnull const args,
-    const int fd,
-    const uint64_t base_offset)
-{
-    const uint32_t nsyms = args->nsyms;
-    if (unlikely(nsyms == 0)) {
-        return E_MACHO_FILE_PARSE_OK;
-    }
-
-    /*
-     * Ensure the string-table and symbol-table can be fully contained within
-     * the mach-o file.
-     */
-
-    uint64_t symbol_table_size = sizeof(struct nlist_64);
-    if (guard_overflow_mul(&symbol_table_size, nsyms)) {
-        return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
-    }
-
-    uint64_t absolute_symoff = base_offset;
-    if (guard_overflow_add(&absolute_symoff, args->symoff)) {
-        return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
-    }
-
-    uint64_t symbol_table_end = absolute_symoff;
-    if (guard_overflow_add(&symbol_table_end, symbol_table_size)) {
-        return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
-    }
-
-    const struct range symbol_table_range = {
-        .begin = absolute_symoff,
-        .end = symbol_table_end
-    };
-
-    /*
-     * Validate that the symbol-table range is fully within the provided
-     * available-range.
-     */
-
-    const struct range available_range = args->available_range;
-    if (!range_contains_other(available_range, symbol_table_range)) {
-        return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
-    }
-
-    uint64_t absolute_stroff = base_offset;
-    if (guard_overflow_add(&absolute_stroff, args->stroff)) {
-        return E_MACHO_FILE_PARSE_INVALID_STRING_TABLE;
-    }
-
-    const uint32_t strsize = args->strsize;
-    uint64_t string_table_end = absolute_stroff;
-
-    if (guard_overflow_add(&string_table_end, strsize)) {
-        return E_MACHO_FILE_PARSE_INVALID_STRING_TABLE;
-    }
-
-    const struct range string_table_range = {
-        .begin = absolute_stroff,
-        .end = string_table_end
-    };
-
-    /*
-     * Validate that the string-table range is fully within the given
-     * available-range.
-     */
-
-    if (!range_contains_other(available_range, string_table_range)) {
-        return E_MACHO_FILE_PARSE_INVALID_STRING_TABLE;
-    }
-
-    /*
-     * Ensure the string-table and symbol-table don't overlap.
-     */
-
-    if (ranges_overlap(symbol_table_range, string_table_range)) {
-        return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
-    }
-
-    if (our_lseek(fd, absolute_symoff, SEEK_SET) < 0) {
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
-    }
-
-    struct nlist_64 *const symbol_table = malloc(symbol_table_size);
-    if (symbol_table == NULL) {
-        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
-    }
-
-    if (our_read(fd, symbol_table, symbol_table_size) < 0) {
-        free(symbol_table);
-        return E_MACHO_FILE_PARSE_READ_FAIL;
-    }
-
-    if (our_lseek(fd, absolute_stroff, SEEK_SET) < 0) {
-        free(symbol_table);
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
-    }
-
-    char *const string_table = malloc(strsize);
-    if (string_table == NULL) {
-        free(symbol_table);
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
-    }
-
-    if (our_read(fd, string_table, strsize) < 0) {
-        free(symbol_table);
-        free(string_table);
-
-        return E_MACHO_FILE_PARSE_READ_FAIL;
-    }
-
-    const enum macho_file_parse_result loop_nlist_result =
-        loop_nlist_64(args->info_in,
-                      symbol_table,
-                      string_table,
-                      nsyms,
-                      strsize,
-                      args->arch_index,
-                      args->tbd_options,
-                      args->is_big_endian);
-
-    free(symbol_table);
-    free(string_table);
-
-    if (loop_nlist_result != E_MACHO_FILE_PARSE_OK) {
-        return loop_nlist_result;
-    }
-
-    return E_MACHO_FILE_PARSE_OK;
-}
-
 enum macho_file_parse_result
 macho_file_parse_symtab_from_map(
     const struct macho_file_parse_symtab_args *__notnull const args,
@@ -748,7 +488,8 @@ macho_file_parse_symtab_from_map(
                       strsize,
                       args->arch_index,
                       args->tbd_options,
-                      args->is_big_endian);
+                      args->is_big_endian,
+                      args->copy_strings);
 
     if (loop_nlist_result != E_MACHO_FILE_PARSE_OK) {
         return loop_nlist_result;
@@ -826,7 +567,8 @@ macho_file_parse_symtab_64_from_map(
                       strsize,
                       args->arch_index,
                       args->tbd_options,
-                      args->is_big_endian);
+                      args->is_big_endian,
+                      args->copy_strings);
 
     if (loop_nlist_result != E_MACHO_FILE_PARSE_OK) {
         return loop_nlist_result;
@@ -11,6 +11,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include <stdlib.h>
 #include <string.h>
@@ -27,8 +28,10 @@
 #include "parse_macho_for_main.h"
 
 #include "request_user_input.h"
+#include "stdin_file.h"
 #include "tbd.h"
 #include "tbd_for_main.h"
+#include "tbd_stats.h"
 #include "tbd_write.h"
 #include "unused.h"
 #include "usage.h"
@@ -41,28 +44,45 @@ struct recurse_callback_info {
     FILE *combine_file;
     uint64_t files_parsed;
 
+    /*
+     * When combining while recursing with jobs, the buffer the documents of
+     * the file being parsed are written to, and NULL otherwise.
+     */
+
+    struct string_buffer *combine_sb;
+
     struct retained_user_info *retained;
     struct string_buffer *export_trie_sb;
+
+    /*
+     * Held while orig is read or modified when files are parsed by multiple
+     * threads, and NULL otherwise.
+     */
+
+    pthread_mutex_t *orig_lock;
+
+    /*
+     * Held while a dyld_shared_cache is parsed when files are parsed by
+     * multiple threads, and NULL otherwise.
+     */
+
+    pthread_mutex_t *dsc_lock;
 };
 
-static bool
-recurse_directory_callback(const char *__notnull const dir_path,
-                           const uint64_t dir_path_length,
-                           const int fd,
-                           struct dirent *const dirent,
-                           const uint64_t name_length,
-                           void *__notnull const callback_info)
+static void
+parse_recursed_file(struct recurse_callback_info *__notnull const recurse_info,
+                    const char *__notnull const dir_path,
+                    const uint64_t dir_path_length,
+                    const int fd,
+                    const char *__notnull const name,
+                    const uint64_t name_length)
 {
-    struct recurse_callback_info *const recurse_info =
-        (struct recurse_callback_info *)callback_info;
-
     struct tbd_for_main *const orig = recurse_info->orig;
     struct tbd_for_main *const tbd = recurse_info->tbd;
 
     struct retained_user_info *const retained = recurse_info->retained;
     struct magic_buffer magic_buffer = {};
 
-    const char *const name = dirent->d_name;
     const bool should_combine = tbd->options.combine_tbds;
 
     if (tbd->filetypes.macho) {
@@ -83,11 +103,13 @@ recurse_directory_callback(const char *__notnull const dir_path,
             .dont_handle_non_macho_error = true,
             .print_paths = true,
 
-            .export_trie_sb = recurse_info->export_trie_sb
+            .export_trie_sb = recurse_info->export_trie_sb,
+            .orig_lock = recurse_info->orig_lock
         };
 
         if (should_combine) {
             args.combine_file = recurse_info->combine_file;
+            args.combine_sb = recurse_info->combine_sb;
         }
 
         const enum parse_macho_for_main_result parse_as_macho_result =
@@ -101,8 +123,7 @@ recurse_directory_callback(const char *__notnull const dir_path,
 
                 recurse_info->files_parsed += 1;
                 close(fd);
-
-                return true;
+                return;
             }
 
             case E_PARSE_MACHO_FOR_MAIN_NOT_A_MACHO:
@@ -110,7 +131,7 @@ recurse_directory_callback(const char *__notnull const dir_path,
 
             case E_PARSE_MACHO_FOR_MAIN_OTHER_ERROR:
                 close(fd);
-                return true;
+                return;
         }
     }
 
@@ -133,16 +154,34 @@ recurse_directory_callback(const char *__notnull const dir_path,
             .dont_handle_non_dsc_error = true,
             .print_paths = true,
 
-            .export_trie_sb = recurse_info->export_trie_sb
+            .export_trie_sb = recurse_info->export_trie_sb,
+            .orig_lock = recurse_info->orig_lock
         };
 
         if (should_combine) {
             args.combine_file = recurse_info->combine_file;
+            args.combine_sb = recurse_info->combine_sb;
+        }
+
+        /*
+         * Every dyld_shared_cache marks the same dsc-image filters as its
+         * images are parsed, so only one is parsed at a time. orig is only
+         * locked while it's read or modified, so the other threads keep parsing
+         * files in the meantime.
+         */
+
+        pthread_mutex_t *const dsc_lock = recurse_info->dsc_lock;
+        if (dsc_lock != NULL) {
+            pthread_mutex_lock(dsc_lock);
         }
 
         const enum parse_dsc_for_main_result parse_as_dsc_result =
             parse_dsc_for_main_while_recursing(&args);
 
+        if (dsc_lock != NULL) {
+            pthread_mutex_unlock(dsc_lock);
+        }
+
         switch (parse_as_dsc_result) {
             case E_PARSE_DSC_FOR_MAIN_OK:
                 if (should_combine) {
@@ -151,15 +190,14 @@ recurse_directory_callback(const char *__notnull const dir_path,
 
                 recurse_info->files_parsed += 1;
                 close(fd);
-
-                return true;
+                return;
 
             case E_PARSE_DSC_FOR_MAIN_NOT_A_SHARED_CACHE:
                 break;
 
             case E_PARSE_DSC_FOR_MAIN_OTHER_ERROR:
                 close(fd);
-                return true;
+                return;
 
             /*
              * This error shouldn't be returned while recursing.
@@ -171,6 +209,26 @@ recurse_directory_callback(const char *__notnull const dir_path,
     }
 
     close(fd);
+}
+
+static bool
+recurse_directory_callback(const char *__notnull const dir_path,
+                           const uint64_t dir_path_length,
+                           const int fd,
+                           struct dirent *const dirent,
+                           const uint64_t name_length,
+                           void *__notnull const callback_info)
+{
+    struct recurse_callback_info *const recurse_info =
+        (struct recurse_callback_info *)callback_info;
+
+    parse_recursed_file(recurse_info,
+                        dir_path,
+                        dir_path_length,
+                        fd,
+                        dirent->d_name,
+                        name_length);
+
     return true;
 }
 
@@ -216,6 +274,420 @@ recurse_directory_fail_callback(const char *const dir_path,
     return true;
 }
 
+/*
+ * When recursing with jobs, the calling thread walks the directory and hands
+ * out the opened files to the workers through a bounded queue, so the amount of
+ * open, but not yet parsed, files stays bounded as well.
+ *
+ * When combining, every worker writes the documents of its file to its own
+ * buffer. The buffer is then handed over to the pool, which writes out the
+ * buffers to the combined file in the order their files were queued in, so the
+ * combined file is the same as when parsing on a single thread.
+ */
+
+struct recurse_file_job {
+    char *dir_path;
+    uint64_t dir_path_length;
+
+    const char *name;
+    uint64_t name_length;
+
+    int fd;
+    uint64_t index;
+};
+
+struct recurse_document {
+    struct string_buffer sb;
+    bool is_ready;
+};
+
+struct recurse_worker_pool {
+    struct recurse_file_job *jobs;
+    uint64_t jobs_capacity;
+
+    uint64_t jobs_front;
+    uint64_t jobs_count;
+    uint64_t jobs_queued;
+
+    bool is_done;
+
+    pthread_mutex_t lock;
+    pthread_cond_t job_free_cond;
+    pthread_cond_t job_ready_cond;
+
+    pthread_mutex_t orig_lock;
+    pthread_mutex_t dsc_lock;
+
+    /*
+     * Documents are stored at the index of their job, modulo
+     * documents_capacity, until every document before them has been written
+     * out. documents is NULL when not combining.
+     */
+
+    const struct tbd_for_main *tbd;
+
+    struct recurse_document *documents;
+    uint64_t documents_capacity;
+    uint64_t documents_front;
+
+    FILE *combine_file;
+
+    pthread_mutex_t combine_lock;
+    pthread_cond_t document_free_cond;
+};
+
+struct recurse_worker {
+    struct recurse_worker_pool *pool;
+    struct tbd_for_main tbd;
+
+    struct recurse_callback_info recurse_info;
+
+    struct string_buffer export_trie_sb;
+    struct string_buffer combine_sb;
+
+    pthread_t thread;
+};
+
+static bool
+queue_recursed_file(const char *__notnull const dir_path,
+                    const uint64_t dir_path_length,
+                    const int fd,
+                    struct dirent *const dirent,
+                    const uint64_t name_length,
+                    void *__notnull const callback_info)
+{
+    struct recurse_worker_pool *const pool =
+        (struct recurse_worker_pool *)callback_info;
+
+    /*
+     * dir_path and dirent are only valid for the duration of this call, so
+     * store a copy of both in one allocation.
+     */
+
+    char *const path = malloc(dir_path_length + name_length + 2);
+    if (path == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    memcpy(path, dir_path, dir_path_length);
+    path[dir_path_length] = '\0';
+
+    char *const name = path + dir_path_length + 1;
+
+    memcpy(name, dirent->d_name, name_length);
+    name[name_length] = '\0';
+
+    const struct recurse_file_job job = {
+        .dir_path = path,
+        .dir_path_length = dir_path_length,
+
+        .name = name,
+        .name_length = name_length,
+
+        .fd = fd
+    };
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->jobs_count == pool->jobs_capacity) {
+        pthread_cond_wait(&pool->job_free_cond, &pool->lock);
+    }
+
+    const uint64_t index =
+        (pool->jobs_front + pool->jobs_count) % pool->jobs_capacity;
+
+    pool->jobs[index] = job;
+    pool->jobs[index].index = pool->jobs_queued;
+
+    pool->jobs_count += 1;
+    pool->jobs_queued += 1;
+
+    pthread_cond_signal(&pool->job_ready_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    return true;
+}
+
+static void
+write_combined_document(struct recurse_worker_pool *__notnull const pool,
+                        const struct string_buffer *__notnull const sb)
+{
+    const struct tbd_for_main *const tbd = pool->tbd;
+    char *const write_path = tbd->write_path;
+
+    if (pool->combine_file == NULL) {
+        char *terminator = NULL;
+        pool->combine_file =
+            tbd_for_main_open_write_file_or_print_error(tbd,
+                                                        write_path,
+                                                        tbd->write_path_length,
+                                                        &terminator);
+
+        if (pool->combine_file == NULL) {
+            return;
+        }
+    }
+
+    if (fwrite(sb->data, 1, sb->length, pool->combine_file) != sb->length) {
+        if (!tbd->options.ignore_warnings) {
+            fprintf(stderr,
+                    "Failed to write to write-file (at path %s)\n",
+                    write_path);
+        }
+    }
+}
+
+/*
+ * Hand over the worker's combine_sb, holding the documents of the job at index,
+ * to the pool, and write out every document whose turn has come.
+ */
+
+static void
+add_combined_document(struct recurse_worker_pool *__notnull const pool,
+                      struct recurse_worker *__notnull const worker,
+                      const uint64_t index)
+{
+    const uint64_t capacity = pool->documents_capacity;
+    pthread_mutex_lock(&pool->combine_lock);
+
+    while (index - pool->documents_front >= capacity) {
+        pthread_cond_wait(&pool->document_free_cond, &pool->combine_lock);
+    }
+
+    /*
+     * Swap buffers with the document, so the worker reuses the buffer of a
+     * document already written out.
+     */
+
+    struct recurse_document *document = pool->documents + (index % capacity);
+    const struct string_buffer sb = document->sb;
+
+    document->sb = worker->combine_sb;
+    document->is_ready = true;
+
+    worker->combine_sb = sb;
+    sb_clear(&worker->combine_sb);
+
+    if (index == pool->documents_front) {
+        do {
+            if (document->sb.length != 0) {
+                write_combined_document(pool, &document->sb);
+            }
+
+            document->is_ready = false;
+            pool->documents_front += 1;
+
+            document = pool->documents + (pool->documents_front % capacity);
+        } while (document->is_ready);
+
+        pthread_cond_broadcast(&pool->document_free_cond);
+    }
+
+    pthread_mutex_unlock(&pool->combine_lock);
+}
+
+static void *recurse_worker_run(void *__notnull const arg) {
+    struct recurse_worker *const worker = (struct recurse_worker *)arg;
+    struct recurse_worker_pool *const pool = worker->pool;
+
+    do {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->jobs_count == 0 && !pool->is_done) {
+            pthread_cond_wait(&pool->job_ready_cond, &pool->lock);
+        }
+
+        if (pool->jobs_count == 0) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        const struct recurse_file_job job = pool->jobs[pool->jobs_front];
+
+        pool->jobs_front = (pool->jobs_front + 1) % pool->jobs_capacity;
+        pool->jobs_count -= 1;
+
+        pthread_cond_signal(&pool->job_free_cond);
+        pthread_mutex_unlock(&pool->lock);
+
+        parse_recursed_file(&worker->recurse_info,
+                            job.dir_path,
+                            job.dir_path_length,
+                            job.fd,
+                            job.name,
+                            job.name_length);
+
+        free(job.dir_path);
+        if (pool->documents != NULL) {
+            add_combined_document(pool, worker, job.index);
+        }
+    } while (true);
+
+    return NULL;
+}
+
+static enum dir_recurse_result
+recurse_directory_with_jobs(
+    struct recurse_callback_info *__notnull const recurse_info)
+{
+    struct tbd_for_main *const orig = recurse_info->orig;
+    struct tbd_for_main *const tbd = recurse_info->tbd;
+
+    const uint64_t workers_count = tbd->jobs;
+    const uint64_t jobs_capacity = workers_count * 4;
+
+    struct recurse_file_job *const jobs =
+        calloc(jobs_capacity, sizeof(struct recurse_file_job));
+
+    struct recurse_worker *const workers =
+        calloc(workers_count, sizeof(struct recurse_worker));
+
+    if (jobs == NULL || workers == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    struct recurse_worker_pool pool = {
+        .jobs = jobs,
+        .jobs_capacity = jobs_capacity,
+        .tbd = tbd
+    };
+
+    /*
+     * Allow as many documents to be held as there can be files queued or being
+     * parsed, so workers only wait on a document when a single file takes much
+     * longer to parse than the ones after it.
+     */
+
+    const bool should_combine = tbd->options.combine_tbds;
+    if (should_combine) {
+        pool.documents_capacity = jobs_capacity + workers_count;
+        pool.documents =
+            calloc(pool.documents_capacity, sizeof(struct recurse_document));
+
+        if (pool.documents == NULL) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+    }
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_mutex_init(&pool.orig_lock, NULL);
+    pthread_mutex_init(&pool.dsc_lock, NULL);
+    pthread_mutex_init(&pool.combine_lock, NULL);
+
+    pthread_cond_init(&pool.job_free_cond, NULL);
+    pthread_cond_init(&pool.job_ready_cond, NULL);
+    pthread_cond_init(&pool.document_free_cond, NULL);
+
+    uint64_t started_count = 0;
+    for (; started_count != workers_count; started_count++) {
+        struct recurse_worker *const worker = workers + started_count;
+
+        worker->pool = &pool;
+        worker->tbd = *tbd;
+
+        tbd_for_main_create_info_from_orig(&worker->tbd.info, tbd, orig);
+
+        worker->recurse_info = *recurse_info;
+        worker->recurse_info.tbd = &worker->tbd;
+        worker->recurse_info.files_parsed = 0;
+        worker->recurse_info.export_trie_sb = &worker->export_trie_sb;
+        worker->recurse_info.orig_lock = &pool.orig_lock;
+        worker->recurse_info.dsc_lock = &pool.dsc_lock;
+
+        if (should_combine) {
+            worker->recurse_info.combine_sb = &worker->combine_sb;
+        }
+
+        const int create_result =
+            pthread_create(&worker->thread, NULL, recurse_worker_run, worker);
+
+        if (create_result != 0) {
+            tbd_for_main_destroy_info_from_orig(&worker->tbd.info, orig);
+            break;
+        }
+    }
+
+    if (started_count == 0) {
+        fputs("Failed to create threads to parse files while recursing\n",
+              stderr);
+
+        exit(1);
+    }
+
+    enum dir_recurse_result result = E_DIR_RECURSE_OK;
+    if (tbd->options.recurse_subdirectories) {
+        result =
+            dir_recurse_with_subdirs(tbd->parse_path,
+                                     tbd->parse_path_length,
+                                     O_RDONLY,
+                                     &pool,
+                                     queue_recursed_file,
+                                     recurse_directory_fail_callback);
+    } else {
+        result =
+            dir_recurse(tbd->parse_path,
+                        tbd->parse_path_length,
+                        O_RDONLY,
+                        &pool,
+                        queue_recursed_file,
+                        recurse_directory_fail_callback);
+    }
+
+    /*
+     * Save errno, as joining the workers may overwrite it.
+     */
+
+    const int recurse_errno = errno;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.is_done = true;
+
+    pthread_cond_broadcast(&pool.job_ready_cond);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (uint64_t i = 0; i != started_count; i++) {
+        struct recurse_worker *const worker = workers + i;
+
+        pthread_join(worker->thread, NULL);
+        tbd_for_main_destroy_info_from_orig(&worker->tbd.info, orig);
+
+        recurse_info->files_parsed += worker->recurse_info.files_parsed;
+
+        sb_destroy(&worker->export_trie_sb);
+        sb_destroy(&worker->combine_sb);
+    }
+
+    /*
+     * Every document has been written out once all workers are done, so only
+     * the combined file, if opened, has to be handed over to the caller.
+     */
+
+    if (should_combine) {
+        recurse_info->combine_file = pool.combine_file;
+        for (uint64_t i = 0; i != pool.documents_capacity; i++) {
+            sb_destroy(&pool.documents[i].sb);
+        }
+
+        free(pool.documents);
+    }
+
+    pthread_cond_destroy(&pool.document_free_cond);
+    pthread_cond_destroy(&pool.job_ready_cond);
+    pthread_cond_destroy(&pool.job_free_cond);
+
+    pthread_mutex_destroy(&pool.combine_lock);
+    pthread_mutex_destroy(&pool.orig_lock);
+    pthread_mutex_destroy(&pool.dsc_lock);
+    pthread_mutex_destroy(&pool.lock);
+
+    free(workers);
+    free(jobs);
+
+    errno = recurse_errno;
+    return result;
+}
+
 static void destroy_tbds_array(struct array *const tbds) {
     struct tbd_for_main *tbd = tbds->data;
     const struct tbd_for_main *const end = tbds->data_end;
@@ -1117,6 +1589,36 @@ int main(const int argc, char *const argv[]) {
         return 1;
     }
 
+    /*
+     * The stats of every file are collected into a single report, printed once
+     * all files are parsed.
+     */
+
+    struct tbd_stats_report stats_report = {};
+
+    bool print_stats = false;
+    bool print_stats_as_json = false;
+
+    struct tbd_for_main *tbd = tbds.data;
+    const struct tbd_for_main *const end = tbds.data_end;
+
+    for (; tbd != end; tbd++) {
+        if (!tbd->options.print_stats) {
+            continue;
+        }
+
+        if (!print_stats) {
+            tbd_stats_report_create(&stats_report);
+            print_stats = true;
+        }
+
+        if (tbd->options.print_stats_as_json) {
+            print_stats_as_json = true;
+        }
+
+        tbd->stats_report = &stats_report;
+    }
+
     struct string_buffer export_trie_sb = {};
     if (will_parse_export_trie) {
         const enum string_buffer_result reserve_sb_result =
@@ -1136,10 +1638,7 @@ int main(const int argc, char *const argv[]) {
     const bool should_print_paths = (tbds.item_count != 1);
     struct retained_user_info retained = {};
 
-    struct tbd_for_main *tbd = tbds.data;
-    const struct tbd_for_main *const end = tbds.data_end;
-
-    for (; tbd != end; tbd++) {
+    for (tbd = tbds.data; tbd != end; tbd++) {
         /*
          * To allow user-input to modify tbd-info for single files, we create a
          * copy of tbd to separate the initial info from the user-input info.
@@ -1172,7 +1671,9 @@ int main(const int argc, char *const argv[]) {
             };
 
             enum dir_recurse_result recurse_dir_result = E_DIR_RECURSE_OK;
-            if (options.recurse_subdirectories) {
+            if (tbd->jobs > 1) {
+                recurse_dir_result = recurse_directory_with_jobs(&recurse_info);
+            } else if (options.recurse_subdirectories) {
                 recurse_dir_result =
                     dir_recurse_with_subdirs(tbd->parse_path,
                                              tbd->parse_path_length,
@@ -1219,7 +1720,7 @@ int main(const int argc, char *const argv[]) {
             }
 
             if (tbd->options.combine_tbds) {
-                if (tbd_write_footer(recurse_info.combine_file)) {
+                if (tbd_write_footer_to_file(recurse_info.combine_file)) {
                     if (should_print_paths) {
                         fprintf(stderr,
                                 "Failed to write footer for combined .tbd file "
@@ -1252,14 +1753,29 @@ int main(const int argc, char *const argv[]) {
             tbd_for_main_destroy(&copy);
             memset(tbd, 0, sizeof(*tbd));
         } else {
-            char *const parse_path = tbd->parse_path;
-            const int fd = our_open(parse_path, O_RDONLY, 0);
+            /*
+             * A NULL parse-path means the file is provided through stdin, which
+             * may first have to be read into a file if it's a pipe.
+             */
+
+            const char *parse_path = tbd->parse_path;
+            uint64_t parse_path_length = tbd->parse_path_length;
+
+            int fd = -1;
+            if (parse_path != NULL) {
+                fd = our_open(parse_path, O_RDONLY, 0);
+            } else {
+                parse_path = "stdin";
+                parse_path_length = 5;
+
+                fd = stdin_file_open();
+            }
 
             if (fd < 0) {
                 if (should_print_paths) {
                     fprintf(stderr,
                             "Failed to open file (at path %s), error: %s\n",
-                            tbd->parse_path,
+                            parse_path,
                             strerror(errno));
                 } else {
                     fprintf(stderr,
@@ -1286,7 +1802,7 @@ int main(const int argc, char *const argv[]) {
                     .orig = tbd,
 
                     .dir_path = parse_path,
-                    .dir_path_length = tbd->parse_path_length,
+                    .dir_path_length = parse_path_length,
 
                     .dont_handle_non_macho_error = false,
                     .print_paths = should_print_paths,
@@ -1322,7 +1838,7 @@ int main(const int argc, char *const argv[]) {
                     .orig = tbd,
 
                     .dsc_dir_path = parse_path,
-                    .dsc_dir_path_length = tbd->parse_path_length,
+                    .dsc_dir_path_length = parse_path_length,
 
                     .dont_handle_non_dsc_error = false,
                     .print_paths = should_print_paths,
@@ -1371,6 +1887,11 @@ int main(const int argc, char *const argv[]) {
      * array_destroy().
      */
 
+    if (print_stats) {
+        tbd_stats_report_print(&stats_report, stderr, print_stats_as_json);
+        tbd_stats_report_destroy(&stats_report);
+    }
+
     sb_destroy(&export_trie_sb);
     array_destroy(&tbds);
 
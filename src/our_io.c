@@ -10,10 +10,14 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "our_io.h"
+#include "recursive.h"
 
 int our_open(const char *const path, const int flags, const int mode) {
     do {
@@ -102,6 +106,32 @@ ssize_t our_read(const int fd, void *const buf, const size_t size) {
     return -1;
 }
 
+/*
+ * Unlike our_read(), our_write() keeps going after a partial write, and only
+ * returns once either all of buf was written, or an error occurred.
+ */
+
+ssize_t our_write(const int fd, const void *const buf, const size_t size) {
+    const char *iter = buf;
+    size_t left = size;
+
+    while (left != 0) {
+        const ssize_t num = write(fd, iter, left);
+        if (num == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+        }
+
+        iter += num;
+        left -= (size_t)num;
+    }
+
+    return (ssize_t)size;
+}
+
 DIR *our_fdopendir(const int fd) {
     do {
         DIR *const dir = fdopendir(fd);
@@ -134,3 +164,69 @@ ssize_t our_getline(char **const lineptr, size_t *const n, FILE *const stream) {
 
     return 0;
 }
+
+/*
+ * Store the file at path, inside the directory at dir_path, with the contents
+ * written out by callback.
+ *
+ * The contents are written to a temporary file first, which is renamed to path
+ * afterwards, so that other threads (or processes) never find a partially
+ * written file.
+ */
+
+int
+our_store_file(const char *const dir_path,
+               const uint64_t dir_path_length,
+               const char *const path,
+               const our_store_file_callback callback,
+               const void *const info)
+{
+    const size_t path_length = strlen(path);
+    char *const tmp_path = malloc(path_length + sizeof(".XXXXXX"));
+
+    if (tmp_path == NULL) {
+        return -1;
+    }
+
+    memcpy(tmp_path, path, path_length);
+    memcpy(tmp_path + path_length, ".XXXXXX", sizeof(".XXXXXX"));
+
+    int fd = mkstemp(tmp_path);
+    if (fd < 0 && errno == ENOENT) {
+        char *const dir_path_copy = strdup(dir_path);
+        if (dir_path_copy == NULL) {
+            free(tmp_path);
+            return -1;
+        }
+
+        if (mkdir_r(dir_path_copy, dir_path_length, 0755, NULL) == 0) {
+            memcpy(tmp_path + path_length + 1, "XXXXXX", 6);
+            fd = mkstemp(tmp_path);
+        }
+
+        free(dir_path_copy);
+    }
+
+    if (fd < 0) {
+        free(tmp_path);
+        return -1;
+    }
+
+    /*
+     * mkstemp() creates the file readable only by us, so give it the same
+     * permissions as any other file we create.
+     */
+
+    const bool failed = fchmod(fd, 0644) != 0 || callback(fd, info) != 0;
+    close(fd);
+
+    if (failed || rename(tmp_path, path) != 0) {
+        our_unlink(tmp_path);
+        free(tmp_path);
+
+        return -1;
+    }
+
+    free(tmp_path);
+    return 0;
+}
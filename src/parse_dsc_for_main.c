@@ -12,11 +12,15 @@
 #include <fcntl.h>
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "dsc_image_filter_set.h"
+#include "dsc_index.h"
+#include "dsc_io_policy.h"
 #include "handle_dsc_parse_result.h"
 #include "magic_buffer.h"
 #include "parse_dsc_for_main.h"
@@ -26,6 +30,7 @@
 #include "path.h"
 
 #include "recursive.h"
+#include "tbd_cache.h"
 #include "tbd_for_main.h"
 #include "tbd_write.h"
 #include "unused.h"
@@ -51,7 +56,17 @@ struct dsc_iterate_images_info {
     struct tbd_for_main *orig;
 
     struct array images;
+    struct dsc_image_filter_set filter_set;
+
+    /*
+     * A bit for every image of the dyld_shared_cache, set for the images
+     * selected by their number, or NULL if no numbers were provided.
+     */
+
+    uint64_t *image_numbers;
+
     FILE *combine_file;
+    struct string_buffer *combine_sb;
 
     macho_file_parse_error_callback callback;
     struct handle_dsc_image_parse_error_cb_info *callback_info;
@@ -62,12 +77,52 @@ struct dsc_iterate_images_info {
 
     struct retained_user_info *retained;
     struct string_buffer *export_trie_sb;
-};
 
-enum dyld_cache_image_info_pad {
-    F_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED = 1ull << 0
+    /*
+     * Held while orig is read or modified when other files are parsed by
+     * multiple threads while recursing, and NULL otherwise.
+     */
+
+    pthread_mutex_t *orig_lock;
 };
 
+static uint64_t *create_image_numbers(const uint32_t images_count) {
+    uint64_t words_count = ((uint64_t)images_count + 63) / 64;
+    if (words_count == 0) {
+        words_count = 1;
+    }
+
+    uint64_t *const image_numbers = calloc(words_count, sizeof(uint64_t));
+
+    if (image_numbers == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    return image_numbers;
+}
+
+static inline void
+select_image_number(uint64_t *__notnull const image_numbers,
+                    const uint32_t index)
+{
+    image_numbers[index / 64] |= 1ull << (index % 64);
+}
+
+static inline bool
+image_number_is_selected(
+    const struct dsc_iterate_images_info *__notnull const info,
+    const struct dyld_cache_image_info *__notnull const image)
+{
+    const uint64_t *const image_numbers = info->image_numbers;
+    if (image_numbers == NULL) {
+        return false;
+    }
+
+    const uint64_t index = (uint64_t)(image - info->dsc_info->images);
+    return (image_numbers[index / 64] & (1ull << (index % 64)));
+}
+
 static void
 print_messages_header(
     struct dsc_iterate_images_info *__notnull const iterate_info)
@@ -83,6 +138,53 @@ print_messages_header(
     iterate_info->did_print_messages_header = true;
 }
 
+/*
+ * Print why every subcache that failed to be mapped couldn't be mapped, once
+ * per subcache, instead of an error for every image in the subcache.
+ */
+
+static void
+print_unavailable_subcaches(
+    struct dsc_iterate_images_info *__notnull const iterate_info)
+{
+    const struct dyld_shared_cache_info *const dsc_info =
+        iterate_info->dsc_info;
+
+    struct dyld_shared_cache_subcache *subcache = dsc_info->subcaches;
+    const struct dyld_shared_cache_subcache *const end =
+        subcache + dsc_info->subcaches_count;
+
+    for (; subcache != end; subcache++) {
+        pthread_mutex_lock(&subcache->lock);
+
+        const bool should_print =
+            subcache->failed_to_map && !subcache->did_print_map_failure;
+
+        subcache->did_print_map_failure = subcache->failed_to_map;
+        pthread_mutex_unlock(&subcache->lock);
+
+        if (!should_print) {
+            continue;
+        }
+
+        print_messages_header(iterate_info);
+
+        const int map_errno = subcache->map_errno;
+        if (map_errno != 0) {
+            fprintf(stderr,
+                    "\tSubcache (at path %s) could not be mapped, error: "
+                    "%s\r\n",
+                    subcache->path,
+                    strerror(map_errno));
+        } else {
+            fprintf(stderr,
+                    "\tSubcache (at path %s) is not a valid subcache of the "
+                    "dyld_shared_cache\r\n",
+                    subcache->path);
+        }
+    }
+}
+
 static void
 print_image_error(struct dsc_iterate_images_info *__notnull const iterate_info,
                   const char *__notnull const image_path,
@@ -105,6 +207,10 @@ print_image_error(struct dsc_iterate_images_info *__notnull const iterate_info,
             break;
         }
 
+        case E_DSC_IMAGE_PARSE_SUBCACHE_UNAVAILABLE:
+            print_unavailable_subcaches(iterate_info);
+            return;
+
         case E_DSC_IMAGE_PARSE_ALLOC_FAIL:
         case E_DSC_IMAGE_PARSE_ARRAY_FAIL:
         case E_DSC_IMAGE_PARSE_SEEK_FAIL:
@@ -209,6 +315,16 @@ write_to_path(struct dsc_iterate_images_info *__notnull const iterate_info,
               char *__notnull const write_path,
               const uint64_t write_path_length)
 {
+    struct string_buffer *const combine_sb = iterate_info->combine_sb;
+    if (combine_sb != NULL) {
+        tbd_for_main_write_to_buffer(tbd,
+                                     write_path,
+                                     combine_sb,
+                                     iterate_info->print_paths);
+
+        return;
+    }
+
     char *terminator = NULL;
     const bool should_combine = tbd->options.combine_tbds;
 
@@ -429,10 +545,119 @@ write_out_tbd_info(struct dsc_iterate_images_info *__notnull const info,
     }
 }
 
+/*
+ * Write out the image already parsed into tbd->info, or print out the error
+ * that was received while parsing it.
+ */
+
+static int
+write_out_parsed_image(
+    struct dsc_iterate_images_info *__notnull const iterate_info,
+    struct tbd_for_main *__notnull const tbd,
+    const char *__notnull const image_path,
+    const enum dsc_image_parse_result parse_image_result)
+{
+    if (parse_image_result != E_DSC_IMAGE_PARSE_OK) {
+        print_image_error(iterate_info, image_path, parse_image_result);
+        return 1;
+    }
+
+    uint64_t image_path_length = iterate_info->image_path_length;
+    if (image_path_length == 0) {
+        image_path_length = strlen(image_path);
+        iterate_info->image_path_length = image_path_length;
+    }
+
+    write_out_tbd_info(iterate_info, tbd, image_path, image_path_length);
+    return 0;
+}
+
+/*
+ * Look up the image in the conversion-cache, when caching.
+ *
+ * Returns true if the image can be cached, in which case the image only needs
+ * to be parsed if no document was found for the entry.
+ */
+
+static bool
+find_cache_entry_for_image(
+    const struct tbd_for_main *__notnull const tbd,
+    const struct dyld_shared_cache_info *__notnull const dsc_info,
+    const struct dyld_cache_image_info *__notnull const image,
+    struct tbd_cache_entry *__notnull const entry)
+{
+    if (tbd->cache_path == NULL) {
+        return false;
+    }
+
+    return tbd_cache_entry_create_for_dsc_image(entry, tbd, dsc_info, image);
+}
+
+static inline void
+lock_orig(const struct dsc_iterate_images_info *__notnull const info) {
+    if (info->orig_lock != NULL) {
+        pthread_mutex_lock(info->orig_lock);
+    }
+}
+
+static inline void
+unlock_orig(const struct dsc_iterate_images_info *__notnull const info) {
+    if (info->orig_lock != NULL) {
+        pthread_mutex_unlock(info->orig_lock);
+    }
+}
+
+/*
+ * Lock orig around the error-callback, which may request user-input and modify
+ * orig, and share the user's retained answers through orig with the threads
+ * parsing other files while recursing.
+ */
+
+static void
+lock_orig_for_callback(
+    const struct dsc_iterate_images_info *__notnull const info)
+{
+    if (info->orig_lock == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(info->orig_lock);
+    info->tbd->retained = info->orig->retained;
+}
+
+static void
+unlock_orig_after_callback(
+    const struct dsc_iterate_images_info *__notnull const info)
+{
+    if (info->orig_lock == NULL) {
+        return;
+    }
+
+    info->orig->retained = info->tbd->retained;
+    pthread_mutex_unlock(info->orig_lock);
+}
+
+static bool
+locked_error_callback(struct tbd_create_info *__notnull const info_in,
+                      const enum macho_file_parse_callback_type type,
+                      void *const callback_info)
+{
+    struct dsc_iterate_images_info *const iterate_info =
+        (struct dsc_iterate_images_info *)callback_info;
+
+    lock_orig_for_callback(iterate_info);
+
+    const bool result =
+        iterate_info->callback(info_in, type, iterate_info->callback_info);
+
+    unlock_orig_after_callback(iterate_info);
+    return result;
+}
+
 static int
 actually_parse_image(
     struct dsc_iterate_images_info *__notnull const iterate_info,
-    struct dyld_cache_image_info *__notnull const image,
+    const struct dyld_cache_image_info *__notnull const image,
     const char *const image_path)
 {
     struct tbd_for_main *const tbd = iterate_info->tbd;
@@ -442,79 +667,80 @@ actually_parse_image(
     struct handle_dsc_image_parse_error_cb_info *const cb_info =
         iterate_info->callback_info;
 
-    cb_info->image_path = image_path;
-    cb_info->did_print_messages_header =
-        iterate_info->did_print_messages_header;
-
-    struct dsc_image_parse_options options = {};
-    const enum dsc_image_parse_result parse_image_result =
-        dsc_image_parse(info,
-                        iterate_info->dsc_info,
-                        image,
-                        iterate_info->callback,
-                        cb_info,
-                        iterate_info->export_trie_sb,
-                        tbd->macho_options,
-                        tbd->parse_options,
-                        options);
-
-    iterate_info->did_print_messages_header =
-        cb_info->did_print_messages_header;
+    if (info->stats != NULL) {
+        info->stats->images_skipped -= 1;
+    }
 
-    if (parse_image_result != E_DSC_IMAGE_PARSE_OK) {
-        tbd_create_info_clear_fields_and_create_from(info, &orig->info);
-        print_image_error(iterate_info, image_path, parse_image_result);
+    struct tbd_cache_entry cache_entry = {};
+    const bool has_cache_entry =
+        find_cache_entry_for_image(tbd,
+                                   iterate_info->dsc_info,
+                                   image,
+                                   &cache_entry);
+
+    enum dsc_image_parse_result parse_image_result = E_DSC_IMAGE_PARSE_OK;
+    if (!has_cache_entry || !cache_entry.has_document) {
+        cb_info->image_path = image_path;
+        cb_info->did_print_messages_header =
+            iterate_info->did_print_messages_header;
+
+        struct dsc_image_parse_options options = {};
+        parse_image_result =
+            dsc_image_parse(info,
+                            iterate_info->dsc_info,
+                            image,
+                            locked_error_callback,
+                            iterate_info,
+                            iterate_info->export_trie_sb,
+                            tbd->macho_options,
+                            tbd->parse_options,
+                            options);
+
+        iterate_info->did_print_messages_header =
+            cb_info->did_print_messages_header;
+
+        if (parse_image_result == E_DSC_IMAGE_PARSE_OK) {
+            tbd_for_main_handle_post_parse(tbd);
+        }
+    }
 
-        return 1;
+    if (has_cache_entry) {
+        tbd->cache_entry = &cache_entry;
     }
 
-    tbd_for_main_handle_post_parse(tbd);
+    const int result =
+        write_out_parsed_image(iterate_info, tbd, image_path, parse_image_result);
 
-    uint64_t image_path_length = iterate_info->image_path_length;
-    if (image_path_length == 0) {
-        image_path_length = strlen(image_path);
-        iterate_info->image_path_length = image_path_length;
-    }
+    tbd->cache_entry = NULL;
+    tbd_cache_entry_destroy(&cache_entry);
 
-    write_out_tbd_info(iterate_info, tbd, image_path, image_path_length);
+    lock_orig(iterate_info);
     tbd_create_info_clear_fields_and_create_from(info, &orig->info);
+    unlock_orig(iterate_info);
 
-    return 0;
+    return result;
 }
 
-static bool
-image_path_passes_through_filter(
-    struct dsc_iterate_images_info *__notnull const info,
-    const char *__notnull const path,
-    struct tbd_for_main_dsc_image_filter *__notnull const filter)
-{
-    const char *const string = filter->string;
-    const uint64_t length = filter->length;
+/*
+ * Match path against every filter with info's filter-set, returning the indices
+ * of the filters matched in ascending order.
+ */
 
-    const char **const ptr = &filter->tmp_ptr;
+static const uint32_t *
+match_filters(struct dsc_iterate_images_info *__notnull const info,
+              const char *__notnull const path,
+              uint64_t *__notnull const count_out)
+{
     uint64_t path_len = info->image_path_length;
-
     if (path_len == 0) {
         path_len = strlen(path);
         info->image_path_length = path_len;
     }
 
-    switch (filter->type) {
-        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_PATH:
-            if (length != path_len) {
-                return false;
-            }
-
-            return (memcmp(path, string, length) == 0);
-
-        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_FILE:
-            return path_has_filename(path, path_len, string, length, ptr);
-
-        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_DIRECTORY:
-            return path_has_dir_component(path, path_len, string, length, ptr);
-    }
+    struct dsc_image_filter_set *const set = &info->filter_set;
 
-    return false;
+    *count_out = dsc_image_filter_set_match(set, path, path_len);
+    return set->matches.data;
 }
 
 static inline bool
@@ -524,36 +750,39 @@ filter_was_parsed(
     return (filter->status > TBD_FOR_MAIN_DSC_IMAGE_FILTER_PARSE_HAPPENING);
 }
 
+static void
+mark_filter_happening(
+    struct tbd_for_main_dsc_image_filter *__notnull const filter,
+    const bool should_parse)
+{
+    /*
+     * If we've already determined that the image should be parsed, the filter
+     * doesn't need to be marked as completed again.
+     */
+
+    if (filter_was_parsed(filter)) {
+        if (should_parse) {
+            return;
+        }
+    }
+
+    filter->status = TBD_FOR_MAIN_DSC_IMAGE_FILTER_PARSE_HAPPENING;
+}
+
 static bool
 should_parse_image(struct dsc_iterate_images_info *__notnull const info,
                    const struct array *__notnull const list,
                    const char *__notnull const path)
 {
-    bool should_parse = false;
-
-    struct tbd_for_main_dsc_image_filter *filter = list->data;
-    const struct tbd_for_main_dsc_image_filter *const end = list->data_end;
-
-    for (; filter != end; filter++) {
-        /*
-         * If we've already determined that the image should be parsed, and the
-         * filter doesn't need to be marked as completed, we can avoid an
-         * unnecessary image_path_passes_through_filter() call.
-         */
-
-        if (filter_was_parsed(filter)) {
-            if (should_parse) {
-                continue;
-            }
-        }
+    uint64_t count = 0;
+    const uint32_t *const indices = match_filters(info, path, &count);
 
-        if (image_path_passes_through_filter(info, path, filter)) {
-            filter->status = TBD_FOR_MAIN_DSC_IMAGE_FILTER_PARSE_HAPPENING;
-            should_parse = true;
-        }
+    struct tbd_for_main_dsc_image_filter *const filters = list->data;
+    for (uint64_t i = 0; i != count; i++) {
+        mark_filter_happening(filters + indices[i], i != 0);
     }
 
-    return should_parse;
+    return (count != 0);
 }
 
 static void
@@ -581,161 +810,1280 @@ found_entire_filter_list(const struct array *__notnull const filters) {
         return false;
     }
 
-    return true;
-}
-
-static void
-print_missing_filter(
-    const struct tbd_for_main_dsc_image_filter *__notnull const filter)
-{
-    switch (filter->status) {
-        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_PARSE_NOT_FOUND:
-            switch (filter->type) {
-                case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_FILE:
-                    fprintf(stderr,
-                            "\tNo images were found that passed the provided "
-                            "filter (a file named: %s)\r\n",
-                            filter->string);
+    return true;
+}
+
+static void
+print_missing_filter(
+    const struct tbd_for_main_dsc_image_filter *__notnull const filter)
+{
+    switch (filter->status) {
+        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_PARSE_NOT_FOUND:
+            switch (filter->type) {
+                case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_FILE:
+                    fprintf(stderr,
+                            "\tNo images were found that passed the provided "
+                            "filter (a file named: %s)\r\n",
+                            filter->string);
+
+                    break;
+
+                case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_DIRECTORY:
+                    fprintf(stderr,
+                            "\tNo images were found that passed the provided "
+                            "filter (a directory named: %s)\r\n",
+                            filter->string);
+
+                    break;
+
+                case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_PATH:
+                    fprintf(stderr,
+                            "\tNo images were found with the provided "
+                            "path (%s)\r\n",
+                            filter->string);
+
+                    break;
+            }
+
+            break;
+
+        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_PARSE_FOUND:
+            switch (filter->type) {
+                case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_FILE:
+                    fprintf(stderr,
+                            "\tAt least one image that passed the provided "
+                            "filter (a file named: %s) was not successfully "
+                            "parsed\r\n",
+                            filter->string);
+
+                    break;
+
+                case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_DIRECTORY:
+                    fprintf(stderr,
+                            "\tAt least one image that passed the provided "
+                            "filter (a directory named: %s) was not "
+                            "successfully parsed\r\n",
+                            filter->string);
+
+                    break;
+
+                /*
+                 * Since only one image corresponds to a path, the user already
+                 * knows that this filter failed.
+                 */
+
+                case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_PATH:
+                    break;
+            }
+
+            break;
+
+        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_PARSE_OK:
+        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_PARSE_HAPPENING:
+            break;
+    }
+}
+
+/*
+ * Iterate over every filter to print out errors if at least one image wasn't
+ * found for every filter.
+ *
+ * We verify this here, rather that in
+ * dyld_shared_cache_iterate_images_with_callback as we don't want to loop over
+ * the filters once for the error-code, then again here to print out.
+ */
+
+static void
+print_missing_filter_list(const struct array *__notnull const filters) {
+    const struct tbd_for_main_dsc_image_filter *filter = filters->data;
+    const struct tbd_for_main_dsc_image_filter *const end = filters->data_end;
+
+    for (; filter != end; filter++) {
+        if (filter_was_parsed(filter)) {
+            continue;
+        }
+
+        print_missing_filter(filter);
+    }
+}
+
+/*
+ * Print out any errors we may have received after parsing all images from the
+ * dyld shared-cache file.
+ */
+
+static void
+print_dsc_warnings(struct dsc_iterate_images_info *__notnull const iterate_info,
+                   const struct array *__notnull const filters)
+{
+    if (found_entire_filter_list(filters)) {
+        return;
+    }
+
+    print_messages_header(iterate_info);
+    print_missing_filter_list(filters);
+}
+
+/*
+ * When parsing with multiple jobs, images are parsed on worker-threads into
+ * their own tbd_create_info, while the calling thread writes out every parsed
+ * image in the order of the images in the dyld_shared_cache.
+ *
+ * The calling thread hands out images to the workers through a window of slots
+ * to bound the amount of parsed, but not yet written, images.
+ */
+
+static int
+image_indices_comparator(const void *__notnull const left,
+                         const void *__notnull const right)
+{
+    const uint32_t left_index = *(const uint32_t *)left;
+    const uint32_t right_index = *(const uint32_t *)right;
+
+    if (left_index < right_index) {
+        return -1;
+    } else if (left_index > right_index) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Look up the images that may pass through the filters in the image-index,
+ * adding their indices to the end of candidates.
+ *
+ * Returns false if every image has to be checked instead.
+ */
+
+static bool
+find_indexed_images(
+    const struct dyld_shared_cache_info *__notnull const dsc_info,
+    const struct dsc_iterate_images_info *__notnull const info,
+    struct array *__notnull const candidates)
+{
+    const struct tbd_for_main *const tbd = info->tbd;
+
+    /*
+     * Open the index even when parsing all images, so it's created for later
+     * runs that filter images.
+     */
+
+    struct dsc_index index = {};
+    const bool opened_index =
+        dsc_index_open(&index,
+                       tbd->dsc_index_path,
+                       tbd->dsc_index_path_length,
+                       dsc_info);
+
+    if (!opened_index) {
+        return false;
+    }
+
+    if (info->parse_all_images) {
+        dsc_index_destroy(&index);
+        return false;
+    }
+
+    const struct array *const filters = &tbd->dsc_image_filters;
+
+    const struct tbd_for_main_dsc_image_filter *filter = filters->data;
+    const struct tbd_for_main_dsc_image_filter *const end = filters->data_end;
+
+    for (; filter != end; filter++) {
+        enum dsc_index_kind kind = DSC_INDEX_KIND_PATH;
+        switch (filter->type) {
+            case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_FILE:
+                kind = DSC_INDEX_KIND_FILENAME;
+                break;
+
+            case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_DIRECTORY:
+                kind = DSC_INDEX_KIND_DIRECTORY;
+                break;
+
+            case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_PATH:
+                break;
+        }
+
+        const bool found_images =
+            dsc_index_find_images(&index,
+                                  kind,
+                                  filter->string,
+                                  filter->length,
+                                  candidates);
+
+        if (!found_images) {
+            dsc_index_destroy(&index);
+            return false;
+        }
+    }
+
+    dsc_index_destroy(&index);
+    return true;
+}
+
+static void
+add_numbered_images(
+    const struct dyld_shared_cache_info *__notnull const dsc_info,
+    const struct dsc_iterate_images_info *__notnull const info,
+    struct array *__notnull const candidates)
+{
+    const uint64_t *const image_numbers = info->image_numbers;
+    const uint64_t words_count = ((uint64_t)dsc_info->images_count + 63) / 64;
+
+    for (uint64_t i = 0; i != words_count; i++) {
+        uint64_t word = image_numbers[i];
+        while (word != 0) {
+            const uint32_t index =
+                (uint32_t)(i * 64 + (uint64_t)__builtin_ctzll(word));
+
+            const enum array_result add_index_result =
+                array_add_item(candidates, sizeof(index), &index, NULL);
+
+            if (add_index_result != E_ARRAY_OK) {
+                fputs("Experienced an array failure while trying to find "
+                      "dyld_shared_cache images by their number\n",
+                      stderr);
+
+                exit(1);
+            }
+
+            word &= word - 1;
+        }
+    }
+}
+
+/*
+ * Find the images that may be parsed, either through the image-index, or
+ * through the image-numbers alone when no filters were provided, storing their
+ * indices in ascending order in candidates.
+ *
+ * Returns false if every image has to be checked instead.
+ */
+
+static bool
+find_candidate_images(
+    const struct dyld_shared_cache_info *__notnull const dsc_info,
+    const struct dsc_iterate_images_info *__notnull const info,
+    struct array *__notnull const candidates)
+{
+    const struct tbd_for_main *const tbd = info->tbd;
+    if (tbd->dsc_index_path != NULL) {
+        if (!find_indexed_images(dsc_info, info, candidates)) {
+            array_destroy(candidates);
+            return false;
+        }
+    } else if (tbd->dsc_image_filters.item_count != 0) {
+        return false;
+    }
+
+    if (info->image_numbers == NULL) {
+        if (tbd->dsc_index_path == NULL) {
+            return false;
+        }
+    } else {
+        add_numbered_images(dsc_info, info, candidates);
+    }
+
+    /*
+     * Images are parsed in the order of the image-table, so sort the indices,
+     * and remove any image found more than once.
+     */
+
+    array_sort_with_comparator(candidates,
+                               sizeof(uint32_t),
+                               image_indices_comparator);
+
+    uint32_t *const front = candidates->data;
+    const uint32_t *const back = candidates->data_end;
+
+    uint64_t unique_count = 0;
+    for (const uint32_t *iter = front; iter != back; iter++) {
+        if (unique_count != 0 && front[unique_count - 1] == *iter) {
+            continue;
+        }
+
+        front[unique_count] = *iter;
+        unique_count++;
+    }
+
+    array_trim_to_item_count(candidates, sizeof(uint32_t), unique_count);
+    return true;
+}
+
+static inline uint64_t
+get_images_count(const struct dyld_shared_cache_info *__notnull const dsc_info,
+                 const struct array *const candidates)
+{
+    if (candidates != NULL) {
+        return candidates->item_count;
+    }
+
+    return dsc_info->images_count;
+}
+
+/*
+ * Get the image at index i of either the candidates, if found, or otherwise the
+ * image-table.
+ */
+
+static inline const struct dyld_cache_image_info *
+get_image(const struct dyld_shared_cache_info *__notnull const dsc_info,
+          const struct array *const candidates,
+          const uint64_t i)
+{
+    if (candidates != NULL) {
+        const uint32_t *const indices = candidates->data;
+        return dsc_info->images + indices[i];
+    }
+
+    return dsc_info->images + i;
+}
+
+struct dsc_image_job {
+    const struct dyld_cache_image_info *image;
+    const char *image_path;
+
+    /*
+     * The file-offset of the image's header, which jobs are sorted by when
+     * parsing images in file-order.
+     */
+
+    uint64_t file_offset;
+};
+
+struct dsc_image_job_order {
+    uint64_t file_offset;
+    uint64_t index;
+};
+
+struct dsc_image_slot {
+    struct tbd_create_info info;
+    enum dsc_image_parse_result result;
+
+    struct tbd_cache_entry cache_entry;
+    bool has_cache_entry;
+
+    bool is_ready : 1;
+};
+
+struct dsc_image_worker_pool {
+    struct dsc_iterate_images_info *iterate_info;
+
+    const struct dsc_image_job *jobs;
+    uint64_t jobs_count;
+
+    /*
+     * The jobs sorted by file-offset, in the order they're taken in, when
+     * parsing in file-order. Otherwise, jobs are taken in order, and order is
+     * NULL.
+     */
+
+    const struct dsc_image_job_order *order;
+
+    struct dsc_image_slot *slots;
+    uint64_t slots_count;
+
+    uint64_t next_job;
+    uint64_t written_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free_cond;
+    pthread_cond_t slot_ready_cond;
+
+    /*
+     * messages_lock serializes the error-callback, which may request user-input
+     * and modify orig, with the writing out of images.
+     */
+
+    pthread_mutex_t messages_lock;
+    bool did_print_messages_header;
+};
+
+struct dsc_image_worker {
+    struct dsc_image_worker_pool *pool;
+    struct tbd_for_main tbd;
+
+    /*
+     * The stats of the images parsed by this worker, added to the stats of the
+     * dyld_shared_cache once all images are parsed.
+     */
+
+    struct tbd_stats stats;
+
+    struct handle_dsc_image_parse_error_cb_info cb_info;
+    struct string_buffer export_trie_sb;
+
+    pthread_t thread;
+};
+
+static bool
+worker_parse_error_callback(struct tbd_create_info *__notnull const info_in,
+                            const enum macho_file_parse_callback_type type,
+                            void *const callback_info)
+{
+    struct dsc_image_worker *const worker =
+        (struct dsc_image_worker *)callback_info;
+
+    struct dsc_image_worker_pool *const pool = worker->pool;
+    struct tbd_for_main *const tbd = pool->iterate_info->tbd;
+
+    pthread_mutex_lock(&pool->messages_lock);
+    lock_orig_for_callback(pool->iterate_info);
+
+    /*
+     * Share the user's retained answers between all workers, so the user isn't
+     * asked again after choosing to never be asked.
+     */
+
+    worker->tbd.retained = tbd->retained;
+    worker->cb_info.did_print_messages_header = pool->did_print_messages_header;
+
+    const bool result =
+        handle_dsc_image_parse_error_callback(info_in, type, &worker->cb_info);
+
+    pool->did_print_messages_header = worker->cb_info.did_print_messages_header;
+    tbd->retained = worker->tbd.retained;
+
+    unlock_orig_after_callback(pool->iterate_info);
+    pthread_mutex_unlock(&pool->messages_lock);
+    return result;
+}
+
+/*
+ * Get the index of the job taken at position out of every job taken.
+ */
+
+static inline uint64_t
+get_job_index(const struct dsc_image_worker_pool *__notnull const pool,
+              const uint64_t position)
+{
+    if (pool->order != NULL) {
+        return pool->order[position].index;
+    }
+
+    return position;
+}
+
+/*
+ * Take the next job to parse, waiting for the job's slot to be written out
+ * first. Returns false once every job has been taken.
+ *
+ * Must be called with the pool's lock held.
+ */
+
+static bool
+take_job(struct dsc_image_worker_pool *__notnull const pool,
+         uint64_t *__notnull const index_out)
+{
+    while (pool->next_job != pool->jobs_count) {
+        const uint64_t index = get_job_index(pool, pool->next_job);
+        if (index - pool->written_count < pool->slots_count) {
+            pool->next_job += 1;
+            *index_out = index;
+
+            return true;
+        }
+
+        pthread_cond_wait(&pool->slot_free_cond, &pool->lock);
+    }
+
+    return false;
+}
+
+static void *dsc_image_worker_run(void *__notnull const arg) {
+    struct dsc_image_worker *const worker = (struct dsc_image_worker *)arg;
+    struct dsc_image_worker_pool *const pool = worker->pool;
+
+    struct dsc_iterate_images_info *const iterate_info = pool->iterate_info;
+    struct tbd_for_main *const tbd = &worker->tbd;
+
+    do {
+        pthread_mutex_lock(&pool->lock);
+
+        uint64_t index = 0;
+        if (!take_job(pool, &index)) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        pthread_mutex_unlock(&pool->lock);
+
+        const struct dsc_image_job *const job = pool->jobs + index;
+        worker->cb_info.image_path = job->image_path;
+
+        struct tbd_cache_entry cache_entry = {};
+        const bool has_cache_entry =
+            find_cache_entry_for_image(tbd,
+                                       iterate_info->dsc_info,
+                                       job->image,
+                                       &cache_entry);
+
+        enum dsc_image_parse_result result = E_DSC_IMAGE_PARSE_OK;
+        if (!has_cache_entry || !cache_entry.has_document) {
+            struct dsc_image_parse_options options = {};
+            result =
+                dsc_image_parse(&tbd->info,
+                                iterate_info->dsc_info,
+                                job->image,
+                                worker_parse_error_callback,
+                                worker,
+                                &worker->export_trie_sb,
+                                tbd->macho_options,
+                                tbd->parse_options,
+                                options);
+
+            if (result == E_DSC_IMAGE_PARSE_OK) {
+                tbd_for_main_handle_post_parse(tbd);
+            }
+        }
+
+        /*
+         * The slot is no longer in use, as its previous job has been written
+         * out. We hand over our info, and take the slot's cleared info in
+         * exchange.
+         */
+
+        struct dsc_image_slot *const slot =
+            pool->slots + (index % pool->slots_count);
+
+        const struct tbd_create_info info = slot->info;
+
+        slot->info = tbd->info;
+        tbd->info = info;
+
+        /*
+         * Our stats stay with us, rather than with the info.
+         */
+
+        tbd->info.stats = slot->info.stats;
+        slot->info.stats = NULL;
+
+        pthread_mutex_lock(&pool->lock);
+
+        slot->cache_entry = cache_entry;
+        slot->has_cache_entry = has_cache_entry;
+
+        slot->result = result;
+        slot->is_ready = true;
+
+        pthread_cond_broadcast(&pool->slot_ready_cond);
+        pthread_mutex_unlock(&pool->lock);
+    } while (true);
+
+    return NULL;
+}
+
+static inline bool
+image_passes_through_filters(
+    struct dsc_iterate_images_info *__notnull const info,
+    const char *__notnull const path)
+{
+    uint64_t count = 0;
+    match_filters(info, path, &count);
+
+    return (count != 0);
+}
+
+/*
+ * Get the path of image if image is to be parsed, or NULL otherwise, without
+ * marking the filters image passes through.
+ */
+
+static const char *
+get_path_if_parsing_image(
+    const struct dyld_shared_cache_info *__notnull const dsc_info,
+    struct dsc_iterate_images_info *__notnull const info,
+    const struct dyld_cache_image_info *__notnull const image)
+{
+    if (dyld_shared_cache_image_was_extracted(dsc_info, image)) {
+        return NULL;
+    }
+
+    const char *const image_path =
+        (const char *)(dsc_info->map + image->pathFileOffset);
+
+    if (unlikely(image_path[0] == '\0')) {
+        return NULL;
+    }
+
+    info->image_path = image_path;
+    info->image_path_length = 0;
+
+    if (!info->parse_all_images) {
+        if (!image_number_is_selected(info, image)) {
+            if (!image_passes_through_filters(info, image_path)) {
+                return NULL;
+            }
+        }
+    }
+
+    return image_path;
+}
+
+/*
+ * The number of images to be parsed that are read in ahead of the images being
+ * parsed.
+ */
+
+static const uint32_t readahead_images_count = 4;
+
+static void
+create_io_policy(struct dsc_io_policy *__notnull const policy,
+                 const struct dyld_shared_cache_info *__notnull const dsc_info,
+                 const struct tbd_for_main *__notnull const tbd,
+                 const uint32_t window_capacity)
+{
+    const bool created =
+        dsc_io_policy_create(policy,
+                             dsc_info,
+                             window_capacity,
+                             tbd->max_rss);
+
+    if (!created) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+}
+
+/*
+ * Prefetch the jobs in the order they're taken in, starting from position next,
+ * until the policy's window is full. Jobs already written out are skipped.
+ * Returns the position of the first job not prefetched.
+ */
+
+static uint64_t
+prefetch_jobs(struct dsc_io_policy *__notnull const policy,
+              const struct dsc_image_worker_pool *__notnull const pool,
+              const uint64_t written_count,
+              uint64_t next)
+{
+    for (; next != pool->jobs_count; next++) {
+        const uint64_t index = get_job_index(pool, next);
+        if (index < written_count) {
+            continue;
+        }
+
+        if (!dsc_io_policy_prefetch(policy, pool->jobs[index].image)) {
+            break;
+        }
+    }
+
+    return next;
+}
+
+static int
+job_order_comparator(const void *__notnull const left,
+                     const void *__notnull const right)
+{
+    const struct dsc_image_job_order *const left_order =
+        (const struct dsc_image_job_order *)left;
+
+    const struct dsc_image_job_order *const right_order =
+        (const struct dsc_image_job_order *)right;
+
+    if (left_order->file_offset != right_order->file_offset) {
+        return (left_order->file_offset < right_order->file_offset) ? -1 : 1;
+    }
+
+    if (left_order->index != right_order->index) {
+        return (left_order->index < right_order->index) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Sort the jobs by the file-offsets of their images, to be taken in that order.
+ */
+
+static struct dsc_image_job_order *
+create_job_order(const struct dsc_image_job *__notnull const jobs,
+                 const uint64_t jobs_count)
+{
+    struct dsc_image_job_order *const order =
+        calloc(jobs_count, sizeof(struct dsc_image_job_order));
+
+    if (order == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    for (uint64_t i = 0; i != jobs_count; i++) {
+        order[i].file_offset = jobs[i].file_offset;
+        order[i].index = i;
+    }
+
+    qsort(order,
+          jobs_count,
+          sizeof(struct dsc_image_job_order),
+          job_order_comparator);
+
+    return order;
+}
+
+static void
+write_out_slot(struct dsc_image_worker_pool *__notnull const pool,
+               struct dsc_image_slot *__notnull const slot,
+               const struct dsc_image_job *__notnull const job)
+{
+    struct dsc_iterate_images_info *const info = pool->iterate_info;
+    struct tbd_for_main *const tbd = info->tbd;
+
+    const struct array *const filters = &tbd->dsc_image_filters;
+    const char *const image_path = job->image_path;
+
+    info->image_path = image_path;
+    info->image_path_length = 0;
+
+    /*
+     * Call should_parse_image() again, this time in order, to mark the filters
+     * the image passes through.
+     */
+
+    if (!info->parse_all_images) {
+        should_parse_image(info, filters, image_path);
+    }
+
+    pthread_mutex_lock(&pool->messages_lock);
+    info->did_print_messages_header = pool->did_print_messages_header;
+
+    const struct tbd_create_info tbd_info = tbd->info;
+
+    tbd->info = slot->info;
+    tbd->info.stats = tbd_info.stats;
+
+    if (slot->has_cache_entry) {
+        tbd->cache_entry = &slot->cache_entry;
+    }
+
+    const int result =
+        write_out_parsed_image(info, tbd, image_path, slot->result);
+
+    slot->info = tbd->info;
+    slot->info.stats = NULL;
+
+    tbd->info = tbd_info;
+
+    tbd->cache_entry = NULL;
+    tbd_cache_entry_destroy(&slot->cache_entry);
+
+    if (result != 0) {
+        unmark_happening_filters(filters);
+    } else {
+        dyld_shared_cache_mark_image_extracted(info->dsc_info, job->image);
+    }
+
+    /*
+     * When parsing in file-order, every job has its own slot, so the slot's
+     * memory is freed instead of being kept around to be reused.
+     */
+
+    lock_orig(info);
+
+    if (pool->order != NULL) {
+        tbd_for_main_destroy_info_from_orig(&slot->info, info->orig);
+        tbd_for_main_create_info_from_orig(&slot->info, tbd, info->orig);
+    } else {
+        tbd_create_info_clear_fields_and_create_from(&slot->info,
+                                                     &info->orig->info);
+    }
+
+    unlock_orig(info);
+
+    pool->did_print_messages_header = info->did_print_messages_header;
+    pthread_mutex_unlock(&pool->messages_lock);
+}
+
+static void
+dsc_iterate_images_with_jobs(
+    const struct dyld_shared_cache_info *__notnull const dsc_info,
+    struct dsc_iterate_images_info *__notnull const info,
+    const struct array *const candidates)
+{
+    struct tbd_for_main *const tbd = info->tbd;
+    struct tbd_for_main *const orig = info->orig;
+
+    const struct array *const filters = &tbd->dsc_image_filters;
+    const uint64_t images_count = get_images_count(dsc_info, candidates);
+
+    struct array jobs = {};
+    for (uint64_t i = 0; i != images_count; i++) {
+        const struct dyld_cache_image_info *const image =
+            get_image(dsc_info, candidates, i);
+
+        const char *const image_path =
+            get_path_if_parsing_image(dsc_info, info, image);
+
+        if (image_path == NULL) {
+            continue;
+        }
+
+        uint64_t max_image_size = 0;
+        const struct dsc_image_job job = {
+            .image = image,
+            .image_path = image_path,
+            .file_offset =
+                dyld_shared_cache_get_offset_for_addr(dsc_info,
+                                                      image->address,
+                                                      &max_image_size)
+        };
+
+        const enum array_result add_job_result =
+            array_add_item(&jobs, sizeof(job), &job, NULL);
+
+        if (add_job_result != E_ARRAY_OK) {
+            fputs("Experienced an array failure while trying to queue "
+                  "dyld_shared_cache images\n",
+                  stderr);
+
+            exit(1);
+        }
+    }
+
+    const uint64_t jobs_count = jobs.item_count;
+    if (tbd->info.stats != NULL) {
+        tbd->info.stats->images_skipped -= jobs_count;
+    }
+
+    /*
+     * When only parsing in file-order, the images are parsed on one worker.
+     */
+
+    uint64_t workers_count = tbd->jobs;
+    if (workers_count == 0) {
+        workers_count = 1;
+    }
+
+    if (workers_count > jobs_count) {
+        workers_count = jobs_count;
+    }
+
+    if (workers_count == 0) {
+        array_destroy(&jobs);
+        print_dsc_warnings(info, filters);
+
+        return;
+    }
+
+    /*
+     * When parsing in file-order, a job may be parsed long before the jobs
+     * ahead of it in the image-table are written out, so every job is given its
+     * own slot.
+     */
+
+    struct dsc_image_job_order *order = NULL;
+    uint64_t slots_count = workers_count * 2;
+
+    if (tbd->options.dsc_images_in_file_order) {
+        order = create_job_order(jobs.data, jobs_count);
+        slots_count = jobs_count;
+    }
+
+    struct dsc_image_slot *const slots =
+        calloc(slots_count, sizeof(struct dsc_image_slot));
+
+    struct dsc_image_worker *const workers =
+        calloc(workers_count, sizeof(struct dsc_image_worker));
+
+    if (slots == NULL || workers == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    struct dsc_image_worker_pool pool = {
+        .iterate_info = info,
+
+        .jobs = jobs.data,
+        .jobs_count = jobs_count,
+
+        .order = order,
+
+        .slots = slots,
+        .slots_count = slots_count,
+
+        .did_print_messages_header = info->did_print_messages_header
+    };
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_mutex_init(&pool.messages_lock, NULL);
+
+    pthread_cond_init(&pool.slot_free_cond, NULL);
+    pthread_cond_init(&pool.slot_ready_cond, NULL);
+
+    lock_orig(info);
+
+    for (uint64_t i = 0; i != slots_count; i++) {
+        tbd_for_main_create_info_from_orig(&slots[i].info, tbd, orig);
+    }
+
+    unlock_orig(info);
+
+    /*
+     * The window holds the images of every slot, along with the images read in
+     * ahead of them.
+     */
+
+    struct dsc_io_policy io_policy = {};
+    create_io_policy(&io_policy,
+                     dsc_info,
+                     tbd,
+                     (uint32_t)slots_count + readahead_images_count);
+
+    uint64_t next_prefetch = prefetch_jobs(&io_policy, &pool, 0, 0);
+
+    uint64_t started_count = 0;
+    for (; started_count != workers_count; started_count++) {
+        struct dsc_image_worker *const worker = workers + started_count;
+
+        worker->pool = &pool;
+        worker->tbd = *tbd;
+
+        lock_orig(info);
+        tbd_for_main_create_info_from_orig(&worker->tbd.info, tbd, orig);
+        unlock_orig(info);
+
+        if (tbd->info.stats != NULL) {
+            worker->tbd.info.stats = &worker->stats;
+        }
+
+        worker->cb_info = *info->callback_info;
+        worker->cb_info.tbd = &worker->tbd;
+
+        const int create_result =
+            pthread_create(&worker->thread, NULL, dsc_image_worker_run, worker);
+
+        if (create_result != 0) {
+            lock_orig(info);
+            tbd_for_main_destroy_info_from_orig(&worker->tbd.info, orig);
+            unlock_orig(info);
+
+            break;
+        }
+    }
+
+    if (started_count == 0) {
+        fputs("Failed to create threads to parse dyld_shared_cache images\n",
+              stderr);
+
+        exit(1);
+    }
+
+    for (uint64_t i = 0; i != jobs_count; i++) {
+        struct dsc_image_slot *const slot = slots + (i % slots_count);
+
+        pthread_mutex_lock(&pool.lock);
+        while (!slot->is_ready) {
+            pthread_cond_wait(&pool.slot_ready_cond, &pool.lock);
+        }
+
+        pthread_mutex_unlock(&pool.lock);
+        write_out_slot(&pool, slot, pool.jobs + i);
+
+        dsc_io_policy_release(&io_policy, pool.jobs[i].image);
+        next_prefetch =
+            prefetch_jobs(&io_policy, &pool, i + 1, next_prefetch);
+
+        pthread_mutex_lock(&pool.lock);
+
+        slot->is_ready = false;
+        pool.written_count = i + 1;
+
+        pthread_cond_broadcast(&pool.slot_free_cond);
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+    for (uint64_t i = 0; i != started_count; i++) {
+        struct dsc_image_worker *const worker = workers + i;
+
+        pthread_join(worker->thread, NULL);
+
+        lock_orig(info);
+        tbd_for_main_destroy_info_from_orig(&worker->tbd.info, orig);
+        unlock_orig(info);
+
+        if (tbd->info.stats != NULL) {
+            tbd_stats_add(tbd->info.stats, &worker->stats);
+        }
+
+        sb_destroy(&worker->export_trie_sb);
+    }
+
+    lock_orig(info);
+
+    for (uint64_t i = 0; i != slots_count; i++) {
+        tbd_for_main_destroy_info_from_orig(&slots[i].info, orig);
+    }
+
+    unlock_orig(info);
+
+    dsc_io_policy_destroy(&io_policy);
+
+    pthread_cond_destroy(&pool.slot_ready_cond);
+    pthread_cond_destroy(&pool.slot_free_cond);
+
+    pthread_mutex_destroy(&pool.messages_lock);
+    pthread_mutex_destroy(&pool.lock);
+
+    info->did_print_messages_header = pool.did_print_messages_header;
+
+    free(workers);
+    free(slots);
+    free(order);
+
+    array_destroy(&jobs);
+    print_dsc_warnings(info, filters);
+}
+
+/*
+ * A filter an image passes through, along with the part of the image's path
+ * the filter matched.
+ */
+
+struct dsc_image_filter_match {
+    uint32_t index;
+    const char *ptr;
+};
+
+/*
+ * An image found to be parsed, ahead of the image being parsed, along with the
+ * filters it passes through, so an image's filters are only matched once.
+ */
+
+struct dsc_image_decision {
+    const struct dyld_cache_image_info *image;
+
+    const char *image_path;
+    uint64_t image_path_length;
+
+    struct array matches;
+};
+
+/*
+ * The images to be parsed next, in order, with the images ahead of
+ * prefetched_count not yet prefetched.
+ */
+
+struct dsc_image_queue {
+    struct dsc_image_decision *decisions;
+    uint32_t capacity;
+
+    uint32_t front;
+    uint32_t count;
+    uint32_t prefetched_count;
+
+    uint64_t next;
+};
+
+static inline struct dsc_image_decision *
+get_queued_decision(const struct dsc_image_queue *__notnull const queue,
+                    const uint32_t index)
+{
+    return queue->decisions + ((queue->front + index) % queue->capacity);
+}
+
+/*
+ * Decide whether image is to be parsed, storing its path, and the filters it
+ * passes through, in decision if so.
+ */
+
+static bool
+decide_image(const struct dyld_shared_cache_info *__notnull const dsc_info,
+             struct dsc_iterate_images_info *__notnull const info,
+             const struct dyld_cache_image_info *__notnull const image,
+             struct dsc_image_decision *__notnull const decision)
+{
+    if (dyld_shared_cache_image_was_extracted(dsc_info, image)) {
+        return false;
+    }
+
+    const char *const image_path =
+        (const char *)(dsc_info->map + image->pathFileOffset);
 
-                    break;
+    /*
+     * We never expect to encounter an empty image-path string, but we check
+     * regardless as a general precaution.
+     */
 
-                case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_DIRECTORY:
-                    fprintf(stderr,
-                            "\tNo images were found that passed the provided "
-                            "filter (a directory named: %s)\r\n",
-                            filter->string);
+    if (unlikely(image_path[0] == '\0')) {
+        return false;
+    }
 
-                    break;
+    info->image_path = image_path;
+    info->image_path_length = 0;
 
-                case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_PATH:
-                    fprintf(stderr,
-                            "\tNo images were found with the provided "
-                            "path (%s)\r\n",
-                            filter->string);
+    decision->image = image;
+    decision->image_path = image_path;
 
-                    break;
-            }
+    array_clear(&decision->matches);
+    if (info->parse_all_images) {
+        decision->image_path_length = 0;
+        return true;
+    }
 
-            break;
+    /*
+     * If we're not parsing all images, we need to verify that our image was
+     * either selected by its number, or passes through either a name-filter or
+     * a path-filter.
+     *
+     * The filters are matched even for selected images, so the filters the
+     * image passes through are marked as found.
+     */
 
-        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_PARSE_FOUND:
-            switch (filter->type) {
-                case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_FILE:
-                    fprintf(stderr,
-                            "\tAt least one image that passed the provided "
-                            "filter (a file named: %s) was not successfully "
-                            "parsed\r\n",
-                            filter->string);
+    const bool is_selected = image_number_is_selected(info, image);
+    const struct array *const filters = &info->tbd->dsc_image_filters;
 
-                    break;
+    uint64_t count = 0;
+    const uint32_t *const indices = match_filters(info, image_path, &count);
 
-                case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_DIRECTORY:
-                    fprintf(stderr,
-                            "\tAt least one image that passed the provided "
-                            "filter (a directory named: %s) was not "
-                            "successfully parsed\r\n",
-                            filter->string);
+    decision->image_path_length = info->image_path_length;
+    if (count == 0) {
+        return is_selected;
+    }
 
-                    break;
+    const struct tbd_for_main_dsc_image_filter *const filter_list =
+        filters->data;
 
-                /*
-                 * Since only one image corresponds to a path, the user already
-                 * knows that this filter failed.
-                 */
+    for (uint64_t i = 0; i != count; i++) {
+        const struct dsc_image_filter_match match = {
+            .index = indices[i],
+            .ptr = filter_list[indices[i]].tmp_ptr
+        };
 
-                case TBD_FOR_MAIN_DSC_IMAGE_FILTER_TYPE_PATH:
-                    break;
-            }
+        const enum array_result add_match_result =
+            array_add_item(&decision->matches, sizeof(match), &match, NULL);
 
-            break;
+        if (add_match_result != E_ARRAY_OK) {
+            fputs("Experienced an array failure while trying to match "
+                  "dyld_shared_cache images against the provided filters\n",
+                  stderr);
 
-        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_PARSE_OK:
-        case TBD_FOR_MAIN_DSC_IMAGE_FILTER_PARSE_HAPPENING:
-            break;
+            exit(1);
+        }
     }
+
+    return true;
 }
 
 /*
- * Iterate over every filter to print out errors if at least one image wasn't
- * found for every filter.
- *
- * We verify this here, rather that in
- * dyld_shared_cache_iterate_images_with_callback as we don't want to loop over
- * the filters once for the error-code, then again here to print out.
+ * Mark the filters decision's image passes through, as should_parse_image()
+ * does, restoring the part of the path each filter matched.
  */
 
 static void
-print_missing_filter_list(const struct array *__notnull const filters) {
-    const struct tbd_for_main_dsc_image_filter *filter = filters->data;
-    const struct tbd_for_main_dsc_image_filter *const end = filters->data_end;
+mark_decision_filters(const struct array *__notnull const list,
+                      const struct dsc_image_decision *__notnull const decision)
+{
+    struct tbd_for_main_dsc_image_filter *const filters = list->data;
 
-    for (; filter != end; filter++) {
-        if (filter_was_parsed(filter)) {
-            continue;
-        }
+    const struct dsc_image_filter_match *const matches =
+        decision->matches.data;
 
-        print_missing_filter(filter);
+    const uint64_t count = decision->matches.item_count;
+    for (uint64_t i = 0; i != count; i++) {
+        struct tbd_for_main_dsc_image_filter *const filter =
+            filters + matches[i].index;
+
+        filter->tmp_ptr = matches[i].ptr;
+        mark_filter_happening(filter, i != 0);
     }
 }
 
 /*
- * Print out any errors we may have received after parsing all images from the
- * dyld shared-cache file.
+ * Queue the images to be parsed, starting from the queue's next image, until
+ * the queue is full, and prefetch the images queued until the policy's window
+ * is full. Returns false if no images are left to be parsed.
  */
 
-static void
-print_dsc_warnings(struct dsc_iterate_images_info *__notnull const iterate_info,
-                   const struct array *__notnull const filters)
+static bool
+fill_image_queue(const struct dyld_shared_cache_info *__notnull const dsc_info,
+                 struct dsc_iterate_images_info *__notnull const info,
+                 const struct array *const candidates,
+                 struct dsc_image_queue *__notnull const queue,
+                 struct dsc_io_policy *__notnull const policy)
 {
-    if (found_entire_filter_list(filters)) {
-        return;
+    const uint64_t images_count = get_images_count(dsc_info, candidates);
+    while (queue->count != queue->capacity && queue->next != images_count) {
+        const struct dyld_cache_image_info *const image =
+            get_image(dsc_info, candidates, queue->next);
+
+        struct dsc_image_decision *const decision =
+            get_queued_decision(queue, queue->count);
+
+        queue->next += 1;
+        if (decide_image(dsc_info, info, image, decision)) {
+            queue->count += 1;
+        }
     }
 
-    print_messages_header(iterate_info);
-    print_missing_filter_list(filters);
+    while (queue->prefetched_count != queue->count) {
+        const struct dsc_image_decision *const decision =
+            get_queued_decision(queue, queue->prefetched_count);
+
+        if (!dsc_io_policy_prefetch(policy, decision->image)) {
+            break;
+        }
+
+        queue->prefetched_count += 1;
+    }
+
+    return (queue->count != 0);
 }
 
 static void
-dsc_iterate_images(
+dsc_iterate_images_serially(
     const struct dyld_shared_cache_info *__notnull const dsc_info,
-    struct dsc_iterate_images_info *__notnull const info)
+    struct dsc_iterate_images_info *__notnull const info,
+    const struct array *const candidates)
 {
     const struct tbd_for_main *const tbd = info->tbd;
     const struct array *const filters = &tbd->dsc_image_filters;
-    const uint64_t images_count = dsc_info->images_count;
 
-    struct dyld_cache_image_info *image = dsc_info->images;
-    const struct dyld_cache_image_info *const end = image + images_count;
+    struct dsc_io_policy io_policy = {};
+    create_io_policy(&io_policy, dsc_info, tbd, readahead_images_count);
 
-    for (uint32_t i = 0; image != end; i++, image++) {
-        if (image->pad & F_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED) {
-            continue;
-        }
+    struct dsc_image_decision *const decisions =
+        calloc(readahead_images_count, sizeof(struct dsc_image_decision));
 
-        const char *const image_path =
-            (const char *)(dsc_info->map + image->pathFileOffset);
+    if (decisions == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    struct dsc_image_queue queue = {
+        .decisions = decisions,
+        .capacity = readahead_images_count
+    };
+
+    while (fill_image_queue(dsc_info, info, candidates, &queue, &io_policy)) {
+        const struct dsc_image_decision *const decision =
+            get_queued_decision(&queue, 0);
+
+        const struct dyld_cache_image_info *const image = decision->image;
+        const char *const image_path = decision->image_path;
+
+        queue.front = (queue.front + 1) % queue.capacity;
+        queue.count -= 1;
+
+        if (queue.prefetched_count != 0) {
+            queue.prefetched_count -= 1;
+        }
 
         /*
-         * We never expect to encounter an empty image-path string, but we
-         * check regardless as a general precaution.
+         * The image may have been extracted, through another entry for the
+         * same image, after it was queued.
          */
 
-        if (unlikely(image_path[0] == '\0')) {
+        if (dyld_shared_cache_image_was_extracted(dsc_info, image)) {
+            dsc_io_policy_release(&io_policy, image);
             continue;
         }
 
         info->image_path = image_path;
-        info->image_path_length = 0;
-
-        /*
-         * If we're not parsing all images, we need to verify that our image
-         * passes through either a name-filter or a path-filter.
-         */
+        info->image_path_length = decision->image_path_length;
 
         if (!info->parse_all_images) {
-            if (!should_parse_image(info, filters, image_path)) {
-                continue;
-            }
+            mark_decision_filters(filters, decision);
         }
 
         if (actually_parse_image(info, image, image_path)) {
@@ -746,15 +2094,62 @@ dsc_iterate_images(
              */
 
             unmark_happening_filters(filters);
-            continue;
+        } else {
+            dyld_shared_cache_mark_image_extracted(info->dsc_info, image);
         }
 
-        image->pad |= F_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED;
+        dsc_io_policy_release(&io_policy, image);
+    }
+
+    for (uint32_t i = 0; i != readahead_images_count; i++) {
+        array_destroy(&decisions[i].matches);
     }
 
+    free(decisions);
+
+    dsc_io_policy_destroy(&io_policy);
     print_dsc_warnings(info, filters);
 }
 
+static void
+dsc_iterate_images(
+    const struct dyld_shared_cache_info *__notnull const dsc_info,
+    struct dsc_iterate_images_info *__notnull const info)
+{
+    struct array candidates = {};
+    const struct array *images = NULL;
+
+    if (find_candidate_images(dsc_info, info, &candidates)) {
+        images = &candidates;
+    }
+
+    /*
+     * Compile the filters once for all images, instead of matching every image
+     * against every filter.
+     */
+
+    if (!info->parse_all_images) {
+        const struct array *const filters = &info->tbd->dsc_image_filters;
+        if (!dsc_image_filter_set_create(&info->filter_set, filters)) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+    }
+
+    const struct tbd_for_main *const tbd = info->tbd;
+    if (tbd->jobs > 1 || tbd->options.dsc_images_in_file_order) {
+        dsc_iterate_images_with_jobs(dsc_info, info, images);
+    } else {
+        dsc_iterate_images_serially(dsc_info, info, images);
+    }
+
+    if (!info->parse_all_images) {
+        dsc_image_filter_set_destroy(&info->filter_set);
+    }
+
+    array_destroy(&candidates);
+}
+
 enum read_magic_result {
     E_READ_MAGIC_OK,
 
@@ -913,8 +2308,69 @@ static void verify_write_path(struct tbd_for_main *__notnull const tbd) {
     return;
 }
 
-enum parse_dsc_for_main_result
-parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
+/*
+ * Every image of the dyld_shared_cache is counted as skipped, until the image
+ * is parsed.
+ *
+ * The cache's subcaches are found next to the cache-file, which has no path
+ * when provided through stdin.
+ */
+
+static enum dyld_shared_cache_parse_result
+parse_dsc_file(const struct parse_dsc_for_main_args *__notnull const args,
+               struct dyld_shared_cache_info *__notnull const dsc_info,
+               const char *__notnull const magic)
+{
+    struct tbd_for_main *const tbd = args->tbd;
+    struct tbd_stats *const stats = tbd->info.stats;
+    enum tbd_stats_phase prev_phase = TBD_STATS_PHASE_NONE;
+
+    if (stats != NULL) {
+        prev_phase = tbd_stats_enter_phase(stats, TBD_STATS_PHASE_OPEN);
+    }
+
+    struct dyld_shared_cache_parse_options dsc_options = tbd->dsc_options;
+    dsc_options.track_extracted_images = true;
+
+    char *dsc_path = NULL;
+    if (args->dsc_name != NULL) {
+        dsc_path =
+            path_append_component(args->dsc_dir_path,
+                                  args->dsc_dir_path_length,
+                                  args->dsc_name,
+                                  args->dsc_name_length,
+                                  NULL);
+
+        if (dsc_path == NULL) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+
+        dsc_options.path = dsc_path;
+    } else {
+        dsc_options.path = tbd->parse_path;
+    }
+
+    const enum dyld_shared_cache_parse_result result =
+        dyld_shared_cache_parse_from_file(dsc_info,
+                                          args->fd,
+                                          magic,
+                                          dsc_options);
+
+    free(dsc_path);
+
+    if (stats != NULL) {
+        tbd_stats_leave_phase(stats, prev_phase);
+        if (result == E_DYLD_SHARED_CACHE_PARSE_OK) {
+            stats->images_skipped += dsc_info->images_count;
+        }
+    }
+
+    return result;
+}
+
+static enum parse_dsc_for_main_result
+parse_dsc(const struct parse_dsc_for_main_args args) {
     const enum magic_buffer_result get_magic_result =
         magic_buffer_read_n(args.magic_buffer, args.fd, 16);
 
@@ -928,15 +2384,11 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
         return E_PARSE_DSC_FOR_MAIN_OTHER_ERROR;
     }
 
-    struct dyld_shared_cache_parse_options dsc_options = args.tbd->dsc_options;
-    dsc_options.zero_image_pads = true;
-
     struct dyld_shared_cache_info dsc_info = {};
     const enum dyld_shared_cache_parse_result parse_dsc_file_result =
-        dyld_shared_cache_parse_from_file(&dsc_info,
-                                          args.fd,
-                                          (const char *)args.magic_buffer->buff,
-                                          dsc_options);
+        parse_dsc_file(&args,
+                       &dsc_info,
+                       (const char *)args.magic_buffer->buff);
 
     if (parse_dsc_file_result == E_DYLD_SHARED_CACHE_PARSE_NOT_A_CACHE) {
         if (args.dont_handle_non_dsc_error) {
@@ -1005,8 +2457,8 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
     const struct array *const numbers = &args.tbd->dsc_image_numbers;
 
     /*
-     * If numbers have been provided, directly call actually_parse_image()
-     * instead of waiting around for the numbers to match up.
+     * If numbers have been provided, select their images to be parsed along
+     * with the images that pass through the filters.
      */
 
     if (numbers->item_count != 0) {
@@ -1016,6 +2468,8 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
          */
 
         iterate_info.parse_all_images = false;
+        iterate_info.image_numbers =
+            create_image_numbers(dsc_info.images_count);
 
         const uint32_t *iter = numbers->data;
         const uint32_t *const end = numbers->data_end;
@@ -1045,28 +2499,7 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
                 continue;
             }
 
-            const uint32_t index = number - 1;
-            struct dyld_cache_image_info *const image = dsc_info.images + index;
-
-            const uint32_t path_offset = image->pathFileOffset;
-            const char *const image_path =
-                (const char *)(dsc_info.map + path_offset);
-
-            if (actually_parse_image(&iterate_info, image, image_path) == 0) {
-                image->pad |= F_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED;
-            }
-        }
-
-        /*
-         * If there are no filters, we should simply return after handling the
-         * numbers.
-         */
-
-        if (filters->item_count == 0) {
-            print_dsc_warnings(&iterate_info, filters);
-            dyld_shared_cache_info_destroy(&dsc_info);
-
-            return E_PARSE_DSC_FOR_MAIN_OK;
+            select_image_number(iterate_info.image_numbers, number - 1);
         }
     } else {
         /*
@@ -1089,6 +2522,8 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
     dsc_iterate_images(&dsc_info, &iterate_info);
     dyld_shared_cache_info_destroy(&dsc_info);
 
+    free(iterate_info.image_numbers);
+
     /*
      * After iterating over all our images, we need to cleanup after
      * combine_file.
@@ -1102,7 +2537,7 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
 
     FILE *const combine_file = iterate_info.combine_file;
     if (combine_file != NULL) {
-        if (tbd_write_footer(combine_file)) {
+        if (tbd_write_footer_to_file(combine_file)) {
             if (args.print_paths) {
                 fprintf(stderr,
                         "Failed to write footer for combined .tbd file for "
@@ -1123,9 +2558,8 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
     return E_PARSE_DSC_FOR_MAIN_OK;
 }
 
-enum parse_dsc_for_main_result
-parse_dsc_for_main_while_recursing(
-    struct parse_dsc_for_main_args *__notnull const args)
+static enum parse_dsc_for_main_result
+parse_dsc_while_recursing(struct parse_dsc_for_main_args *__notnull const args)
 {
     struct magic_buffer *const magic_buffer = args->magic_buffer;
     const enum magic_buffer_result get_magic_result =
@@ -1142,18 +2576,11 @@ parse_dsc_for_main_while_recursing(
     }
 
     const char *const magic = (const char *)magic_buffer->buff;
-
     struct tbd_for_main *const tbd = args->tbd;
-    struct dyld_shared_cache_parse_options dsc_options = tbd->dsc_options;
-
-    dsc_options.zero_image_pads = true;
 
     struct dyld_shared_cache_info dsc_info = {};
     const enum dyld_shared_cache_parse_result parse_dsc_file_result =
-        dyld_shared_cache_parse_from_file(&dsc_info,
-                                          args->fd,
-                                          magic,
-                                          dsc_options);
+        parse_dsc_file(args, &dsc_info, magic);
 
     if (parse_dsc_file_result == E_DYLD_SHARED_CACHE_PARSE_NOT_A_CACHE) {
         if (args->dont_handle_non_dsc_error) {
@@ -1233,6 +2660,8 @@ parse_dsc_for_main_while_recursing(
         .orig = orig,
 
         .combine_file = args->combine_file,
+        .combine_sb = args->combine_sb,
+
         .retained = args->retained,
 
         .callback = handle_dsc_image_parse_error_callback,
@@ -1241,18 +2670,23 @@ parse_dsc_for_main_while_recursing(
         .print_paths = print_paths,
         .parse_all_images = true,
 
-        .export_trie_sb = args->export_trie_sb
+        .export_trie_sb = args->export_trie_sb,
+        .orig_lock = args->orig_lock
     };
 
     const struct array *const filters = &tbd->dsc_image_filters;
     const struct array *const numbers = &tbd->dsc_image_numbers;
 
     /*
-     * If numbers have been provided, directly call actually_parse_image()
-     * instead of waiting around for the numbers to match up.
+     * If numbers have been provided, select their images to be parsed along
+     * with the images that pass through the filters.
      */
 
     if (numbers->item_count != 0) {
+        iterate_info.parse_all_images = false;
+        iterate_info.image_numbers =
+            create_image_numbers(dsc_info.images_count);
+
         const uint32_t *iter = numbers->data;
         const uint32_t *const end = numbers->data_end;
 
@@ -1285,37 +2719,8 @@ parse_dsc_for_main_while_recursing(
                 continue;
             }
 
-            const uint32_t index = number - 1;
-            struct dyld_cache_image_info *const image = dsc_info.images + index;
-
-            const uint32_t path_offset = image->pathFileOffset;
-            const char *const image_path =
-                (const char *)(dsc_info.map + path_offset);
-
-            if (actually_parse_image(&iterate_info, image, image_path) == 0) {
-                image->pad |= F_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED;
-            }
-        }
-
-        /*
-         * If there are no filters and no paths, we should simply return after
-         * handling the numbers.
-         *
-         * Note: Since there are numbers, we do not parse all images as we do by
-         * default.
-         */
-
-        const uint64_t filters_count = filters->item_count;
-        if (filters_count == 0) {
-            free(write_path);
-
-            print_dsc_warnings(&iterate_info, filters);
-            dyld_shared_cache_info_destroy(&dsc_info);
-
-            return E_PARSE_DSC_FOR_MAIN_OK;
+            select_image_number(iterate_info.image_numbers, number - 1);
         }
-
-        iterate_info.parse_all_images = false;
     } else {
         /*
          * By default, if no filters or numbers are provided, we parse all
@@ -1337,6 +2742,8 @@ parse_dsc_for_main_while_recursing(
     dsc_iterate_images(&dsc_info, &iterate_info);
     dyld_shared_cache_info_destroy(&dsc_info);
 
+    free(iterate_info.image_numbers);
+
     /*
      * We may have opened combine_file, which we should turn over to the caller.
      */
@@ -1349,6 +2756,70 @@ parse_dsc_for_main_while_recursing(
     return E_PARSE_DSC_FOR_MAIN_OK;
 }
 
+/*
+ * Files that turn out to not be dyld_shared_caches are left out of the stats,
+ * as they're instead parsed as another filetype.
+ */
+
+static void
+add_file_stats(const struct parse_dsc_for_main_args *__notnull const args,
+               struct tbd_stats *__notnull const stats,
+               const uint64_t begin,
+               const enum parse_dsc_for_main_result result)
+{
+    args->tbd->info.stats = NULL;
+    if (result == E_PARSE_DSC_FOR_MAIN_NOT_A_SHARED_CACHE) {
+        return;
+    }
+
+    stats->elapsed = tbd_stats_get_time() - begin;
+    tbd_stats_report_add_file(args->tbd->stats_report,
+                              args->dsc_dir_path,
+                              args->dsc_dir_path_length,
+                              args->dsc_name,
+                              args->dsc_name_length,
+                              stats);
+}
+
+enum parse_dsc_for_main_result
+parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
+    struct tbd_for_main *const tbd = args.tbd;
+    if (tbd->stats_report == NULL) {
+        return parse_dsc(args);
+    }
+
+    struct tbd_stats stats = {};
+    const uint64_t begin = tbd_stats_get_time();
+
+    tbd->info.stats = &stats;
+
+    const enum parse_dsc_for_main_result result = parse_dsc(args);
+    add_file_stats(&args, &stats, begin, result);
+
+    return result;
+}
+
+enum parse_dsc_for_main_result
+parse_dsc_for_main_while_recursing(
+    struct parse_dsc_for_main_args *__notnull const args)
+{
+    struct tbd_for_main *const tbd = args->tbd;
+    if (tbd->stats_report == NULL) {
+        return parse_dsc_while_recursing(args);
+    }
+
+    struct tbd_stats stats = {};
+    const uint64_t begin = tbd_stats_get_time();
+
+    tbd->info.stats = &stats;
+
+    const enum parse_dsc_for_main_result result =
+        parse_dsc_while_recursing(args);
+
+    add_file_stats(args, &stats, begin, result);
+    return result;
+}
+
 void print_list_of_dsc_images(const int fd) {
     char magic[16] = {};
     if (our_read(fd, &magic, sizeof(magic)) < 0) {
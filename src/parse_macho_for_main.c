@@ -6,10 +6,12 @@
 //  Copyright © 2018 - 2020 inoahdev. All rights reserved.
 //
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include <stdlib.h>
 #include <string.h>
@@ -21,6 +23,7 @@
 #include "parse_macho_for_main.h"
 #include "recursive.h"
 #include "tbd.h"
+#include "tbd_cache.h"
 #include "tbd_for_main.h"
 
 static void verify_write_path(const struct tbd_for_main *__notnull const tbd) {
@@ -127,51 +130,145 @@ open_file_for_path_while_recursing(struct parse_macho_for_main_args *const args,
     }
 
     const struct tbd_for_main *const tbd = args->tbd;
-    const enum tbd_for_main_open_write_file_result open_file_result =
-        tbd_for_main_open_write_file_for_path(tbd,
-                                              write_path,
-                                              write_path_length,
-                                              &file,
-                                              terminator_out);
+    file = tbd_for_main_open_write_file_or_print_error(tbd,
+                                                       write_path,
+                                                       write_path_length,
+                                                       terminator_out);
 
-    switch (open_file_result) {
-        case E_TBD_FOR_MAIN_OPEN_WRITE_FILE_OK:
-            break;
+    if (file == NULL) {
+        return NULL;
+    }
 
-        case E_TBD_FOR_MAIN_OPEN_WRITE_FILE_FAILED:
-            fprintf(stderr,
-                    "Failed to open write-file (at path: %s), error: %s\n",
-                    write_path,
-                    strerror(errno));
+    if (tbd->options.combine_tbds) {
+        args->combine_file = file;
+    }
 
-            return NULL;
+    return file;
+}
 
-        case E_TBD_FOR_MAIN_OPEN_WRITE_FILE_PATH_ALREADY_EXISTS:
-            if (tbd->options.ignore_warnings) {
-                return NULL;
-            }
+/*
+ * Look up the mach-o file in the conversion-cache, when caching.
+ *
+ * The file is mapped to create the entry's key, and the map is returned in
+ * map_out so the file can be parsed out of the same map, or NULL if the file
+ * wasn't mapped.
+ *
+ * Returns the entry the file should be written out through, or NULL if the file
+ * cannot be cached.
+ */
+
+static struct tbd_cache_entry *
+find_cache_entry(struct tbd_for_main *__notnull const tbd,
+                 const struct macho_file *__notnull const macho,
+                 struct tbd_cache_entry *__notnull const entry,
+                 uint8_t **__notnull const map_out)
+{
+    if (tbd->cache_path == NULL) {
+        return NULL;
+    }
 
-            fprintf(stderr,
-                    "File at write-path (%s) already exists\n",
-                    write_path);
+    const uint64_t size = macho->range.end;
+    uint8_t *const map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, macho->fd, 0);
 
-            return NULL;
+    if (map == MAP_FAILED) {
+        return NULL;
     }
 
-    if (tbd->options.combine_tbds) {
-        args->combine_file = file;
+    *map_out = map;
+    if (!tbd_cache_entry_create_for_macho(entry, tbd, map, size)) {
+        return NULL;
     }
 
-    return file;
+    tbd->cache_entry = entry;
+    return entry;
 }
 
-enum parse_macho_for_main_result
-parse_macho_file_for_main(const struct parse_macho_for_main_args args) {
-    struct macho_file macho = {};
-    struct range range = {};
+/*
+ * Parse the mach-o file out of map if it was already mapped by
+ * find_cache_entry(), and out of the file otherwise.
+ */
+
+static enum macho_file_parse_result
+parse_macho_from_map_or_file(
+    struct tbd_for_main *__notnull const tbd,
+    struct macho_file *__notnull const macho,
+    const uint8_t *const map,
+    const struct macho_file_parse_extra_args extra)
+{
+    struct tbd_create_info *const info = &tbd->info;
+    if (map == NULL) {
+        return macho_file_parse_from_file(info,
+                                          macho,
+                                          extra,
+                                          tbd->parse_options,
+                                          tbd->macho_options);
+    }
+
+    /*
+     * The map is unmapped right after parsing, so all strings have to be
+     * copied.
+     */
 
+    struct macho_file_parse_options options = tbd->macho_options;
+    options.copy_strings_in_map = true;
+
+    return macho_file_parse_from_map(info,
+                                     macho,
+                                     map,
+                                     extra,
+                                     tbd->parse_options,
+                                     options);
+}
+
+static void
+unmap_macho_file(const struct macho_file *__notnull const macho,
+                 uint8_t *const map)
+{
+    if (map != NULL) {
+        munmap(map, macho->range.end);
+    }
+}
+
+static void
+clear_cache_entry(struct tbd_for_main *__notnull const tbd,
+                  struct tbd_cache_entry *__notnull const entry)
+{
+    tbd->cache_entry = NULL;
+    tbd_cache_entry_destroy(entry);
+}
+
+static inline bool
+needs_parse(const struct tbd_cache_entry *const entry) {
+    return (entry == NULL || !entry->has_document);
+}
+
+static enum macho_file_open_result
+open_macho_file(const struct parse_macho_for_main_args *__notnull const args,
+                struct macho_file *__notnull const macho)
+{
+    struct tbd_stats *const stats = args->tbd->info.stats;
+    enum tbd_stats_phase prev_phase = TBD_STATS_PHASE_NONE;
+
+    if (stats != NULL) {
+        prev_phase = tbd_stats_enter_phase(stats, TBD_STATS_PHASE_OPEN);
+    }
+
+    const struct range range = {};
+    const enum macho_file_open_result result =
+        macho_file_open(macho, args->magic_buffer, args->fd, range);
+
+    if (stats != NULL) {
+        tbd_stats_leave_phase(stats, prev_phase);
+    }
+
+    return result;
+}
+
+static enum parse_macho_for_main_result
+parse_macho_file(const struct parse_macho_for_main_args args) {
+    struct macho_file macho = {};
     const enum macho_file_open_result open_macho_result =
-        macho_file_open(&macho, args.magic_buffer, args.fd, range);
+        open_macho_file(&args, &macho);
 
     switch (open_macho_result) {
         case E_MACHO_FILE_OPEN_OK:
@@ -224,23 +321,32 @@ parse_macho_file_for_main(const struct parse_macho_for_main_args args) {
         .export_trie_sb = &sb_buffer
     };
 
-    const enum macho_file_parse_result parse_macho_result =
-        macho_file_parse_from_file(info,
-                                   &macho,
-                                   extra,
-                                   args.tbd->parse_options,
-                                   args.tbd->macho_options);
-
-    if (parse_macho_result != E_MACHO_FILE_PARSE_OK) {
-        tbd_create_info_clear_fields_and_create_from(info, orig);
-        handle_macho_file_parse_result(args.dir_path,
-                                       args.name,
-                                       parse_macho_result,
-                                       args.print_paths,
-                                       false,
-                                       args.tbd->options.ignore_warnings);
+    uint8_t *map = NULL;
+    struct tbd_cache_entry cache_entry = {};
 
-        return E_PARSE_MACHO_FOR_MAIN_OTHER_ERROR;
+    const struct tbd_cache_entry *const entry =
+        find_cache_entry(args.tbd, &macho, &cache_entry, &map);
+
+    if (needs_parse(entry)) {
+        const enum macho_file_parse_result parse_macho_result =
+            parse_macho_from_map_or_file(args.tbd, &macho, map, extra);
+
+        unmap_macho_file(&macho, map);
+        if (parse_macho_result != E_MACHO_FILE_PARSE_OK) {
+            clear_cache_entry(args.tbd, &cache_entry);
+            tbd_create_info_clear_fields_and_create_from(info, orig);
+
+            handle_macho_file_parse_result(args.dir_path,
+                                           args.name,
+                                           parse_macho_result,
+                                           args.print_paths,
+                                           false,
+                                           args.tbd->options.ignore_warnings);
+
+            return E_PARSE_MACHO_FOR_MAIN_OTHER_ERROR;
+        }
+    } else {
+        unmap_macho_file(&macho, map);
     }
 
     if (args.options.verify_write_path) {
@@ -260,7 +366,9 @@ parse_macho_file_for_main(const struct parse_macho_for_main_args args) {
                                   &terminator);
 
         if (file == NULL) {
+            clear_cache_entry(args.tbd, &cache_entry);
             tbd_create_info_clear_fields_and_create_from(info, orig);
+
             return E_PARSE_MACHO_FOR_MAIN_OK;
         }
 
@@ -276,19 +384,74 @@ parse_macho_file_for_main(const struct parse_macho_for_main_args args) {
         tbd_for_main_write_to_stdout(args.tbd, args.dir_path, true);
     }
 
+    clear_cache_entry(args.tbd, &cache_entry);
     tbd_create_info_clear_fields_and_create_from(info, orig);
+
     return E_PARSE_MACHO_FOR_MAIN_OK;
 }
 
-enum parse_macho_for_main_result
-parse_macho_file_for_main_while_recursing(
+struct locked_error_cb_info {
+    struct handle_macho_file_parse_error_cb_info cb_info;
+    pthread_mutex_t *orig_lock;
+};
+
+static bool
+locked_error_callback(struct tbd_create_info *__notnull const info_in,
+                      const enum macho_file_parse_callback_type type,
+                      void *const callback_info)
+{
+    struct locked_error_cb_info *const locked_info =
+        (struct locked_error_cb_info *)callback_info;
+
+    struct tbd_for_main *const orig = locked_info->cb_info.orig;
+    struct tbd_for_main *const tbd = locked_info->cb_info.tbd;
+
+    pthread_mutex_lock(locked_info->orig_lock);
+
+    /*
+     * Share the user's retained answers between all threads through orig, so
+     * the user isn't asked again after choosing to never be asked.
+     */
+
+    tbd->retained = orig->retained;
+
+    const bool result =
+        handle_macho_file_for_main_error_callback(info_in,
+                                                  type,
+                                                  &locked_info->cb_info);
+
+    orig->retained = tbd->retained;
+    pthread_mutex_unlock(locked_info->orig_lock);
+
+    return result;
+}
+
+static void
+clear_info_while_recursing(
+    const struct parse_macho_for_main_args *__notnull const args)
+{
+    pthread_mutex_t *const orig_lock = args->orig_lock;
+    if (orig_lock == NULL) {
+        tbd_create_info_clear_fields_and_create_from(&args->tbd->info,
+                                                     &args->orig->info);
+
+        return;
+    }
+
+    pthread_mutex_lock(orig_lock);
+    tbd_create_info_clear_fields_and_create_from(&args->tbd->info,
+                                                 &args->orig->info);
+
+    pthread_mutex_unlock(orig_lock);
+}
+
+static enum parse_macho_for_main_result
+parse_macho_file_while_recursing(
     struct parse_macho_for_main_args *__notnull const args)
 {
     struct macho_file macho = {};
-    struct range range = {};
-
     const enum macho_file_open_result open_macho_result =
-        macho_file_open(&macho, args->magic_buffer, args->fd, range);
+        open_macho_file(args, &macho);
 
     switch (open_macho_result) {
         case E_MACHO_FILE_OPEN_OK:
@@ -329,54 +492,80 @@ parse_macho_file_for_main_while_recursing(
     struct tbd_create_info *const info = &tbd->info;
 
     struct tbd_for_main *const orig = args->orig;
-    struct tbd_create_info *const orig_info = &orig->info;
 
     const char *const dir_path = args->dir_path;
     const char *const name = args->name;
     const bool print_paths = args->print_paths;
 
-    const struct handle_macho_file_parse_error_cb_info cb_info = {
-        .orig = orig,
-        .tbd = tbd,
+    const struct locked_error_cb_info locked_info = {
+        .cb_info = {
+            .orig = orig,
+            .tbd = tbd,
+
+            .dir_path = dir_path,
+            .name = name,
 
-        .dir_path = dir_path,
-        .name = name,
+            .print_paths = print_paths,
+            .is_recursing = true
+        },
 
-        .print_paths = print_paths,
-        .is_recursing = true
+        .orig_lock = args->orig_lock
     };
 
     struct macho_file_parse_extra_args extra = {
         .callback = handle_macho_file_for_main_error_callback,
-        .cb_info = (void *)&cb_info,
+        .cb_info = (void *)&locked_info.cb_info,
         .export_trie_sb = args->export_trie_sb
     };
 
-    const enum macho_file_parse_result parse_macho_result =
-        macho_file_parse_from_file(info,
-                                   &macho,
-                                   extra,
-                                   tbd->parse_options,
-                                   tbd->macho_options);
-
-    if (parse_macho_result != E_MACHO_FILE_PARSE_OK) {
-        tbd_create_info_clear_fields_and_create_from(info, orig_info);
-        handle_macho_file_parse_result(dir_path,
-                                       name,
-                                       parse_macho_result,
-                                       print_paths,
-                                       true,
-                                       tbd->options.ignore_warnings);
+    if (args->orig_lock != NULL) {
+        extra.callback = locked_error_callback;
+        extra.cb_info = (void *)&locked_info;
+    }
+
+    /*
+     * Set ignore_footer before looking up the cache-entry, as the footer is
+     * part of the cached document.
+     */
 
-        return E_PARSE_MACHO_FOR_MAIN_OTHER_ERROR;
+    const bool should_combine = tbd->options.combine_tbds;
+    if (should_combine) {
+        tbd->write_options.ignore_footer = true;
     }
 
-    tbd_for_main_handle_post_parse(tbd);
+    uint8_t *map = NULL;
+    struct tbd_cache_entry cache_entry = {};
+
+    const struct tbd_cache_entry *const entry =
+        find_cache_entry(tbd, &macho, &cache_entry, &map);
+
+    if (needs_parse(entry)) {
+        const enum macho_file_parse_result parse_macho_result =
+            parse_macho_from_map_or_file(tbd, &macho, map, extra);
+
+        unmap_macho_file(&macho, map);
+        if (parse_macho_result != E_MACHO_FILE_PARSE_OK) {
+            clear_cache_entry(tbd, &cache_entry);
+            clear_info_while_recursing(args);
+
+            handle_macho_file_parse_result(dir_path,
+                                           name,
+                                           parse_macho_result,
+                                           print_paths,
+                                           true,
+                                           tbd->options.ignore_warnings);
+
+            return E_PARSE_MACHO_FOR_MAIN_OTHER_ERROR;
+        }
+
+        tbd_for_main_handle_post_parse(tbd);
+    } else {
+        unmap_macho_file(&macho, map);
+    }
 
     char *write_path = NULL;
     uint64_t write_path_length = 0;
 
-    const bool should_combine = tbd->options.combine_tbds;
     if (!should_combine) {
         write_path =
             tbd_for_main_create_write_path_for_recursing(tbd,
@@ -390,8 +579,18 @@ parse_macho_file_for_main_while_recursing(
     } else {
         write_path = tbd->write_path;
         write_path_length = tbd->write_path_length;
+    }
 
-        tbd->write_options.ignore_footer = true;
+    if (args->combine_sb != NULL) {
+        tbd_for_main_write_to_buffer(tbd,
+                                     write_path,
+                                     args->combine_sb,
+                                     print_paths);
+
+        clear_cache_entry(tbd, &cache_entry);
+        clear_info_while_recursing(args);
+
+        return E_PARSE_MACHO_FOR_MAIN_OK;
     }
 
     char *terminator = NULL;
@@ -406,7 +605,9 @@ parse_macho_file_for_main_while_recursing(
             free(write_path);
         }
 
-        tbd_create_info_clear_fields_and_create_from(info, orig_info);
+        clear_cache_entry(tbd, &cache_entry);
+        clear_info_while_recursing(args);
+
         return E_PARSE_MACHO_FOR_MAIN_OTHER_ERROR;
     }
 
@@ -422,6 +623,72 @@ parse_macho_file_for_main_while_recursing(
         free(write_path);
     }
 
-    tbd_create_info_clear_fields_and_create_from(info, orig_info);
+    clear_cache_entry(tbd, &cache_entry);
+    clear_info_while_recursing(args);
+
     return E_PARSE_MACHO_FOR_MAIN_OK;
 }
+
+/*
+ * Files that turn out to not be mach-o files are left out of the stats, as
+ * they're instead parsed as another filetype.
+ */
+
+static void
+add_file_stats(const struct parse_macho_for_main_args *__notnull const args,
+               struct tbd_stats *__notnull const stats,
+               const uint64_t begin,
+               const enum parse_macho_for_main_result result)
+{
+    args->tbd->info.stats = NULL;
+    if (result == E_PARSE_MACHO_FOR_MAIN_NOT_A_MACHO) {
+        return;
+    }
+
+    stats->elapsed = tbd_stats_get_time() - begin;
+    tbd_stats_report_add_file(args->tbd->stats_report,
+                              args->dir_path,
+                              args->dir_path_length,
+                              args->name,
+                              args->name_length,
+                              stats);
+}
+
+enum parse_macho_for_main_result
+parse_macho_file_for_main(const struct parse_macho_for_main_args args) {
+    struct tbd_for_main *const tbd = args.tbd;
+    if (tbd->stats_report == NULL) {
+        return parse_macho_file(args);
+    }
+
+    struct tbd_stats stats = {};
+    const uint64_t begin = tbd_stats_get_time();
+
+    tbd->info.stats = &stats;
+
+    const enum parse_macho_for_main_result result = parse_macho_file(args);
+    add_file_stats(&args, &stats, begin, result);
+
+    return result;
+}
+
+enum parse_macho_for_main_result
+parse_macho_file_for_main_while_recursing(
+    struct parse_macho_for_main_args *__notnull const args)
+{
+    struct tbd_for_main *const tbd = args->tbd;
+    if (tbd->stats_report == NULL) {
+        return parse_macho_file_while_recursing(args);
+    }
+
+    struct tbd_stats stats = {};
+    const uint64_t begin = tbd_stats_get_time();
+
+    tbd->info.stats = &stats;
+
+    const enum parse_macho_for_main_result result =
+        parse_macho_file_while_recursing(args);
+
+    add_file_stats(args, &stats, begin, result);
+    return result;
+}
@@ -6,8 +6,11 @@
 //  Copyright © 2018 - 2020 inoahdev. All rights reserved.
 //
 
-#include "range.h"
 #include <stdint.h>
+#include <stdlib.h>
+
+#include "notnull.h"
+#include "range.h"
 
 uint64_t range_get_size(const struct range range) {
     return (range.end - range.begin);
@@ -58,3 +61,87 @@ bool ranges_overlap(const struct range left, const struct range right) {
     return (right.begin < left.begin && right.end > left.end);
 }
 
+int
+range_begin_comparator(const void *__notnull const left,
+                       const void *__notnull const right)
+{
+    const uint64_t left_begin = ((const struct range *)left)->begin;
+    const uint64_t right_begin = ((const struct range *)right)->begin;
+
+    if (left_begin < right_begin) {
+        return -1;
+    } else if (left_begin > right_begin) {
+        return 1;
+    }
+
+    return 0;
+}
+
+void ranges_sort(struct range *const ranges, const uint64_t count) {
+    if (count < 2) {
+        return;
+    }
+
+    qsort(ranges, count, sizeof(struct range), range_begin_comparator);
+}
+
+uint64_t
+ranges_sort_and_merge(struct range *const ranges, const uint64_t count) {
+    if (count == 0) {
+        return 0;
+    }
+
+    ranges_sort(ranges, count);
+
+    struct range *back = ranges;
+    const struct range *const end = ranges + count;
+
+    for (const struct range *iter = ranges + 1; iter != end; iter++) {
+        if (iter->begin <= back->end) {
+            if (iter->end > back->end) {
+                back->end = iter->end;
+            }
+
+            continue;
+        }
+
+        back++;
+        *back = *iter;
+    }
+
+    return (uint64_t)(back - ranges) + 1;
+}
+
+bool ranges_have_overlap(struct range *const ranges, const uint64_t count) {
+    if (count < 2) {
+        return false;
+    }
+
+    ranges_sort(ranges, count);
+
+    /*
+     * Once sorted, a range overlaps a range before it only if it begins before
+     * the furthest end of the ranges before it.
+     */
+
+    uint64_t furthest_end = 0;
+
+    const struct range *iter = ranges;
+    const struct range *const end = ranges + count;
+
+    for (; iter != end; iter++) {
+        if (iter->begin == iter->end) {
+            continue;
+        }
+
+        if (iter->begin < furthest_end) {
+            return true;
+        }
+
+        if (iter->end > furthest_end) {
+            furthest_end = iter->end;
+        }
+    }
+
+    return false;
+}
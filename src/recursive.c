@@ -226,7 +226,12 @@ reverse_mkdir_ignoring_last(char *__notnull const path,
         const int ret = our_mkdir(path, mode);
         restore_slash_c_str(slash);
 
-        if (unlikely(ret < 0)) {
+        /*
+         * The directory may have been created in the meantime when files are
+         * written out from multiple threads.
+         */
+
+        if (unlikely(ret < 0) && errno != EEXIST) {
             return 1;
         }
 
@@ -320,7 +325,7 @@ mkdir_r(char *__notnull const path,
         return 1;
     }
 
-    if (our_mkdir(path, mode) < 0) {
+    if (our_mkdir(path, mode) < 0 && errno != EEXIST) {
         return 1;
     }
 
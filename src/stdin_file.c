@@ -0,0 +1,629 @@
+//
+//  src/stdin_file.c
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mach-o/loader.h"
+#include "mach-o/nlist.h"
+
+#include "array.h"
+#include "guard_overflow.h"
+#include "objc.h"
+#include "our_io.h"
+#include "range.h"
+#include "stdin_file.h"
+#include "swap.h"
+
+/*
+ * Create an anonymous file, which is removed from the filesystem (if it was
+ * ever there) as soon as it's closed.
+ */
+
+static int create_anonymous_file(void) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    const int memfd = memfd_create("tbd-stdin", MFD_CLOEXEC);
+    if (memfd != -1) {
+        return memfd;
+    }
+#endif
+
+    const char *tmpdir = getenv("TMPDIR");
+    if (tmpdir == NULL || tmpdir[0] == '\0') {
+        tmpdir = "/tmp";
+    }
+
+    const size_t tmpdir_length = strlen(tmpdir);
+    const char template[] = "/tbd-stdin.XXXXXX";
+
+    char *const path = malloc(tmpdir_length + sizeof(template));
+    if (path == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memcpy(path, tmpdir, tmpdir_length);
+    memcpy(path + tmpdir_length, template, sizeof(template));
+
+    const int fd = mkstemp(path);
+    if (fd != -1) {
+        our_unlink(path);
+    }
+
+    free(path);
+    return fd;
+}
+
+/*
+ * Read from stdin until either size bytes were read, or the end of the input
+ * was reached. Returns the number of bytes read, or -1 on failure.
+ */
+
+static ssize_t read_stdin_fully(void *const buf, const size_t size) {
+    uint8_t *iter = buf;
+    size_t left = size;
+
+    while (left != 0) {
+        const ssize_t read_size = our_read(STDIN_FILENO, iter, left);
+        if (read_size < 0) {
+            return -1;
+        }
+
+        if (read_size == 0) {
+            break;
+        }
+
+        iter += read_size;
+        left -= (size_t)read_size;
+    }
+
+    return (ssize_t)(size - left);
+}
+
+static int close_with_errno(const int fd) {
+    const int saved_errno = errno;
+
+    close(fd);
+    errno = saved_errno;
+
+    return -1;
+}
+
+/*
+ * Copy the rest of stdin to the end of fd, and seek fd back to its start.
+ */
+
+static int spool_stdin(const int fd) {
+    char buffer[65536];
+    do {
+        const ssize_t read_size =
+            our_read(STDIN_FILENO, buffer, sizeof(buffer));
+
+        if (read_size == 0) {
+            break;
+        }
+
+        if (read_size < 0) {
+            return close_with_errno(fd);
+        }
+
+        if (our_write(fd, buffer, (size_t)read_size) < 0) {
+            return close_with_errno(fd);
+        }
+    } while (true);
+
+    if (our_lseek(fd, 0, SEEK_SET) < 0) {
+        return close_with_errno(fd);
+    }
+
+    return fd;
+}
+
+static int
+write_at_offset(const int fd, const void *const buf, size_t size, off_t offset)
+{
+    const uint8_t *iter = buf;
+    while (size != 0) {
+        const ssize_t num = pwrite(fd, iter, size, offset);
+        if (num < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+        }
+
+        iter += num;
+        size -= (size_t)num;
+        offset += num;
+    }
+
+    return 0;
+}
+
+static void
+add_needed_range(struct array *__notnull const ranges,
+                 const uint64_t begin,
+                 const uint64_t size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    uint64_t end = begin;
+    if (guard_overflow_add(&end, size)) {
+        end = UINT64_MAX;
+    }
+
+    const struct range range = {
+        .begin = begin,
+        .end = end
+    };
+
+    const enum array_result add_range_result =
+        array_add_item(ranges, sizeof(range), &range, NULL);
+
+    if (add_range_result != E_ARRAY_OK) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+}
+
+static inline uint32_t get_field(const uint32_t field, const bool big_endian) {
+    if (big_endian) {
+        return swap_uint32(field);
+    }
+
+    return field;
+}
+
+static bool is_needed_section_name(const char name[const 16]) {
+    return (strncmp(name, "__objc_imageinfo", 16) == 0 ||
+            strncmp(name, "__image_info", 16) == 0);
+}
+
+/*
+ * Collect the ranges of a mach-o file that are parsed past its load-commands:
+ * the symbol and string tables, the export-trie, and the objc image-info
+ * sections. Malformed load-commands are skipped here, and left for the parser
+ * to report.
+ */
+
+static void
+collect_needed_ranges(const uint8_t *__notnull const lc_begin,
+                      const uint32_t sizeofcmds,
+                      const bool is_64,
+                      const bool big_endian,
+                      struct array *__notnull const ranges)
+{
+    const uint8_t *iter = lc_begin;
+    uint32_t size_left = sizeofcmds;
+
+    while (size_left >= sizeof(struct load_command)) {
+        const struct load_command *const lc =
+            (const struct load_command *)iter;
+
+        const uint32_t cmd = get_field(lc->cmd, big_endian);
+        const uint32_t cmdsize = get_field(lc->cmdsize, big_endian);
+
+        if (cmdsize < sizeof(struct load_command) || cmdsize > size_left) {
+            break;
+        }
+
+        switch (cmd) {
+            case LC_SYMTAB: {
+                if (cmdsize < sizeof(struct symtab_command)) {
+                    break;
+                }
+
+                const struct symtab_command *const symtab =
+                    (const struct symtab_command *)iter;
+
+                uint64_t symbols_size =
+                    is_64 ? sizeof(struct nlist_64) : sizeof(struct nlist);
+
+                symbols_size *= get_field(symtab->nsyms, big_endian);
+
+                add_needed_range(ranges,
+                                 get_field(symtab->symoff, big_endian),
+                                 symbols_size);
+
+                add_needed_range(ranges,
+                                 get_field(symtab->stroff, big_endian),
+                                 get_field(symtab->strsize, big_endian));
+
+                break;
+            }
+
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY: {
+                if (cmdsize < sizeof(struct dyld_info_command)) {
+                    break;
+                }
+
+                const struct dyld_info_command *const dyld_info =
+                    (const struct dyld_info_command *)iter;
+
+                add_needed_range(ranges,
+                                 get_field(dyld_info->export_off, big_endian),
+                                 get_field(dyld_info->export_size, big_endian));
+
+                break;
+            }
+
+            case LC_DYLD_EXPORTS_TRIE: {
+                if (cmdsize < sizeof(struct linkedit_data_command)) {
+                    break;
+                }
+
+                const struct linkedit_data_command *const linkedit_data =
+                    (const struct linkedit_data_command *)iter;
+
+                add_needed_range(ranges,
+                                 get_field(linkedit_data->dataoff, big_endian),
+                                 get_field(linkedit_data->datasize,
+                                           big_endian));
+
+                break;
+            }
+
+            case LC_SEGMENT: {
+                if (cmdsize < sizeof(struct segment_command)) {
+                    break;
+                }
+
+                const struct segment_command *const segment =
+                    (const struct segment_command *)iter;
+
+                const uint64_t max_nsects =
+                    (cmdsize - sizeof(*segment)) / sizeof(struct section);
+
+                uint64_t nsects = get_field(segment->nsects, big_endian);
+                if (nsects > max_nsects) {
+                    nsects = max_nsects;
+                }
+
+                const struct section *sect =
+                    (const struct section *)(segment + 1);
+
+                for (uint64_t i = 0; i != nsects; i++, sect++) {
+                    if (!is_needed_section_name(sect->sectname)) {
+                        continue;
+                    }
+
+                    add_needed_range(ranges,
+                                     get_field(sect->offset, big_endian),
+                                     get_field(sect->size, big_endian));
+                }
+
+                break;
+            }
+
+            case LC_SEGMENT_64: {
+                if (cmdsize < sizeof(struct segment_command_64)) {
+                    break;
+                }
+
+                const struct segment_command_64 *const segment =
+                    (const struct segment_command_64 *)iter;
+
+                const uint64_t max_nsects =
+                    (cmdsize - sizeof(*segment)) / sizeof(struct section_64);
+
+                uint64_t nsects = get_field(segment->nsects, big_endian);
+                if (nsects > max_nsects) {
+                    nsects = max_nsects;
+                }
+
+                const struct section_64 *sect =
+                    (const struct section_64 *)(segment + 1);
+
+                for (uint64_t i = 0; i != nsects; i++, sect++) {
+                    if (!is_needed_section_name(sect->sectname)) {
+                        continue;
+                    }
+
+                    /*
+                     * Only an objc_image_info-sized section is ever parsed,
+                     * so larger sizes are clamped rather than swapped.
+                     */
+
+                    uint64_t size = sect->size;
+                    if (big_endian) {
+                        size = swap_uint64(size);
+                    }
+
+                    if (size > sizeof(struct objc_image_info)) {
+                        size = sizeof(struct objc_image_info);
+                    }
+
+                    add_needed_range(ranges,
+                                     get_field(sect->offset, big_endian),
+                                     size);
+                }
+
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        iter += cmdsize;
+        size_left -= cmdsize;
+    }
+}
+
+/*
+ * Stream a single-arch mach-o file from stdin into fd, after its header and
+ * load-commands were already read into lc_buffer.
+ *
+ * The rest of stdin is read sequentially, and only the bytes inside the needed
+ * ranges are written out, in increasing-offset order. Everything else is
+ * discarded, and left as a hole in fd, which is then extended to the full size
+ * of the input so the parser's bounds-checks still hold.
+ */
+
+static int
+stream_macho(const int fd,
+             const uint8_t *__notnull const lc_buffer,
+             const uint32_t lc_buffer_size,
+             const uint32_t header_size,
+             const uint32_t sizeofcmds,
+             const bool is_64,
+             const bool big_endian)
+{
+    if (write_at_offset(fd, lc_buffer, lc_buffer_size, 0) != 0) {
+        return close_with_errno(fd);
+    }
+
+    struct array ranges = {};
+    collect_needed_ranges(lc_buffer + header_size,
+                          sizeofcmds,
+                          is_64,
+                          big_endian,
+                          &ranges);
+
+    const uint64_t ranges_count =
+        ranges_sort_and_merge(ranges.data, ranges.item_count);
+
+    const struct range *range = ranges.data;
+    const struct range *const ranges_end = range + ranges_count;
+
+    uint64_t offset = lc_buffer_size;
+    uint8_t buffer[65536];
+
+    do {
+        const ssize_t read_size =
+            our_read(STDIN_FILENO, buffer, sizeof(buffer));
+
+        if (read_size == 0) {
+            break;
+        }
+
+        if (read_size < 0) {
+            array_destroy(&ranges);
+            return close_with_errno(fd);
+        }
+
+        const uint64_t buffer_end = offset + (uint64_t)read_size;
+        for (; range != ranges_end; range++) {
+            if (range->begin >= buffer_end) {
+                break;
+            }
+
+            const uint64_t begin =
+                (range->begin > offset) ? range->begin : offset;
+            const uint64_t end =
+                (range->end < buffer_end) ? range->end : buffer_end;
+
+            if (begin < end) {
+                const int write_result =
+                    write_at_offset(fd,
+                                    buffer + (begin - offset),
+                                    end - begin,
+                                    (off_t)begin);
+
+                if (write_result != 0) {
+                    array_destroy(&ranges);
+                    return close_with_errno(fd);
+                }
+            }
+
+            /*
+             * Keep the current range if it continues into the next buffer.
+             */
+
+            if (range->end > buffer_end) {
+                break;
+            }
+        }
+
+        offset = buffer_end;
+    } while (true);
+
+    array_destroy(&ranges);
+
+    if (ftruncate(fd, (off_t)offset) != 0) {
+        return close_with_errno(fd);
+    }
+
+    if (our_lseek(fd, 0, SEEK_SET) < 0) {
+        return close_with_errno(fd);
+    }
+
+    return fd;
+}
+
+/*
+ * Get the header-size of a single-arch mach-o file from its magic, or zero if
+ * magic isn't of a single-arch mach-o file.
+ */
+
+static uint32_t
+get_thin_header_size(const uint32_t magic,
+                     bool *__notnull const is_64_out,
+                     bool *__notnull const big_endian_out)
+{
+    switch (magic) {
+        case MH_MAGIC:
+        case MH_CIGAM:
+            *is_64_out = false;
+            *big_endian_out = (magic == MH_CIGAM);
+
+            return sizeof(struct mach_header);
+
+        case MH_MAGIC_64:
+        case MH_CIGAM_64:
+            *is_64_out = true;
+            *big_endian_out = (magic == MH_CIGAM_64);
+
+            return sizeof(struct mach_header_64);
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+static int read_and_stream_stdin(void) {
+    const int fd = create_anonymous_file();
+    if (fd == -1) {
+        return -1;
+    }
+
+    struct mach_header_64 header = {};
+    const ssize_t header_read_size = read_stdin_fully(&header, sizeof(header));
+
+    if (header_read_size < 0) {
+        return close_with_errno(fd);
+    }
+
+    bool is_64 = false;
+    bool big_endian = false;
+
+    uint32_t header_size = 0;
+    if (header_read_size >= (ssize_t)sizeof(header.magic)) {
+        header_size = get_thin_header_size(header.magic, &is_64, &big_endian);
+    }
+
+    /*
+     * Fat files and dyld_shared_caches are read from all over, so everything
+     * that isn't a complete single-arch mach-o header is spooled as is.
+     */
+
+    if (header_size == 0 || (uint64_t)header_read_size < header_size) {
+        if (our_write(fd, &header, (size_t)header_read_size) < 0) {
+            return close_with_errno(fd);
+        }
+
+        return spool_stdin(fd);
+    }
+
+    /*
+     * A 32-bit header is smaller than header, so the start of the load-commands
+     * may have already been read.
+     */
+
+    const uint32_t sizeofcmds = get_field(header.sizeofcmds, big_endian);
+
+    uint32_t lc_end = header_size;
+    if (guard_overflow_add(&lc_end, sizeofcmds)) {
+        if (our_write(fd, &header, (size_t)header_read_size) < 0) {
+            return close_with_errno(fd);
+        }
+
+        return spool_stdin(fd);
+    }
+
+    const uint32_t prefix_size = (uint32_t)header_read_size;
+    const uint32_t lc_buffer_size =
+        (lc_end > prefix_size) ? lc_end : prefix_size;
+
+    uint8_t *const lc_buffer = malloc(lc_buffer_size);
+    if (lc_buffer == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    memcpy(lc_buffer, &header, prefix_size);
+
+    const ssize_t lc_read_size =
+        read_stdin_fully(lc_buffer + prefix_size,
+                         lc_buffer_size - prefix_size);
+
+    if (lc_read_size < 0) {
+        free(lc_buffer);
+        return close_with_errno(fd);
+    }
+
+    const uint32_t read_size = prefix_size + (uint32_t)lc_read_size;
+
+    /*
+     * A file that ends within its load-commands is invalid, and is written out
+     * as is for the parser to report.
+     */
+
+    if (read_size != lc_buffer_size) {
+        if (our_write(fd, lc_buffer, read_size) < 0) {
+            free(lc_buffer);
+            return close_with_errno(fd);
+        }
+
+        free(lc_buffer);
+        return spool_stdin(fd);
+    }
+
+    const int result =
+        stream_macho(fd,
+                     lc_buffer,
+                     lc_buffer_size,
+                     header_size,
+                     sizeofcmds,
+                     is_64,
+                     big_endian);
+
+    free(lc_buffer);
+    return result;
+}
+
+int stdin_file_open(void) {
+    struct stat sbuf = {};
+    if (fstat(STDIN_FILENO, &sbuf) != 0) {
+        return -1;
+    }
+
+    /*
+     * Only regular files can be both seeked and mapped, so everything else has
+     * to be read into an anonymous file first.
+     */
+
+    if (S_ISREG(sbuf.st_mode)) {
+        if (our_lseek(STDIN_FILENO, 0, SEEK_SET) == 0) {
+            return STDIN_FILENO;
+        }
+    }
+
+    return read_and_stream_stdin();
+}
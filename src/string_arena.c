@@ -0,0 +1,126 @@
+//
+//  src/string_arena.c
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "likely.h"
+#include "string_arena.h"
+
+#define STRING_ARENA_BLOCK_SIZE 65536
+
+struct string_arena_block {
+    struct string_arena_block *next;
+    uint64_t size;
+
+    char data[];
+};
+
+/*
+ * Move on to the next block that is able to hold size bytes, allocating and
+ * linking a new block after the current one if none of the blocks left over
+ * from before the last clear are large enough.
+ */
+
+static struct string_arena_block *
+next_block_for_size(struct string_arena *__notnull const arena,
+                    const uint64_t size)
+{
+    struct string_arena_block *const current = arena->current;
+    struct string_arena_block *next = NULL;
+
+    if (current != NULL) {
+        next = current->next;
+        if (next != NULL && next->size >= size) {
+            arena->current = next;
+            arena->used = 0;
+
+            return next;
+        }
+    } else {
+        next = arena->first;
+        if (next != NULL && next->size >= size) {
+            arena->current = next;
+            arena->used = 0;
+
+            return next;
+        }
+    }
+
+    uint64_t block_size = STRING_ARENA_BLOCK_SIZE;
+    if (block_size < size) {
+        block_size = size;
+    }
+
+    struct string_arena_block *const block =
+        malloc(sizeof(struct string_arena_block) + block_size);
+
+    if (unlikely(block == NULL)) {
+        return NULL;
+    }
+
+    block->next = next;
+    block->size = block_size;
+
+    if (current != NULL) {
+        current->next = block;
+    } else {
+        arena->first = block;
+    }
+
+    arena->current = block;
+    arena->used = 0;
+
+    return block;
+}
+
+char *
+string_arena_copy(struct string_arena *__notnull const arena,
+                  const char *__notnull const string,
+                  const uint64_t length)
+{
+    /*
+     * Add one for the null-terminator.
+     */
+
+    const uint64_t size = length + 1;
+
+    struct string_arena_block *block = arena->current;
+    if (block == NULL || block->size - arena->used < size) {
+        block = next_block_for_size(arena, size);
+        if (unlikely(block == NULL)) {
+            return NULL;
+        }
+    }
+
+    char *const copy = block->data + arena->used;
+
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+
+    arena->used += size;
+    return copy;
+}
+
+void string_arena_clear(struct string_arena *__notnull const arena) {
+    arena->current = NULL;
+    arena->used = 0;
+}
+
+void string_arena_destroy(struct string_arena *__notnull const arena) {
+    struct string_arena_block *block = arena->first;
+    while (block != NULL) {
+        struct string_arena_block *const next = block->next;
+
+        free(block);
+        block = next;
+    }
+
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->used = 0;
+}
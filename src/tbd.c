@@ -12,8 +12,10 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "copy.h"
 #include "likely.h"
+#include "our_io.h"
+#include "string_arena.h"
+#include "string_buffer.h"
 #include "target_list.h"
 #include "tbd.h"
 #include "tbd_write.h"
@@ -415,7 +417,9 @@ add_metadata_with_type(struct tbd_create_info *__notnull const info_in,
         return E_TBD_CI_ADD_DATA_OK;
     }
 
-    info.string = alloc_and_copy(info.string, info.length);
+    info.string =
+        string_arena_copy(&info_in->string_arena, info.string, info.length);
+
     if (unlikely(info.string == NULL)) {
         return E_TBD_CI_ADD_DATA_ALLOC_FAIL;
     }
@@ -429,7 +433,6 @@ add_metadata_with_type(struct tbd_create_info *__notnull const info_in,
         bit_list_create_with_capacity(&info.targets, targets_count);
 
     if (create_bits_result != E_BIT_LIST_OK) {
-        free(info.string);
         return E_TBD_CI_ADD_DATA_ALLOC_FAIL;
     }
 
@@ -448,7 +451,7 @@ add_metadata_with_type(struct tbd_create_info *__notnull const info_in,
                                               NULL);
 
     if (unlikely(add_export_info_result != E_ARRAY_OK)) {
-        free(info.string);
+        bit_list_destroy(&info.targets);
         return E_TBD_CI_ADD_DATA_ARRAY_FAIL;
     }
 
@@ -561,14 +564,211 @@ tbd_ci_get_single_platform(const struct tbd_create_info *__notnull const info) {
     return platform;
 }
 
-enum tbd_ci_add_data_result
-tbd_ci_add_symbol_with_type(struct tbd_create_info *__notnull const info_in,
-                            const char *__notnull const string,
-                            const uint64_t length,
-                            const uint64_t arch_index,
-                            const enum tbd_symbol_type type,
-                            enum tbd_symbol_meta_type meta_type,
-                            const struct tbd_parse_options options)
+/*
+ * Each slot stores the symbol's index into the symbols array plus one, so that
+ * a zeroed slot is empty, along with the lower half of the symbol's hash, so
+ * that most mismatching symbols are skipped without a string compare.
+ */
+
+struct tbd_symbol_index_slot {
+    uint32_t index;
+    uint32_t hash;
+};
+
+#define TBD_SYMBOL_INDEX_MIN_CAPACITY 64
+
+static uint64_t
+hash_symbol(const char *__notnull const string,
+            const uint64_t length,
+            const enum tbd_symbol_meta_type meta_type,
+            const enum tbd_symbol_type type)
+{
+    const uint64_t multiplier = 0x9e3779b97f4a7c15;
+
+    uint64_t hash = length;
+    uint64_t left = length;
+
+    hash ^= ((uint64_t)meta_type << 56) | ((uint64_t)type << 48);
+
+    const char *iter = string;
+
+    /*
+     * Hash the string a word at a time, with the trailing bytes of the string
+     * padded with zeros.
+     */
+
+    for (; left >= sizeof(uint64_t); left -= sizeof(uint64_t)) {
+        uint64_t word = 0;
+        memcpy(&word, iter, sizeof(word));
+
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+
+        iter += sizeof(uint64_t);
+    }
+
+    if (left != 0) {
+        uint64_t word = 0;
+        memcpy(&word, iter, left);
+
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+
+    hash *= multiplier;
+    return hash ^ (hash >> 32);
+}
+
+static struct tbd_symbol_index_slot *
+symbol_index_find_slot(const struct tbd_symbol_index *__notnull const index,
+                       const struct array *__notnull const symbols,
+                       const struct tbd_symbol_info *__notnull const info,
+                       const uint64_t hash)
+{
+    const uint64_t mask = index->capacity - 1;
+    const uint32_t short_hash = (uint32_t)hash;
+
+    struct tbd_symbol_index_slot *const slots = index->slots;
+    const struct tbd_symbol_info *const list = symbols->data;
+
+    for (uint64_t i = hash & mask;; i = (i + 1) & mask) {
+        struct tbd_symbol_index_slot *const slot = slots + i;
+        if (slot->index == 0) {
+            return slot;
+        }
+
+        if (slot->hash != short_hash) {
+            continue;
+        }
+
+        const struct tbd_symbol_info *const existing = list + (slot->index - 1);
+        if (existing->length != info->length) {
+            continue;
+        }
+
+        if (existing->meta_type != info->meta_type) {
+            continue;
+        }
+
+        if (existing->type != info->type) {
+            continue;
+        }
+
+        if (memcmp(existing->string, info->string, info->length) != 0) {
+            continue;
+        }
+
+        return slot;
+    }
+}
+
+/*
+ * Grow the index to keep its load-factor at or below one-half, rehashing the
+ * existing slots with their stored hashes.
+ */
+
+static bool
+symbol_index_grow(struct tbd_symbol_index *__notnull const index,
+                  const uint64_t count)
+{
+    uint64_t capacity = index->capacity;
+    if (capacity == 0) {
+        capacity = TBD_SYMBOL_INDEX_MIN_CAPACITY;
+    }
+
+    while (capacity <= count * 2) {
+        capacity *= 2;
+    }
+
+    if (capacity == index->capacity) {
+        return true;
+    }
+
+    struct tbd_symbol_index_slot *const slots =
+        calloc(capacity, sizeof(struct tbd_symbol_index_slot));
+
+    if (unlikely(slots == NULL)) {
+        return false;
+    }
+
+    const uint64_t mask = capacity - 1;
+
+    struct tbd_symbol_index_slot *old = index->slots;
+    const struct tbd_symbol_index_slot *const old_end = old + index->capacity;
+
+    for (; old != old_end; old++) {
+        if (old->index == 0) {
+            continue;
+        }
+
+        uint64_t i = old->hash & mask;
+        while (slots[i].index != 0) {
+            i = (i + 1) & mask;
+        }
+
+        slots[i] = *old;
+    }
+
+    free(index->slots);
+
+    index->slots = slots;
+    index->capacity = capacity;
+
+    return true;
+}
+
+static void
+symbol_index_destroy(struct tbd_symbol_index *__notnull const index) {
+    free(index->slots);
+
+    index->slots = NULL;
+    index->capacity = 0;
+}
+
+/*
+ * Clearing is done once for every image of a dyld_shared_cache, so an index
+ * much larger than the symbols it last held is freed rather than zeroed, to
+ * keep the cost of clearing proportional to the symbols-count.
+ */
+
+static void
+symbol_index_clear(struct tbd_symbol_index *__notnull const index,
+                   const uint64_t count)
+{
+    const uint64_t capacity = index->capacity;
+    if (capacity == 0) {
+        return;
+    }
+
+    if (capacity > TBD_SYMBOL_INDEX_MIN_CAPACITY && capacity / 8 > count) {
+        symbol_index_destroy(index);
+        return;
+    }
+
+    memset(index->slots, 0, capacity * sizeof(struct tbd_symbol_index_slot));
+}
+
+/*
+ * Whether a symbol needs quotes is already known when the symbol's length had
+ * to be found, as both are found in the same scan of the symbol.
+ */
+
+enum symbol_quotes_status {
+    SYMBOL_QUOTES_UNKNOWN,
+    SYMBOL_QUOTES_NEEDED,
+    SYMBOL_QUOTES_NOT_NEEDED
+};
+
+static enum tbd_ci_add_data_result
+insert_symbol(struct tbd_create_info *__notnull const info_in,
+              const char *__notnull const string,
+              const uint64_t length,
+              const uint64_t arch_index,
+              const enum tbd_symbol_type type,
+              enum tbd_symbol_meta_type meta_type,
+              const bool copy_string,
+              const enum symbol_quotes_status quotes_status,
+              const struct tbd_parse_options options)
 {
     const enum tbd_version version = info_in->version;
     switch (version) {
@@ -672,29 +872,50 @@ tbd_ci_add_symbol_with_type(struct tbd_create_info *__notnull const info_in,
         .meta_type = meta_type
     };
 
-    struct array_cached_index_info cached_info = {};
-    struct tbd_symbol_info *const existing_info =
-        array_find_item_in_sorted(&info_in->fields.symbols,
-                                  sizeof(symbol_info),
-                                  &symbol_info,
-                                  tbd_symbol_info_no_targets_comparator,
-                                  &cached_info);
+    struct array *const symbols = &info_in->fields.symbols;
+    struct tbd_symbol_index *const index = &info_in->symbols_index;
 
-    if (existing_info != NULL) {
+    if (index->capacity <= symbols->item_count * 2) {
+        if (unlikely(!symbol_index_grow(index, symbols->item_count))) {
+            return E_TBD_CI_ADD_DATA_ALLOC_FAIL;
+        }
+    }
+
+    const uint64_t hash = hash_symbol(string, length, meta_type, type);
+    struct tbd_symbol_index_slot *const slot =
+        symbol_index_find_slot(index, symbols, &symbol_info, hash);
+
+    if (slot->index != 0) {
         if (options.ignore_targets) {
             return E_TBD_CI_ADD_DATA_OK;
         }
 
+        struct tbd_symbol_info *const existing_info =
+            (struct tbd_symbol_info *)symbols->data + (slot->index - 1);
+
         bit_list_set_bit(&existing_info->targets, arch_index);
+        if (info_in->stats != NULL) {
+            info_in->stats->duplicates_merged += 1;
+        }
+
         return E_TBD_CI_ADD_DATA_OK;
     }
 
-    symbol_info.string = alloc_and_copy(symbol_info.string, symbol_info.length);
-    if (unlikely(symbol_info.string == NULL)) {
-        return E_TBD_CI_ADD_DATA_ALLOC_FAIL;
+    if (copy_string) {
+        symbol_info.string =
+            string_arena_copy(&info_in->string_arena, string, length);
+
+        if (unlikely(symbol_info.string == NULL)) {
+            return E_TBD_CI_ADD_DATA_ALLOC_FAIL;
+        }
     }
 
-    if (yaml_c_str_needs_quotes(string, length)) {
+    bool needs_quotes = (quotes_status == SYMBOL_QUOTES_NEEDED);
+    if (quotes_status == SYMBOL_QUOTES_UNKNOWN) {
+        needs_quotes = yaml_c_str_needs_quotes(string, length);
+    }
+
+    if (needs_quotes) {
         symbol_info.flags.needs_quotes = true;
     }
 
@@ -703,7 +924,6 @@ tbd_ci_add_symbol_with_type(struct tbd_create_info *__notnull const info_in,
         bit_list_create_with_capacity(&symbol_info.targets, targets_count);
 
     if (create_bits_result != E_BIT_LIST_OK) {
-        free(symbol_info.string);
         return E_TBD_CI_ADD_DATA_ALLOC_FAIL;
     }
 
@@ -713,21 +933,88 @@ tbd_ci_add_symbol_with_type(struct tbd_create_info *__notnull const info_in,
         bit_list_set_bit(&symbol_info.targets, arch_index);
     }
 
+    const uint64_t symbol_index = symbols->item_count;
     const enum array_result add_export_info_result =
-        array_add_item_with_cached_index_info(&info_in->fields.symbols,
-                                              sizeof(symbol_info),
-                                              &symbol_info,
-                                              &cached_info,
-                                              NULL);
+        array_add_item(symbols, sizeof(symbol_info), &symbol_info, NULL);
 
     if (unlikely(add_export_info_result != E_ARRAY_OK)) {
-        free(symbol_info.string);
+        bit_list_destroy(&symbol_info.targets);
         return E_TBD_CI_ADD_DATA_ARRAY_FAIL;
     }
 
+    slot->index = (uint32_t)(symbol_index + 1);
+    slot->hash = (uint32_t)hash;
+
+    if (info_in->stats != NULL) {
+        info_in->stats->symbols_added += 1;
+    }
+
     return E_TBD_CI_ADD_DATA_OK;
 }
 
+static enum tbd_ci_add_data_result
+add_symbol_with_type(struct tbd_create_info *__notnull const info_in,
+                     const char *__notnull const string,
+                     const uint64_t length,
+                     const uint64_t arch_index,
+                     const enum tbd_symbol_type type,
+                     const enum tbd_symbol_meta_type meta_type,
+                     const bool copy_string,
+                     const enum symbol_quotes_status quotes_status,
+                     const struct tbd_parse_options options)
+{
+    struct tbd_stats *const stats = info_in->stats;
+    if (likely(stats == NULL)) {
+        return insert_symbol(info_in,
+                             string,
+                             length,
+                             arch_index,
+                             type,
+                             meta_type,
+                             copy_string,
+                             quotes_status,
+                             options);
+    }
+
+    const enum tbd_stats_phase prev_phase =
+        tbd_stats_enter_phase(stats, TBD_STATS_PHASE_SYMBOLS);
+
+    const enum tbd_ci_add_data_result result =
+        insert_symbol(info_in,
+                      string,
+                      length,
+                      arch_index,
+                      type,
+                      meta_type,
+                      copy_string,
+                      quotes_status,
+                      options);
+
+    tbd_stats_leave_phase(stats, prev_phase);
+    return result;
+}
+
+enum tbd_ci_add_data_result
+tbd_ci_add_symbol_with_type(struct tbd_create_info *__notnull const info_in,
+                            const char *__notnull const string,
+                            const uint64_t length,
+                            const uint64_t arch_index,
+                            const enum tbd_symbol_type type,
+                            const enum tbd_symbol_meta_type meta_type,
+                            const bool copy_string,
+                            const struct tbd_parse_options options)
+{
+    return add_symbol_with_type(info_in,
+                                string,
+                                length,
+                                arch_index,
+                                type,
+                                meta_type,
+                                copy_string,
+                                SYMBOL_QUOTES_UNKNOWN,
+                                options);
+}
+
 
 /*
  * We compare strings by using the largest possible byte size when reading from
@@ -939,9 +1226,13 @@ tbd_ci_add_symbol_with_info(struct tbd_create_info *__notnull const info_in,
                             const enum tbd_symbol_type predefined_type,
                             const enum tbd_symbol_meta_type meta_type,
                             const bool is_exported,
+                            bool copy_string,
                             const struct tbd_parse_options options)
 {
     uint64_t length = 0;
+    uint64_t max_length = lnmax;
+
+    bool needs_quotes = false;
     enum tbd_symbol_type type = TBD_SYMBOL_TYPE_NORMAL;
 
     /*
@@ -973,7 +1264,12 @@ tbd_ci_add_symbol_with_info(struct tbd_create_info *__notnull const info_in,
                     lnmax -= 1;
                 }
 
-                length = strnlen(string, lnmax - offset);
+                max_length = lnmax - offset;
+                length =
+                    yaml_c_str_get_length_and_needs_quotes(string,
+                                                           max_length,
+                                                           &needs_quotes);
+
                 if (likely(length != 0)) {
                     type = TBD_SYMBOL_TYPE_OBJC_CLASS;
                 }
@@ -994,7 +1290,12 @@ tbd_ci_add_symbol_with_info(struct tbd_create_info *__notnull const info_in,
                     lnmax -= 1;
                 }
 
-                length = strnlen(string, lnmax - offset);
+                max_length = lnmax - offset;
+                length =
+                    yaml_c_str_get_length_and_needs_quotes(string,
+                                                           max_length,
+                                                           &needs_quotes);
+
                 if (likely(length != 0)) {
                     type = TBD_SYMBOL_TYPE_OBJC_IVAR;
                 }
@@ -1004,7 +1305,11 @@ tbd_ci_add_symbol_with_info(struct tbd_create_info *__notnull const info_in,
                 }
 
                 string += offset;
-                length = strnlen(string, lnmax - offset);
+                max_length = lnmax - offset;
+                length =
+                    yaml_c_str_get_length_and_needs_quotes(string,
+                                                           max_length,
+                                                           &needs_quotes);
 
                 if (likely(length != 0)) {
                     type = TBD_SYMBOL_TYPE_OBJC_EHTYPE;
@@ -1014,7 +1319,11 @@ tbd_ci_add_symbol_with_info(struct tbd_create_info *__notnull const info_in,
                     return E_TBD_CI_ADD_DATA_OK;
                 }
 
-                length = (uint32_t)strnlen(string, lnmax);
+                length =
+                    yaml_c_str_get_length_and_needs_quotes(string,
+                                                           lnmax,
+                                                           &needs_quotes);
+
                 if (unlikely(length == 0)) {
                     return E_TBD_CI_ADD_DATA_OK;
                 }
@@ -1024,7 +1333,11 @@ tbd_ci_add_symbol_with_info(struct tbd_create_info *__notnull const info_in,
                 return E_TBD_CI_ADD_DATA_OK;
             }
 
-            length = (uint32_t)strnlen(string, lnmax);
+            length =
+                yaml_c_str_get_length_and_needs_quotes(string,
+                                                       lnmax,
+                                                       &needs_quotes);
+
             if (unlikely(length == 0)) {
                 return E_TBD_CI_ADD_DATA_OK;
             }
@@ -1034,7 +1347,11 @@ tbd_ci_add_symbol_with_info(struct tbd_create_info *__notnull const info_in,
             return E_TBD_CI_ADD_DATA_OK;
         }
 
-        length = (uint32_t)strnlen(string, lnmax);
+        length =
+            yaml_c_str_get_length_and_needs_quotes(string,
+                                                   lnmax,
+                                                   &needs_quotes);
+
         if (unlikely(length == 0)) {
             return E_TBD_CI_ADD_DATA_OK;
         }
@@ -1042,14 +1359,30 @@ tbd_ci_add_symbol_with_info(struct tbd_create_info *__notnull const info_in,
         type = predefined_type;
     }
 
+    /*
+     * A string can only be stored without a copy if it was null-terminated
+     * within its max-length.
+     */
+
+    if (length == max_length) {
+        copy_string = true;
+    }
+
+    enum symbol_quotes_status quotes_status = SYMBOL_QUOTES_NOT_NEEDED;
+    if (needs_quotes) {
+        quotes_status = SYMBOL_QUOTES_NEEDED;
+    }
+
     const enum tbd_ci_add_data_result add_symbol_result =
-        tbd_ci_add_symbol_with_type(info_in,
-                                    string,
-                                    length,
-                                    arch_index,
-                                    type,
-                                    meta_type,
-                                    options);
+        add_symbol_with_type(info_in,
+                             string,
+                             length,
+                             arch_index,
+                             type,
+                             meta_type,
+                             copy_string,
+                             quotes_status,
+                             options);
 
     if (add_symbol_result != E_TBD_CI_ADD_DATA_OK) {
         return add_symbol_result;
@@ -1163,6 +1496,7 @@ tbd_ci_add_symbol_with_info_and_len(
                                     arch_index,
                                     type,
                                     meta_type,
+                                    true,
                                     options);
 
     if (add_symbol_result != E_TBD_CI_ADD_DATA_OK) {
@@ -1199,7 +1533,23 @@ tbd_uuid_info_comparator(const void *__notnull const array_item,
     return 0;
 }
 
-void tbd_ci_sort_info(struct tbd_create_info *__notnull const info_in) {
+/*
+ * Symbols are added unsorted, and are only sorted here once parsing has
+ * finished.
+ *
+ * When all symbols share the tbd's full set of targets, only the symbols need
+ * to be sorted, as the uuids and metadata were already added in order.
+ */
+
+static void sort_info(struct tbd_create_info *__notnull const info_in) {
+    if (info_in->flags.uses_full_targets) {
+        array_sort_with_comparator(&info_in->fields.symbols,
+                                   sizeof(struct tbd_symbol_info),
+                                   tbd_symbol_info_no_targets_comparator);
+
+        return;
+    }
+
     array_sort_with_comparator(&info_in->fields.uuids,
                                sizeof(struct tbd_uuid_info),
                                tbd_uuid_info_comparator);
@@ -1213,6 +1563,20 @@ void tbd_ci_sort_info(struct tbd_create_info *__notnull const info_in) {
                                tbd_symbol_info_targets_comparator);
 }
 
+void tbd_ci_sort_info(struct tbd_create_info *__notnull const info_in) {
+    struct tbd_stats *const stats = info_in->stats;
+    if (stats == NULL) {
+        sort_info(info_in);
+        return;
+    }
+
+    const enum tbd_stats_phase prev_phase =
+        tbd_stats_enter_phase(stats, TBD_STATS_PHASE_SORT);
+
+    sort_info(info_in);
+    tbd_stats_leave_phase(stats, prev_phase);
+}
+
 static bool
 tbd_uuid_info_is_unique_comparator(const void *__notnull const array_item,
                                    const void *__notnull const item)
@@ -1262,12 +1626,13 @@ tbd_ci_add_uuid(struct tbd_create_info *__notnull const info_in,
 }
 
 enum tbd_create_result
-tbd_create_with_info(const struct tbd_create_info *__notnull const info,
-                     FILE *__notnull const file,
-                     const struct tbd_create_options options)
+tbd_create_with_info_to_buffer(
+    const struct tbd_create_info *__notnull const info,
+    struct string_buffer *__notnull const sb,
+    const struct tbd_create_options options)
 {
     const enum tbd_version version = info->version;
-    if (tbd_write_magic(file, version)) {
+    if (tbd_write_magic(sb, version)) {
         return E_TBD_CREATE_WRITE_FAIL;
     }
 
@@ -1275,11 +1640,11 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
     const bool uses_archs = tbd_uses_archs(version);
 
     if (!uses_archs) {
-        if (tbd_write_targets_for_header(file, targets, version)) {
+        if (tbd_write_targets_for_header(sb, targets, version)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     } else {
-        if (tbd_write_archs_for_header(file, targets)) {
+        if (tbd_write_archs_for_header(sb, targets)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
@@ -1287,34 +1652,34 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
     if (!options.ignore_uuids) {
         const struct array *const uuids = &info->fields.uuids;
         if (!uses_archs) {
-            if (tbd_write_uuids_for_targets(file, uuids, version)) {
+            if (tbd_write_uuids_for_targets(sb, uuids, version)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         } else if (version != TBD_VERSION_V1) {
-            if (tbd_write_uuids_for_archs(file, uuids)) {
+            if (tbd_write_uuids_for_archs(sb, uuids)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
     }
 
     if (uses_archs) {
-        if (tbd_write_platform(file, info, version)) {
+        if (tbd_write_platform(sb, info, version)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
 
     if (version != TBD_VERSION_V1 && !options.ignore_flags) {
-        if (tbd_write_flags(file, info->fields.flags)) {
+        if (tbd_write_flags(sb, info->fields.flags)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
 
-    if (tbd_write_install_name(file, info)) {
+    if (tbd_write_install_name(sb, info)) {
         return E_TBD_CREATE_WRITE_FAIL;
     }
 
     if (!options.ignore_current_version) {
-        if (tbd_write_current_version(file, info->fields.current_version)) {
+        if (tbd_write_current_version(sb, info->fields.current_version)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
@@ -1323,7 +1688,7 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
         const uint32_t compatibility_version =
             info->fields.compatibility_version;
 
-        if (tbd_write_compatibility_version(file, compatibility_version)) {
+        if (tbd_write_compatibility_version(sb, compatibility_version)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
@@ -1331,7 +1696,7 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
     if (version != TBD_VERSION_V1) {
         if (!options.ignore_swift_version) {
             const uint32_t swift_version = info->fields.swift_version;
-            if (tbd_write_swift_version(file, version, swift_version)) {
+            if (tbd_write_swift_version(sb, version, swift_version)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
@@ -1341,13 +1706,13 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
                 const enum tbd_objc_constraint objc_constraint =
                     info->fields.archs.objc_constraint;
 
-                if (tbd_write_objc_constraint(file, objc_constraint)) {
+                if (tbd_write_objc_constraint(sb, objc_constraint)) {
                     return E_TBD_CREATE_WRITE_FAIL;
                 }
             }
 
             if (!options.ignore_parent_umbrellas) {
-                if (tbd_write_parent_umbrella_for_archs(file, info)) {
+                if (tbd_write_parent_umbrella_for_archs(sb, info)) {
                     return E_TBD_CREATE_WRITE_FAIL;
                 }
             }
@@ -1356,36 +1721,36 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
 
     if (!uses_archs) {
         if (info->flags.uses_full_targets) {
-            if (tbd_write_metadata_with_full_targets(file, info, options)) {
+            if (tbd_write_metadata_with_full_targets(sb, info, options)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
 
-            if (tbd_write_symbols_with_full_targets(file, info, options)) {
+            if (tbd_write_symbols_with_full_targets(sb, info, options)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         } else {
-            if (tbd_write_metadata(file, info, options)) {
+            if (tbd_write_metadata(sb, info, options)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
 
-            if (tbd_write_symbols_for_targets(file, info, options)) {
+            if (tbd_write_symbols_for_targets(sb, info, options)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
     } else {
         if (info->flags.uses_full_targets) {
-            if (tbd_write_symbols_with_full_archs(file, info, options)) {
+            if (tbd_write_symbols_with_full_archs(sb, info, options)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         } else {
-            if (tbd_write_symbols_for_archs(file, info, options)) {
+            if (tbd_write_symbols_for_archs(sb, info, options)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
     }
 
     if (!options.ignore_footer) {
-        if (tbd_write_footer(file)) {
+        if (tbd_write_footer(sb)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
@@ -1393,13 +1758,66 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
     return E_TBD_CREATE_OK;
 }
 
+/*
+ * Format the whole document in memory first, so it reaches the file through a
+ * single write, instead of through many small stdio calls.
+ */
+
+static const uint64_t TBD_CREATE_BUFFER_INITIAL_CAPACITY = 64 * 1024;
+
+enum tbd_create_result
+tbd_create_with_info(const struct tbd_create_info *__notnull const info,
+                     FILE *__notnull const file,
+                     const struct tbd_create_options options)
+{
+    struct string_buffer sb = {};
+    const uint64_t capacity = TBD_CREATE_BUFFER_INITIAL_CAPACITY;
+
+    if (sb_reserve_space(&sb, capacity) != E_STRING_BUFFER_OK) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    const enum tbd_create_result create_result =
+        tbd_create_with_info_to_buffer(info, &sb, options);
+
+    if (create_result != E_TBD_CREATE_OK) {
+        sb_destroy(&sb);
+        return create_result;
+    }
+
+    /*
+     * Anything already written to file through stdio has to reach the
+     * file-descriptor before our document does.
+     */
+
+    if (fflush(file) != 0) {
+        sb_destroy(&sb);
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    const int fd = fileno(file);
+    const uint64_t length = sb.length;
+    const ssize_t written = our_write(fd, sb.data, length);
+
+    sb_destroy(&sb);
+
+    if (written != (ssize_t)length) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    if (info->stats != NULL) {
+        info->stats->bytes_written += length;
+    }
+
+    return E_TBD_CREATE_OK;
+}
+
 static void clear_metadata_array(struct array *__notnull const list) {
     struct tbd_metadata_info *info = list->data;
     const struct tbd_metadata_info *const end = list->data_end;
 
     for (; info != end; info++) {
         bit_list_destroy(&info->targets);
-        free(info->string);
     }
 
     array_clear(list);
@@ -1411,7 +1829,6 @@ static void clear_symbols_array(struct array *__notnull const list) {
 
     for (; info != end; info++) {
         bit_list_destroy(&info->targets);
-        free(info->string);
     }
 
     array_clear(list);
@@ -1426,10 +1843,14 @@ tbd_create_info_clear_fields_and_create_from(
         free((char *)dst->fields.install_name);
     }
 
+    symbol_index_clear(&dst->symbols_index, dst->fields.symbols.item_count);
+
     clear_metadata_array(&dst->fields.metadata);
     clear_symbols_array(&dst->fields.symbols);
     array_clear(&dst->fields.uuids);
 
+    string_arena_clear(&dst->string_arena);
+
     const struct array metadata = dst->fields.metadata;
     const struct array symbols = dst->fields.symbols;
     const struct array uuids = dst->fields.uuids;
@@ -1448,7 +1869,6 @@ static void destroy_metadata_array(struct array *__notnull const list) {
 
     for (; info != end; info++) {
         bit_list_destroy(&info->targets);
-        free(info->string);
     }
 
     array_destroy(list);
@@ -1460,7 +1880,6 @@ static void destroy_symbols_array(struct array *__notnull const list) {
 
     for (; info != end; info++) {
         bit_list_destroy(&info->targets);
-        free(info->string);
     }
 
     array_destroy(list);
@@ -1477,6 +1896,9 @@ void tbd_create_info_destroy(struct tbd_create_info *__notnull const info) {
     target_list_destroy(&info->fields.targets);
     array_destroy(&info->fields.uuids);
 
+    symbol_index_destroy(&info->symbols_index);
+    string_arena_destroy(&info->string_arena);
+
     memset(&info->fields, 0, sizeof(info->fields));
 
     info->flags.install_name_was_allocated = false;
@@ -0,0 +1,622 @@
+//
+//  src/tbd_cache.c
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mach-o/fat.h"
+#include "mach-o/loader.h"
+
+#include "guard_overflow.h"
+#include "likely.h"
+#include "our_io.h"
+#include "swap.h"
+#include "tbd_cache.h"
+#include "tbd_for_main.h"
+
+/*
+ * Every cache-file starts with this magic, followed by the length of the key,
+ * the key itself, and finally the .tbd document.
+ */
+
+static const char tbd_cache_magic[8] = "tbdcach1";
+
+/*
+ * The version of the documents tbd creates, which is added to every key. This
+ * must be bumped whenever a change to tbd may change the created .tbd document
+ * for the same file and options, so entries stored by older versions of tbd are
+ * no longer found.
+ */
+
+static const uint32_t tbd_cache_format_version = 1;
+
+enum tbd_cache_entry_kind {
+    TBD_CACHE_ENTRY_KIND_MACHO = 1,
+    TBD_CACHE_ENTRY_KIND_DSC_IMAGE
+};
+
+static inline bool
+add_to_key(struct string_buffer *__notnull const key,
+           const void *__notnull const data,
+           const uint64_t size)
+{
+    return (sb_add_c_str(key, data, size) == E_STRING_BUFFER_OK);
+}
+
+static inline bool
+add_uint32_to_key(struct string_buffer *__notnull const key,
+                  const uint32_t value)
+{
+    return add_to_key(key, &value, sizeof(value));
+}
+
+static inline bool
+add_uint64_to_key(struct string_buffer *__notnull const key,
+                  const uint64_t value)
+{
+    return add_to_key(key, &value, sizeof(value));
+}
+
+/*
+ * Serialize the options one bit at a time, instead of adding the bitfields
+ * themselves to the key, as their layout (and padding) is left up to the
+ * compiler.
+ */
+
+static uint32_t
+get_parse_options_bits(const struct tbd_parse_options options) {
+    const uint32_t bits =
+        ((uint32_t)options.ignore_clients << 0) |
+        ((uint32_t)options.ignore_current_version << 1) |
+        ((uint32_t)options.ignore_compat_version << 2) |
+        ((uint32_t)options.ignore_exports << 3) |
+        ((uint32_t)options.ignore_flags << 4) |
+        ((uint32_t)options.ignore_install_name << 5) |
+        ((uint32_t)options.ignore_objc_constraint << 6) |
+        ((uint32_t)options.ignore_parent_umbrellas << 7) |
+        ((uint32_t)options.ignore_platform << 8) |
+        ((uint32_t)options.ignore_reexports << 9) |
+        ((uint32_t)options.ignore_swift_version << 10) |
+        ((uint32_t)options.ignore_targets << 11) |
+        ((uint32_t)options.ignore_undefineds << 12) |
+        ((uint32_t)options.ignore_uuids << 13) |
+        ((uint32_t)options.allow_priv_objc_class_syms << 14) |
+        ((uint32_t)options.allow_priv_objc_ehtype_syms << 15) |
+        ((uint32_t)options.allow_priv_objc_ivar_syms << 16) |
+        ((uint32_t)options.ignore_missing_exports << 17) |
+        ((uint32_t)options.ignore_missing_uuids << 18) |
+        ((uint32_t)options.ignore_non_unique_uuids << 19);
+
+    return bits;
+}
+
+static uint32_t
+get_macho_options_bits(const struct macho_file_parse_options options) {
+    /*
+     * copy_strings_in_map is left out, as it doesn't affect the created .tbd
+     * document.
+     */
+
+    const uint32_t bits =
+        ((uint32_t)options.skip_invalid_archs << 0) |
+        ((uint32_t)options.dont_parse_exports << 1) |
+        ((uint32_t)options.sect_off_absolute << 2) |
+        ((uint32_t)options.ignore_wrong_filetype << 3) |
+        ((uint32_t)options.use_symbol_table << 4);
+
+    return bits;
+}
+
+/*
+ * Add the cache-format version, the tbd-version, and every option and
+ * replacement-field that affects the created .tbd document, to the key.
+ */
+
+static bool
+add_options_to_key(struct string_buffer *__notnull const key,
+                   const struct tbd_for_main *__notnull const tbd,
+                   const enum tbd_cache_entry_kind kind)
+{
+    const struct tbd_create_info *const info = &tbd->info;
+    const struct tbd_create_info_fields *const fields = &info->fields;
+
+    enum tbd_platform platform = TBD_PLATFORM_NONE;
+    if (tbd->flags.provided_platform) {
+        platform = tbd->platform;
+    }
+
+    const uint32_t parse_options = get_parse_options_bits(tbd->parse_options);
+    const uint32_t macho_options = get_macho_options_bits(tbd->macho_options);
+
+    const bool failed =
+        !add_uint32_to_key(key, tbd_cache_format_version) ||
+        !add_uint32_to_key(key, kind) ||
+        !add_uint32_to_key(key, info->version) ||
+        !add_uint32_to_key(key, tbd->write_options.value) ||
+        !add_uint32_to_key(key, parse_options) ||
+        !add_uint32_to_key(key, macho_options) ||
+        !add_uint32_to_key(key, platform) ||
+        !add_uint32_to_key(key, fields->archs.objc_constraint) ||
+        !add_uint32_to_key(key, fields->flags.value) ||
+        !add_uint32_to_key(key, fields->current_version) ||
+        !add_uint32_to_key(key, fields->compatibility_version) ||
+        !add_uint32_to_key(key, fields->swift_version) ||
+        !add_uint64_to_key(key, fields->install_name_length) ||
+        !add_uint64_to_key(key, fields->targets.set_count);
+
+    if (failed) {
+        return false;
+    }
+
+    if (fields->install_name != NULL) {
+        const char *const install_name = fields->install_name;
+        if (!add_to_key(key, install_name, fields->install_name_length)) {
+            return false;
+        }
+    }
+
+    const uint64_t targets_count = fields->targets.set_count;
+    for (uint64_t i = 0; i != targets_count; i++) {
+        const struct arch_info *arch = NULL;
+        enum tbd_platform target_platform = TBD_PLATFORM_NONE;
+
+        target_list_get_target(&fields->targets, i, &arch, &target_platform);
+
+        const bool failed_target =
+            !add_uint32_to_key(key, (uint32_t)arch->cputype) ||
+            !add_uint32_to_key(key, (uint32_t)arch->cpusubtype) ||
+            !add_uint32_to_key(key, target_platform);
+
+        if (failed_target) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Find the LC_UUID load-command of the mach-o in map, and add the mach-o's
+ * cputype and cpusubtype, along with the uuid, to the key.
+ *
+ * As uuids aren't always unique among different builds, the load-commands are
+ * added to the key as well, which covers the install-name, the versions, and
+ * the layout of the symbol-table and export-trie.
+ *
+ * Only the header and load-commands are read, so this is much cheaper than
+ * parsing the mach-o.
+ */
+
+static bool
+add_macho_uuid_to_key(struct string_buffer *__notnull const key,
+                      const uint8_t *__notnull const map,
+                      const uint64_t size)
+{
+    struct mach_header header = {};
+    if (size < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, map, sizeof(header));
+
+    const uint32_t magic = header.magic;
+    const bool is_64 = (magic == MH_MAGIC_64 || magic == MH_CIGAM_64);
+    const bool is_big_endian = (magic == MH_CIGAM || magic == MH_CIGAM_64);
+
+    if (!is_64 && magic != MH_MAGIC && magic != MH_CIGAM) {
+        return false;
+    }
+
+    if (is_big_endian) {
+        header.cputype = swap_int32(header.cputype);
+        header.cpusubtype = swap_int32(header.cpusubtype);
+        header.ncmds = swap_uint32(header.ncmds);
+        header.sizeofcmds = swap_uint32(header.sizeofcmds);
+    }
+
+    uint64_t header_size = sizeof(struct mach_header);
+    if (is_64) {
+        header_size = sizeof(struct mach_header_64);
+    }
+
+    if (size < header_size || header.sizeofcmds > size - header_size) {
+        return false;
+    }
+
+    const uint8_t *iter = map + header_size;
+    uint64_t size_left = header.sizeofcmds;
+
+    for (uint32_t i = 0; i != header.ncmds; i++) {
+        struct load_command load_cmd = {};
+        if (size_left < sizeof(load_cmd)) {
+            return false;
+        }
+
+        memcpy(&load_cmd, iter, sizeof(load_cmd));
+        if (is_big_endian) {
+            load_cmd.cmd = swap_uint32(load_cmd.cmd);
+            load_cmd.cmdsize = swap_uint32(load_cmd.cmdsize);
+        }
+
+        if (load_cmd.cmdsize < sizeof(load_cmd) ||
+            load_cmd.cmdsize > size_left)
+        {
+            return false;
+        }
+
+        if (load_cmd.cmd == LC_UUID) {
+            if (load_cmd.cmdsize < sizeof(struct uuid_command)) {
+                return false;
+            }
+
+            const struct uuid_command *const uuid_cmd =
+                (const struct uuid_command *)iter;
+
+            const bool failed =
+                !add_uint32_to_key(key, (uint32_t)header.cputype) ||
+                !add_uint32_to_key(key, (uint32_t)header.cpusubtype) ||
+                !add_to_key(key, uuid_cmd->uuid, sizeof(uuid_cmd->uuid)) ||
+                !add_uint32_to_key(key, header.sizeofcmds) ||
+                !add_to_key(key, map + header_size, header.sizeofcmds);
+
+            return !failed;
+        }
+
+        iter += load_cmd.cmdsize;
+        size_left -= load_cmd.cmdsize;
+    }
+
+    return false;
+}
+
+static bool
+add_fat_uuids_to_key(struct string_buffer *__notnull const key,
+                     const uint8_t *__notnull const map,
+                     const uint64_t size)
+{
+    struct fat_header header = {};
+    memcpy(&header, map, sizeof(header));
+
+    const bool is_64 =
+        (header.magic == FAT_MAGIC_64 || header.magic == FAT_CIGAM_64);
+
+    const bool is_big_endian =
+        (header.magic == FAT_CIGAM || header.magic == FAT_CIGAM_64);
+
+    uint32_t nfat_arch = header.nfat_arch;
+    if (is_big_endian) {
+        nfat_arch = swap_uint32(nfat_arch);
+    }
+
+    uint64_t arch_size = sizeof(struct fat_arch);
+    if (is_64) {
+        arch_size = sizeof(struct fat_arch_64);
+    }
+
+    uint64_t archs_size = arch_size;
+    if (guard_overflow_mul(&archs_size, nfat_arch)) {
+        return false;
+    }
+
+    if (nfat_arch == 0 || archs_size > size - sizeof(header)) {
+        return false;
+    }
+
+    const uint8_t *iter = map + sizeof(header);
+    for (uint32_t i = 0; i != nfat_arch; i++, iter += arch_size) {
+        uint64_t offset = 0;
+        uint64_t arch_macho_size = 0;
+
+        if (is_64) {
+            struct fat_arch_64 arch = {};
+            memcpy(&arch, iter, sizeof(arch));
+
+            offset = arch.offset;
+            arch_macho_size = arch.size;
+
+            if (is_big_endian) {
+                offset = swap_uint64(offset);
+                arch_macho_size = swap_uint64(arch_macho_size);
+            }
+        } else {
+            struct fat_arch arch = {};
+            memcpy(&arch, iter, sizeof(arch));
+
+            offset = arch.offset;
+            arch_macho_size = arch.size;
+
+            if (is_big_endian) {
+                offset = swap_uint32((uint32_t)offset);
+                arch_macho_size = swap_uint32((uint32_t)arch_macho_size);
+            }
+        }
+
+        if (offset > size || arch_macho_size > size - offset) {
+            return false;
+        }
+
+        if (!add_macho_uuid_to_key(key, map + offset, arch_macho_size)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static uint64_t hash_key(const struct string_buffer *__notnull const key) {
+    /*
+     * FNV-1a. The hash only names the cache-file, the full key is compared
+     * against the one stored in the file.
+     */
+
+    uint64_t hash = 14695981039346656037ull;
+
+    const uint8_t *iter = (const uint8_t *)key->data;
+    const uint8_t *const end = iter + key->length;
+
+    for (; iter != end; iter++) {
+        hash ^= *iter;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static char *
+create_entry_path(const struct tbd_for_main *__notnull const tbd,
+                  const uint64_t hash)
+{
+    const uint64_t length =
+        tbd->cache_path_length + sizeof("/0123456789abcdef.tbd");
+
+    char *const path = malloc(length);
+    if (path == NULL) {
+        return NULL;
+    }
+
+    snprintf(path,
+             length,
+             "%s/%016llx.tbd",
+             tbd->cache_path,
+             (unsigned long long)hash);
+
+    return path;
+}
+
+/*
+ * Look up the document for the entry's key, and copy it into the entry's
+ * document on a match.
+ */
+
+static void
+find_document(struct tbd_cache_entry *__notnull const entry,
+              const struct tbd_for_main *__notnull const tbd)
+{
+    char *const path = create_entry_path(tbd, entry->hash);
+    if (path == NULL) {
+        return;
+    }
+
+    const int fd = our_open(path, O_RDONLY, 0);
+    free(path);
+
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) < 0) {
+        close(fd);
+        return;
+    }
+
+    const uint64_t size = (uint64_t)sbuf.st_size;
+    const uint64_t key_length = entry->key.length;
+    const uint64_t header_size = sizeof(tbd_cache_magic) + sizeof(uint64_t);
+
+    if (size < header_size + key_length) {
+        close(fd);
+        return;
+    }
+
+    const uint8_t *const map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return;
+    }
+
+    uint64_t stored_key_length = 0;
+    memcpy(&stored_key_length,
+           map + sizeof(tbd_cache_magic),
+           sizeof(stored_key_length));
+
+    const bool matches =
+        memcmp(map, tbd_cache_magic, sizeof(tbd_cache_magic)) == 0 &&
+        stored_key_length == key_length &&
+        memcmp(map + header_size, entry->key.data, key_length) == 0;
+
+    if (matches) {
+        const uint64_t document_offset = header_size + key_length;
+        const char *const document = (const char *)(map + document_offset);
+
+        const enum string_buffer_result add_document_result =
+            sb_add_c_str(&entry->document, document, size - document_offset);
+
+        if (add_document_result == E_STRING_BUFFER_OK) {
+            entry->has_document = true;
+        }
+    }
+
+    munmap((void *)map, size);
+}
+
+static bool
+finish_entry(struct tbd_cache_entry *__notnull const entry,
+             const struct tbd_for_main *__notnull const tbd,
+             const bool created_key)
+{
+    if (!created_key) {
+        tbd_cache_entry_destroy(entry);
+        return false;
+    }
+
+    entry->hash = hash_key(&entry->key);
+    find_document(entry, tbd);
+
+    return true;
+}
+
+bool
+tbd_cache_entry_create_for_macho(struct tbd_cache_entry *__notnull const entry,
+                                 const struct tbd_for_main *__notnull const tbd,
+                                 const uint8_t *__notnull const map,
+                                 const uint64_t size)
+{
+    *entry = (struct tbd_cache_entry){};
+    if (size < sizeof(struct fat_header)) {
+        return false;
+    }
+
+    uint32_t magic = 0;
+    memcpy(&magic, map, sizeof(magic));
+
+    struct string_buffer *const key = &entry->key;
+    if (!add_options_to_key(key, tbd, TBD_CACHE_ENTRY_KIND_MACHO)) {
+        return finish_entry(entry, tbd, false);
+    }
+
+    switch (magic) {
+        case FAT_MAGIC:
+        case FAT_CIGAM:
+        case FAT_MAGIC_64:
+        case FAT_CIGAM_64:
+            return finish_entry(entry,
+                                tbd,
+                                add_fat_uuids_to_key(key, map, size));
+
+        default:
+            return finish_entry(entry,
+                                tbd,
+                                add_macho_uuid_to_key(key, map, size));
+    }
+}
+
+bool
+tbd_cache_entry_create_for_dsc_image(
+    struct tbd_cache_entry *__notnull const entry,
+    const struct tbd_for_main *__notnull const tbd,
+    const struct dyld_shared_cache_info *__notnull const dsc_info,
+    const struct dyld_cache_image_info *__notnull const image)
+{
+    *entry = (struct tbd_cache_entry){};
+
+    struct dyld_shared_cache_file image_file = {};
+    uint64_t max_image_size = 0;
+
+    const uint64_t file_offset =
+        dyld_shared_cache_get_file_for_addr(dsc_info,
+                                            image->address,
+                                            &max_image_size,
+                                            &image_file);
+
+    if (file_offset == 0 || file_offset > image_file.size) {
+        return false;
+    }
+
+    if (max_image_size > image_file.size - file_offset) {
+        max_image_size = image_file.size - file_offset;
+    }
+
+    /*
+     * Images of a dyld_shared_cache aren't guaranteed to have unique uuids, so
+     * the image's path, address, and modification-info are added to the key as
+     * well.
+     */
+
+    const char *const image_path =
+        (const char *)(dsc_info->map + image->pathFileOffset);
+
+    const uint64_t image_path_length =
+        strnlen(image_path, dsc_info->size - image->pathFileOffset);
+
+    struct string_buffer *const key = &entry->key;
+    const uint8_t *const map = image_file.map + file_offset;
+
+    const bool created_key =
+        add_options_to_key(key, tbd, TBD_CACHE_ENTRY_KIND_DSC_IMAGE) &&
+        add_uint64_to_key(key, image->address) &&
+        add_uint64_to_key(key, image->modTime) &&
+        add_uint64_to_key(key, image->inode) &&
+        add_uint64_to_key(key, image_path_length) &&
+        add_to_key(key, image_path, image_path_length) &&
+        add_macho_uuid_to_key(key, map, max_image_size);
+
+    return finish_entry(entry, tbd, created_key);
+}
+
+static int write_entry(const int fd, const void *const info) {
+    const struct tbd_cache_entry *const entry =
+        (const struct tbd_cache_entry *)info;
+
+    const uint64_t key_length = entry->key.length;
+    const bool failed =
+        our_write(fd, tbd_cache_magic, sizeof(tbd_cache_magic)) < 0 ||
+        our_write(fd, &key_length, sizeof(key_length)) < 0 ||
+        our_write(fd, entry->key.data, key_length) < 0 ||
+        our_write(fd, entry->document.data, entry->document.length) < 0;
+
+    return failed;
+}
+
+void
+tbd_cache_entry_store(const struct tbd_cache_entry *__notnull const entry,
+                      const struct tbd_for_main *__notnull const tbd)
+{
+    char *const path = create_entry_path(tbd, entry->hash);
+    if (path == NULL) {
+        return;
+    }
+
+    our_store_file(tbd->cache_path,
+                   tbd->cache_path_length,
+                   path,
+                   write_entry,
+                   entry);
+
+    free(path);
+}
+
+int
+tbd_cache_entry_write_to_file(
+    const struct tbd_cache_entry *__notnull const entry,
+    FILE *__notnull const file)
+{
+    if (fflush(file) != 0) {
+        return 1;
+    }
+
+    const int fd = fileno(file);
+    if (our_write(fd, entry->document.data, entry->document.length) < 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+void tbd_cache_entry_destroy(struct tbd_cache_entry *__notnull const entry) {
+    sb_destroy(&entry->key);
+    sb_destroy(&entry->document);
+
+    entry->hash = 0;
+    entry->has_document = false;
+}
@@ -159,6 +159,62 @@ add_image_path(int *__notnull const index_in,
     *index_in = index + 1;
 }
 
+/*
+ * Parse a size in bytes, with an optional K, M, or G suffix for kibibytes,
+ * mebibytes, or gibibytes respectively.
+ */
+
+static bool
+parse_size(const char *__notnull const string,
+           uint64_t *__notnull const size_out)
+{
+    char *end = NULL;
+
+    errno = 0;
+    const uint64_t number = strtoull(string, &end, 10);
+
+    if (errno != 0 || end == string) {
+        return false;
+    }
+
+    uint64_t shift = 0;
+    switch (*end) {
+        case '\0':
+            break;
+
+        case 'k':
+        case 'K':
+            shift = 10;
+            end++;
+
+            break;
+
+        case 'm':
+        case 'M':
+            shift = 20;
+            end++;
+
+            break;
+
+        case 'g':
+        case 'G':
+            shift = 30;
+            end++;
+
+            break;
+
+        default:
+            return false;
+    }
+
+    if (*end != '\0' || number > (UINT64_MAX >> shift)) {
+        return false;
+    }
+
+    *size_out = number << shift;
+    return true;
+}
+
 bool
 tbd_for_main_parse_option(int *const __notnull index_in,
                           struct tbd_for_main *__notnull const tbd,
@@ -231,6 +287,103 @@ tbd_for_main_parse_option(int *const __notnull index_in,
         add_image_number(&index, tbd, argc, argv);
     } else if (strcmp(option, "image-path") == 0) {
         add_image_path(&index, tbd, argc, argv);
+    } else if (strcmp(option, "jobs") == 0) {
+        index += 1;
+        if (index == argc) {
+            fputs("Please provide a number of jobs to parse dyld_shared_cache "
+                  "images, or files while recursing, with\n",
+                  stderr);
+
+            exit(1);
+        }
+
+        const char *const jobs_string = argv[index];
+        char *end = NULL;
+
+        /*
+         * strtoull() accepts leading whitespace and signs, and stops at the
+         * first non-digit, so the jobs-count is only valid if it's made up of
+         * only digits.
+         */
+
+        errno = 0;
+        const uint64_t jobs = strtoull(jobs_string, &end, 10);
+
+        const char first = jobs_string[0];
+        if (first < '0' || first > '9' || *end != '\0' || jobs == 0) {
+            fprintf(stderr,
+                    "A jobs-count of \"%s\" is invalid\n",
+                    jobs_string);
+
+            exit(1);
+        }
+
+        if (errno == ERANGE || jobs > UINT16_MAX) {
+            fprintf(stderr,
+                    "A jobs-count of \"%s\" is too large to be valid\n",
+                    jobs_string);
+
+            exit(1);
+        }
+
+        tbd->jobs = (uint32_t)jobs;
+    } else if (strcmp(option, "cache") == 0) {
+        index += 1;
+        if (index == argc) {
+            fputs("Please provide a path to a directory to store the "
+                  "conversion-cache in\n",
+                  stderr);
+
+            exit(1);
+        }
+
+        const char *const cache_path = argv[index];
+
+        tbd->cache_path = cache_path;
+        tbd->cache_path_length = strlen(cache_path);
+    } else if (strcmp(option, "dsc-index") == 0) {
+        index += 1;
+        if (index == argc) {
+            fputs("Please provide a path to a directory to store the "
+                  "image-indices of dyld_shared_caches in\n",
+                  stderr);
+
+            exit(1);
+        }
+
+        const char *const dsc_index_path = argv[index];
+
+        tbd->dsc_index_path = dsc_index_path;
+        tbd->dsc_index_path_length = strlen(dsc_index_path);
+    } else if (strcmp(option, "dsc-file-order") == 0) {
+        tbd->options.dsc_images_in_file_order = true;
+    } else if (strcmp(option, "max-rss") == 0) {
+        index += 1;
+        if (index == argc) {
+            fputs("Please provide a size of memory to bound the resident "
+                  "memory to while parsing dyld_shared_caches\n",
+                  stderr);
+
+            exit(1);
+        }
+
+        const char *const max_rss_string = argv[index];
+
+        uint64_t max_rss = 0;
+        if (!parse_size(max_rss_string, &max_rss) || max_rss == 0) {
+            fprintf(stderr,
+                    "A memory-size of \"%s\" is invalid\n",
+                    max_rss_string);
+
+            exit(1);
+        }
+
+        tbd->max_rss = max_rss;
+    } else if (strcmp(option, "stats") == 0) {
+        tbd->options.print_stats = true;
+    } else if (strcmp(option, "stats=json") == 0) {
+        tbd->options.print_stats = true;
+        tbd->options.print_stats_as_json = true;
     } else if (strcmp(option, "dsc") == 0) {
         if (!tbd->filetypes.user_provided) {
             tbd->filetypes.value = 0;
@@ -821,6 +974,180 @@ tbd_for_main_open_write_file_for_path(
     return E_TBD_FOR_MAIN_OPEN_WRITE_FILE_OK;
 }
 
+FILE *
+tbd_for_main_open_write_file_or_print_error(
+    const struct tbd_for_main *__notnull const tbd,
+    char *__notnull const path,
+    const uint64_t path_length,
+    char **__notnull const terminator_out)
+{
+    FILE *file = NULL;
+    const enum tbd_for_main_open_write_file_result open_file_result =
+        tbd_for_main_open_write_file_for_path(tbd,
+                                              path,
+                                              path_length,
+                                              &file,
+                                              terminator_out);
+
+    switch (open_file_result) {
+        case E_TBD_FOR_MAIN_OPEN_WRITE_FILE_OK:
+            break;
+
+        case E_TBD_FOR_MAIN_OPEN_WRITE_FILE_FAILED:
+            fprintf(stderr,
+                    "Failed to open write-file (at path: %s), error: %s\n",
+                    path,
+                    strerror(errno));
+
+            return NULL;
+
+        case E_TBD_FOR_MAIN_OPEN_WRITE_FILE_PATH_ALREADY_EXISTS:
+            if (tbd->options.ignore_warnings) {
+                return NULL;
+            }
+
+            fprintf(stderr, "File at write-path (%s) already exists\n", path);
+            return NULL;
+    }
+
+    return file;
+}
+
+/*
+ * Create the document of tbd's cache-entry, if the entry was not found in the
+ * cache, storing the document in the cache unless user-input could have been
+ * involved.
+ */
+
+static enum tbd_create_result
+create_cache_document(const struct tbd_for_main *__notnull const tbd,
+                      struct tbd_cache_entry *__notnull const entry)
+{
+    if (entry->has_document) {
+        return E_TBD_CREATE_OK;
+    }
+
+    const enum tbd_create_result create_result =
+        tbd_create_with_info_to_buffer(&tbd->info,
+                                       &entry->document,
+                                       tbd->write_options);
+
+    if (create_result != E_TBD_CREATE_OK) {
+        sb_clear(&entry->document);
+        return create_result;
+    }
+
+    entry->has_document = true;
+    if (!tbd->info.flags.called_error_callback) {
+        tbd_cache_entry_store(entry, tbd);
+    }
+
+    return E_TBD_CREATE_OK;
+}
+
+/*
+ * Write out the .tbd document for tbd's info, through tbd's cache-entry when
+ * caching.
+ */
+
+static enum tbd_create_result
+write_tbd_to_file(const struct tbd_for_main *__notnull const tbd,
+                  FILE *__notnull const file)
+{
+    struct tbd_cache_entry *const entry = tbd->cache_entry;
+    if (entry == NULL) {
+        return tbd_create_with_info(&tbd->info, file, tbd->write_options);
+    }
+
+    const enum tbd_create_result create_result =
+        create_cache_document(tbd, entry);
+
+    if (create_result != E_TBD_CREATE_OK) {
+        return create_result;
+    }
+
+    if (tbd_cache_entry_write_to_file(entry, file)) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    if (tbd->info.stats != NULL) {
+        tbd->info.stats->bytes_written += entry->document.length;
+    }
+
+    return E_TBD_CREATE_OK;
+}
+
+static enum tbd_create_result
+write_tbd_to_buffer(const struct tbd_for_main *__notnull const tbd,
+                    struct string_buffer *__notnull const sb)
+{
+    struct tbd_cache_entry *const entry = tbd->cache_entry;
+    if (entry == NULL) {
+        return tbd_create_with_info_to_buffer(&tbd->info,
+                                              sb,
+                                              tbd->write_options);
+    }
+
+    const enum tbd_create_result create_result =
+        create_cache_document(tbd, entry);
+
+    if (create_result != E_TBD_CREATE_OK) {
+        return create_result;
+    }
+
+    const struct string_buffer *const document = &entry->document;
+    const enum string_buffer_result add_document_result =
+        sb_add_c_str(sb, document->data, document->length);
+
+    if (add_document_result != E_STRING_BUFFER_OK) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    if (tbd->info.stats != NULL) {
+        tbd->info.stats->bytes_written += document->length;
+    }
+
+    return E_TBD_CREATE_OK;
+}
+
+/*
+ * Write out the .tbd document for tbd's info to either file or sb, whichever
+ * isn't NULL.
+ */
+
+static enum tbd_create_result
+create_tbd(const struct tbd_for_main *__notnull const tbd,
+           FILE *const file,
+           struct string_buffer *const sb)
+{
+    struct tbd_stats *const stats = tbd->info.stats;
+    enum tbd_stats_phase prev_phase = TBD_STATS_PHASE_NONE;
+
+    if (stats != NULL) {
+        prev_phase = tbd_stats_enter_phase(stats, TBD_STATS_PHASE_WRITE);
+    }
+
+    enum tbd_create_result result = E_TBD_CREATE_OK;
+    if (file != NULL) {
+        result = write_tbd_to_file(tbd, file);
+    } else {
+        result = write_tbd_to_buffer(tbd, sb);
+    }
+
+    if (stats != NULL) {
+        tbd_stats_leave_phase(stats, prev_phase);
+    }
+
+    return result;
+}
+
+static inline enum tbd_create_result
+create_tbd_for_file(const struct tbd_for_main *__notnull const tbd,
+                    FILE *__notnull const file)
+{
+    return create_tbd(tbd, file, NULL);
+}
+
 void
 tbd_for_main_write_to_file(const struct tbd_for_main *__notnull const tbd,
                            char *__notnull const write_path,
@@ -829,9 +1156,8 @@ tbd_for_main_write_to_file(const struct tbd_for_main *__notnull const tbd,
                            FILE *__notnull const file,
                            const bool print_paths)
 {
-    const struct tbd_create_info *const create_info = &tbd->info;
     const enum tbd_create_result create_tbd_result =
-        tbd_create_with_info(create_info, file, tbd->write_options);
+        create_tbd_for_file(tbd, file);
 
     if (create_tbd_result != E_TBD_CREATE_OK) {
         if (!tbd->options.ignore_warnings) {
@@ -850,14 +1176,41 @@ tbd_for_main_write_to_file(const struct tbd_for_main *__notnull const tbd,
     }
 }
 
+void
+tbd_for_main_write_to_buffer(const struct tbd_for_main *__notnull const tbd,
+                             const char *__notnull const write_path,
+                             struct string_buffer *__notnull const sb,
+                             const bool print_paths)
+{
+    const uint64_t length = sb->length;
+    const enum tbd_create_result create_tbd_result = create_tbd(tbd, NULL, sb);
+
+    if (create_tbd_result != E_TBD_CREATE_OK) {
+        if (!tbd->options.ignore_warnings) {
+            if (print_paths) {
+                fprintf(stderr,
+                        "Failed to write to write-file (at path %s)\n",
+                        write_path);
+            } else {
+                fputs("Failed to write to provided write-file\n", stderr);
+            }
+        }
+
+        /*
+         * Drop whatever part of the document was written out.
+         */
+
+        sb->length = length;
+    }
+}
+
 void
 tbd_for_main_write_to_stdout(const struct tbd_for_main *__notnull const tbd,
                              const char *__notnull const input_path,
                              const bool print_paths)
 {
-    const struct tbd_create_info *const create_info = &tbd->info;
     const enum tbd_create_result create_tbd_result =
-        tbd_create_with_info(create_info, stdout, tbd->write_options);
+        create_tbd_for_file(tbd, stdout);
 
     if (create_tbd_result != E_TBD_CREATE_OK) {
         if (!tbd->options.ignore_warnings) {
@@ -883,9 +1236,8 @@ tbd_for_main_write_to_stdout_for_dsc_image(
     const char *__notnull const image_path,
     const bool print_paths)
 {
-    const struct tbd_create_info *const create_info = &tbd->info;
     const enum tbd_create_result create_tbd_result =
-        tbd_create_with_info(create_info, stdout, tbd->write_options);
+        create_tbd_for_file(tbd, stdout);
 
     if (create_tbd_result != E_TBD_CREATE_OK) {
         if (!tbd->options.ignore_warnings) {
@@ -909,6 +1261,35 @@ tbd_for_main_write_to_stdout_for_dsc_image(
     }
 }
 
+void
+tbd_for_main_create_info_from_orig(
+    struct tbd_create_info *__notnull const info,
+    const struct tbd_for_main *__notnull const tbd,
+    const struct tbd_for_main *__notnull const orig)
+{
+    *info = (struct tbd_create_info){ .version = tbd->info.version };
+    tbd_create_info_clear_fields_and_create_from(info, &orig->info);
+}
+
+void
+tbd_for_main_destroy_info_from_orig(
+    struct tbd_create_info *__notnull const info,
+    const struct tbd_for_main *__notnull const orig)
+{
+    /*
+     * Fields not stored in the arrays are shared with orig, and are not ours to
+     * free, so drop them before destroying what is left.
+     */
+
+    tbd_create_info_clear_fields_and_create_from(info, &orig->info);
+
+    info->fields.targets = (struct target_list){};
+    info->fields.install_name = NULL;
+    info->flags.install_name_was_allocated = false;
+
+    tbd_create_info_destroy(info);
+}
+
 void tbd_for_main_destroy(struct tbd_for_main *__notnull const tbd) {
     tbd_create_info_destroy(&tbd->info);
 
@@ -0,0 +1,271 @@
+//
+//  src/tbd_stats.c
+//  tbd
+//
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "copy.h"
+#include "path.h"
+#include "tbd_stats.h"
+
+static const char *const phase_names[TBD_STATS_PHASE_COUNT] = {
+    [TBD_STATS_PHASE_NONE] = "none",
+    [TBD_STATS_PHASE_OPEN] = "open",
+    [TBD_STATS_PHASE_LOAD_COMMANDS] = "load-commands",
+    [TBD_STATS_PHASE_EXPORT_TRIE] = "export-trie",
+    [TBD_STATS_PHASE_SYMBOLS] = "symbols",
+    [TBD_STATS_PHASE_SORT] = "sort",
+    [TBD_STATS_PHASE_WRITE] = "write"
+};
+
+uint64_t tbd_stats_get_time(void) {
+    struct timespec spec = {};
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+
+    return (uint64_t)spec.tv_sec * 1000000000ull + (uint64_t)spec.tv_nsec;
+}
+
+enum tbd_stats_phase
+tbd_stats_enter_phase(struct tbd_stats *__notnull const stats,
+                      const enum tbd_stats_phase phase)
+{
+    const uint64_t now = tbd_stats_get_time();
+    const enum tbd_stats_phase prev_phase = stats->phase;
+
+    if (prev_phase != TBD_STATS_PHASE_NONE) {
+        stats->phase_times[prev_phase] += now - stats->phase_begin;
+    }
+
+    stats->phase = phase;
+    stats->phase_begin = now;
+
+    return prev_phase;
+}
+
+void
+tbd_stats_leave_phase(struct tbd_stats *__notnull const stats,
+                      const enum tbd_stats_phase prev_phase)
+{
+    const uint64_t now = tbd_stats_get_time();
+
+    stats->phase_times[stats->phase] += now - stats->phase_begin;
+    stats->phase = prev_phase;
+    stats->phase_begin = now;
+}
+
+void
+tbd_stats_add(struct tbd_stats *__notnull const stats,
+              const struct tbd_stats *__notnull const other)
+{
+    stats->elapsed += other->elapsed;
+    for (uint64_t i = 0; i != TBD_STATS_PHASE_COUNT; i++) {
+        stats->phase_times[i] += other->phase_times[i];
+    }
+
+    stats->symbols_added += other->symbols_added;
+    stats->duplicates_merged += other->duplicates_merged;
+    stats->bytes_written += other->bytes_written;
+    stats->images_skipped += other->images_skipped;
+}
+
+void tbd_stats_report_create(struct tbd_stats_report *__notnull const report) {
+    *report = (struct tbd_stats_report){};
+    pthread_mutex_init(&report->lock, NULL);
+}
+
+void
+tbd_stats_report_add_file(struct tbd_stats_report *__notnull const report,
+                          const char *__notnull const path,
+                          const uint64_t path_length,
+                          const char *const name,
+                          const uint64_t name_length,
+                          const struct tbd_stats *__notnull const stats)
+{
+    char *file_path = NULL;
+    if (name != NULL) {
+        file_path =
+            path_append_component(path, path_length, name, name_length, NULL);
+    } else {
+        file_path = alloc_and_copy(path, path_length);
+    }
+
+    if (file_path == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    const struct tbd_stats_file file = {
+        .path = file_path,
+        .stats = *stats
+    };
+
+    pthread_mutex_lock(&report->lock);
+
+    const enum array_result add_file_result =
+        array_add_item(&report->files, sizeof(file), &file, NULL);
+
+    if (add_file_result != E_ARRAY_OK) {
+        fputs("Experienced an array failure trying to add stats of a file\n",
+              stderr);
+
+        exit(1);
+    }
+
+    tbd_stats_add(&report->total, stats);
+    pthread_mutex_unlock(&report->lock);
+}
+
+static double get_ms(const uint64_t ns) {
+    return (double)ns / 1e6;
+}
+
+static void
+print_stats(FILE *__notnull const file,
+            const struct tbd_stats *__notnull const stats)
+{
+    fprintf(file, "%.3f ms (", get_ms(stats->elapsed));
+
+    for (uint64_t i = TBD_STATS_PHASE_OPEN; i != TBD_STATS_PHASE_COUNT; i++) {
+        if (i != TBD_STATS_PHASE_OPEN) {
+            fputs(", ", file);
+        }
+
+        fprintf(file,
+                "%s: %.3f ms",
+                phase_names[i],
+                get_ms(stats->phase_times[i]));
+    }
+
+    fprintf(file,
+            "), %" PRIu64 " symbols added, %" PRIu64 " duplicates merged, "
+            "%" PRIu64 " bytes written, %" PRIu64 " images skipped\n",
+            stats->symbols_added,
+            stats->duplicates_merged,
+            stats->bytes_written,
+            stats->images_skipped);
+}
+
+static void print_json_string(FILE *__notnull const file, const char *string) {
+    fputc('"', file);
+
+    for (char ch = *string; ch != '\0'; ch = *(++string)) {
+        switch (ch) {
+            case '"':
+            case '\\':
+                fputc('\\', file);
+                fputc(ch, file);
+
+                break;
+
+            default:
+                if ((unsigned char)ch < 0x20) {
+                    fprintf(file, "\\u%04x", (unsigned int)ch);
+                } else {
+                    fputc(ch, file);
+                }
+
+                break;
+        }
+    }
+
+    fputc('"', file);
+}
+
+static void
+print_json_stats(FILE *__notnull const file,
+                 const struct tbd_stats *__notnull const stats)
+{
+    fprintf(file,
+            "\"elapsed_ns\": %" PRIu64 ", \"phases_ns\": {",
+            stats->elapsed);
+
+    for (uint64_t i = TBD_STATS_PHASE_OPEN; i != TBD_STATS_PHASE_COUNT; i++) {
+        if (i != TBD_STATS_PHASE_OPEN) {
+            fputs(", ", file);
+        }
+
+        fprintf(file,
+                "\"%s\": %" PRIu64,
+                phase_names[i],
+                stats->phase_times[i]);
+    }
+
+    fprintf(file,
+            "}, \"symbols_added\": %" PRIu64
+            ", \"duplicates_merged\": %" PRIu64
+            ", \"bytes_written\": %" PRIu64
+            ", \"images_skipped\": %" PRIu64,
+            stats->symbols_added,
+            stats->duplicates_merged,
+            stats->bytes_written,
+            stats->images_skipped);
+}
+
+static void
+print_report_as_json(const struct tbd_stats_report *__notnull const report,
+                     FILE *__notnull const file)
+{
+    fputs("{\n    \"files\": [", file);
+
+    const struct tbd_stats_file *stats_file = report->files.data;
+    const struct tbd_stats_file *const end = report->files.data_end;
+
+    for (; stats_file != end; stats_file++) {
+        if (stats_file != report->files.data) {
+            fputc(',', file);
+        }
+
+        fputs("\n        {\"path\": ", file);
+        print_json_string(file, stats_file->path);
+        fputs(", ", file);
+
+        print_json_stats(file, &stats_file->stats);
+        fputc('}', file);
+    }
+
+    fprintf(file,
+            "\n    ],\n    \"total\": {\"files\": %" PRIu64 ", ",
+            report->files.item_count);
+
+    print_json_stats(file, &report->total);
+    fputs("}\n}\n", file);
+}
+
+void
+tbd_stats_report_print(const struct tbd_stats_report *__notnull const report,
+                       FILE *__notnull const file,
+                       const bool as_json)
+{
+    if (as_json) {
+        print_report_as_json(report, file);
+        return;
+    }
+
+    const struct tbd_stats_file *stats_file = report->files.data;
+    const struct tbd_stats_file *const end = report->files.data_end;
+
+    for (; stats_file != end; stats_file++) {
+        fprintf(file, "%s: ", stats_file->path);
+        print_stats(file, &stats_file->stats);
+    }
+
+    fprintf(file, "Total (%" PRIu64 " files): ", report->files.item_count);
+    print_stats(file, &report->total);
+}
+
+void tbd_stats_report_destroy(struct tbd_stats_report *__notnull const report) {
+    struct tbd_stats_file *stats_file = report->files.data;
+    const struct tbd_stats_file *const end = report->files.data_end;
+
+    for (; stats_file != end; stats_file++) {
+        free(stats_file->path);
+    }
+
+    array_destroy(&report->files);
+    pthread_mutex_destroy(&report->lock);
+}
@@ -6,15 +6,62 @@
 //  Copyright © 2018 - 2020 inoahdev. All rights reserved.
 //
 
-#include <inttypes.h>
+#include <string.h>
+
+#include "string_buffer.h"
 #include "tbd.h"
 #include "tbd_write.h"
 
 static const uint64_t MAX_ARCH_ON_LINE = 7;
 static const uint64_t MAX_TARGET_ON_LINE = 5;
 
+/*
+ * All output is formatted directly into a string-buffer, rather than through
+ * stdio, to avoid parsing format-strings and locking a FILE for every token.
+ */
+
+static inline int
+write_string(struct string_buffer *__notnull const sb,
+             const char *__notnull const string,
+             const uint64_t length)
+{
+    return (sb_add_c_str(sb, string, length) != E_STRING_BUFFER_OK);
+}
+
+static inline int
+write_c_str(struct string_buffer *__notnull const sb,
+            const char *__notnull const c_str)
+{
+    return write_string(sb, c_str, strlen(c_str));
+}
+
+static inline int
+write_char(struct string_buffer *__notnull const sb, const char ch) {
+    return write_string(sb, &ch, 1);
+}
+
+static int
+write_uint(struct string_buffer *__notnull const sb, uint32_t number) {
+    /*
+     * A 32-bit number has at most 10 decimal digits, which we write backwards
+     * from the end of the buffer.
+     */
+
+    char buffer[10];
+    char *iter = buffer + sizeof(buffer);
+
+    do {
+        iter--;
+        *iter = (char)('0' + (number % 10));
+
+        number /= 10;
+    } while (number != 0);
+
+    return write_string(sb, iter, (uint64_t)(buffer + sizeof(buffer) - iter));
+}
+
 int
-tbd_write_archs_for_header(FILE *__notnull const file,
+tbd_write_archs_for_header(struct string_buffer *__notnull const sb,
                            const struct target_list list)
 {
     if (list.set_count == 0) {
@@ -25,7 +72,11 @@ tbd_write_archs_for_header(FILE *__notnull const file,
     enum tbd_platform platform = TBD_PLATFORM_NONE;
 
     target_list_get_target(&list, 0, &arch, &platform);
-    if (fprintf(file, "archs:%-17s[ %s", "", arch->name) < 0) {
+    if (write_c_str(sb, "archs:                 [ ")) {
+        return 1;
+    }
+
+    if (write_string(sb, arch->name, arch->name_length)) {
         return 1;
     }
 
@@ -39,17 +90,17 @@ tbd_write_archs_for_header(FILE *__notnull const file,
 
         const bool write_comma = (counter != 0);
         if (write_comma) {
-            if (fputs(", ", file) < 0) {
+            if (write_c_str(sb, ", ")) {
                 return 1;
             }
         }
 
-        if (fwrite(arch->name, arch->name_length, 1, file) != 1) {
+        if (write_string(sb, arch->name, arch->name_length)) {
             return 1;
         }
 
         if (counter == MAX_ARCH_ON_LINE && i != (list.set_count - 1)) {
-            if (fprintf(file, ",\n%-28s", "") < 0) {
+            if (write_c_str(sb, ",\n                            ")) {
                 return 1;
             }
 
@@ -63,7 +114,7 @@ tbd_write_archs_for_header(FILE *__notnull const file,
      * Write the end bracket for the arch-info list and return.
      */
 
-    if (fputs(" ]\n", file) < 0) {
+    if (write_c_str(sb, " ]\n")) {
         return 1;
     }
 
@@ -71,28 +122,27 @@ tbd_write_archs_for_header(FILE *__notnull const file,
 }
 
 static inline int
-write_target(FILE *__notnull const file,
+write_target(struct string_buffer *__notnull const sb,
              const struct arch_info *__notnull const arch,
              const enum tbd_platform platform,
              const enum tbd_version version,
              const bool has_comma)
 {
-    int ret = 0;
     if (has_comma) {
-        ret =
-            fprintf(file,
-                    ", %s-%s",
-                    arch->name,
-                    tbd_platform_to_string(platform, version));
-    } else {
-        ret =
-            fprintf(file,
-                    "%s-%s",
-                    arch->name,
-                    tbd_platform_to_string(platform, version));
+        if (write_string(sb, ", ", 2)) {
+            return 1;
+        }
+    }
+
+    if (write_string(sb, arch->name, arch->name_length)) {
+        return 1;
+    }
+
+    if (write_char(sb, '-')) {
+        return 1;
     }
 
-    if (ret < 0) {
+    if (write_c_str(sb, tbd_platform_to_string(platform, version))) {
         return 1;
     }
 
@@ -100,7 +150,7 @@ write_target(FILE *__notnull const file,
 }
 
 int
-tbd_write_targets_for_header(FILE *__notnull const file,
+tbd_write_targets_for_header(struct string_buffer *__notnull const sb,
                              const struct target_list list,
                              const enum tbd_version version)
 {
@@ -108,7 +158,7 @@ tbd_write_targets_for_header(FILE *__notnull const file,
         return 1;
     }
 
-    if (fprintf(file, "targets:%-15s[ ", "") < 0) {
+    if (write_c_str(sb, "targets:               [ ")) {
         return 1;
     }
 
@@ -116,7 +166,7 @@ tbd_write_targets_for_header(FILE *__notnull const file,
     enum tbd_platform platform = TBD_PLATFORM_NONE;
 
     target_list_get_target(&list, 0, &arch, &platform);
-    if (write_target(file, arch, platform, version, false) < 0) {
+    if (write_target(sb, arch, platform, version, false) < 0) {
         return 1;
     }
 
@@ -129,12 +179,12 @@ tbd_write_targets_for_header(FILE *__notnull const file,
          */
 
         const bool write_comma = (counter != 0);
-        if (write_target(file, arch, platform, version, write_comma) < 0) {
+        if (write_target(sb, arch, platform, version, write_comma) < 0) {
             return 1;
         }
 
         if (counter == MAX_TARGET_ON_LINE && i != (list.set_count - 1)) {
-            if (fprintf(file, ",\n%-28s", "") < 0) {
+            if (write_c_str(sb, ",\n                            ")) {
                 return 1;
             }
 
@@ -144,18 +194,18 @@ tbd_write_targets_for_header(FILE *__notnull const file,
         }
     }
 
-    if (fputs(" ]\n", file) < 0) {
+    if (write_c_str(sb, " ]\n")) {
         return 1;
     }
 
     return 0;
 }
 
-static const char *const archs_symbol_key_fmt = "  - archs:%-16s[ %s";
-static const char *const targets_symbol_key_fmt = "  - targets:%-14s[ ";
+static const char *const archs_symbol_key = "  - archs:                [ ";
+static const char *const targets_symbol_key = "  - targets:              [ ";
 
 static int
-write_archs_for_symbol_arrays(FILE *__notnull const file,
+write_archs_for_symbol_arrays(struct string_buffer *__notnull const sb,
                               const struct target_list list,
                               const struct bit_list bits)
 {
@@ -169,7 +219,11 @@ write_archs_for_symbol_arrays(FILE *__notnull const file,
     uint64_t first = bit_list_find_first_bit(bits);
     target_list_get_target(&list, first, &arch, &platform);
 
-    if (fprintf(file, archs_symbol_key_fmt, "", arch->name) < 0) {
+    if (write_c_str(sb, archs_symbol_key)) {
+        return 1;
+    }
+
+    if (write_string(sb, arch->name, arch->name_length)) {
         return 1;
     }
 
@@ -184,17 +238,17 @@ write_archs_for_symbol_arrays(FILE *__notnull const file,
 
         const bool write_comma = (counter != 0);
         if (write_comma) {
-            if (fputs(", ", file) < 0) {
+            if (write_c_str(sb, ", ")) {
                 return 1;
             }
         }
 
-        if (fwrite(arch->name, arch->name_length, 1, file) != 1) {
+        if (write_string(sb, arch->name, arch->name_length)) {
             return 1;
         }
 
         if (counter == MAX_ARCH_ON_LINE && i != (bits.set_count - 1)) {
-            if (fprintf(file, ",\n%-28s", "") < 0) {
+            if (write_c_str(sb, ",\n                            ")) {
                 return 1;
             }
 
@@ -208,7 +262,7 @@ write_archs_for_symbol_arrays(FILE *__notnull const file,
      * Write the end bracket for the arch-info list and return.
      */
 
-    if (fputs(" ]\n", file) < 0) {
+    if (write_c_str(sb, " ]\n")) {
         return 1;
     }
 
@@ -216,7 +270,7 @@ write_archs_for_symbol_arrays(FILE *__notnull const file,
 }
 
 static int
-write_targets_as_dict_key(FILE *__notnull const file,
+write_targets_as_dict_key(struct string_buffer *__notnull const sb,
                           const struct target_list list,
                           const struct bit_list bits,
                           const enum tbd_version version)
@@ -225,7 +279,7 @@ write_targets_as_dict_key(FILE *__notnull const file,
         return 1;
     }
 
-    if (fprintf(file, targets_symbol_key_fmt, "") < 0) {
+    if (write_c_str(sb, targets_symbol_key)) {
         return 1;
     }
 
@@ -235,7 +289,7 @@ write_targets_as_dict_key(FILE *__notnull const file,
     uint64_t first = bit_list_find_first_bit(bits);
     target_list_get_target(&list, first, &arch, &platform);
 
-    if (write_target(file, arch, platform, version, false) < 0) {
+    if (write_target(sb, arch, platform, version, false) < 0) {
         return 1;
     }
 
@@ -249,12 +303,12 @@ write_targets_as_dict_key(FILE *__notnull const file,
          */
 
         const bool write_comma = (counter != 0);
-        if (write_target(file, arch, platform, version, write_comma) < 0) {
+        if (write_target(sb, arch, platform, version, write_comma) < 0) {
             return 1;
         }
 
         if (counter == MAX_TARGET_ON_LINE && i != (bits.set_count != 1)) {
-            if (fprintf(file, ",\n%-28s", "") < 0) {
+            if (write_c_str(sb, ",\n                            ")) {
                 return 1;
             }
 
@@ -268,15 +322,17 @@ write_targets_as_dict_key(FILE *__notnull const file,
      * Write the end bracket for the target-list and return.
      */
 
-    if (fputs(" ]\n", file) < 0) {
+    if (write_c_str(sb, " ]\n")) {
         return 1;
     }
 
     return 0;
 }
 
-static
-int write_packed_version(FILE *__notnull const file, const uint32_t version) {
+static int
+write_packed_version(struct string_buffer *__notnull const sb,
+                     const uint32_t version)
+{
     /*
      * The revision for a packed-version is stored in the LSB.
      */
@@ -294,12 +350,16 @@ int write_packed_version(FILE *__notnull const file, const uint32_t version) {
      */
 
     const uint16_t major = ((version & 0xffff0000) >> 16);
-    if (fprintf(file, "%" PRIu16, major) < 0) {
+    if (write_uint(sb, major)) {
         return 1;
     }
 
     if (minor != 0) {
-        if (fprintf(file, ".%" PRIu8, minor) < 0) {
+        if (write_char(sb, '.')) {
+            return 1;
+        }
+
+        if (write_uint(sb, minor)) {
             return 1;
         }
     }
@@ -311,17 +371,21 @@ int write_packed_version(FILE *__notnull const file, const uint32_t version) {
          */
 
         if (minor == 0) {
-            if (fprintf(file, ".0.%" PRIu8, revision) < 0) {
+            if (write_string(sb, ".0.", 3)) {
                 return 1;
             }
         } else {
-            if (fprintf(file, ".%" PRIu8, revision) < 0) {
+            if (write_char(sb, '.')) {
                 return 1;
             }
         }
+
+        if (write_uint(sb, revision)) {
+            return 1;
+        }
     }
 
-    if (fputc('\n', file) == EOF) {
+    if (write_char(sb, '\n')) {
         return 1;
     }
 
@@ -329,50 +393,66 @@ int write_packed_version(FILE *__notnull const file, const uint32_t version) {
 }
 
 int
-tbd_write_current_version(FILE *__notnull const file, const uint32_t version) {
-    if (fprintf(file, "current-version:%-7s", "") < 0) {
+tbd_write_current_version(struct string_buffer *__notnull const sb,
+                          const uint32_t version)
+{
+    if (write_c_str(sb, "current-version:       ")) {
         return 1;
     }
 
-    return write_packed_version(file, version);
+    return write_packed_version(sb, version);
 }
 
 int
-tbd_write_compatibility_version(FILE *__notnull const file,
+tbd_write_compatibility_version(struct string_buffer *__notnull const sb,
                                 const uint32_t version)
 {
-    if (fputs("compatibility-version: ", file) < 0) {
+    if (write_c_str(sb, "compatibility-version: ")) {
         return 1;
     }
 
-    return write_packed_version(file, version);
+    return write_packed_version(sb, version);
 }
 
-int tbd_write_footer(FILE *__notnull const file) {
-    if (fputs("...\n", file) < 0) {
+int tbd_write_footer(struct string_buffer *__notnull const sb) {
+    if (write_c_str(sb, "...\n")) {
         return 1;
     }
 
     return 0;
 }
 
-int tbd_write_flags(FILE *__notnull const file, const struct tbd_flags flags) {
+int tbd_write_footer_to_file(FILE *__notnull const file) {
+    if (fputs("...\n", file) == EOF) {
+        return 1;
+    }
+
+    return 0;
+}
+
+int
+tbd_write_flags(struct string_buffer *__notnull const sb,
+                const struct tbd_flags flags)
+{
     if (flags.flat_namespace) {
-        if (fprintf(file, "flags:%-17s[ flat_namespace", "") < 0) {
+        if (write_c_str(sb, "flags:                 [ flat_namespace")) {
             return 1;
         }
 
         if (flags.not_app_extension_safe) {
-            if (fputs(", not_app_extension_safe", file) < 0) {
+            if (write_c_str(sb, ", not_app_extension_safe")) {
                 return 1;
             }
         }
 
-        if (fputs(" ]\n", file) < 0) {
+        if (write_c_str(sb, " ]\n")) {
             return 1;
         }
     } else if (flags.not_app_extension_safe) {
-        if (fprintf(file, "flags:%-17s[ not_app_extension_safe ]\n", "") < 0) {
+        const char *const flags_line =
+            "flags:                 [ not_app_extension_safe ]\n";
+
+        if (write_c_str(sb, flags_line)) {
             return 1;
         }
     } else {
@@ -383,17 +463,25 @@ int tbd_write_flags(FILE *__notnull const file, const struct tbd_flags flags) {
 }
 
 static int
-write_yaml_string(FILE *__notnull const file,
+write_yaml_string(struct string_buffer *__notnull const sb,
                   const char *__notnull const string,
                   const uint64_t length,
                   const bool needs_quotes)
 {
     if (needs_quotes) {
-        if (fprintf(file, "\"%s\"", string) < 0) {
+        if (write_char(sb, '"')) {
+            return 1;
+        }
+
+        if (write_string(sb, string, length)) {
+            return 1;
+        }
+
+        if (write_char(sb, '"')) {
             return 1;
         }
     } else {
-        if (fwrite(string, length, 1, file) != 1) {
+        if (write_string(sb, string, length)) {
             return 1;
         }
     }
@@ -402,10 +490,10 @@ write_yaml_string(FILE *__notnull const file,
 }
 
 int
-tbd_write_install_name(FILE *__notnull const file,
+tbd_write_install_name(struct string_buffer *__notnull const sb,
                        const struct tbd_create_info *__notnull const info)
 {
-    if (fprintf(file, "install-name:%-10s", "") < 0) {
+    if (write_c_str(sb, "install-name:          ")) {
         return 1;
     }
 
@@ -413,11 +501,11 @@ tbd_write_install_name(FILE *__notnull const file,
     const uint64_t length = info->fields.install_name_length;
     const bool needs_quotes = info->flags.install_name_needs_quotes;
 
-    if (write_yaml_string(file, install_name, length, needs_quotes)) {
+    if (write_yaml_string(sb, install_name, length, needs_quotes)) {
         return 1;
     }
 
-    if (fputc('\n', file) == EOF) {
+    if (write_char(sb, '\n')) {
         return 1;
     }
 
@@ -425,7 +513,7 @@ tbd_write_install_name(FILE *__notnull const file,
 }
 
 int
-tbd_write_objc_constraint(FILE *__notnull const file,
+tbd_write_objc_constraint(struct string_buffer *__notnull const sb,
                           const enum tbd_objc_constraint constraint)
 {
     switch (constraint) {
@@ -433,29 +521,31 @@ tbd_write_objc_constraint(FILE *__notnull const file,
             break;
 
         case TBD_OBJC_CONSTRAINT_NONE:
-            if (fprintf(file, "objc-constraint:%-7snone\n", "") < 0) {
+            if (write_c_str(sb, "objc-constraint:       none\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_OBJC_CONSTRAINT_GC:
-            if (fprintf(file, "objc-constraint:%-7sgc\n", "") < 0) {
+            if (write_c_str(sb, "objc-constraint:       gc\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_OBJC_CONSTRAINT_RETAIN_RELEASE:
-            if (fprintf(file, "objc-constraint:%-7sretain_release\n", "") < 0) {
+            if (write_c_str(sb, "objc-constraint:       retain_release\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_OBJC_CONSTRAINT_RETAIN_RELEASE_OR_GC: {
-            const char *const str = "retain_release_or_gc";
-            if (fprintf(file, "objc-constraint:%-7s%s\n", "", str) < 0) {
+            const char *const str =
+                "objc-constraint:       retain_release_or_gc\n";
+
+            if (write_c_str(sb, str)) {
                 return 1;
             }
 
@@ -463,8 +553,10 @@ tbd_write_objc_constraint(FILE *__notnull const file,
         }
 
         case TBD_OBJC_CONSTRAINT_RETAIN_RELEASE_FOR_SIMULATOR: {
-            const char *const str = "retain_release_for_simulator";
-            if (fprintf(file, "objc-constraint:%-7s%s\n", "", str) < 0) {
+            const char *const str =
+                "objc-constraint:       retain_release_for_simulator\n";
+
+            if (write_c_str(sb, str)) {
                 return 1;
             }
 
@@ -476,34 +568,36 @@ tbd_write_objc_constraint(FILE *__notnull const file,
 }
 
 int
-tbd_write_magic(FILE *__notnull const file, const enum tbd_version version) {
+tbd_write_magic(struct string_buffer *__notnull const sb,
+                const enum tbd_version version)
+{
     switch (version) {
         case TBD_VERSION_NONE:
             return 1;
 
         case TBD_VERSION_V1:
-            if (fputs("---\n", file) < 0) {
+            if (write_c_str(sb, "---\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_VERSION_V2:
-            if (fputs("--- !tapi-tbd-v2\n", file) < 0) {
+            if (write_c_str(sb, "--- !tapi-tbd-v2\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_VERSION_V3:
-            if (fputs("--- !tapi-tbd-v3\n", file) < 0) {
+            if (write_c_str(sb, "--- !tapi-tbd-v3\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_VERSION_V4:
-            if (fprintf(file, "--- !tapi-tbd\ntbd-version:%-11s4\n", "") < 0) {
+            if (write_c_str(sb, "--- !tapi-tbd\ntbd-version:           4\n")) {
                 return 1;
             }
 
@@ -515,7 +609,7 @@ tbd_write_magic(FILE *__notnull const file, const enum tbd_version version) {
 
 int
 tbd_write_parent_umbrella_for_archs(
-    FILE *__notnull const file,
+    struct string_buffer *__notnull const sb,
     const struct tbd_create_info *__notnull const info)
 {
     if (info->fields.metadata.item_count == 0) {
@@ -534,18 +628,18 @@ tbd_write_parent_umbrella_for_archs(
         return 1;
     }
 
-    if (fprintf(file, "parent-umbrella:%-7s", "") < 0) {
+    if (write_c_str(sb, "parent-umbrella:       ")) {
         return 1;
     }
 
     const uint64_t length = umbrella_info->length;
     const bool needs_quotes = umbrella_info->flags.needs_quotes;
 
-    if (write_yaml_string(file, umbrella, length, needs_quotes)) {
+    if (write_yaml_string(sb, umbrella, length, needs_quotes)) {
         return 1;
     }
 
-    if (fputc('\n', file) == EOF) {
+    if (write_char(sb, '\n')) {
         return 1;
     }
 
@@ -553,7 +647,7 @@ tbd_write_parent_umbrella_for_archs(
 }
 
 int
-tbd_write_platform(FILE *__notnull const file,
+tbd_write_platform(struct string_buffer *__notnull const sb,
                    const struct tbd_create_info *__notnull const info,
                    const enum tbd_version version)
 {
@@ -563,7 +657,15 @@ tbd_write_platform(FILE *__notnull const file,
     target_list_get_target(&info->fields.targets, 0, &arch, &platform);
 
     const char *const platform_str = tbd_platform_to_string(platform, version);
-    if (fprintf(file, "platform:%-14s%s\n", "", platform_str) < 0) {
+    if (write_c_str(sb, "platform:              ")) {
+        return 1;
+    }
+
+    if (write_c_str(sb, platform_str)) {
+        return 1;
+    }
+
+    if (write_char(sb, '\n')) {
         return 1;
     }
 
@@ -571,7 +673,7 @@ tbd_write_platform(FILE *__notnull const file,
 }
 
 int
-tbd_write_swift_version(FILE *__notnull const file,
+tbd_write_swift_version(struct string_buffer *__notnull const sb,
                         const enum tbd_version tbd_version,
                         const uint32_t swift_version)
 {
@@ -587,7 +689,7 @@ tbd_write_swift_version(FILE *__notnull const file,
             return 0;
 
         case TBD_VERSION_V2:
-            if (fprintf(file, "swift-version:%-9s", "") < 0) {
+            if (write_c_str(sb, "swift-version:         ")) {
                 return 1;
             }
 
@@ -595,7 +697,7 @@ tbd_write_swift_version(FILE *__notnull const file,
 
         case TBD_VERSION_V3:
         case TBD_VERSION_V4:
-            if (fprintf(file, "swift-abi-version:%-5s", "") < 0) {
+            if (write_c_str(sb, "swift-abi-version:     ")) {
                 return 1;
             }
 
@@ -604,21 +706,25 @@ tbd_write_swift_version(FILE *__notnull const file,
 
     switch (swift_version) {
         case 1:
-            if (fputs("1\n", file) < 0) {
+            if (write_c_str(sb, "1\n")) {
                 return 1;
             }
 
             break;
 
         case 2:
-            if (fputs("1.2\n", file) < 0) {
+            if (write_c_str(sb, "1.2\n")) {
                 return 1;
             }
 
             break;
 
         default:
-            if (fprintf(file, "%" PRIu32 "\n", swift_version - 1) < 0) {
+            if (write_uint(sb, swift_version - 1)) {
+                return 1;
+            }
+
+            if (write_char(sb, '\n')) {
                 return 1;
             }
 
@@ -628,38 +734,38 @@ tbd_write_swift_version(FILE *__notnull const file,
     return 0;
 }
 
+/*
+ * Write out a uuid in its quoted and hyphenated form, such as
+ * '1F262D34-3B42-4950-575E-656C737A8188'.
+ */
+
 static inline int
-write_uuid(FILE *__notnull const file, const uint8_t *__notnull const uuid) {
-    const int ret =
-        fprintf(file,
-                "'%.2X%.2X%.2X%.2X-%.2X%.2X-%.2X%.2X-%.2X%.2X-%.2X"
-                "%.2X%.2X%.2X%.2X%.2X'",
-                uuid[0],
-                uuid[1],
-                uuid[2],
-                uuid[3],
-                uuid[4],
-                uuid[5],
-                uuid[6],
-                uuid[7],
-                uuid[8],
-                uuid[9],
-                uuid[10],
-                uuid[11],
-                uuid[12],
-                uuid[13],
-                uuid[14],
-                uuid[15]);
-
-    if (ret < 0) {
-        return 1;
+write_uuid(struct string_buffer *__notnull const sb,
+           const uint8_t *__notnull const uuid)
+{
+    static const char *const hex = "0123456789ABCDEF";
+
+    char buffer[38];
+    char *iter = buffer;
+
+    *iter++ = '\'';
+    for (uint8_t i = 0; i != 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            *iter++ = '-';
+        }
+
+        const uint8_t byte = uuid[i];
+
+        *iter++ = hex[byte >> 4];
+        *iter++ = hex[byte & 0xf];
     }
 
-    return 0;
+    *iter = '\'';
+    return write_string(sb, buffer, sizeof(buffer));
 }
 
 static inline int
-write_single_uuid_for_archs(FILE *__notnull const file,
+write_single_uuid_for_archs(struct string_buffer *__notnull const sb,
                             const uint64_t target,
                             const uint8_t *__notnull const uuid,
                             const bool has_comma)
@@ -667,18 +773,25 @@ write_single_uuid_for_archs(FILE *__notnull const file,
     const struct arch_info *const arch =
         (const struct arch_info *)(target & TARGET_ARCH_INFO_MASK);
 
-    int ret = 0;
     if (has_comma) {
-        ret = fprintf(file, ", '%s: ", arch->name);
+        if (write_string(sb, ", '", 3)) {
+            return 1;
+        }
     } else {
-        ret = fprintf(file, "'%s: ", arch->name);
+        if (write_char(sb, '\'')) {
+            return 1;
+        }
     }
 
-    if (ret < 0) {
+    if (write_string(sb, arch->name, arch->name_length)) {
         return 1;
     }
 
-    if (write_uuid(file, uuid)) {
+    if (write_string(sb, ": ", 2)) {
+        return 1;
+    }
+
+    if (write_uuid(sb, uuid)) {
         return 1;
     }
 
@@ -686,21 +799,21 @@ write_single_uuid_for_archs(FILE *__notnull const file,
 }
 
 int
-tbd_write_uuids_for_archs(FILE *__notnull const file,
+tbd_write_uuids_for_archs(struct string_buffer *__notnull const sb,
                           const struct array *__notnull const uuids)
 {
     if (uuids->item_count == 0) {
         return 0;
     }
 
-    if (fprintf(file, "uuids:%-17s[ ", "") < 0) {
+    if (write_c_str(sb, "uuids:                 [ ")) {
         return 1;
     }
 
     const struct tbd_uuid_info *info = uuids->data;
     const struct tbd_uuid_info *const end = uuids->data_end;
 
-    if (write_single_uuid_for_archs(file, info->target, info->uuid, false)) {
+    if (write_single_uuid_for_archs(sb, info->target, info->uuid, false)) {
         return 1;
     }
 
@@ -725,7 +838,7 @@ tbd_write_uuids_for_archs(FILE *__notnull const file,
         const uint64_t target = info->target;
         const uint8_t *const uuid = info->uuid;
 
-        if (write_single_uuid_for_archs(file, target, uuid, needs_comma)) {
+        if (write_single_uuid_for_archs(sb, target, uuid, needs_comma)) {
             return 1;
         }
 
@@ -736,7 +849,7 @@ tbd_write_uuids_for_archs(FILE *__notnull const file,
 
         counter++;
         if (counter == 2) {
-            if (fprintf(file, ",%-26s", "\n") < 0) {
+            if (write_c_str(sb, ",\n                         ")) {
                 return 1;
             }
 
@@ -747,7 +860,7 @@ tbd_write_uuids_for_archs(FILE *__notnull const file,
         }
     } while (true);
 
-    if (fputs(" ]\n", file) < 0) {
+    if (write_c_str(sb, " ]\n")) {
         return 1;
     }
 
@@ -755,7 +868,7 @@ tbd_write_uuids_for_archs(FILE *__notnull const file,
 }
 
 static inline int
-write_uuid_with_target(FILE *__notnull const file,
+write_uuid_with_target(struct string_buffer *__notnull const sb,
                        const uint64_t target,
                        const uint8_t *__notnull const uuid,
                        const enum tbd_version version)
@@ -767,20 +880,31 @@ write_uuid_with_target(FILE *__notnull const file,
         (const enum tbd_platform)(target & TARGET_PLATFORM_MASK);
 
     const char *const platform_str = tbd_platform_to_string(platform, version);
-    if (fprintf(file,
-                "  - target: %s-%s\n%-4svalue: ",
-                arch->name,
-                platform_str,
-                "") < 0)
-    {
+    if (write_c_str(sb, "  - target: ")) {
+        return 1;
+    }
+
+    if (write_string(sb, arch->name, arch->name_length)) {
+        return 1;
+    }
+
+    if (write_char(sb, '-')) {
+        return 1;
+    }
+
+    if (write_c_str(sb, platform_str)) {
+        return 1;
+    }
+
+    if (write_c_str(sb, "\n    value: ")) {
         return 1;
     }
 
-    if (write_uuid(file, uuid)) {
+    if (write_uuid(sb, uuid)) {
         return 1;
     }
 
-    if (fputc('\n', file) < 0) {
+    if (write_char(sb, '\n')) {
         return 1;
     }
 
@@ -788,7 +912,7 @@ write_uuid_with_target(FILE *__notnull const file,
 }
 
 int
-tbd_write_uuids_for_targets(FILE *__notnull const file,
+tbd_write_uuids_for_targets(struct string_buffer *__notnull const sb,
                             const struct array *__notnull const uuids,
                             const enum tbd_version version)
 {
@@ -796,7 +920,7 @@ tbd_write_uuids_for_targets(FILE *__notnull const file,
         return 0;
     }
 
-    if (fputs("uuids:\n", file) < 0) {
+    if (write_c_str(sb, "uuids:\n")) {
         return 1;
     }
 
@@ -804,7 +928,7 @@ tbd_write_uuids_for_targets(FILE *__notnull const file,
     const struct tbd_uuid_info *const end = uuids->data_end;
 
     for (; uuid != end; uuid++) {
-        if (write_uuid_with_target(file, uuid->target, uuid->uuid, version)) {
+        if (write_uuid_with_target(sb, uuid->target, uuid->uuid, version)) {
             return 1;
         }
     }
@@ -835,7 +959,7 @@ enum write_comma_result {
 };
 
 static enum write_comma_result
-write_comma_or_newline(FILE *__notnull const file,
+write_comma_or_newline(struct string_buffer *__notnull const sb,
                        const uint64_t line_length,
                        const uint64_t string_length)
 {
@@ -846,7 +970,7 @@ write_comma_or_newline(FILE *__notnull const file,
 
     const uint64_t max_string_length = line_length_max - line_length_initial;
     if (string_length >= max_string_length) {
-        if (fprintf(file, ",\n%-28s", "") < 0) {
+        if (write_c_str(sb, ",\n                            ")) {
             return E_WRITE_COMMA_WRITE_FAIL;
         }
 
@@ -861,7 +985,7 @@ write_comma_or_newline(FILE *__notnull const file,
 
     const uint64_t new_line_length = line_length + string_length + 2;
     if (new_line_length > line_length_max) {
-        if (fprintf(file, ",\n%-28s", "") < 0) {
+        if (write_c_str(sb, ",\n                            ")) {
             return E_WRITE_COMMA_WRITE_FAIL;
         }
 
@@ -874,7 +998,7 @@ write_comma_or_newline(FILE *__notnull const file,
      */
 
     const char *const comma_space = ", ";
-    if (fwrite(comma_space, 2, 1, file) != 1) {
+    if (write_string(sb, comma_space, 2)) {
         return E_WRITE_COMMA_WRITE_FAIL;
     }
 
@@ -882,7 +1006,7 @@ write_comma_or_newline(FILE *__notnull const file,
 }
 
 static int
-write_metadata_type(FILE *__notnull const file,
+write_metadata_type(struct string_buffer *__notnull const sb,
                     const enum tbd_metadata_type type)
 {
     switch (type) {
@@ -890,21 +1014,21 @@ write_metadata_type(FILE *__notnull const file,
             return 1;
 
         case TBD_METADATA_TYPE_PARENT_UMBRELLA:
-            if (fputs("parent-umbrella:\n", file) < 0) {
+            if (write_c_str(sb, "parent-umbrella:\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_METADATA_TYPE_CLIENT:
-            if (fputs("allowable-clients:\n", file) < 0) {
+            if (write_c_str(sb, "allowable-clients:\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_METADATA_TYPE_REEXPORTED_LIBRARY:
-            if (fputs("reexported-libraries:\n", file) < 0) {
+            if (write_c_str(sb, "reexported-libraries:\n")) {
                 return 1;
             }
 
@@ -914,9 +1038,10 @@ write_metadata_type(FILE *__notnull const file,
     return 0;
 }
 
-static inline int end_written_sequence(FILE *__notnull const file) {
+static inline int
+end_written_sequence(struct string_buffer *__notnull const sb) {
     static const char *const end = " ]\n";
-    if (fwrite(end, 3, 1, file) != 1) {
+    if (write_string(sb, end, 3)) {
         return 1;
     }
 
@@ -964,15 +1089,15 @@ skip_metadata_if_needed(const struct tbd_metadata_info *__notnull info,
 }
 
 static inline int
-write_metadata_info(FILE *__notnull const file,
+write_metadata_info(struct string_buffer *__notnull const sb,
                     const struct tbd_metadata_info *__notnull const info)
 {
     const bool needs_quotes = info->flags.needs_quotes;
-    return write_yaml_string(file, info->string, info->length, needs_quotes);
+    return write_yaml_string(sb, info->string, info->length, needs_quotes);
 }
 
 static int
-write_umbrella_list(FILE *__notnull const file,
+write_umbrella_list(struct string_buffer *__notnull const sb,
                     const struct tbd_create_info *__notnull const info,
                     const struct tbd_metadata_info *__notnull m_info,
                     const struct tbd_metadata_info *__notnull const end,
@@ -982,19 +1107,19 @@ write_umbrella_list(FILE *__notnull const file,
     const enum tbd_version version = info->version;
 
     do {
-        if (write_targets_as_dict_key(file, targets, m_info->targets, version)) {
+        if (write_targets_as_dict_key(sb, targets, m_info->targets, version)) {
             return 1;
         }
 
-        if (fprintf(file, "%-4sumbrella:%-15s", "", "") < 0) {
+        if (write_c_str(sb, "    umbrella:               ")) {
             return 1;
         }
 
-        if (write_metadata_info(file, m_info)) {
+        if (write_metadata_info(sb, m_info)) {
             return 1;
         }
 
-        if (fputc('\n', file) < 0) {
+        if (write_char(sb, '\n')) {
             return 1;
         }
 
@@ -1013,7 +1138,7 @@ write_umbrella_list(FILE *__notnull const file,
 }
 
 int
-tbd_write_metadata(FILE *__notnull const file,
+tbd_write_metadata(struct string_buffer *__notnull const sb,
                    const struct tbd_create_info *__notnull const info_in,
                    const struct tbd_create_options options)
 {
@@ -1037,7 +1162,7 @@ tbd_write_metadata(FILE *__notnull const file,
         }
 
         type = info->type;
-        if (write_metadata_type(file, type)) {
+        if (write_metadata_type(sb, type)) {
             return 1;
         }
 
@@ -1047,14 +1172,14 @@ tbd_write_metadata(FILE *__notnull const file,
 
             case TBD_METADATA_TYPE_PARENT_UMBRELLA: {
                 const int result =
-                    write_umbrella_list(file, info_in, info, end, &info);
+                    write_umbrella_list(sb, info_in, info, end, &info);
 
                 if (result != 2) {
                     return result;
                 }
 
                 type = info->type;
-                if (write_metadata_type(file, type)) {
+                if (write_metadata_type(sb, type)) {
                     return 1;
                 }
 
@@ -1070,15 +1195,15 @@ tbd_write_metadata(FILE *__notnull const file,
         uint64_t line_length = 0;
 
         do {
-            if (write_targets_as_dict_key(file, targets, bits, version)) {
+            if (write_targets_as_dict_key(sb, targets, bits, version)) {
                 return 1;
             }
 
-            if (fprintf(file, "%-4slibraries:%-12s[ ", "", "") < 0) {
+            if (write_c_str(sb, "    libraries:            [ ")) {
                 return 1;
             }
 
-            if (write_metadata_info(file, info)) {
+            if (write_metadata_info(sb, info)) {
                 return 1;
             }
 
@@ -1086,7 +1211,7 @@ tbd_write_metadata(FILE *__notnull const file,
             do {
                 info++;
                 if (info == end) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(sb)) {
                         return 1;
                     }
 
@@ -1095,7 +1220,7 @@ tbd_write_metadata(FILE *__notnull const file,
 
                 const enum tbd_metadata_type inner_type = info->type;
                 if (inner_type != type) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(sb)) {
                         return 1;
                     }
 
@@ -1114,7 +1239,7 @@ tbd_write_metadata(FILE *__notnull const file,
 
                 const uint64_t length = info->length;
                 const enum write_comma_result write_comma_result =
-                    write_comma_or_newline(file, line_length, length);
+                    write_comma_or_newline(sb, line_length, length);
 
                 switch (write_comma_result) {
                     case E_WRITE_COMMA_OK:
@@ -1128,7 +1253,7 @@ tbd_write_metadata(FILE *__notnull const file,
                         break;
                 }
 
-                if (write_metadata_info(file, info)) {
+                if (write_metadata_info(sb, info)) {
                     return 1;
                 }
 
@@ -1141,7 +1266,7 @@ tbd_write_metadata(FILE *__notnull const file,
 }
 
 static int
-write_full_targets(FILE *__notnull file,
+write_full_targets(struct string_buffer *__notnull sb,
                    const enum tbd_version version,
                    const struct target_list list)
 {
@@ -1149,7 +1274,7 @@ write_full_targets(FILE *__notnull file,
         return 1;
     }
 
-    if (fprintf(file, targets_symbol_key_fmt, "") < 0) {
+    if (write_c_str(sb, targets_symbol_key)) {
         return 1;
     }
 
@@ -1157,7 +1282,7 @@ write_full_targets(FILE *__notnull file,
     enum tbd_platform platform = TBD_PLATFORM_NONE;
 
     target_list_get_target(&list, 0, &arch, &platform);
-    if (write_target(file, arch, platform, version, false) < 0) {
+    if (write_target(sb, arch, platform, version, false) < 0) {
         return 1;
     }
 
@@ -1170,12 +1295,12 @@ write_full_targets(FILE *__notnull file,
          */
 
         const bool write_comma = (counter != 0);
-        if (write_target(file, arch, platform, version, write_comma) < 0) {
+        if (write_target(sb, arch, platform, version, write_comma) < 0) {
             return 1;
         }
 
         if (counter == MAX_TARGET_ON_LINE && (i != list.set_count - 1)) {
-            if (fprintf(file, ",\n%-11s", "") < 0) {
+            if (write_c_str(sb, ",\n           ")) {
                 return 1;
             }
 
@@ -1189,7 +1314,7 @@ write_full_targets(FILE *__notnull file,
      * Write the end bracket for the target-list and return.
      */
 
-    if (fputs(" ]\n", file) < 0) {
+    if (write_c_str(sb, " ]\n")) {
         return 1;
     }
 
@@ -1198,7 +1323,7 @@ write_full_targets(FILE *__notnull file,
 
 static int
 write_umbrella_list_with_full_targets(
-    FILE *__notnull const file,
+    struct string_buffer *__notnull const sb,
     const struct tbd_create_info *__notnull const info,
     const struct tbd_metadata_info *__notnull m_info,
     const struct tbd_metadata_info *__notnull const end,
@@ -1208,19 +1333,19 @@ write_umbrella_list_with_full_targets(
     const enum tbd_version version = info->version;
 
     do {
-        if (write_full_targets(file, version, targets)) {
+        if (write_full_targets(sb, version, targets)) {
             return 1;
         }
 
-        if (fprintf(file, "%-4sumbrella:%-15s", "", "") < 0) {
+        if (write_c_str(sb, "    umbrella:               ")) {
             return 1;
         }
 
-        if (write_metadata_info(file, m_info)) {
+        if (write_metadata_info(sb, m_info)) {
             return 1;
         }
 
-        if (fputc('\n', file) < 0) {
+        if (write_char(sb, '\n')) {
             return 1;
         }
 
@@ -1240,7 +1365,7 @@ write_umbrella_list_with_full_targets(
 
 int
 tbd_write_metadata_with_full_targets(
-    FILE *__notnull const file,
+    struct string_buffer *__notnull const sb,
     const struct tbd_create_info *__notnull const info_in,
     const struct tbd_create_options options)
 {
@@ -1263,7 +1388,7 @@ tbd_write_metadata_with_full_targets(
         }
 
         type = info->type;
-        if (write_metadata_type(file, type)) {
+        if (write_metadata_type(sb, type)) {
             return 1;
         }
 
@@ -1273,7 +1398,7 @@ tbd_write_metadata_with_full_targets(
 
             case TBD_METADATA_TYPE_PARENT_UMBRELLA: {
                 const int result =
-                    write_umbrella_list_with_full_targets(file,
+                    write_umbrella_list_with_full_targets(sb,
                                                           info_in,
                                                           info,
                                                           end,
@@ -1284,7 +1409,7 @@ tbd_write_metadata_with_full_targets(
                 }
 
                 type = info->type;
-                if (write_metadata_type(file, type)) {
+                if (write_metadata_type(sb, type)) {
                     return 1;
                 }
 
@@ -1297,15 +1422,15 @@ tbd_write_metadata_with_full_targets(
         }
 
         uint64_t line_length = 0;
-        if (write_full_targets(file, version, targets)) {
+        if (write_full_targets(sb, version, targets)) {
             return 1;
         }
 
-        if (fprintf(file, "%-4slibraries:%-12s[ ", "", "") < 0) {
+        if (write_c_str(sb, "    libraries:            [ ")) {
             return 1;
         }
 
-        if (write_metadata_info(file, info)) {
+        if (write_metadata_info(sb, info)) {
             return 1;
         }
 
@@ -1314,7 +1439,7 @@ tbd_write_metadata_with_full_targets(
         do {
             info++;
             if (info == end) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(sb)) {
                     return 1;
                 }
 
@@ -1323,7 +1448,7 @@ tbd_write_metadata_with_full_targets(
 
             const enum tbd_metadata_type inner_type = info->type;
             if (inner_type != type) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(sb)) {
                     return 1;
                 }
 
@@ -1337,7 +1462,7 @@ tbd_write_metadata_with_full_targets(
 
             const uint64_t length = info->length;
             const enum write_comma_result write_comma_result =
-                write_comma_or_newline(file, line_length, length);
+                write_comma_or_newline(sb, line_length, length);
 
             switch (write_comma_result) {
                 case E_WRITE_COMMA_OK:
@@ -1351,7 +1476,7 @@ tbd_write_metadata_with_full_targets(
                     break;
             }
 
-            if (write_metadata_info(file, info)) {
+            if (write_metadata_info(sb, info)) {
                 return 1;
             }
 
@@ -1363,7 +1488,7 @@ tbd_write_metadata_with_full_targets(
 }
 
 static int
-write_symbol_meta_type(FILE *__notnull const file,
+write_symbol_meta_type(struct string_buffer *__notnull const sb,
                        const enum tbd_symbol_meta_type type)
 {
     switch (type) {
@@ -1371,21 +1496,21 @@ write_symbol_meta_type(FILE *__notnull const file,
             return 1;
 
         case TBD_SYMBOL_META_TYPE_EXPORT:
-            if (fputs("exports:\n", file) < 0) {
+            if (write_c_str(sb, "exports:\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_SYMBOL_META_TYPE_REEXPORT:
-            if (fputs("reexports:\n", file) < 0) {
+            if (write_c_str(sb, "reexports:\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_SYMBOL_META_TYPE_UNDEFINED:
-            if (fputs("undefineds:\n", file) < 0) {
+            if (write_c_str(sb, "undefineds:\n")) {
                 return 1;
             }
 
@@ -1395,7 +1520,7 @@ write_symbol_meta_type(FILE *__notnull const file,
 }
 
 static int
-write_symbol_type_key(FILE *__notnull const file,
+write_symbol_type_key(struct string_buffer *__notnull const sb,
                       const enum tbd_symbol_type type,
                       const enum tbd_version version,
                       const bool is_export)
@@ -1406,11 +1531,11 @@ write_symbol_type_key(FILE *__notnull const file,
 
         case TBD_SYMBOL_TYPE_CLIENT: {
             if (version != TBD_VERSION_V1) {
-                if (fprintf(file, "%-4sallowable-clients:%-4s[ ", "", "") < 0) {
+                if (write_c_str(sb, "    allowable-clients:    [ ")) {
                     return 1;
                 }
             } else {
-                if (fprintf(file, "%-4sallowed-clients:%-6s[ ", "", "") < 0) {
+                if (write_c_str(sb, "    allowed-clients:      [ ")) {
                     return 1;
                 }
             }
@@ -1419,35 +1544,35 @@ write_symbol_type_key(FILE *__notnull const file,
         }
 
         case TBD_SYMBOL_TYPE_REEXPORT:
-            if (fprintf(file, "%-4sre-exports:%11s[ ", "", "") < 0) {
+            if (write_c_str(sb, "    re-exports:           [ ")) {
                 return 1;
             }
 
             break;
 
         case TBD_SYMBOL_TYPE_NORMAL:
-            if (fprintf(file, "%-4ssymbols:%14s[ ", "", "") < 0) {
+            if (write_c_str(sb, "    symbols:              [ ")) {
                 return 1;
             }
 
             break;
 
         case TBD_SYMBOL_TYPE_OBJC_CLASS:
-            if (fprintf(file, "%-4sobjc-classes:%9s[ ", "", "") < 0) {
+            if (write_c_str(sb, "    objc-classes:         [ ")) {
                 return 1;
             }
 
             break;
 
         case TBD_SYMBOL_TYPE_OBJC_EHTYPE:
-            if (fprintf(file, "%-4sobjc-eh-types:%8s[ ", "", "") < 0) {
+            if (write_c_str(sb, "    objc-eh-types:        [ ")) {
                 return 1;
             }
 
             break;
 
         case TBD_SYMBOL_TYPE_OBJC_IVAR:
-            if (fprintf(file, "%-4sobjc-ivars:%11s[ ", "", "") < 0) {
+            if (write_c_str(sb, "    objc-ivars:           [ ")) {
                 return 1;
             }
 
@@ -1455,11 +1580,11 @@ write_symbol_type_key(FILE *__notnull const file,
 
         case TBD_SYMBOL_TYPE_WEAK_DEF:
             if (is_export) {
-                if (fprintf(file, "%-4sweak-def-symbols:%5s[ ", "", "") < 0) {
+                if (write_c_str(sb, "    weak-def-symbols:     [ ")) {
                     return 1;
                 }
             } else {
-                if (fprintf(file, "%-4sweak-ref-symbols:%5s[ ", "", "") < 0) {
+                if (write_c_str(sb, "    weak-ref-symbols:     [ ")) {
                     return 1;
                 }
             }
@@ -1471,7 +1596,7 @@ write_symbol_type_key(FILE *__notnull const file,
                 return 1;
             }
 
-            if (fprintf(file, "%-4sthread-local-symbols: [ ", "") < 0) {
+            if (write_c_str(sb, "    thread-local-symbols: [ ")) {
                 return 1;
             }
 
@@ -1482,11 +1607,11 @@ write_symbol_type_key(FILE *__notnull const file,
 }
 
 static inline int
-write_symbol_info(FILE *__notnull const file,
+write_symbol_info(struct string_buffer *__notnull const sb,
                   const struct tbd_symbol_info *__notnull const info)
 {
     const bool needs_quotes = info->flags.needs_quotes;
-    return write_yaml_string(file, info->string, info->length, needs_quotes);
+    return write_yaml_string(sb, info->string, info->length, needs_quotes);
 }
 
 static int
@@ -1531,7 +1656,7 @@ skip_syms_with_mtype(const struct tbd_symbol_info *__notnull sym,
 }
 
 int
-tbd_write_symbols_for_archs(FILE *__notnull const file,
+tbd_write_symbols_for_archs(struct string_buffer *__notnull const sb,
                             const struct tbd_create_info *__notnull const info,
                             const struct tbd_create_options options)
 {
@@ -1562,22 +1687,22 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
         }
 
         m_type = sym->meta_type;
-        if (write_symbol_meta_type(file, m_type)) {
+        if (write_symbol_meta_type(sb, m_type)) {
             return 1;
         }
 
         do {
             const struct bit_list bits = sym->targets;
-            if (write_archs_for_symbol_arrays(file, targets, bits)) {
+            if (write_archs_for_symbol_arrays(sb, targets, bits)) {
                 return 1;
             }
 
             enum tbd_symbol_type type = sym->type;
-            if (write_symbol_type_key(file, type, version, true)) {
+            if (write_symbol_type_key(sb, type, version, true)) {
                 return 1;
             }
 
-            if (write_symbol_info(file, sym)) {
+            if (write_symbol_info(sb, sym)) {
                 return 1;
             }
 
@@ -1597,7 +1722,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
                  */
 
                 if (sym == end) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(sb)) {
                         return 1;
                     }
 
@@ -1608,7 +1733,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
                     sym->meta_type;
 
                 if (inner_meta_type != m_type) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(sb)) {
                         return 1;
                     }
 
@@ -1625,7 +1750,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
                 const uint64_t inner_count = inner_bits.set_count;
 
                 if (inner_count != bits.set_count) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(sb)) {
                         return 1;
                     }
 
@@ -1633,7 +1758,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
                 }
 
                 if (!bit_list_equal_counts_is_equal(bits, inner_bits)) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(sb)) {
                         return 1;
                     }
 
@@ -1648,15 +1773,15 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
 
                 const enum tbd_symbol_type in_type = sym->type;
                 if (in_type != type) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(sb)) {
                         return 1;
                     }
 
-                    if (write_symbol_type_key(file, in_type, version, true)) {
+                    if (write_symbol_type_key(sb, in_type, version, true)) {
                         return 1;
                     }
 
-                    if (write_symbol_info(file, sym)) {
+                    if (write_symbol_info(sb, sym)) {
                         return 1;
                     }
 
@@ -1678,7 +1803,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
 
                 const uint64_t length = sym->length;
                 const enum write_comma_result write_comma_result =
-                    write_comma_or_newline(file, line_length, length);
+                    write_comma_or_newline(sb, line_length, length);
 
                 switch (write_comma_result) {
                     case E_WRITE_COMMA_OK:
@@ -1692,7 +1817,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
                         break;
                 }
 
-                if (write_symbol_info(file, sym)) {
+                if (write_symbol_info(sb, sym)) {
                     return 1;
                 }
 
@@ -1706,7 +1831,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
 
 int
 tbd_write_symbols_for_targets(
-    FILE *__notnull const file,
+    struct string_buffer *__notnull const sb,
     const struct tbd_create_info *__notnull const info,
     const struct tbd_create_options options)
 {
@@ -1732,22 +1857,22 @@ meta:
         }
 
         m_type = sym->meta_type;
-        if (write_symbol_meta_type(file, m_type)) {
+        if (write_symbol_meta_type(sb, m_type)) {
             return 1;
         }
 
         do {
             const struct bit_list bits = sym->targets;
-            if (write_targets_as_dict_key(file, targets, bits, version)) {
+            if (write_targets_as_dict_key(sb, targets, bits, version)) {
                 return 1;
             }
 
             enum tbd_symbol_type type = sym->type;
-            if (write_symbol_type_key(file, type, version, true)) {
+            if (write_symbol_type_key(sb, type, version, true)) {
                 return 1;
             }
 
-            if (write_symbol_info(file, sym)) {
+            if (write_symbol_info(sb, sym)) {
                 return 1;
             }
 
@@ -1767,7 +1892,7 @@ meta:
                  */
 
                 if (sym == end) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(sb)) {
                         return 1;
                     }
 
@@ -1776,7 +1901,7 @@ meta:
 
                 const enum tbd_symbol_meta_type inner_m_type = sym->meta_type;
                 if (inner_m_type != m_type) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(sb)) {
                         return 1;
                     }
 
@@ -1793,7 +1918,7 @@ meta:
                 const uint64_t inner_count = inner_bits.set_count;
 
                 if (inner_count != bits.set_count) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(sb)) {
                         return 1;
                     }
 
@@ -1801,7 +1926,7 @@ meta:
                 }
 
                 if (!bit_list_equal_counts_is_equal(bits, inner_bits)) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(sb)) {
                         return 1;
                     }
 
@@ -1816,15 +1941,15 @@ meta:
 
                 const enum tbd_symbol_type in_type = sym->type;
                 if (in_type != type) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(sb)) {
                         return 1;
                     }
 
-                    if (write_symbol_type_key(file, in_type, version, true)) {
+                    if (write_symbol_type_key(sb, in_type, version, true)) {
                         return 1;
                     }
 
-                    if (write_symbol_info(file, sym)) {
+                    if (write_symbol_info(sb, sym)) {
                         return 1;
                     }
 
@@ -1846,7 +1971,7 @@ meta:
 
                 const uint64_t length = sym->length;
                 const enum write_comma_result write_comma_result =
-                    write_comma_or_newline(file, line_length, length);
+                    write_comma_or_newline(sb, line_length, length);
 
                 switch (write_comma_result) {
                     case E_WRITE_COMMA_OK:
@@ -1860,7 +1985,7 @@ meta:
                         break;
                 }
 
-                if (write_symbol_info(file, sym)) {
+                if (write_symbol_info(sb, sym)) {
                     return 1;
                 }
 
@@ -1872,8 +1997,10 @@ meta:
     return 0;
 }
 
-static
-int write_full_archs(FILE *__notnull file, const struct target_list list) {
+static int
+write_full_archs(struct string_buffer *__notnull const sb,
+                 const struct target_list list)
+{
     if (list.set_count == 0) {
         return 1;
     }
@@ -1882,7 +2009,11 @@ int write_full_archs(FILE *__notnull file, const struct target_list list) {
     enum tbd_platform platform = TBD_PLATFORM_NONE;
 
     target_list_get_target(&list, 0, &arch, &platform);
-    if (fprintf(file, archs_symbol_key_fmt, "", arch->name) < 0) {
+    if (write_c_str(sb, archs_symbol_key)) {
+        return 1;
+    }
+
+    if (write_string(sb, arch->name, arch->name_length)) {
         return 1;
     }
 
@@ -1896,17 +2027,17 @@ int write_full_archs(FILE *__notnull file, const struct target_list list) {
 
         const bool write_comma = (counter != 0);
         if (write_comma) {
-            if (fputs(", ", file) < 0) {
+            if (write_c_str(sb, ", ")) {
                 return 1;
             }
         }
 
-        if (fwrite(arch->name, arch->name_length, 1, file) < 0) {
+        if (write_string(sb, arch->name, arch->name_length)) {
             return 1;
         }
 
         if (counter == MAX_TARGET_ON_LINE && (i != list.set_count - 1)) {
-            if (fprintf(file, ",\n%-11s", "") < 0) {
+            if (write_c_str(sb, ",\n           ")) {
                 return 1;
             }
 
@@ -1920,7 +2051,7 @@ int write_full_archs(FILE *__notnull file, const struct target_list list) {
      * Write the end bracket for the target-list and return.
      */
 
-    if (fputs(" ]\n", file) < 0) {
+    if (write_c_str(sb, " ]\n")) {
         return 1;
     }
 
@@ -1929,7 +2060,7 @@ int write_full_archs(FILE *__notnull file, const struct target_list list) {
 
 int
 tbd_write_symbols_with_full_archs(
-    FILE *__notnull const file,
+    struct string_buffer *__notnull const sb,
     const struct tbd_create_info *__notnull const info,
     const struct tbd_create_options options)
 {
@@ -1952,22 +2083,22 @@ tbd_write_symbols_with_full_archs(
         }
 
         m_type = sym->meta_type;
-        if (write_symbol_meta_type(file, m_type)) {
+        if (write_symbol_meta_type(sb, m_type)) {
             return 1;
         }
 
-        if (write_full_archs(file, targets)) {
+        if (write_full_archs(sb, targets)) {
             return 1;
         }
 
         const enum tbd_version version = info->version;
         enum tbd_symbol_type type = sym->type;
 
-        if (write_symbol_type_key(file, type, version, true)) {
+        if (write_symbol_type_key(sb, type, version, true)) {
             return 1;
         }
 
-        if (write_symbol_info(file, sym)) {
+        if (write_symbol_info(sb, sym)) {
             return 1;
         }
 
@@ -1982,7 +2113,7 @@ tbd_write_symbols_with_full_archs(
              */
 
             if (sym == end) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(sb)) {
                     return 1;
                 }
 
@@ -1991,7 +2122,7 @@ tbd_write_symbols_with_full_archs(
 
             const enum tbd_symbol_meta_type inner_meta_type = sym->meta_type;
             if (inner_meta_type != m_type) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(sb)) {
                     return 1;
                 }
 
@@ -2007,15 +2138,15 @@ tbd_write_symbols_with_full_archs(
 
             const enum tbd_symbol_type inner_type = sym->type;
             if (inner_type != type) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(sb)) {
                     return 1;
                 }
 
-                if (write_symbol_type_key(file, inner_type, version, true)) {
+                if (write_symbol_type_key(sb, inner_type, version, true)) {
                     return 1;
                 }
 
-                if (write_symbol_info(file, sym)) {
+                if (write_symbol_info(sb, sym)) {
                     return 1;
                 }
 
@@ -2037,7 +2168,7 @@ tbd_write_symbols_with_full_archs(
 
             const uint64_t length = sym->length;
             const enum write_comma_result write_comma_result =
-                write_comma_or_newline(file, line_length, length);
+                write_comma_or_newline(sb, line_length, length);
 
             switch (write_comma_result) {
                 case E_WRITE_COMMA_OK:
@@ -2051,7 +2182,7 @@ tbd_write_symbols_with_full_archs(
                     break;
             }
 
-            if (write_symbol_info(file, sym)) {
+            if (write_symbol_info(sb, sym)) {
                 return 1;
             }
 
@@ -2064,7 +2195,7 @@ tbd_write_symbols_with_full_archs(
 
 int
 tbd_write_symbols_with_full_targets(
-    FILE *__notnull const file,
+    struct string_buffer *__notnull const sb,
     const struct tbd_create_info *__notnull const info,
     const struct tbd_create_options options)
 {
@@ -2086,23 +2217,23 @@ tbd_write_symbols_with_full_targets(
         }
 
         m_type = sym->meta_type;
-        if (write_symbol_meta_type(file, m_type)) {
+        if (write_symbol_meta_type(sb, m_type)) {
             return 1;
         }
 
         const struct target_list targets = info->fields.targets;
         const enum tbd_version version = info->version;
 
-        if (write_full_targets(file, version, targets)) {
+        if (write_full_targets(sb, version, targets)) {
             return 1;
         }
 
         enum tbd_symbol_type type = sym->type;
-        if (write_symbol_type_key(file, type, version, true)) {
+        if (write_symbol_type_key(sb, type, version, true)) {
             return 1;
         }
 
-        if (write_symbol_info(file, sym)) {
+        if (write_symbol_info(sb, sym)) {
             return 1;
         }
 
@@ -2117,7 +2248,7 @@ tbd_write_symbols_with_full_targets(
              */
 
             if (sym == end) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(sb)) {
                     return 1;
                 }
 
@@ -2126,7 +2257,7 @@ tbd_write_symbols_with_full_targets(
 
             const enum tbd_symbol_meta_type inner_meta_type = sym->meta_type;
             if (inner_meta_type != m_type) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(sb)) {
                     return 1;
                 }
 
@@ -2142,15 +2273,15 @@ tbd_write_symbols_with_full_targets(
 
             const enum tbd_symbol_type inner_type = sym->type;
             if (inner_type != type) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(sb)) {
                     return 1;
                 }
 
-                if (write_symbol_type_key(file, inner_type, version, true)) {
+                if (write_symbol_type_key(sb, inner_type, version, true)) {
                     return 1;
                 }
 
-                if (write_symbol_info(file, sym)) {
+                if (write_symbol_info(sb, sym)) {
                     return 1;
                 }
 
@@ -2172,7 +2303,7 @@ tbd_write_symbols_with_full_targets(
 
             const uint64_t length = sym->length;
             const enum write_comma_result write_comma_result =
-                write_comma_or_newline(file, line_length, length);
+                write_comma_or_newline(sb, line_length, length);
 
             switch (write_comma_result) {
                 case E_WRITE_COMMA_OK:
@@ -2186,7 +2317,7 @@ tbd_write_symbols_with_full_targets(
                     break;
             }
 
-            if (write_symbol_info(file, sym)) {
+            if (write_symbol_info(sb, sym)) {
                 return 1;
             }
 
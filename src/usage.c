@@ -50,6 +50,23 @@ void print_usage(void) {
     fputs("                                         To get the numbers of all available images, use the option --list-dsc-images\n", stdout);
     fputs("               --image-path,             Specify the path of an image to parse out.\n", stdout);
     fputs("                                         To get the paths of all available images, use the option --list-dsc-images\n", stdout);
+    fputs("               --jobs,                   Specify the number of threads to parse dyld_shared_cache images, or files while recursing, with.\n", stdout);
+    fputs("                                         Created files are still written out in the order of the images\n", stdout);
+    fputs("               --dsc-file-order,         Parse dyld_shared_cache images in the order of their file-offsets, to read the file more sequentially.\n", stdout);
+    fputs("                                         Created files are still written out in the order of the images, so images parsed\n", stdout);
+    fputs("                                         ahead of the images before them are held in memory until they're written out\n", stdout);
+    fputs("        --cache,                         Specify a directory to store created .tbd files in, and to reuse them from\n", stdout);
+    fputs("                                         when converting the same file(s), with the same options, again\n", stdout);
+    fputs("                                         Only files with an uuid for every architecture are cached\n", stdout);
+    fputs("        --dsc-index,                     Specify a directory to store an index of the image-paths of every dyld_shared_cache parsed in,\n", stdout);
+    fputs("                                         and to find images passing the provided filters and image-paths through\n", stdout);
+    fputs("        --max-rss,                       Specify the most memory (in bytes, or with a K, M, or G suffix) to keep resident\n", stdout);
+    fputs("                                         while parsing dyld_shared_cache images. Once over, pages of the dyld_shared_cache\n", stdout);
+    fputs("                                         not in use are dropped, and fewer images are read in ahead of time.\n", stdout);
+    fputs("                                         Memory allocated by tbd itself counts toward the limit, but isn't dropped\n", stdout);
+    fputs("        --stats,                         Print the time spent on, and counters of, every file parsed, along with their totals,\n", stdout);
+    fputs("                                         to stderr once all files are parsed\n", stdout);
+    fputs("                                         Provide --stats=json to print them as json instead\n", stdout);
     fputs("        -v, --version,                   Specify version of .tbd files to convert to (default is v2).\n", stdout);
     fputs("                                         This applies to all files where tbd-version was not explicitly set.\n", stdout);
     fputs("                                         To get a list of all available versions, look at the options below, or use\n", stdout);
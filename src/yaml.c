@@ -6,51 +6,158 @@
 //  Copyright © 2018 - 2020 inoahdev. All rights reserved.
 //
 
-#include <ctype.h>
 #include <stdbool.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "yaml.h"
 
-static inline bool char_needs_quotes(const char ch) {
-    switch (ch) {
-        case ':':
-        case '{':
-        case '}':
-        case '[':
-        case ']':
-        case ',':
-        case '&':
-        case '*':
-        case '#':
-        case '?':
-        case '|':
-        case '-':
-        case '<':
-        case '>':
-        case '=':
-        case '!':
-        case '%':
-        case '@':
-        case '`':
-        case ' ':
-            return true;
+enum yaml_char_class {
+    YAML_CHAR_END = 1 << 0,
+    YAML_CHAR_NEEDS_QUOTES = 1 << 1
+};
 
-        default:
-            return false;
-    }
+static const uint8_t yaml_char_classes[256] = {
+    ['\0'] = YAML_CHAR_END,
+
+    [':'] = YAML_CHAR_NEEDS_QUOTES,
+    ['{'] = YAML_CHAR_NEEDS_QUOTES,
+    ['}'] = YAML_CHAR_NEEDS_QUOTES,
+    ['['] = YAML_CHAR_NEEDS_QUOTES,
+    [']'] = YAML_CHAR_NEEDS_QUOTES,
+    [','] = YAML_CHAR_NEEDS_QUOTES,
+    ['&'] = YAML_CHAR_NEEDS_QUOTES,
+    ['*'] = YAML_CHAR_NEEDS_QUOTES,
+    ['#'] = YAML_CHAR_NEEDS_QUOTES,
+    ['?'] = YAML_CHAR_NEEDS_QUOTES,
+    ['|'] = YAML_CHAR_NEEDS_QUOTES,
+    ['-'] = YAML_CHAR_NEEDS_QUOTES,
+    ['<'] = YAML_CHAR_NEEDS_QUOTES,
+    ['>'] = YAML_CHAR_NEEDS_QUOTES,
+    ['='] = YAML_CHAR_NEEDS_QUOTES,
+    ['!'] = YAML_CHAR_NEEDS_QUOTES,
+    ['%'] = YAML_CHAR_NEEDS_QUOTES,
+    ['@'] = YAML_CHAR_NEEDS_QUOTES,
+    ['`'] = YAML_CHAR_NEEDS_QUOTES,
+    [' '] = YAML_CHAR_NEEDS_QUOTES
+};
+
+#if defined(__SSE2__)
+
+/*
+ * Classify 16 bytes at a time. The characters needing quotes are grouped into
+ * as few ranges as possible, with a range [low, high] checked by subtracting
+ * low, and checking if the result, as unsigned, is at most (high - low).
+ */
+
+static inline __m128i
+chars_in_range(const __m128i chars, const char low, const char high) {
+    const __m128i offset = _mm_sub_epi8(chars, _mm_set1_epi8(low));
+    const __m128i min = _mm_min_epu8(offset, _mm_set1_epi8(high - low));
+
+    return _mm_cmpeq_epi8(min, offset);
+}
+
+static inline __m128i chars_equal(const __m128i chars, const char ch) {
+    return _mm_cmpeq_epi8(chars, _mm_set1_epi8(ch));
 }
 
+static inline uint32_t get_needs_quotes_mask(const __m128i chars) {
+    __m128i mask = chars_in_range(chars, ' ', '!');
+
+    mask = _mm_or_si128(mask, chars_equal(chars, '#'));
+    mask = _mm_or_si128(mask, chars_in_range(chars, '%', '&'));
+    mask = _mm_or_si128(mask, chars_equal(chars, '*'));
+    mask = _mm_or_si128(mask, chars_in_range(chars, ',', '-'));
+    mask = _mm_or_si128(mask, chars_equal(chars, ':'));
+    mask = _mm_or_si128(mask, chars_in_range(chars, '<', '@'));
+    mask = _mm_or_si128(mask, chars_equal(chars, '['));
+    mask = _mm_or_si128(mask, chars_equal(chars, ']'));
+    mask = _mm_or_si128(mask, chars_equal(chars, '`'));
+    mask = _mm_or_si128(mask, chars_in_range(chars, '{', '}'));
+
+    return (uint32_t)_mm_movemask_epi8(mask);
+}
+
+#endif
+
 bool
 yaml_c_str_needs_quotes(const char *__notnull const string,
                         const uint64_t length)
 {
+    const char *iter = string;
     const char *const end = string + length;
-    for (const char *iter = string; iter != end; ++iter) {
-        const char ch = *iter;
-        if (char_needs_quotes(ch)) {
+
+#if defined(__SSE2__)
+    for (; end - iter >= 16; iter += 16) {
+        const __m128i chars = _mm_loadu_si128((const __m128i *)iter);
+        if (get_needs_quotes_mask(chars) != 0) {
+            return true;
+        }
+    }
+#endif
+
+    for (; iter != end; iter++) {
+        const uint8_t class = yaml_char_classes[(uint8_t)*iter];
+        if (class & YAML_CHAR_NEEDS_QUOTES) {
             return true;
         }
     }
 
     return false;
 }
+
+uint64_t
+yaml_c_str_get_length_and_needs_quotes(const char *__notnull const string,
+                                       const uint64_t max_length,
+                                       bool *__notnull const needs_quotes_out)
+{
+    const char *iter = string;
+    const char *const end = string + max_length;
+
+    uint8_t classes = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; end - iter >= 16; iter += 16) {
+        const __m128i chars = _mm_loadu_si128((const __m128i *)iter);
+
+        const uint32_t end_mask =
+            (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chars, zero));
+
+        const uint32_t needs_quotes_mask = get_needs_quotes_mask(chars);
+        if (end_mask != 0) {
+            /*
+             * Only the characters before the null-terminator are part of the
+             * string.
+             */
+
+            const uint32_t index = (uint32_t)__builtin_ctz(end_mask);
+            const uint32_t before_end_mask = (1u << index) - 1;
+
+            *needs_quotes_out =
+                (classes != 0 || (needs_quotes_mask & before_end_mask) != 0);
+
+            return (uint64_t)(iter - string) + index;
+        }
+
+        if (needs_quotes_mask != 0) {
+            classes = YAML_CHAR_NEEDS_QUOTES;
+        }
+    }
+#endif
+
+    for (; iter != end; iter++) {
+        const uint8_t class = yaml_char_classes[(uint8_t)*iter];
+        if (class & YAML_CHAR_END) {
+            break;
+        }
+
+        classes |= class;
+    }
+
+    *needs_quotes_out = (classes != 0);
+    return (uint64_t)(iter - string);
+}